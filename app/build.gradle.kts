@@ -32,6 +32,11 @@ android {
                 arguments += "-DLLAMA_BUILD_COMMON=ON"
                 arguments += "-DCMAKE_BUILD_TYPE=Release"
 
+                // Compile in native profiling with ./gradlew assembleDebug -PhipsProfiling
+                if (project.hasProperty("hipsProfiling")) {
+                    arguments += "-DHIPS_ENABLE_PROFILING=ON"
+                }
+
                 // CLI flags for C++ compiler called by CMake
                 cppFlags += ""
             }
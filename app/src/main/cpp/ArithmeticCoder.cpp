@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cmath>
+#include "ArithmeticCoder.h"
+#include "LlamaCpp.h"
+#include "Profiler.h"
+#include "Selection.h"
+#include "VocabInfo.h"
+
+ArithmeticCoder::ArithmeticCoder(const llama_model* model, float temperature, int topK, int precision, bool isBinaryConversion)
+    : temperature(temperature),
+      topK(topK),
+      precision(precision),
+      isBinaryConversion(isBinaryConversion),
+      // Only needed for binary conversion, so don't throw if the LLM vocabulary doesn't contain it otherwise
+      asciiNul(isBinaryConversion ? LlamaCpp::getAsciiNul(model) : VocabInfo::get(model).asciiNul),
+      currentInterval({0LL, 1LL << precision}) {}
+
+ArithmeticCoder::ArithmeticCoder(float temperature, int topK, int precision, bool isBinaryConversion, llama_token asciiNul)
+    : temperature(temperature),
+      topK(topK),
+      precision(precision),
+      isBinaryConversion(isBinaryConversion),
+      asciiNul(asciiNul),
+      currentInterval({0LL, 1LL << precision}) {}
+
+void ArithmeticCoder::reset() {
+    // Define initial interval as [0, 2^precision)
+    // Stegasuras variable "max_val" is redundant
+    currentInterval = {0LL, 1LL << precision};
+}
+
+void ArithmeticCoder::calculateSubintervals(StegoWorkspace& workspace) const {
+    std::vector<double>& probabilities = workspace.probabilities;
+    std::vector<std::pair<llama_token, double>>& topScaledProbabilities = workspace.topProbabilities;
+    std::vector<std::pair<llama_token, long long>>& roundedScaledProbabilities = workspace.roundedProbabilities;
+    std::vector<std::pair<llama_token, long long>>& cumulatedProbabilities = workspace.cumulatedProbabilities;
+
+    auto vocabSize = static_cast<int32_t>(probabilities.size());
+
+    // Stegasuras: "Cut off low probabilities that would be rounded to 0"
+    // currentThreshold needs to be float as it will be compared to probabilities, float division happens implicitly in Python but explicitly in Kotlin
+    long long currentIntervalRange = currentInterval.second - currentInterval.first;
+    double currentThreshold = 1.0 / static_cast<double>(currentIntervalRange);
+
+    // Invert logic of Stegasuras:
+    // Stegasuras: Drop all tokens with probability < currentThreshold
+    // <=> HiPS: Keep all tokens with probability >= currentThreshold
+    // Probabilities are already scaled with 1/temperature by softmax, counting them doesn't need them to be sorted
+    int numberOfTokensAboveThreshold = 0;
+
+    for (int32_t token = 0; token < vocabSize; token++) {
+        if (probabilities[token] >= currentThreshold) {
+            numberOfTokensAboveThreshold++;
+        }
+    }
+
+    // Minimum ensures that k doesn't exceed topK
+    // Maximum ensures that at least the tokens with the top 2 probabilities are considered
+    // => Maximum is relevant if next token is practically certain (e.g. "Albert Einstein was a renowned theoretical" will be continued with " physicist" with > 99.5% probability)
+    //    Probability of second most likely token will already be rounded to 0
+    // => Loop can go through runs that don't encode any information (i.e. secret message bits) because a token is certain, but next token won't be certain and will encode information again
+    //    Not possible with Huffman, where every token encodes bitsPerToken bits of information
+    // => Matches entropy: Events that are certain don't contain any information (<=> Events that are very uncertain contain a lot of information)
+    int k = std::min(std::max(2, numberOfTokensAboveThreshold), topK);
+
+    // Keep tokens with top k (!= topK) probabilities, only these are selected and sorted instead of the whole vocabulary
+    Selection::getTopProbabilities(probabilities.data(), vocabSize, k, topScaledProbabilities);
+
+    // Deviation from Stegasuras:
+    // Quantize the top k probabilities to fixed point numbers with PROBABILITY_BITS fractional bits, everything after this is integer arithmetic
+    // Scaling by a power of 2 is exact and llround is correctly rounded, so this is the only rounding step and it is the same on every ABI
+    roundedScaledProbabilities.clear();
+
+    unsigned long long fixedPointSum = 0;
+
+    for (const auto& [token, probability] : topScaledProbabilities) {
+        auto fixedPoint = static_cast<long long>(std::llround(std::ldexp(probability, PROBABILITY_BITS)));
+
+        roundedScaledProbabilities.emplace_back(token, fixedPoint);
+        fixedPointSum += static_cast<unsigned long long>(fixedPoint);
+    }
+
+    // Stegasuras: "Rescale to correct range" and "Round probabilities to integers given precision"
+    // Rescale the fixed point numbers to frequencies that sum up to roughly the range of the current interval, rounding down
+    // Only the scale factor range/sum needs a division, every frequency is then a multiplication and a shift by PROBABILITY_BITS
+    // Top k probabilities sum up to at least k/n_vocab, so the scale factor is below 2^precision * n_vocab/k and fits into 64 bits only for precision <= 64 - log2(n_vocab/k)
+    // With k >= 2, that is precision <= 47 for vocabularies up to 2^18 tokens (e.g. 40 for binary conversion, at most 32 for steganography), the products then fit into 128 bits
+    // Every token keeps at least MIN_FREQUENCY, so that every token gets a non-empty sub-interval
+    auto scale = static_cast<unsigned long long>((static_cast<unsigned __int128>(currentIntervalRange) << PROBABILITY_BITS) / fixedPointSum);
+
+    long long frequencySum = 0;
+
+    for (auto& pair : roundedScaledProbabilities) {
+        auto frequency = static_cast<long long>((static_cast<unsigned __int128>(pair.second) * scale) >> PROBABILITY_BITS);
+
+        pair.second = std::max(frequency, MIN_FREQUENCY);
+        frequencySum += pair.second;
+    }
+
+    // Stegasuras: "Remove any elements from the bottom if rounding caused the total prob to be too large"
+    // Minimum frequencies can exceed the current interval, remove tokens with low probabilities until the top token can give up the excess
+    // Terminates with at least the top token left, whose frequency alone can't exceed the current interval
+    long long excess = frequencySum - currentIntervalRange;
+
+    while (excess >= roundedScaledProbabilities.front().second) {
+        excess -= roundedScaledProbabilities.back().second;
+        roundedScaledProbabilities.pop_back();
+    }
+
+    // Stegasuras: "Add any mass to the top if removing/rounding causes the total prob to be too small"
+    // Arithmetic coding only works when current interval is exactly filled, so the top token takes up the difference (positive or negative) in a single step
+    roundedScaledProbabilities.front().second -= excess;
+
+    // Stegasuras: "Convert to position in range"
+    // Cumulated frequencies are the tops of the sub-intervals, shifted up by bottom of current interval
+    // All frequencies are at least 1, so cumulated frequencies are strictly increasing and can be binary searched
+    cumulatedProbabilities.clear();
+
+    long long cumulatedProbability = currentInterval.first;
+
+    for (const auto& [token, frequency] : roundedScaledProbabilities) {
+        cumulatedProbability += frequency;
+        cumulatedProbabilities.emplace_back(token, cumulatedProbability);
+    }
+
+    // Replace token of last sub-interval with ASCII NUL character so it can be sampled during decompression
+    // Similar to explanation at https://www.youtube.com/watch?v=RFWJM8JMXBs
+    // TODO Downward concat of split cover text
+    //  Assignment of ASCII {STX,ETX} to {first,last} sub-interval caused crash last time I tried it
+    if (isBinaryConversion) {
+        cumulatedProbabilities[cumulatedProbabilities.size() - 1].first = asciiNul;
+    }
+}
+
+int ArithmeticCoder::narrowInterval(const StegoWorkspace& workspace, int selectedSubinterval, bool isLastToken, BitStream* cipherBits) {
+    const std::vector<std::pair<llama_token, long long>>& cumulatedProbabilities = workspace.cumulatedProbabilities;
+
+    // Stegasuras: "Calculate new range as ints"
+    // Calculate bottom and top of relevant sub-interval for next iteration
+    // New bottom (inclusive) is top of preceding sub-interval (exclusive there) if relevant one is not the first one, old bottom otherwise
+    // New top (exclusive) is top of relevant sub-interval
+    long long newIntervalBottom = selectedSubinterval > 0 ? cumulatedProbabilities[selectedSubinterval-1].second : currentInterval.first;
+    long long newIntervalTop = cumulatedProbabilities[selectedSubinterval].second;
+
+    // Stegasuras: "Convert range to bits"
+    // Not needed as interval bounds are processed as integers with precision bits directly
+    long long newIntervalTopInclusive = newIntervalTop - 1;     // Stegasuras: "-1 here because upper bound is exclusive"
+
+    // Stegasuras: "Consume/Emit most significant bits which are now fixed and update interval"
+    // Arithmetic coding encodes data into a number by iteratively narrowing initial interval defined earlier
+    // Therefore most significant bits are fixed first (~ numberOfSameBitsFromBeginning), determining the order of magnitude of the number, less significant bits are fixed later
+    int numberOfEncodedBits = ArithmeticCoder::numberOfSameBitsFromBeginning(newIntervalBottom, newIntervalTopInclusive, precision);
+
+    // Deviation from Stegasuras:
+    // For cases where the LLM is very confident about the next token, interval barely narrows and numberOfEncodedBits can be 0, so it would loop
+    // Need to force 1 bit of progress during decompression to avoid this
+    if (cipherBits == nullptr && isBinaryConversion && numberOfEncodedBits == 0) {
+        numberOfEncodedBits = 1;
+    }
+
+    // Decoding emits the fixed bits, or all bits of the bottom for the last token
+    if (cipherBits != nullptr) {
+        if (isLastToken) {
+            cipherBits->write(newIntervalBottom, precision);
+        }
+        else {
+            cipherBits->write(newIntervalTopInclusive >> (precision - numberOfEncodedBits), numberOfEncodedBits);
+        }
+    }
+
+    // New interval is determined by shifting out the fixed bits and setting the shifted in bits to 0 for bottom end, to 1 for top end
+    // Interval boundaries can jump around because first numberOfEncodedBits bits are already processed and therefore cut off
+    // Next portion of cipher bits in general doesn't narrow the interval
+    long long mask = (1LL << precision) - 1;
+
+    currentInterval.first = (newIntervalBottom << numberOfEncodedBits) & mask;
+    currentInterval.second = (((newIntervalTopInclusive << numberOfEncodedBits) & mask) | ((1LL << numberOfEncodedBits) - 1)) + 1;     // Stegasuras: "+1 here because upper bound is exclusive"
+
+    return numberOfEncodedBits;
+}
+
+llama_token ArithmeticCoder::encodeToken(StegoWorkspace& workspace, BitReader& cipherBitReader) {
+    Profiler::Scope scope(Profiler::Stage::Coding);
+
+    calculateSubintervals(workspace);
+
+    const std::vector<std::pair<llama_token, long long>>& cumulatedProbabilities = workspace.cumulatedProbabilities;
+
+    // Stegasuras: "Get selected index based on binary fraction from message bits"
+    // Process cipher bits in portions of size precision
+    // Reading past the end of the cipher bits returns 0s, so last portion is of size precision as well
+    // Portion of cipher bits is read as integer directly for comparison with cumulated probabilities
+    auto message = static_cast<long long>(cipherBitReader.peek(precision));
+
+    // Find position of first token with cumulated probability larger than this integer, i.e. find relevant sub-interval of current interval
+    // Cumulated probabilities are strictly increasing, so a binary search finds it in O(log k)
+    // => Token is already determined here, next steps only calculate new interval
+    // Stegasuras variable "message_token" is redundant
+    auto iterator = std::upper_bound(
+        cumulatedProbabilities.begin(),
+        cumulatedProbabilities.end(),
+        message,
+        [](long long value, const std::pair<llama_token, long long>& pair) { return value < pair.second; }    // Stegasuras would reverse cipherBitSubstring, shouldn't be necessary here
+    );
+
+    int selectedSubinterval = std::distance(cumulatedProbabilities.begin(), iterator);
+
+    int numberOfEncodedBits = narrowInterval(workspace, selectedSubinterval, false, nullptr);
+
+    cipherBitReader.consume(numberOfEncodedBits);
+
+    // Sample token as determined above
+    return cumulatedProbabilities[selectedSubinterval].first;
+}
+
+bool ArithmeticCoder::decodeToken(StegoWorkspace& workspace, llama_token coverTextToken, bool isLastToken, BitStream& cipherBits) {
+    Profiler::Scope scope(Profiler::Stage::Coding);
+
+    calculateSubintervals(workspace);
+
+    const std::vector<std::pair<llama_token, long long>>& cumulatedProbabilities = workspace.cumulatedProbabilities;
+
+    // Stegasuras: n/a
+    // Determine rank of predicted token amongst the top k tokens based on its probability
+    // Tokens outside the top k can't be the cover text token, so searching the whole vocabulary isn't needed
+    auto iterator = std::find_if(
+        cumulatedProbabilities.begin(),
+        cumulatedProbabilities.end(),
+        [coverTextToken](const std::pair<llama_token, long long>& pair) { return pair.first == coverTextToken; }
+    );
+
+    // Deviation from Stegasuras:
+    // Error handling for if the token isn't found in the valid range
+    // Small chance but possible as token probability has to be > currentThreshold (~ 1/2^precision)
+    // Token that wasn't found or was removed because of minimum frequencies can't be decoded
+    if (iterator == cumulatedProbabilities.end()) {
+        return false;
+    }
+
+    // Sample token at rank
+    int selectedSubinterval = std::distance(cumulatedProbabilities.begin(), iterator);
+
+    narrowInterval(workspace, selectedSubinterval, isLastToken, &cipherBits);
+
+    return true;
+}
+
+int ArithmeticCoder::numberOfSameBitsFromBeginning(long long loong1, long long loong2, int precision) {
+    // Bits that are the same are 0 in the XOR, so the common prefix ends at its most significant 1
+    auto difference = static_cast<unsigned long long>(loong1 ^ loong2);
+
+    // All precision bits are the same
+    if (difference == 0) {
+        return precision;
+    }
+
+    // Leading zeros are counted for all 64 bits, but only the lowest precision bits are part of the numbers
+    return __builtin_clzll(difference) - (64 - precision);
+}
@@ -0,0 +1,124 @@
+#ifndef ARITHMETIC_CODER_H
+#define ARITHMETIC_CODER_H
+
+#include <utility>
+#include "llama.h"
+#include "Coder.h"
+
+/**
+ * Class that represents steganography using arithmetic encoding.
+ *
+ * Corresponds to Stegasuras methods `encode_arithmetic` and `decode_arithmetic` in `arithmetic.py`. Also used for binary conversion (i.e. compression/decompression) of the secret message.
+ */
+class ArithmeticCoder : public Coder {
+private:
+    /**
+     * Number of fractional bits of the fixed point numbers that the top k probabilities are quantized to.
+     */
+    static constexpr int PROBABILITY_BITS = 32;
+
+    /**
+     * Minimum frequency, i.e. size of the sub-interval of every token that is kept.
+     */
+    static constexpr long long MIN_FREQUENCY = 1;
+
+    float temperature;
+    int topK;
+    int precision;
+
+    /**
+     * Boolean that is true if the coder is used for binary conversion, false if it is used for steganography.
+     */
+    bool isBinaryConversion;
+
+    /**
+     * Token ID of the ASCII NUL character. Replaces the token of the last sub-interval during binary conversion to signal the end of the secret message.
+     */
+    llama_token asciiNul;
+
+    /**
+     * Current interval [bottom, top) of arithmetic coding.
+     */
+    std::pair<long long, long long> currentInterval;
+
+    /**
+     * Function to divide the current interval into sub-intervals based on the probabilities of the top tokens. Stores them in `workspace.cumulatedProbabilities`.
+     *
+     * Shared by encoding and decoding, so that both are guaranteed to calculate the same sub-intervals.
+     * Probabilities are quantized to fixed point numbers once, sub-intervals are then calculated with integer arithmetic only, so they are identical across ABIs.
+     * Scale factor of the frequencies only fits into 64 bits for precision <= 64 - log2(n_vocab/k), i.e. precision must not exceed 47 (see `benchmark/ArithmeticRoundTripCheck.cpp` for the round trips).
+     *
+     * @param workspace Workspace of the engine, `probabilities` is filled for the current step.
+     */
+    void calculateSubintervals(StegoWorkspace& workspace) const;
+
+    /**
+     * Function to narrow the current interval to a sub-interval.
+     *
+     * @param workspace Workspace of the engine, `cumulatedProbabilities` is filled for the current step.
+     * @param selectedSubinterval Index of the sub-interval.
+     * @param isLastToken Boolean that is true if the fixed bits are the last ones to be decoded, false otherwise.
+     * @param cipherBits Bit stream to append the fixed bits to, only needed for decoding.
+     * @return Number of fixed bits, i.e. bits that were encoded/decoded.
+     */
+    int narrowInterval(const StegoWorkspace& workspace, int selectedSubinterval, bool isLastToken, BitStream* cipherBits);
+
+public:
+    /**
+     * Constructor for an arithmetic coder.
+     *
+     * @param model Memory address of the LLM.
+     * @param temperature Temperature to scale the logits with.
+     * @param topK Number of most likely tokens to consider.
+     * @param precision Number of bits to encode the top k tokens with, at most 47 (see `calculateSubintervals`).
+     * @param isBinaryConversion Boolean that is true if the coder is used for binary conversion, false if it is used for steganography.
+     * @throws std::runtime_error If the coder is used for binary conversion and the LLM vocabulary doesn't contain the ASCII NUL character.
+     */
+    ArithmeticCoder(const llama_model* model, float temperature, int topK, int precision, bool isBinaryConversion);
+
+    /**
+     * Constructor for an arithmetic coder that doesn't look up the ASCII NUL character in an LLM vocabulary, e.g. for benchmarks with synthetic probabilities.
+     *
+     * @param temperature Temperature to scale the logits with.
+     * @param topK Number of most likely tokens to consider.
+     * @param precision Number of bits to encode the top k tokens with, at most 47 (see `calculateSubintervals`).
+     * @param isBinaryConversion Boolean that is true if the coder is used for binary conversion, false if it is used for steganography.
+     * @param asciiNul Token ID of the ASCII NUL character.
+     */
+    ArithmeticCoder(float temperature, int topK, int precision, bool isBinaryConversion, llama_token asciiNul);
+
+    void reset() override;
+
+    float getTemperature() const override {
+        return temperature;
+    }
+
+    llama_token encodeToken(StegoWorkspace& workspace, BitReader& cipherBitReader) override;
+
+    bool decodeToken(StegoWorkspace& workspace, llama_token coverTextToken, bool isLastToken, BitStream& cipherBits) override;
+
+    /**
+     * Stegasuras: "For text->bits->text"
+     *
+     * @param token ID of the last picked token.
+     * @return Boolean that is true if the token is the ASCII NUL character, false otherwise.
+     */
+    bool isEndOfStream(llama_token token) const override {
+        return token == asciiNul;
+    }
+
+    /**
+     * Function to determine number of bits that are the same from the beginning of the binary representations of two numbers with `precision` bits.
+     *
+     * Corresponds to Stegasuras method `num_same_from_beg` in `utils.py`, but works on the numbers directly instead of their bit vectors.
+     * Length of the common prefix is determined from the leading zeros of their XOR.
+     *
+     * @param loong1 A number smaller than 2^precision.
+     * @param loong2 Another number smaller than 2^precision.
+     * @param precision Number of bits of both numbers, at most 62.
+     * @return Number of bits that are the same from the beginning of the binary representations.
+     */
+    static int numberOfSameBitsFromBeginning(long long loong1, long long loong2, int precision);
+};
+
+#endif
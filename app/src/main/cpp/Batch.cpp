@@ -0,0 +1,28 @@
+#include <algorithm>
+#include <stdexcept>
+#include "Batch.h"
+
+Batch::Batch(int32_t capacity) : capacity(std::max(1, capacity)) {
+    // Token IDs instead of embeddings (embd = 0), every token belongs to a single sequence
+    batch = llama_batch_init(this->capacity, 0, 1);
+}
+
+Batch::~Batch() {
+    llama_batch_free(batch);
+}
+
+void Batch::add(llama_token token, llama_pos position, llama_seq_id sequenceId, bool hasLogits) {
+    if (batch.n_tokens == capacity) {
+        throw std::length_error("Batch is full");
+    }
+
+    int32_t i = batch.n_tokens;
+
+    batch.token[i] = token;
+    batch.pos[i] = position;
+    batch.n_seq_id[i] = 1;
+    batch.seq_id[i][0] = sequenceId;
+    batch.logits[i] = hasLogits;
+
+    batch.n_tokens++;
+}
@@ -0,0 +1,72 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include "llama.h"
+
+/**
+ * Class that represents a reusable `llama_batch`, allocated once with a fixed capacity and refilled for every decode.
+ *
+ * Unlike `llama_batch_get_one`, positions, sequence IDs and output flags are set explicitly for every token,
+ * so callers decide which rows of the logit matrix are calculated and where in memory the tokens are stored.
+ */
+class Batch {
+private:
+    llama_batch batch;
+    int32_t capacity;
+
+public:
+    /**
+     * Constructor for a batch. Allocates memory for `capacity` tokens in a single sequence each.
+     *
+     * @param capacity Maximum number of tokens, usually `llama_n_batch` of the context.
+     */
+    explicit Batch(int32_t capacity);
+
+    ~Batch();
+
+    // Batch owns the memory allocated by llama_batch_init, so it can't be copied
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+    /**
+     * Function to remove all tokens from the batch. Keeps the allocated memory.
+     */
+    void clear() {
+        batch.n_tokens = 0;
+    }
+
+    /**
+     * Function to add a token to the batch.
+     *
+     * @param token ID of the token.
+     * @param position Position of the token in its sequence.
+     * @param sequenceId ID of the sequence the token belongs to.
+     * @param hasLogits Boolean that is true if the logits for this token are needed, false otherwise.
+     * @throws std::length_error If the batch is full.
+     */
+    void add(llama_token token, llama_pos position, llama_seq_id sequenceId, bool hasLogits);
+
+    /**
+     * @return Number of tokens in the batch.
+     */
+    int32_t size() const {
+        return batch.n_tokens;
+    }
+
+    /**
+     * @return Maximum number of tokens in the batch.
+     */
+    int32_t getCapacity() const {
+        return capacity;
+    }
+
+    /**
+     * @return The underlying `llama_batch` to pass to llama.cpp.
+     */
+    const llama_batch& get() const {
+        return batch;
+    }
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "BestOfEncoder.h"
+#include "LlamaCpp.h"
+#include "Selection.h"
+
+namespace {
+    /**
+     * Function to get the padding bits of a candidate, i.e. the SplitMix64 hash of its index. Is part of the format, so a candidate always pads the same way.
+     */
+    uint64_t getPaddingBits(size_t candidate) {
+        uint64_t bits = static_cast<uint64_t>(candidate) * 0x9E3779B97F4A7C15ULL;
+
+        bits = (bits ^ (bits >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        bits = (bits ^ (bits >> 27)) * 0x94D049BB133111EBULL;
+
+        return bits ^ (bits >> 31);
+    }
+}
+
+BestOfEncoder::BestOfEncoder(StegoEngine& engine)
+    : engine(engine),
+      batch(engine.getSession().getBatchCapacity()) {}
+
+void BestOfEncoder::step(std::vector<Branch>& branches, size_t branchIndex, std::vector<std::unique_ptr<Candidate>>& candidates, std::vector<llama_seq_id>& freeSequenceIds, const float* logits) {
+    llama_memory_t memory = llama_get_memory(engine.getContext());
+    const VocabInfo& vocabInfo = engine.vocabInfo;
+
+    Branch& branch = branches[branchIndex];
+
+    // Candidates of a branch have the same temperature and consumed the same number of bits, so the first one stands for all of them
+    Candidate& firstCandidate = *candidates[branch.candidates.front()];
+
+    engine.calculateProbabilities(logits, firstCandidate.coder->getTemperature());
+
+    const std::vector<double>& probabilities = engine.workspace.probabilities;
+
+    // Greedy sampling to pick the most likely token until the last sentence is finished, the same for all candidates of the branch
+    if (!firstCandidate.cipherBitReader.hasRemainingBits()) {
+        llama_token token = Selection::getTopLogit(logits, vocabInfo.vocabSize, vocabInfo.specialTokenMask);
+
+        branch.tokens.push_back(token);
+        branch.logProbability += std::log(probabilities[token]);
+        branch.isFinished = vocabInfo.endOfSentenceMask[token];
+
+        return;
+    }
+
+    // Every coder samples a token to encode its bits into, candidates that sample the same token stay together
+    // Coders only read the probabilities, so all of them can sample from the same workspace
+    std::vector<std::pair<llama_token, std::vector<size_t>>> groups;
+
+    for (size_t candidate : branch.candidates) {
+        llama_token token = candidates[candidate]->coder->encodeToken(engine.workspace, candidates[candidate]->cipherBitReader);
+
+        auto group = std::find_if(groups.begin(), groups.end(), [token](const std::pair<llama_token, std::vector<size_t>>& pair) { return pair.first == token; });
+
+        if (group == groups.end()) {
+            groups.emplace_back(token, std::vector<size_t>{candidate});
+        }
+        else {
+            group->second.push_back(candidate);
+        }
+    }
+
+    // All groups except the first one fork the branch, i.e. copy its sequence, as long as sequences are free
+    // Candidates of groups without a free sequence are dropped
+    std::vector<Branch> forks;
+
+    for (size_t i = 1; i < groups.size() && !freeSequenceIds.empty(); i++) {
+        Branch fork;
+        fork.sequenceId = freeSequenceIds.back();
+        fork.candidates = std::move(groups[i].second);
+        fork.tokens = branch.tokens;
+        fork.tokens.push_back(groups[i].first);
+        fork.logProbability = branch.logProbability + std::log(probabilities[groups[i].first]);
+
+        freeSequenceIds.pop_back();
+
+        // Copying a sequence only tags the cells of its tokens with the new sequence ID, their keys and values are shared
+        llama_memory_seq_cp(memory, branch.sequenceId, fork.sequenceId, -1, -1);
+
+        forks.push_back(std::move(fork));
+    }
+
+    branch.candidates = std::move(groups.front().second);
+    branch.tokens.push_back(groups.front().first);
+    branch.logProbability += std::log(probabilities[groups.front().first]);
+
+    // Appending invalidates the reference to the branch, so do it last
+    branches.insert(branches.end(), std::make_move_iterator(forks.begin()), std::make_move_iterator(forks.end()));
+}
+
+llama_tokens BestOfEncoder::encode(const llama_tokens& contextTokens, const BitStream& cipherBits, const std::function<std::unique_ptr<Coder>()>& createCoder, int numberOfCandidates, EncodeListener* listener) {
+    llama_context* ctx = engine.getContext();
+    llama_memory_t memory = llama_get_memory(ctx);
+
+    // Without additional sequences, candidates could only be encoded one after another through the session
+    auto numberOfSequences = static_cast<llama_seq_id>(llama_n_seq_max(ctx));
+
+    if (numberOfCandidates <= 1 || numberOfSequences <= FIRST_SEQUENCE_ID) {
+        std::unique_ptr<Coder> coder = createCoder();
+
+        return engine.encode(contextTokens, cipherBits, *coder, true, false, listener);
+    }
+
+    // Candidate 0 reads 0s after the cipher bits, so it encodes the same cover text as StegoEngine::encode
+    std::vector<std::unique_ptr<Candidate>> candidates;
+
+    for (size_t candidate = 0; candidate < static_cast<size_t>(numberOfCandidates); candidate++) {
+        BitStream paddedCipherBits = cipherBits;
+
+        if (candidate > 0) {
+            paddedCipherBits.write(getPaddingBits(candidate), NUMBER_OF_PADDING_BITS);
+        }
+
+        candidates.push_back(std::make_unique<Candidate>(createCoder(), std::move(paddedCipherBits), cipherBits.size()));
+        candidates.back()->coder->reset();
+    }
+
+    // Prefill the context once for all candidates, its logits predict the first token of every candidate
+    Session& session = engine.getSession();
+
+    const float* contextLogits = session.prefill(contextTokens);
+
+    // Sequences share the memory of the context with the session, so their tokens have to fit next to the context
+    size_t memoryBudget = llama_n_ctx(ctx) > session.getHistory().size() ? llama_n_ctx(ctx) - session.getHistory().size() : 0;
+    size_t memoryInUse = 0;
+
+    std::vector<llama_seq_id> freeSequenceIds;
+
+    for (llama_seq_id sequenceId = numberOfSequences - 1; sequenceId > FIRST_SEQUENCE_ID; sequenceId--) {
+        freeSequenceIds.push_back(sequenceId);
+    }
+
+    // Root branch holds all candidates and starts with the context of the session
+    std::vector<Branch> branches(1);
+    branches.front().sequenceId = FIRST_SEQUENCE_ID;
+
+    for (size_t candidate = 0; candidate < candidates.size(); candidate++) {
+        branches.front().candidates.push_back(candidate);
+    }
+
+    llama_memory_seq_cp(memory, 0, FIRST_SEQUENCE_ID, -1, -1);
+
+    // Remove the tokens of a branch from memory and free its sequence, shared tokens stay for the other sequences
+    auto releaseBranch = [&](Branch& branch) {
+        if (branch.sequenceId < FIRST_SEQUENCE_ID) {
+            return;
+        }
+
+        llama_memory_seq_rm(memory, branch.sequenceId, -1, -1);
+
+        freeSequenceIds.push_back(branch.sequenceId);
+        branch.sequenceId = -1;
+    };
+
+    // Branch with the highest log-probability, ties are broken by the number of tokens and then by the first candidate
+    auto isBetter = [](const Branch& branch1, const Branch& branch2) {
+        if (branch1.logProbability != branch2.logProbability) {
+            return branch1.logProbability > branch2.logProbability;
+        }
+
+        if (branch1.tokens.size() != branch2.tokens.size()) {
+            return branch1.tokens.size() < branch2.tokens.size();
+        }
+
+        return branch1.candidates.front() < branch2.candidates.front();
+    };
+
+    Branch bestBranch;
+    bool hasBestBranch = false;
+
+    // Tokens that every branch which can still win agrees on are final, so they are streamed while the candidates are still being encoded
+    // Cancelling keeps the tokens up to the last one that was streamed
+    llama_tokens coverTextTokens;
+    bool isCancelled = false;
+
+    auto streamTokens = [&](const llama_tokens& tokens, size_t numberOfTokens) {
+        while (!isCancelled && coverTextTokens.size() < numberOfTokens) {
+            coverTextTokens.push_back(tokens[coverTextTokens.size()]);
+
+            isCancelled = listener != nullptr && !listener->onToken(coverTextTokens.back());
+        }
+    };
+
+    // Stream the tokens that the best finished branch and all active branches share, the ones that were streamed already are shared by all of them
+    auto streamSharedTokens = [&]() {
+        const Branch* reference = hasBestBranch ? &bestBranch : nullptr;
+        size_t numberOfSharedTokens = reference != nullptr ? reference->tokens.size() : 0;
+
+        for (const Branch& branch : branches) {
+            if (branch.sequenceId < FIRST_SEQUENCE_ID || branch.isFinished) {
+                continue;
+            }
+
+            if (reference == nullptr) {
+                reference = &branch;
+                numberOfSharedTokens = branch.tokens.size();
+            }
+
+            size_t length = coverTextTokens.size();
+
+            while (length < std::min(numberOfSharedTokens, branch.tokens.size()) && reference->tokens[length] == branch.tokens[length]) {
+                length++;
+            }
+
+            numberOfSharedTokens = length;
+        }
+
+        if (reference != nullptr) {
+            streamTokens(reference->tokens, numberOfSharedTokens);
+        }
+    };
+
+    try {
+        while (true) {
+            // Pick the next token of every active branch, forks already picked theirs when they were appended
+            size_t numberOfBranches = branches.size();
+
+            for (size_t i = 0; i < numberOfBranches; i++) {
+                if (branches[i].sequenceId >= FIRST_SEQUENCE_ID && !branches[i].isFinished) {
+                    step(branches, i, candidates, freeSequenceIds, branches[i].row < 0 ? contextLogits : llama_get_logits_ith(ctx, branches[i].row));
+                }
+            }
+
+            // Log-probabilities only decrease with more tokens, so a branch that already scores worse than a finished one can't win anymore
+            for (Branch& branch : branches) {
+                if (branch.isFinished && branch.sequenceId >= FIRST_SEQUENCE_ID) {
+                    releaseBranch(branch);
+
+                    if (!hasBestBranch || isBetter(branch, bestBranch)) {
+                        bestBranch = branch;
+                        hasBestBranch = true;
+                    }
+                }
+            }
+
+            for (Branch& branch : branches) {
+                if (!branch.isFinished && branch.sequenceId >= FIRST_SEQUENCE_ID && hasBestBranch && branch.logProbability < bestBranch.logProbability) {
+                    releaseBranch(branch);
+                }
+            }
+
+            if (listener != nullptr) {
+                streamSharedTokens();
+
+                // Released branches shared tokens with the remaining ones, so releasing all of them leaves the memory as it was before
+                if (isCancelled) {
+                    for (Branch& branch : branches) {
+                        releaseBranch(branch);
+                    }
+
+                    return coverTextTokens;
+                }
+            }
+
+            // One forward pass advances all active branches, every branch feeds its last token to predict the next one
+            batch.clear();
+
+            for (Branch& branch : branches) {
+                if (branch.sequenceId >= FIRST_SEQUENCE_ID && !branch.isFinished) {
+                    branch.row = batch.size();
+
+                    batch.add(branch.tokens.back(), static_cast<llama_pos>(contextTokens.size() + branch.tokens.size() - 1), branch.sequenceId, true);
+                }
+            }
+
+            if (batch.size() == 0) {
+                break;
+            }
+
+            // Tokens of released branches can still be shared by their forks, so count every fed token
+            memoryInUse += static_cast<size_t>(batch.size());
+
+            if (memoryInUse > memoryBudget) {
+                throw std::length_error("Context window of " + std::to_string(llama_n_ctx(ctx)) + " tokens can't fit " + std::to_string(memoryInUse) + " candidate tokens after " + std::to_string(session.getHistory().size()) + " cached ones");
+            }
+
+            LlamaCpp::decode(batch, ctx);
+        }
+    }
+    catch (...) {
+        // Leave the memory as it was before, i.e. only with the tokens of the session
+        for (Branch& branch : branches) {
+            releaseBranch(branch);
+        }
+
+        throw;
+    }
+
+    // Deviation from single candidate encoding:
+    // Candidates were picked from the logits of a batch with several sequences, the receiver teacher-forces a single sequence and batch shapes can change the last ulp of the logits
+    // Decode the best cover text like the receiver would before returning it, so that a mismatch falls back to the cover text of StegoEngine::encode instead of sending an undecodable one
+    if (!isDecodable(contextTokens, bestBranch.tokens, cipherBits, createCoder)) {
+        std::unique_ptr<Coder> coder = createCoder();
+
+        // Streamed tokens were only a preview, the returned cover text replaces them
+        return engine.encode(contextTokens, cipherBits, *coder, true, false, nullptr);
+    }
+
+    // Stream the rest of the best cover text
+    streamTokens(bestBranch.tokens, bestBranch.tokens.size());
+
+    return coverTextTokens;
+}
+
+bool BestOfEncoder::isDecodable(const llama_tokens& contextTokens, const llama_tokens& coverTextTokens, const BitStream& cipherBits, const std::function<std::unique_ptr<Coder>()>& createCoder) {
+    std::unique_ptr<Coder> coder = createCoder();
+    BitStream decodedCipherBits;
+
+    // Foreign tokens can't be decoded at all, which is a mismatch as well
+    try {
+        decodedCipherBits = engine.decode(contextTokens, coverTextTokens, *coder, static_cast<int>(cipherBits.size()), false);
+    }
+    catch (const std::invalid_argument&) {
+        return false;
+    }
+
+    if (decodedCipherBits.size() < cipherBits.size()) {
+        return false;
+    }
+
+    // Padding after the cipher bits differs between candidates and is ignored by the receiver, so only the cipher bits need to match
+    for (size_t position = 0; position < cipherBits.size(); position += 64) {
+        int n = static_cast<int>(std::min<size_t>(64, cipherBits.size() - position));
+
+        if (decodedCipherBits.peek(position, n) != cipherBits.peek(position, n)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,130 @@
+#ifndef BEST_OF_ENCODER_H
+#define BEST_OF_ENCODER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "llama.h"
+#include "common.h"
+#include "Batch.h"
+#include "BitStream.h"
+#include "Coder.h"
+#include "StegoEngine.h"
+
+/**
+ * Class that represents an encoder of the same cipher bits into several candidate cover texts at once, returning the most natural one.
+ *
+ * Candidates differ in the padding that is read after the last cipher bit: Candidate 0 reads 0s like `StegoEngine::encode`, every other candidate reads its own
+ * pseudo-random bits. This changes the last coded tokens and therefore the greedy tail, but not what is decoded, as everything after the end signal of the
+ * secret message is ignored. Temperatures or context suffixes can't vary between candidates, as the receiver wouldn't know which one to decode with.
+ *
+ * The context is prefilled once by the session. Candidates that picked the same tokens so far share a branch, i.e. a sequence in the memory of the context
+ * that is forked via `llama_memory_seq_cp` (so forks share the keys and values of the context and of the tokens before the fork) as soon as their tokens differ.
+ * Every decode advances all active branches in a shared batch. Candidates are scored by the total log-probability of their tokens, branches that already
+ * score worse than a finished one are dropped early.
+ *
+ * Batch shapes can change the last ulp of the logits, so the best cover text is decoded through the session like the receiver does before it is returned.
+ * If that doesn't recover the cipher bits, the cover text of `StegoEngine::encode` is returned instead, which is encoded through the session as well.
+ *
+ * Tokens are streamed to the listener as soon as every branch that can still win agrees on them, i.e. the tokens up to the first fork while they are picked.
+ * They are only a preview if the best cover text is replaced, the returned tokens are always the ones to send.
+ * Cancelling is only noticed when a token is streamed, so after a fork it takes effect once the competing branches are finished or dropped and saves less work.
+ *
+ * Sequence 0 belongs to the session of the context and is left with the context tokens.
+ */
+class BestOfEncoder {
+private:
+    /**
+     * First sequence ID used for branches, sequence 0 belongs to the session.
+     */
+    static constexpr llama_seq_id FIRST_SEQUENCE_ID = 1;
+
+    /**
+     * Number of padding bits after the cipher bits of every candidate other than candidate 0. More than any coder reads per token.
+     */
+    static constexpr int NUMBER_OF_PADDING_BITS = 64;
+
+    /**
+     * Struct that represents a candidate, i.e. a coder with its own padded cipher bits.
+     * Isn't moved after construction, as the reader references the bits.
+     */
+    struct Candidate {
+        std::unique_ptr<Coder> coder;
+        BitStream paddedCipherBits;
+        BitReader cipherBitReader;
+
+        Candidate(std::unique_ptr<Coder> coder, BitStream paddedCipherBits, size_t numberOfCipherBits)
+            : coder(std::move(coder)),
+              paddedCipherBits(std::move(paddedCipherBits)),
+              cipherBitReader(this->paddedCipherBits, numberOfCipherBits) {}
+    };
+
+    /**
+     * Struct that represents a branch, i.e. the candidates that picked the same tokens so far.
+     * Their coders are in the same state, as the state of a coder only depends on the picked tokens.
+     */
+    struct Branch {
+        llama_seq_id sequenceId = -1;
+        std::vector<size_t> candidates;
+        llama_tokens tokens;
+        double logProbability = 0.0;
+        bool isFinished = false;
+
+        /**
+         * Row of the logit matrix that predicts the next token, -1 for the logits of the prefilled context.
+         */
+        int32_t row = -1;
+    };
+
+    StegoEngine& engine;
+    Batch batch;
+
+    /**
+     * Function to pick the next token of a branch, forking it if its candidates pick different tokens.
+     *
+     * @param branches All branches, new ones are appended.
+     * @param branchIndex Index of the branch.
+     * @param candidates All candidates.
+     * @param freeSequenceIds Sequence IDs that are free for new branches.
+     * @param logits Logits that predict the next token of the branch.
+     */
+    void step(std::vector<Branch>& branches, size_t branchIndex, std::vector<std::unique_ptr<Candidate>>& candidates, std::vector<llama_seq_id>& freeSequenceIds, const float* logits);
+
+    /**
+     * Function to check if a cover text decodes to the cipher bits when it is teacher-forced through the session, i.e. the same way the receiver decodes it.
+     *
+     * @param contextTokens Token IDs of the context.
+     * @param coverTextTokens Token IDs of the cover text.
+     * @param cipherBits Cipher bits that were encoded.
+     * @param createCoder Function to create a new coder.
+     * @return Boolean that is true if the decoded bits start with the cipher bits, false otherwise.
+     * @throws std::runtime_error If llama.cpp fails to decode a batch.
+     */
+    bool isDecodable(const llama_tokens& contextTokens, const llama_tokens& coverTextTokens, const BitStream& cipherBits, const std::function<std::unique_ptr<Coder>()>& createCoder);
+
+public:
+    /**
+     * Constructor for a best-of encoder.
+     *
+     * @param engine Engine of the context to encode with. Context needs `n_seq_max` > 1 to encode more than one candidate.
+     */
+    explicit BestOfEncoder(StegoEngine& engine);
+
+    /**
+     * Function to encode cipher bits into the most natural of several candidate cover texts, finishing the last sentence.
+     *
+     * Falls back to `StegoEngine::encode` if there is only one candidate or the context has no additional sequences.
+     *
+     * @param contextTokens Token IDs of the context.
+     * @param cipherBits Cipher bits to encode.
+     * @param createCoder Function to create a new coder for every candidate.
+     * @param numberOfCandidates Number of candidates. At most `n_seq_max` - 1 of them are encoded to the end, if their tokens differ.
+     * @param listener Listener to notify about every token of the best candidate once it is final, can cancel encoding. Optional.
+     * @return Token IDs of the cover text with the highest log-probability, ties are broken by the number of tokens and then by the candidate. Those of `StegoEngine::encode` if it doesn't decode through the session. Only the streamed tokens if cancelled.
+     * @throws std::length_error If the candidates don't fit into the context window.
+     * @throws std::runtime_error If llama.cpp fails to decode a batch.
+     */
+    llama_tokens encode(const llama_tokens& contextTokens, const BitStream& cipherBits, const std::function<std::unique_ptr<Coder>()>& createCoder, int numberOfCandidates, EncodeListener* listener = nullptr);
+};
+
+#endif
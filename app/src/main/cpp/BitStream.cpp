@@ -0,0 +1,105 @@
+#include "BitStream.h"
+
+BitStream BitStream::fromBytes(const uint8_t* bytes, size_t numberOfBytes) {
+    BitStream bitStream;
+
+    bitStream.numberOfBits = numberOfBytes * 8;
+    bitStream.words.assign((numberOfBytes + 7) / 8, 0);
+
+    // Byte j of the stream becomes the (j % 8)-th most significant byte of word j / 8, i.e. words are filled big-endian
+    for (size_t j = 0; j < numberOfBytes; j++) {
+        bitStream.words[j / 8] |= static_cast<uint64_t>(bytes[j]) << (56 - 8 * (j % 8));
+    }
+
+    return bitStream;
+}
+
+void BitStream::toBytes(uint8_t* bytes, size_t numberOfBytes) const {
+    for (size_t j = 0; j < numberOfBytes; j++) {
+        bytes[j] = j / 8 < words.size() ? static_cast<uint8_t>(words[j / 8] >> (56 - 8 * (j % 8))) : 0;
+    }
+}
+
+void BitStream::reserve(size_t capacity) {
+    words.reserve((capacity + 63) / 64);
+}
+
+void BitStream::clear() {
+    words.clear();
+    numberOfBits = 0;
+}
+
+void BitStream::resize(size_t newNumberOfBits) {
+    // Appended bits are 0, so only new words need to be added
+    words.resize((newNumberOfBits + 63) / 64, 0);
+    numberOfBits = newNumberOfBits;
+
+    // Clear bits after the new end to keep the invariant that reading past the end returns 0
+    size_t offset = numberOfBits % 64;
+
+    if (offset != 0) {
+        words.back() &= ~0ULL << (64 - offset);
+    }
+}
+
+void BitStream::write(uint64_t bits, int n) {
+    if (n == 0) {
+        return;
+    }
+
+    // Mask higher bits, shifting by 64 would be undefined behaviour
+    if (n < 64) {
+        bits &= (1ULL << n) - 1;
+    }
+
+    size_t offset = numberOfBits % 64;
+
+    if (offset == 0) {
+        words.push_back(0);
+    }
+
+    // Bits fit into the free bits of the last word, or need to be split between it and a new word
+    int numberOfFreeBits = 64 - static_cast<int>(offset);
+
+    if (n <= numberOfFreeBits) {
+        words.back() |= bits << (numberOfFreeBits - n);
+    }
+    else {
+        words.back() |= bits >> (n - numberOfFreeBits);
+        words.push_back(bits << (64 - (n - numberOfFreeBits)));
+    }
+
+    numberOfBits += n;
+}
+
+void BitStream::append(const BitStream& bitStream, size_t position) {
+    reserve(numberOfBits + bitStream.numberOfBits - position);
+
+    // Copy a whole word at a time, then the remaining bits
+    while (position + 64 <= bitStream.numberOfBits) {
+        write(bitStream.peek(position, 64), 64);
+        position += 64;
+    }
+
+    if (position < bitStream.numberOfBits) {
+        int n = static_cast<int>(bitStream.numberOfBits - position);
+        write(bitStream.peek(position, n), n);
+    }
+}
+
+uint64_t BitStream::peek(size_t position, int n) const {
+    if (n == 0) {
+        return 0;
+    }
+
+    // Bits can span two words, so combine them into a 64-bit window starting at position
+    size_t index = position / 64;
+    size_t offset = position % 64;
+
+    uint64_t high = index < words.size() ? words[index] : 0;
+    uint64_t low = index + 1 < words.size() ? words[index + 1] : 0;
+
+    uint64_t window = offset == 0 ? high : (high << offset) | (low >> (64 - offset));
+
+    return window >> (64 - n);
+}
@@ -0,0 +1,175 @@
+#ifndef BIT_STREAM_H
+#define BIT_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Class that represents a sequence of bits, packed MSB first into 64-bit words.
+ *
+ * Replaces `std::vector<bool>`, which can only be read and written one bit at a time.
+ * Bits after the end of the stream are always 0 within the last word, so reading past the end behaves like reading 0-padding.
+ */
+class BitStream {
+private:
+    /**
+     * Words storing the bits. Bit i is bit (63 - i % 64) of word i / 64.
+     */
+    std::vector<uint64_t> words;
+
+    size_t numberOfBits = 0;
+
+public:
+    /**
+     * Function to create a bit stream from bytes, going from MSB to LSB of every byte.
+     *
+     * @param bytes Pointer to the bytes.
+     * @param numberOfBytes Number of bytes.
+     * @return The bit stream, its length is a multiple of 8.
+     */
+    static BitStream fromBytes(const uint8_t* bytes, size_t numberOfBytes);
+
+    /**
+     * Function to copy the bits to bytes, going from MSB to LSB of every byte (i.e. to reverse `BitStream::fromBytes`).
+     * Bits after the end of the stream are written as 0.
+     *
+     * @param bytes Pointer to the bytes to write to.
+     * @param numberOfBytes Number of bytes to write.
+     */
+    void toBytes(uint8_t* bytes, size_t numberOfBytes) const;
+
+    /**
+     * @return Number of bits in the stream.
+     */
+    size_t size() const {
+        return numberOfBits;
+    }
+
+    /**
+     * @return Boolean that is true if the stream contains no bits, false otherwise.
+     */
+    bool empty() const {
+        return numberOfBits == 0;
+    }
+
+    /**
+     * Function to reserve memory for a number of bits, so that writing them doesn't reallocate.
+     *
+     * @param capacity Number of bits.
+     */
+    void reserve(size_t capacity);
+
+    /**
+     * Function to remove all bits. Keeps the allocated memory.
+     */
+    void clear();
+
+    /**
+     * Function to change the number of bits. Truncates the stream or appends 0s at the end.
+     *
+     * @param newNumberOfBits New number of bits.
+     */
+    void resize(size_t newNumberOfBits);
+
+    /**
+     * Function to append the lowest bits of a number, going from MSB to LSB.
+     *
+     * @param bits Number storing the bits, right-aligned. Higher bits are ignored.
+     * @param n Number of bits to append, at most 64.
+     */
+    void write(uint64_t bits, int n);
+
+    /**
+     * Function to append a part of another bit stream.
+     *
+     * @param bitStream Another bit stream.
+     * @param position Position of the first bit to append.
+     */
+    void append(const BitStream& bitStream, size_t position = 0);
+
+    /**
+     * Function to read up to 64 bits starting at a given position, without any bounds checks. Bits after the end of the stream are read as 0.
+     *
+     * @param position Position of the first bit.
+     * @param n Number of bits to read, at most 64.
+     * @return The bits, right-aligned.
+     */
+    uint64_t peek(size_t position, int n) const;
+
+    /**
+     * Function to read a single bit.
+     *
+     * @param position Position of the bit, needs to be smaller than `size()`.
+     * @return The bit.
+     */
+    bool operator[](size_t position) const {
+        return (words[position / 64] >> (63 - position % 64)) & 1;
+    }
+};
+
+/**
+ * Class that represents sequential reading of a bit stream. Doesn't own the bit stream, it needs to outlive the reader.
+ */
+class BitReader {
+private:
+    const BitStream& bitStream;
+
+    /**
+     * Number of bits to read, bits of the stream after them are only read as padding.
+     */
+    size_t numberOfBits;
+
+    size_t position = 0;
+
+public:
+    /**
+     * Constructor for a reader, starting at the first bit of a bit stream.
+     *
+     * @param bitStream A bit stream.
+     */
+    explicit BitReader(const BitStream& bitStream) : bitStream(bitStream), numberOfBits(bitStream.size()) {}
+
+    /**
+     * Constructor for a reader that only reads the first bits of a bit stream and treats the rest as padding, i.e. it is peeked at but doesn't count as remaining bits.
+     *
+     * @param bitStream A bit stream.
+     * @param numberOfBits Number of bits to read, at most the length of the stream.
+     */
+    BitReader(const BitStream& bitStream, size_t numberOfBits) : bitStream(bitStream), numberOfBits(numberOfBits) {}
+
+    /**
+     * Function to read up to 64 bits at the current position without consuming them. Bits after the end of the stream are read as 0, padding is read as is.
+     *
+     * @param n Number of bits to read, at most 64.
+     * @return The bits, right-aligned.
+     */
+    uint64_t peek(int n) const {
+        return bitStream.peek(position, n);
+    }
+
+    /**
+     * Function to consume bits, i.e. to advance the current position. Can advance past the end of the stream.
+     *
+     * @param n Number of bits to consume.
+     */
+    void consume(size_t n) {
+        position += n;
+    }
+
+    /**
+     * @return Position of the next bit to read.
+     */
+    size_t getPosition() const {
+        return position;
+    }
+
+    /**
+     * @return Boolean that is true if there are bits left to read, false otherwise.
+     */
+    bool hasRemainingBits() const {
+        return position < numberOfBits;
+    }
+};
+
+#endif
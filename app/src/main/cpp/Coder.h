@@ -0,0 +1,62 @@
+#ifndef CODER_H
+#define CODER_H
+
+#include "llama.h"
+#include "BitStream.h"
+#include "StegoWorkspace.h"
+
+/**
+ * Class that represents a coding strategy for steganography, i.e. how bits are mapped to tokens and back.
+ *
+ * Coders only handle a single step based on the probabilities in the workspace. Everything else (tokenization, logits, softmax, suppression of special tokens, greedy tail) is done by `StegoEngine` for all coders alike.
+ */
+class Coder {
+public:
+    virtual ~Coder() = default;
+
+    /**
+     * Function to reset the state of the coder. Called by the engine before the first token of every encode/decode run.
+     */
+    virtual void reset() {}
+
+    /**
+     * Function to get the temperature the logits are scaled with before they are normalized.
+     *
+     * @return The temperature.
+     */
+    virtual float getTemperature() const {
+        return 1.0f;
+    }
+
+    /**
+     * Function to pick the next cover text token, encoding bits of the secret message in it.
+     *
+     * @param workspace Workspace of the engine, `probabilities` is filled for the current step.
+     * @param cipherBitReader Reader of the cipher bits, has remaining bits. Consumes the bits that were encoded.
+     * @return ID of the picked token.
+     */
+    virtual llama_token encodeToken(StegoWorkspace& workspace, BitReader& cipherBitReader) = 0;
+
+    /**
+     * Function to recover the bits of the secret message encoded in a cover text token.
+     *
+     * @param workspace Workspace of the engine, `probabilities` is filled for the current step.
+     * @param coverTextToken ID of the cover text token.
+     * @param isLastToken Boolean that is true if this is the last cover text token, false otherwise.
+     * @param cipherBits Bit stream to append the decoded bits to.
+     * @return Boolean that is true if the token could be decoded, false otherwise.
+     */
+    virtual bool decodeToken(StegoWorkspace& workspace, llama_token coverTextToken, bool isLastToken, BitStream& cipherBits) = 0;
+
+    /**
+     * Function to check if a token signals the end of the cover text, so that encoding stops immediately.
+     *
+     * @param token ID of the last picked token.
+     * @return Boolean that is true if encoding should stop, false otherwise.
+     */
+    virtual bool isEndOfStream(llama_token /* token */) const {
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "CodingPipeline.h"
+
+namespace {
+    /**
+     * Number of times a waiting thread yields before it starts sleeping between checks.
+     */
+    constexpr int NUMBER_OF_SPINS = 64;
+
+    /**
+     * Function to wait until a condition holds, yielding first and then sleeping briefly, so that a waiting thread doesn't take a core from the backend for long.
+     */
+    template <typename Condition>
+    void waitUntil(Condition isDone) {
+        for (int i = 0; !isDone(); i++) {
+            if (i < NUMBER_OF_SPINS) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+}
+
+bool CodingPipeline::isAvailable(llama_context* ctx) {
+    // hardware_concurrency is 0 if it isn't known, then there is no core to spare either
+    unsigned int numberOfCores = std::thread::hardware_concurrency();
+
+    return numberOfCores > static_cast<unsigned int>(std::max(1, llama_n_threads_batch(ctx)));
+}
+
+size_t CodingPipeline::calculateMaxNumberOfRows(const StegoEngine& engine) {
+    auto vocabSize = static_cast<size_t>(engine.vocabInfo.vocabSize);
+
+    return std::clamp(MAX_SLOT_BYTES / (vocabSize * sizeof(float)), static_cast<size_t>(1), static_cast<size_t>(engine.session.getBatchCapacity()));
+}
+
+CodingPipeline::CodingPipeline(StegoEngine& engine)
+    : engine(engine),
+      vocabSize(static_cast<size_t>(engine.vocabInfo.vocabSize)),
+      maxNumberOfRows(calculateMaxNumberOfRows(engine)) {
+    // Logits of the slots are tens of MB, so they are only allocated once per engine
+    // Batch capacity and vocabulary size of an engine don't change, so later pipelines always fit into them
+    StegoWorkspace& workspace = engine.workspace;
+    size_t slotSize = maxNumberOfRows * vocabSize;
+
+    if (workspace.pipelineLogitsSize < NUMBER_OF_SLOTS * slotSize) {
+        workspace.pipelineLogits.reset(new float[NUMBER_OF_SLOTS * slotSize]);
+        workspace.pipelineLogitsSize = NUMBER_OF_SLOTS * slotSize;
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_SLOTS; i++) {
+        slots[i].logits = workspace.pipelineLogits.get() + i * slotSize;
+        slots[i].rows.reserve(maxNumberOfRows);
+
+        freeSlots.push_back(NUMBER_OF_SLOTS - 1 - i);
+    }
+
+    // Start the worker last, so that it only sees initialized members
+    worker = std::thread(&CodingPipeline::run, this);
+}
+
+CodingPipeline::~CodingPipeline() {
+    // Rows that weren't submitted are dropped, the worker still finishes the submitted ones as their coders and bit streams outlive the pipeline
+    if (currentSlot != NUMBER_OF_SLOTS) {
+        freeSlots.push_back(currentSlot);
+        currentSlot = NUMBER_OF_SLOTS;
+    }
+
+    while (freeSlots.size() < NUMBER_OF_SLOTS) {
+        collectCodedSlot(true);
+    }
+
+    isStopping.store(true, std::memory_order_release);
+    worker.join();
+}
+
+void CodingPipeline::run() {
+    while (true) {
+        size_t index = NUMBER_OF_SLOTS;
+
+        // Stops only once all slots are back, so there is nothing left to code then
+        waitUntil([&]() { return filledSlots.pop(index) || isStopping.load(std::memory_order_acquire); });
+
+        if (index == NUMBER_OF_SLOTS) {
+            return;
+        }
+
+        Slot& slot = slots[index];
+
+        // After an exception the remaining rows are skipped, it is rethrown on the decoding thread
+        if (!workerException) {
+            try {
+                for (size_t i = 0; i < slot.rows.size(); i++) {
+                    const Row& row = slot.rows[i];
+
+                    // Coder of a failed cover text is in an undefined state, its remaining tokens can't be decoded either
+                    if (failedStreams.count(row.stream) > 0) {
+                        continue;
+                    }
+
+                    engine.calculateProbabilities(slot.logits + i * vocabSize, row.coder->getTemperature());
+
+                    if (!row.coder->decodeToken(engine.workspace, row.token, row.isLastToken, *row.cipherBits)) {
+                        failedStreams.insert(row.stream);
+                        slot.failures.emplace_back(row.stream, row.position);
+                    }
+                }
+            }
+            catch (...) {
+                workerException = std::current_exception();
+            }
+        }
+
+        // Queue has room for every slot, so this always succeeds
+        codedSlots.push(index);
+    }
+}
+
+bool CodingPipeline::collectCodedSlot(bool isBlocking) {
+    size_t index;
+
+    if (isBlocking) {
+        waitUntil([&]() { return codedSlots.pop(index); });
+    }
+    else if (!codedSlots.pop(index)) {
+        return false;
+    }
+
+    Slot& slot = slots[index];
+
+    failures.insert(failures.end(), slot.failures.begin(), slot.failures.end());
+    slot.failures.clear();
+
+    freeSlots.push_back(index);
+
+    return true;
+}
+
+void CodingPipeline::add(const float* logits, const Row& row) {
+    if (currentSlot == NUMBER_OF_SLOTS) {
+        // Collect failures as early as possible, wait for the worker only if both slots are in use
+        while (collectCodedSlot(false)) {}
+
+        if (freeSlots.empty()) {
+            collectCodedSlot(true);
+        }
+
+        currentSlot = freeSlots.back();
+        freeSlots.pop_back();
+
+        slots[currentSlot].rows.clear();
+    }
+
+    Slot& slot = slots[currentSlot];
+
+    // Logits are copied as the next decode overwrites them
+    std::memcpy(slot.logits + slot.rows.size() * vocabSize, logits, vocabSize * sizeof(float));
+    slot.rows.push_back(row);
+
+    if (slot.rows.size() == maxNumberOfRows) {
+        flush();
+    }
+}
+
+void CodingPipeline::flush() {
+    if (currentSlot == NUMBER_OF_SLOTS || slots[currentSlot].rows.empty()) {
+        return;
+    }
+
+    // Queue has room for every slot, so this always succeeds
+    filledSlots.push(currentSlot);
+    currentSlot = NUMBER_OF_SLOTS;
+}
+
+const std::vector<std::pair<size_t, size_t>>& CodingPipeline::drain() {
+    flush();
+
+    // An empty current slot is still held by the decoding thread
+    size_t numberOfHeldSlots = currentSlot == NUMBER_OF_SLOTS ? 0 : 1;
+
+    while (freeSlots.size() + numberOfHeldSlots < NUMBER_OF_SLOTS) {
+        collectCodedSlot(true);
+    }
+
+    // Exception is published together with the slot, so it is visible once all slots are back
+    if (workerException) {
+        std::exception_ptr exception = workerException;
+        workerException = nullptr;
+
+        std::rethrow_exception(exception);
+    }
+
+    return failures;
+}
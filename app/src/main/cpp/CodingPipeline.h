@@ -0,0 +1,189 @@
+#ifndef CODING_PIPELINE_H
+#define CODING_PIPELINE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "llama.h"
+#include "BitStream.h"
+#include "Coder.h"
+#include "SpscQueue.h"
+#include "StegoEngine.h"
+
+/**
+ * Class that represents a pipeline that overlaps the coding of teacher-forced tokens with the next decode.
+ *
+ * The decoding thread copies the logit rows of a decode into a slot and hands it to a worker thread, which runs softmax, suppression of special tokens,
+ * selection and coding for them while the backend already decodes the next tokens. Slots are passed back and forth through two lock-free single-producer/single-consumer
+ * queues, so the logits of a decode can be copied while the worker still codes the ones of the previous decode (double buffering).
+ *
+ * Only pays off if the backend leaves a core free for the worker, see `isAvailable`, and if there are rows to code while the next decode runs, see `calculateMaxNumberOfRows`. While a pipeline exists, the workspace of the engine belongs to its worker,
+ * so the decoding thread must not calculate probabilities itself. Stages of the worker aren't included in the stats of the profiler.
+ */
+class CodingPipeline {
+public:
+    /**
+     * Struct that represents a row of the logit matrix together with what the worker needs to decode the token it predicts.
+     */
+    struct Row {
+        Coder* coder;
+        BitStream* cipherBits;
+        llama_token token;
+        bool isLastToken;
+
+        /**
+         * Index of the cover text. Once a token of a cover text can't be decoded, its remaining rows are skipped.
+         */
+        size_t stream;
+
+        /**
+         * Position of the token in its cover text.
+         */
+        size_t position;
+    };
+
+private:
+    /**
+     * Number of slots, i.e. one that is coded by the worker while the other one is filled.
+     */
+    static constexpr size_t NUMBER_OF_SLOTS = 2;
+
+    /**
+     * Maximum memory of the logits of a slot. Copying all logits of a full batch would take hundreds of MB for large vocabularies.
+     */
+    static constexpr size_t MAX_SLOT_BYTES = 16 * 1024 * 1024;
+
+    /**
+     * Struct that represents the logit rows of a decode and the cover text tokens they predict.
+     */
+    struct Slot {
+        /**
+         * Logit rows of the slot, part of `StegoWorkspace::pipelineLogits`.
+         */
+        float* logits = nullptr;
+
+        std::vector<Row> rows;
+
+        /**
+         * Streams and positions of the tokens that couldn't be decoded, filled by the worker.
+         */
+        std::vector<std::pair<size_t, size_t>> failures;
+    };
+
+    StegoEngine& engine;
+    size_t vocabSize;
+    size_t maxNumberOfRows;
+
+    std::array<Slot, NUMBER_OF_SLOTS> slots;
+
+    /**
+     * Slots that are filled and wait for the worker.
+     */
+    SpscQueue<size_t, NUMBER_OF_SLOTS> filledSlots;
+
+    /**
+     * Slots that the worker is done with.
+     */
+    SpscQueue<size_t, NUMBER_OF_SLOTS> codedSlots;
+
+    // State of the decoding thread
+    std::vector<size_t> freeSlots;
+    size_t currentSlot = NUMBER_OF_SLOTS;
+    std::vector<std::pair<size_t, size_t>> failures;
+
+    // State of the worker
+    std::unordered_set<size_t> failedStreams;
+    std::exception_ptr workerException;
+
+    std::atomic<bool> isStopping {false};
+    std::thread worker;
+
+    /**
+     * Function that runs on the worker thread, codes filled slots until the pipeline is destroyed.
+     */
+    void run();
+
+    /**
+     * Function to take back a slot the worker is done with, collecting its failures.
+     *
+     * @param isBlocking Boolean that is true if the function waits for a slot, false if it returns immediately.
+     * @return Boolean that is true if a slot was taken back, false otherwise.
+     */
+    bool collectCodedSlot(bool isBlocking);
+
+public:
+    /**
+     * Function to check if pipelining pays off for a context, i.e. if its backend threads leave a core free for the worker.
+     *
+     * @param ctx Memory address of the context.
+     * @return Boolean that is true if there are more cores than batch threads of the context, false otherwise.
+     */
+    static bool isAvailable(llama_context* ctx);
+
+    /**
+     * Function to get the maximum number of logit rows per slot of the pipelines of an engine, without creating one.
+     *
+     * @param engine Engine whose workspace the worker codes with.
+     * @return Maximum number of logit rows per slot.
+     */
+    static size_t calculateMaxNumberOfRows(const StegoEngine& engine);
+
+    /**
+     * Constructor for a pipeline. Starts the worker. Allocates the logits of the slots in the workspace of the engine only if no earlier pipeline did.
+     *
+     * @param engine Engine whose workspace the worker codes with.
+     */
+    explicit CodingPipeline(StegoEngine& engine);
+
+    /**
+     * Destructor for a pipeline. Waits for the worker to code all submitted rows and stops it.
+     */
+    ~CodingPipeline();
+
+    CodingPipeline(const CodingPipeline&) = delete;
+    CodingPipeline& operator=(const CodingPipeline&) = delete;
+
+    /**
+     * Function to copy a logit row into the current slot, submitting the slot once it is full.
+     *
+     * Rows of the same cover text need to be added in order of their tokens. The logits only need to stay valid until the function returns.
+     *
+     * @param logits Logits that predict the token of the row.
+     * @param row The token and its coder.
+     */
+    void add(const float* logits, const Row& row);
+
+    /**
+     * Function to submit the current slot to the worker, e.g. before the next decode. Does nothing if it has no rows.
+     */
+    void flush();
+
+    /**
+     * Function to wait until all rows are coded.
+     *
+     * @return Streams and positions of the tokens that couldn't be decoded, at most one per stream.
+     * @throws std::exception Any exception that was thrown by a coder on the worker.
+     */
+    const std::vector<std::pair<size_t, size_t>>& drain();
+
+    /**
+     * @return Maximum number of logit rows per slot, i.e. per decode so that the worker codes them while the next decode runs. At most the batch capacity of the session.
+     */
+    size_t getMaxNumberOfRows() const {
+        return maxNumberOfRows;
+    }
+
+    /**
+     * @return Streams and positions of the tokens that are known to be undecodable so far, at most one per stream.
+     */
+    const std::vector<std::pair<size_t, size_t>>& getFailures() const {
+        return failures;
+    }
+};
+
+#endif
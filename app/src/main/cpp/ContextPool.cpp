@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "ContextPool.h"
+#include "StegoEngine.h"
+#include "WarmStart.h"
+
+ContextPool::ContextPool(llama_model* model, const EngineConfig& config, int numberOfContexts) : numberOfThreads(std::max(1, config.numberOfThreads)) {
+    llama_context_params params = config.toContextParams(model);
+
+    for (int i = 0; i < std::max(1, numberOfContexts); i++) {
+        llama_context* ctx = llama_init_from_model(model, params);
+
+        if (ctx == nullptr) {
+            // Free the contexts created so far, destructor isn't called if the constructor throws
+            for (const Entry& entry : entries) {
+                StegoEngine::unload(entry.ctx);
+                llama_free(entry.ctx);
+            }
+
+            throw std::runtime_error("Context " + std::to_string(i) + " of the pool can't be created");
+        }
+
+        // Allocate the compute buffers of llama.cpp and the buffers needed in every step of encoding/decoding once now
+        WarmStart::warmup(ctx);
+        StegoEngine::load(ctx);
+
+        entries.push_back({ctx});
+    }
+}
+
+ContextPool::~ContextPool() {
+    for (const Entry& entry : entries) {
+        // Free steganography engine first as memory address of the context can be reused afterwards
+        StegoEngine::unload(entry.ctx);
+        llama_free(entry.ctx);
+    }
+}
+
+int ContextPool::findFreeEntry(int role) const {
+    int unusedEntry = -1;
+    int anyEntry = -1;
+
+    for (int i = 0; i < static_cast<int>(entries.size()); i++) {
+        const Entry& entry = entries[i];
+
+        if (entry.isLeased) {
+            continue;
+        }
+
+        if (entry.lastRole == role) {
+            return i;
+        }
+
+        if (entry.lastRole == -1 && unusedEntry == -1) {
+            unusedEntry = i;
+        }
+
+        if (anyEntry == -1) {
+            anyEntry = i;
+        }
+    }
+
+    return unusedEntry != -1 ? unusedEntry : anyEntry;
+}
+
+llama_context* ContextPool::acquire(int role) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    int i = -1;
+    isContextReleased.wait(lock, [&]() { return (i = findFreeEntry(role)) != -1; });
+
+    Entry& entry = entries[i];
+    entry.isLeased = true;
+    entry.lastRole = role;
+    numberOfLeases++;
+
+    // Split the threads among the leased contexts, contexts that are already running keep theirs until their next lease
+    int32_t numberOfThreadsPerLease = std::max(1, numberOfThreads / numberOfLeases);
+    llama_set_n_threads(entry.ctx, numberOfThreadsPerLease, numberOfThreadsPerLease);
+
+    return entry.ctx;
+}
+
+void ContextPool::release(const llama_context* ctx) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto iterator = std::find_if(entries.begin(), entries.end(), [ctx](const Entry& entry) { return entry.ctx == ctx; });
+
+        if (iterator == entries.end() || !iterator->isLeased) {
+            return;
+        }
+
+        iterator->isLeased = false;
+        numberOfLeases--;
+    }
+
+    isContextReleased.notify_one();
+}
@@ -0,0 +1,99 @@
+#ifndef CONTEXT_POOL_H
+#define CONTEXT_POOL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "llama.h"
+#include "EngineConfig.h"
+
+/**
+ * Class that represents a pool of contexts sharing one LLM, so that encoding, decoding and binary conversion can run concurrently.
+ *
+ * Every context has its own steganography engine (i.e. workspace and session with KV cache). Jobs lease a context for their duration,
+ * waiting if all are in use. Threads of the device are split among the leased contexts, so that concurrent jobs run on separate cores.
+ *
+ * Contexts remember the role of their last lease. A lease prefers a free context that last served the same role, so that e.g. consecutive
+ * encodes of a conversation find its prefix still cached, while binary conversion doesn't evict it.
+ */
+class ContextPool {
+private:
+    /**
+     * Struct that represents a context of the pool.
+     */
+    struct Entry {
+        llama_context* ctx;
+        int lastRole = -1;
+        bool isLeased = false;
+    };
+
+    std::mutex mutex;
+    std::condition_variable isContextReleased;
+    std::vector<Entry> entries;
+
+    /**
+     * Total number of threads to split among the leased contexts.
+     */
+    int32_t numberOfThreads;
+
+    int numberOfLeases = 0;
+
+    /**
+     * Function to find the free context that fits a role best, i.e. one that last served the role, otherwise one that no role used yet, otherwise any.
+     *
+     * @param role Role of the lease.
+     * @return Index of the context, -1 if all are in use.
+     */
+    int findFreeEntry(int role) const;
+
+public:
+    /**
+     * Constructor for a pool. Creates the contexts and their steganography engines.
+     *
+     * @param model Memory address of the LLM.
+     * @param config Parameters of the contexts, already resolved.
+     * @param numberOfContexts Number of contexts, at least 1.
+     * @throws std::runtime_error If a context can't be created.
+     */
+    ContextPool(llama_model* model, const EngineConfig& config, int numberOfContexts);
+
+    /**
+     * Destructor for a pool. Frees the steganography engines and contexts, so all leases need to be released first.
+     */
+    ~ContextPool();
+
+    // Pool owns the contexts, so it can't be copied
+    ContextPool(const ContextPool&) = delete;
+    ContextPool& operator=(const ContextPool&) = delete;
+
+    /**
+     * Function to lease a context. Waits until one is free if all are in use.
+     *
+     * @param role Role of the lease (e.g. 0 = steganography, 1 = binary conversion), used to keep the KV caches of different jobs apart.
+     * @return Memory address of the leased context.
+     */
+    llama_context* acquire(int role);
+
+    /**
+     * Function to return a leased context to the pool.
+     *
+     * @param ctx Memory address of the leased context.
+     */
+    void release(const llama_context* ctx);
+
+    /**
+     * @return Number of contexts in the pool.
+     */
+    size_t size() const {
+        return entries.size();
+    }
+
+    /**
+     * @return Maximum number of tokens in every context of the pool (= `n_ctx`).
+     */
+    uint32_t getContextSize() const {
+        return llama_n_ctx(entries.front().ctx);
+    }
+};
+
+#endif
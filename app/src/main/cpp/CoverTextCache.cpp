@@ -0,0 +1,48 @@
+#include <algorithm>
+#include <cstring>
+#include "CoverTextCache.h"
+
+std::mutex CoverTextCache::mutex;
+std::deque<CoverTextCache::Entry> CoverTextCache::entries;
+
+void CoverTextCache::put(const llama_model* model, const std::string& coverText, const llama_tokens& tokens) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Newest entry is at the front, so that lookups of the message that was just sent find it first
+    entries.erase(
+        std::remove_if(entries.begin(), entries.end(), [model, &coverText](const Entry& entry) { return entry.model == model && entry.coverText == coverText; }),
+        entries.end()
+    );
+
+    entries.push_front({model, coverText, tokens});
+
+    if (entries.size() > CAPACITY) {
+        entries.pop_back();
+    }
+}
+
+bool CoverTextCache::get(const llama_model* model, const char* coverText, size_t length, llama_tokens& tokens) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Compare the bytes in place, the cover text is usually still pinned in the JVM
+    auto iterator = std::find_if(entries.begin(), entries.end(), [model, coverText, length](const Entry& entry) {
+        return entry.model == model && entry.coverText.size() == length && std::memcmp(entry.coverText.data(), coverText, length) == 0;
+    });
+
+    if (iterator == entries.end()) {
+        return false;
+    }
+
+    tokens = iterator->tokens;
+
+    return true;
+}
+
+void CoverTextCache::unload(const llama_model* model) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    entries.erase(
+        std::remove_if(entries.begin(), entries.end(), [model](const Entry& entry) { return entry.model == model; }),
+        entries.end()
+    );
+}
@@ -0,0 +1,69 @@
+#ifndef COVER_TEXT_CACHE_H
+#define COVER_TEXT_CACHE_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include "llama.h"
+#include "common.h"
+
+/**
+ * Class that represents a cache of the last cover texts that were encoded, together with the token IDs they were generated as.
+ *
+ * Decoding a cover text that was encoded on this device (e.g. a sent message of the conversation) then uses the generated token IDs
+ * instead of tokenizing the cover text again. Saves the tokenization and avoids the rare cases where the tokenization of a cover text
+ * differs from the token IDs it was generated as, which would fail decoding.
+ */
+class CoverTextCache {
+private:
+    /**
+     * Maximum number of cover texts in the cache. Oldest ones are dropped first.
+     */
+    static constexpr size_t CAPACITY = 16;
+
+    /**
+     * Struct that represents an encoded cover text.
+     */
+    struct Entry {
+        const llama_model* model;
+        std::string coverText;
+        llama_tokens tokens;
+    };
+
+    /**
+     * Mutex to guard the cache, as contexts of a pool can encode and decode concurrently.
+     */
+    static std::mutex mutex;
+
+    static std::deque<Entry> entries;
+
+public:
+    /**
+     * Function to store a cover text and the token IDs it was generated as. Replaces an existing entry of the same cover text.
+     *
+     * @param model Memory address of the LLM that generated the cover text.
+     * @param coverText The cover text as UTF-8 encoded string.
+     * @param tokens Token IDs of the cover text.
+     */
+    static void put(const llama_model* model, const std::string& coverText, const llama_tokens& tokens);
+
+    /**
+     * Function to look up the token IDs a cover text was generated as.
+     *
+     * @param model Memory address of the LLM.
+     * @param coverText Pointer to the UTF-8 encoded cover text, doesn't need to be null-terminated.
+     * @param length Number of bytes of the cover text.
+     * @param tokens Vector to store the token IDs in if the cover text is cached.
+     * @return Boolean that is true if the cover text is cached, false otherwise.
+     */
+    static bool get(const llama_model* model, const char* coverText, size_t length, llama_tokens& tokens);
+
+    /**
+     * Function to remove all cover texts of an LLM from the cache. Needs to be called before the LLM is unloaded, as its memory address can be reused afterwards.
+     *
+     * @param model Memory address of the LLM.
+     */
+    static void unload(const llama_model* model);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "CoverTextListener.h"
+#include "common.h"
+
+CoverTextListener::CoverTextListener(JNIEnv* env, jobject jListener, const llama_context* ctx)
+    : env(env),
+      jListener(jListener),
+      ctx(ctx) {
+    // Look up the method once, not for every token
+    // Kotlin signature: fun onChunk(chunk: ByteArray): Boolean
+    jclass listenerClass = env->GetObjectClass(jListener);
+    onChunk = env->GetMethodID(listenerClass, "onChunk", "([B)Z");
+    env->DeleteLocalRef(listenerClass);
+}
+
+bool CoverTextListener::onToken(llama_token token) {
+    // Same flags as LlamaCpp::detokenize, so that special tokens are rendered the same way
+    pendingBytes += common_token_to_piece(ctx, token, true);
+
+    size_t completePrefixLength = getCompletePrefixLength(pendingBytes);
+
+    if (completePrefixLength == 0) {
+        return true;
+    }
+
+    // Copy the complete characters into a Java byte array to bypass JNI errors with strings
+    auto length = static_cast<jsize>(completePrefixLength);
+
+    jbyteArray jChunk = env->NewByteArray(length);
+    env->SetByteArrayRegion(jChunk, 0, length, reinterpret_cast<const jbyte*>(pendingBytes.data()));
+
+    pendingBytes.erase(0, completePrefixLength);
+
+    jboolean shouldContinue = env->CallBooleanMethod(jListener, onChunk, jChunk);
+
+    // Local references are only freed when the JNI call returns, so free them per token to not run out of them for long cover texts
+    env->DeleteLocalRef(jChunk);
+
+    // Exception thrown by the listener stays pending and is rethrown in Kotlin once the JNI call returns
+    if (env->ExceptionCheck() || !shouldContinue) {
+        isCancelled = true;
+    }
+
+    return !isCancelled;
+}
+
+size_t CoverTextListener::getCompletePrefixLength(const std::string& bytes) {
+    // Only the last character can be incomplete, its lead byte is at most 3 bytes before the end
+    size_t length = bytes.size();
+
+    for (size_t i = 1; i <= 4 && i <= length; i++) {
+        auto byte = static_cast<unsigned char>(bytes[length - i]);
+
+        // Continuation bytes (10xxxxxx) don't start a character, keep looking for the lead byte
+        if ((byte & 0xC0) == 0x80) {
+            continue;
+        }
+
+        // Lead byte encodes the length of its character: 0xxxxxxx = 1, 110xxxxx = 2, 1110xxxx = 3, 11110xxx = 4
+        size_t characterLength = byte < 0x80 ? 1 : (byte & 0xE0) == 0xC0 ? 2 : (byte & 0xF0) == 0xE0 ? 3 : 4;
+
+        return characterLength <= i ? length : length - i;
+    }
+
+    // Invalid UTF-8 without a lead byte, forward it as is
+    return length;
+}
@@ -0,0 +1,57 @@
+#ifndef COVER_TEXT_LISTENER_H
+#define COVER_TEXT_LISTENER_H
+
+#include <string>
+#include <jni.h>
+#include "llama.h"
+#include "EncodeListener.h"
+
+/**
+ * Class that represents a listener that forwards the cover text to a Kotlin `NativeCoverTextListener` while it is being generated.
+ *
+ * Tokens are detokenized one by one, but a token can end in the middle of a multi-byte UTF-8 character.
+ * Only complete characters are forwarded, the remaining bytes are kept until the next token completes them.
+ */
+class CoverTextListener : public EncodeListener {
+private:
+    JNIEnv* env;
+    jobject jListener;
+    jmethodID onChunk;
+    const llama_context* ctx;
+
+    /**
+     * Bytes of the detokenized tokens that weren't forwarded yet because they don't form a complete UTF-8 character.
+     */
+    std::string pendingBytes;
+
+    bool isCancelled = false;
+
+    /**
+     * Function to get the length of the longest prefix of a string that only contains complete UTF-8 characters.
+     *
+     * @param bytes UTF-8 encoded string.
+     * @return Length of the prefix in bytes.
+     */
+    static size_t getCompletePrefixLength(const std::string& bytes);
+
+public:
+    /**
+     * Constructor for a cover text listener.
+     *
+     * @param env The JNI environment, only valid on the calling thread.
+     * @param jListener Kotlin `NativeCoverTextListener`.
+     * @param ctx Memory address of the context.
+     */
+    CoverTextListener(JNIEnv* env, jobject jListener, const llama_context* ctx);
+
+    bool onToken(llama_token token) override;
+
+    /**
+     * @return Boolean that is true if Kotlin cancelled encoding or threw an exception, false otherwise.
+     */
+    bool wasCancelled() const {
+        return isCancelled;
+    }
+};
+
+#endif
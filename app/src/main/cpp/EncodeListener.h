@@ -0,0 +1,24 @@
+#ifndef ENCODE_LISTENER_H
+#define ENCODE_LISTENER_H
+
+#include "llama.h"
+
+/**
+ * Class that represents a listener that is notified about every cover text token as soon as it is picked by `StegoEngine::encode`.
+ *
+ * Also allows cooperative cancellation: The engine checks the return value after every step and stops encoding if it is false.
+ */
+class EncodeListener {
+public:
+    virtual ~EncodeListener() = default;
+
+    /**
+     * Function that is called for every cover text token, including the ones of the greedy tail.
+     *
+     * @param token ID of the picked token.
+     * @return Boolean that is true if encoding should continue, false if it should be cancelled.
+     */
+    virtual bool onToken(llama_token token) = 0;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include "EngineConfig.h"
+#include "common.h"
+
+void EngineConfig::resolve() {
+    // Threads only change the speed, not the logits, so they can fit the device
+    if (numberOfThreads <= 0) {
+        numberOfThreads = std::max(1, static_cast<int>(cpu_get_num_math()));
+    }
+
+    // Everything else changes the logits, so it is the same on every device unless it is set explicitly (and then has to be set the same on both sides)
+    if (contextSize == 0) {
+        contextSize = DEFAULT_CONTEXT_SIZE;
+    }
+
+    if (batchSize == 0) {
+        batchSize = DEFAULT_BATCH_SIZE;
+    }
+
+    if (microBatchSize == 0) {
+        microBatchSize = DEFAULT_BATCH_SIZE;
+    }
+
+    // Micro-batches can't be larger than batches
+    microBatchSize = std::min(microBatchSize, batchSize);
+
+    // Never quantize the KV cache silently, the receiver would compute different probabilities with an F16 one
+    if (kvCacheType == KV_CACHE_TYPE_DEFAULT) {
+        kvCacheType = KV_CACHE_TYPE_F16;
+    }
+}
+
+llama_model_params EngineConfig::toModelParams() const {
+    llama_model_params params = llama_model_default_params();
+
+    params.n_gpu_layers = numberOfGpuLayers;
+    params.use_mmap = useMmap;
+    params.use_mlock = useMlock;
+
+    return params;
+}
+
+llama_context_params EngineConfig::toContextParams(const llama_model* model) const {
+    llama_context_params params = llama_context_default_params();
+
+    params.n_threads = numberOfThreads;
+    params.n_threads_batch = numberOfThreads;
+
+    // Context larger than the one the LLM was trained with only wastes memory
+    int32_t trainedContextSize = llama_model_n_ctx_train(model);
+
+    params.n_ctx = trainedContextSize > 0 ? std::min(contextSize, static_cast<uint32_t>(trainedContextSize)) : contextSize;
+    params.n_batch = batchSize;
+    params.n_ubatch = microBatchSize;
+
+    // Sequences share one unified memory, otherwise llama.cpp would split the context size evenly and limit the session to a fraction of it
+    params.n_seq_max = numberOfSequences;
+    params.kv_unified = true;
+
+#ifdef HIPS_ENABLE_PROFILING
+    // Profiler reports the timings of llama.cpp as well, which are only collected with performance data enabled
+    params.no_perf = false;
+#endif
+
+    // Auto would let llama.cpp decide per backend, so devices with and without support would compute different logits
+    params.flash_attn_type = isFlashAttentionEnabled ? LLAMA_FLASH_ATTN_TYPE_ENABLED : LLAMA_FLASH_ATTN_TYPE_DISABLED;
+
+    ggml_type type = kvCacheType == KV_CACHE_TYPE_Q4_0 ? GGML_TYPE_Q4_0 : kvCacheType == KV_CACHE_TYPE_Q8_0 ? GGML_TYPE_Q8_0 : GGML_TYPE_F16;
+
+    // llama.cpp can only quantize the V cache with flash attention, so only quantize the K cache without it
+    params.type_k = type;
+    params.type_v = isFlashAttentionEnabled ? type : GGML_TYPE_F16;
+
+    return params;
+}
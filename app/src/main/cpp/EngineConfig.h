@@ -0,0 +1,75 @@
+#ifndef ENGINE_CONFIG_H
+#define ENGINE_CONFIG_H
+
+#include <cstdint>
+#include "llama.h"
+
+/**
+ * Struct that represents the parameters the LLM and its contexts are loaded with.
+ *
+ * Values of 0 (or `KV_CACHE_TYPE_DEFAULT`) mean "default". Parameters that don't change the logits (threads) are chosen by probing the device.
+ * Parameters that do change the logits (context size, batch sizes, flash attention, KV cache type) are pinned to fixed defaults instead, as sender and
+ * receiver have to compute the same probabilities. They are shared settings like the ones of the coders, a device never chooses them on its own.
+ */
+struct EngineConfig {
+    /**
+     * KV cache types, matching the order of `KVCacheType` in Kotlin.
+     */
+    static constexpr int KV_CACHE_TYPE_DEFAULT = 0;
+    static constexpr int KV_CACHE_TYPE_F16 = 1;
+    static constexpr int KV_CACHE_TYPE_Q8_0 = 2;
+    static constexpr int KV_CACHE_TYPE_Q4_0 = 3;
+
+    /**
+     * Default context size, small enough that the contexts of a 3B LLM fit into memory on low-end devices.
+     */
+    static constexpr uint32_t DEFAULT_CONTEXT_SIZE = 2048;
+
+    /**
+     * Default batch and micro-batch size. Shapes of the physical batches change the logits, so they are the same on every device.
+     */
+    static constexpr uint32_t DEFAULT_BATCH_SIZE = 512;
+
+    // Model parameters
+    int32_t numberOfGpuLayers = 0;
+    bool useMmap = true;
+    bool useMlock = false;
+
+    // Context parameters
+    int32_t numberOfThreads = 0;
+    uint32_t contextSize = 0;
+    uint32_t batchSize = 0;
+    uint32_t microBatchSize = 0;
+    bool isFlashAttentionEnabled = false;
+    int kvCacheType = KV_CACHE_TYPE_DEFAULT;
+
+    /**
+     * Number of sequences a context can store in its memory, i.e. the session plus the cover texts a `MultiSequenceDecoder` decodes at once.
+     */
+    uint32_t numberOfSequences = 4;
+
+    /**
+     * Function to replace all "default" values.
+     *
+     * - Threads: Number of performance cores (via `cpu_get_num_math` of llama.cpp), as efficiency cores slow down the synchronization of all threads.
+     * - Context size: `DEFAULT_CONTEXT_SIZE` on every device.
+     * - Batch sizes: `DEFAULT_BATCH_SIZE` on every device, large enough to prefill a conversation in few batches, small enough to keep intermediate buffers small.
+     * - KV cache type: F16 on every device, a quantized KV cache is only used if it is set explicitly.
+     */
+    void resolve();
+
+    /**
+     * @return The parameters to load the LLM with.
+     */
+    llama_model_params toModelParams() const;
+
+    /**
+     * Function to get the parameters to load a context with. Call `resolve` first.
+     *
+     * @param model Memory address of the LLM, needed to limit the context size to the one it was trained with.
+     * @return The parameters to load a context with.
+     */
+    llama_context_params toContextParams(const llama_model* model) const;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#include <stdexcept>
+#include "Exceptions.h"
+
+void Exceptions::throwInJava(JNIEnv* env, const std::exception& exception) {
+    // Only one Kotlin/Java exception can be pending, keep the first one
+    if (env->ExceptionCheck()) {
+        return;
+    }
+
+    bool isInvalidArgument = dynamic_cast<const std::invalid_argument*>(&exception) != nullptr || dynamic_cast<const std::length_error*>(&exception) != nullptr;
+
+    jclass exceptionClass = env->FindClass(isInvalidArgument ? "java/lang/IllegalArgumentException" : "java/lang/IllegalStateException");
+    env->ThrowNew(exceptionClass, exception.what());
+    env->DeleteLocalRef(exceptionClass);
+}
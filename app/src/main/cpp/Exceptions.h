@@ -0,0 +1,28 @@
+#ifndef EXCEPTIONS_H
+#define EXCEPTIONS_H
+
+#include <exception>
+#include <jni.h>
+
+/**
+ * Class that represents functions to hand C++ exceptions over to Kotlin at the JNI boundary.
+ *
+ * A C++ exception that leaves a JNI function calls `std::terminate` and kills the app, so every JNI function catches them and throws a Kotlin/Java exception instead.
+ */
+class Exceptions {
+public:
+    /**
+     * Function to throw a Kotlin/Java exception for a C++ exception. Does nothing if a Kotlin/Java exception is already pending (e.g. thrown by a listener).
+     *
+     * Invalid arguments (e.g. undecodable cover texts) and length errors (e.g. a context that doesn't fit the context window) become an `IllegalArgumentException`,
+     * everything else (e.g. llama.cpp failing to decode a batch) becomes an `IllegalStateException`.
+     *
+     * The JNI function has to return right after this call, as the Kotlin/Java exception is only thrown once it does.
+     *
+     * @param env The JNI environment.
+     * @param exception The C++ exception.
+     */
+    static void throwInJava(JNIEnv* env, const std::exception& exception);
+};
+
+#endif
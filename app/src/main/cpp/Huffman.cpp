@@ -1,200 +1,123 @@
-#include "Huffman.h"
+#include <algorithm>
+#include <memory>
+#include <jni.h>
+#include "BestOfEncoder.h"
+#include "BitStream.h"
+#include "CoverTextListener.h"
+#include "Exceptions.h"
+#include "Profiler.h"
 #include "common.h"
-#include "HuffmanCoding.h"
-#include "HuffmanNode.h"
 #include "Format.h"
-#include "LlamaCpp.h"
-#include "Statistics.h"
-
-extern "C" JNIEXPORT jbyteArray JNICALL Java_org_vonderheidt_hips_utils_Huffman_encode(JNIEnv* env, jobject /* thiz */, jbyteArray jContext, jbyteArray jCipherBits, jint jBitsPerToken, jlong jCtx) {
-    // TODO Abstract state management away in LlamaCpp.{h,cpp}
-    auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
-    const llama_model* model = llama_get_model(cppCtx);
-
-    // Tokenize context
-    llama_tokens contextTokens = LlamaCpp::tokenize(env, jContext, cppCtx);
-
-    // Convert cipher bits to bit vector
-    std::vector<bool> cppCipherBits = Format::asBitVector(env, jCipherBits);
-
-    // Initialize vector to store cover text token
-    llama_tokens coverTextTokens;
-
-    // Initialize variables and flags for loop
-    int i = 0;
-    bool isLastSentenceFinished = false;
-
-    bool isFirstRun = true;             // llama.cpp batch needs to store context tokens in first run, but only last sampled token in subsequent runs
-    llama_token sampledToken = -1;      // Will always be overwritten with last cover text token
-
-    // Sample tokens until all bits of secret message are encoded and last sentence is finished
-    while (i < cppCipherBits.size() || !isLastSentenceFinished) {
-        // Call llama.cpp to calculate the logit matrix similar to https://github.com/ggml-org/llama.cpp/blob/master/examples/simple/simple.cpp:
-        // Needs only next tokens to be processed to store in a batch, i.e. contextTokens in first run and last sampled token in subsequent runs, rest is managed internally in ctx
-        // Only last row of logit matrix is needed as it contains logits corresponding to last token of the prompt
-        float* logits = isFirstRun ? LlamaCpp::getLogits(contextTokens, cppCtx) : LlamaCpp::getLogits(sampledToken, cppCtx);
-
-        // Normalize logits to probabilities
-        double* probabilities = Statistics::softmax(logits, model);
-
-        // Suppress special tokens to avoid early termination before all bits of secret message are encoded
-        LlamaCpp::suppressSpecialTokens(probabilities, model);
-
-        // Huffman sampling to encode bits of secret message into tokens
-        if (i < cppCipherBits.size()) {
-            // Get top 2^bitsPerToken probabilities for last token of prompt (= height of Huffman tree)
-            std::vector<std::pair<llama_token, double>> topProbabilities = Huffman::getTopProbabilities(probabilities, jBitsPerToken, model);
-
-            // Construct Huffman tree from top probabilities
-            HuffmanCoding huffmanCoding = HuffmanCoding();
-            huffmanCoding.buildHuffmanTree(topProbabilities);
-            huffmanCoding.mergeHuffmanNodes();
-            HuffmanNode* root = huffmanCoding.generateHuffmanCodes();
-
-            // Traverse Huffman tree based on bits of secret message to sample next token, therefore encoding information in it
-            HuffmanNode* currentNode = root;
-
-            // First nodes won't have a token as they were created during the merge step
-            while (currentNode->token == -1) {
-                // First condition is needed in case (length of cipher bits) % (bits per token) != 0
-                // In last loop of outer while, inner while can cause i to exceed cppCipherBits.size()
-                // Second condition is only checked if first condition is false, so std::out_of_range can't happen
-                if (i >= cppCipherBits.size() || cppCipherBits[i] == 0) {
-                    // Assuming left and right child nodes to be not null is safe as Huffman tree isn't traversed further down than bitsPerToken levels
-                    currentNode = currentNode->left;
-                }
-                else {
-                    currentNode = currentNode->right;
-                }
-
-                // Every time a turn is made when traversing the Huffman tree, another bit is encoded
-                i++;
-            }
-
-            // Token containing the right bitsPerToken bits of information in its path is now found
-            sampledToken = currentNode->token;
-
-            // Update flag
-            isFirstRun = false;
-
-            // Destructor for huffmanCoding is called implicitly as it goes out of scope here
-        }
-        // Greedy sampling to pick most likely token until last sentence is finished
-        else {
-            // Get most likely token by sampling top 2^0 = 1 tokens
-            sampledToken = Huffman::getTopProbabilities(probabilities, 0, model).begin()->first;
+#include "HuffmanCoder.h"
+#include "LlamaCppJni.h"
+#include "MultiSequenceDecoder.h"
+#include "StegoEngine.h"
 
-            // Update flag
-            isLastSentenceFinished = LlamaCpp::isEndOfSentence(sampledToken, cppCtx);
-        }
+extern "C" JNIEXPORT jbyteArray JNICALL Java_org_vonderheidt_hips_utils_Huffman_encode(JNIEnv* env, jobject /* thiz */, jbyteArray jContext, jbyteArray jCipherBits, jint jMinBitsPerToken, jint jMaxBitsPerToken, jint jNumberOfCandidates, jlong jCtx, jobject jListener) {
+    try {
+        auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+        StegoEngine& engine = StegoEngine::get(cppCtx);
 
-        // Append last sampled token to cover text tokens
-        coverTextTokens.push_back(sampledToken);
+        // Measure the stages of this call if profiling is enabled, see LlamaCpp.getStats
+        Profiler::Operation operation("Huffman.encode", cppCtx);
 
-        // Free allocated memory
-        delete[] probabilities;
-    }
+        // Tokenize context
+        llama_tokens contextTokens = LlamaCppJni::tokenize(env, jContext, cppCtx);
 
-    // Detokenize cover text tokens into cover text to return it
-    jbyteArray coverText = LlamaCpp::detokenize(env, coverTextTokens, cppCtx);
+        // Convert cipher bits to bit stream
+        BitStream cppCipherBits = Format::asBitStream(env, jCipherBits);
 
-    return coverText;
-}
+        // Stream the cover text to Kotlin while it is being generated, if a listener was passed
+        std::unique_ptr<CoverTextListener> listener = jListener != nullptr ? std::make_unique<CoverTextListener>(env, jListener, cppCtx) : nullptr;
 
-// TODO Downward concat of split cover text
-//  Parameter isResumed in decode function is to differentiate first from subsequent calls of decode
-extern "C" JNIEXPORT jbyteArray JNICALL Java_org_vonderheidt_hips_utils_Huffman_decode(JNIEnv* env, jobject /* thiz */, jbyteArray jContext, jbyteArray jCoverText, jint jBitsPerToken, jlong jCtx, jint jNumberOfCipherBits, jboolean jIsResumed) {
-    // TODO Abstract state management away in LlamaCpp.{h,cpp}
-    auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
-    const llama_model* model = llama_get_model(cppCtx);
+        // Encode all bits of secret message, then finish last sentence, for every candidate (falls back to a single encode for one candidate)
+        BestOfEncoder encoder(engine);
 
-    // Tokenize context and cover text
-    llama_tokens contextTokens = LlamaCpp::tokenize(env, jContext, cppCtx);
-    llama_tokens coverTextTokens = LlamaCpp::tokenize(env, jCoverText, cppCtx);
+        llama_tokens coverTextTokens = encoder.encode(contextTokens, cppCipherBits, [&]() { return std::make_unique<HuffmanCoder>(jMinBitsPerToken, jMaxBitsPerToken); }, jNumberOfCandidates, listener.get());
 
-    // Initialize vector to store cipher bits
-    std::vector<bool> cppCipherBits;
+        // Cancelled encoding returns null, Kotlin turns it into a CancellationException (or rethrows the exception of the listener)
+        if (listener != nullptr && listener->wasCancelled()) {
+            return nullptr;
+        }
 
-    // Initialize variables and flags for loop
-    int i = 0;
+        // Detokenize cover text tokens into cover text to return it
+        jbyteArray coverText = LlamaCppJni::detokenize(env, coverTextTokens, cppCtx, true);
 
-    bool isFirstRun = !jIsResumed;
-    llama_token coverTextToken = -1;
+        return coverText;
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
 
-    // Decode every cover text token into bitsPerToken bits
-    while (i < coverTextTokens.size()) {
-        // Calculate the logit matrix again initially from context tokens, then from last cover text token, and get last row
-        float* logits = isFirstRun ? LlamaCpp::getLogits(contextTokens, cppCtx) : LlamaCpp::getLogits(coverTextToken, cppCtx);
+        return nullptr;
+    }
+}
 
-        // Normalize logits to probabilities
-        double* probabilities = Statistics::softmax(logits, model);
+// TODO Downward concat of split cover text
+//  Parameter isResumed in decode function is to differentiate first from subsequent calls of decode
+extern "C" JNIEXPORT jbyteArray JNICALL Java_org_vonderheidt_hips_utils_Huffman_decode(JNIEnv* env, jobject /* thiz */, jbyteArray jContext, jbyteArray jCoverText, jint jMinBitsPerToken, jint jMaxBitsPerToken, jlong jCtx, jint jNumberOfCipherBits, jboolean jIsResumed) {
+    try {
+        auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+        StegoEngine& engine = StegoEngine::get(cppCtx);
 
-        // Suppress special tokens
-        LlamaCpp::suppressSpecialTokens(probabilities, model);
+        // Measure the stages of this call if profiling is enabled, see LlamaCpp.getStats
+        Profiler::Operation operation("Huffman.decode", cppCtx);
 
-        // Get top 2^bitsPerToken probabilities
-        std::vector<std::pair<llama_token, double>> topProbabilities = Huffman::getTopProbabilities(probabilities, jBitsPerToken, model);
+        // Tokenize context and cover text
+        llama_tokens contextTokens = LlamaCppJni::tokenize(env, jContext, cppCtx);
+        llama_tokens coverTextTokens = LlamaCppJni::tokenize(env, jCoverText, cppCtx, true);
 
-        // Construct Huffman tree
-        HuffmanCoding huffmanCoding = HuffmanCoding();
-        huffmanCoding.buildHuffmanTree(topProbabilities);
-        huffmanCoding.mergeHuffmanNodes();
-        huffmanCoding.generateHuffmanCodes();        // Return value (root) is not needed here as Huffman tree is not traversed manually
+        // Decode every cover text token into the bits of its Huffman code
+        HuffmanCoder coder(jMinBitsPerToken, jMaxBitsPerToken);
 
-        // Querying Huffman tree for the path to the current cover text token decodes the encoded information
-        cppCipherBits.insert(
-            cppCipherBits.end(),
-            huffmanCoding.huffmanCodes[coverTextTokens[i]].begin(),
-            huffmanCoding.huffmanCodes[coverTextTokens[i]].end()
-        );
+        BitStream cppCipherBits = engine.decode(contextTokens, coverTextTokens, coder, jNumberOfCipherBits, jIsResumed);
 
-        // Update loop variables and flags
-        coverTextToken = coverTextTokens[i];
-        isFirstRun = false;
+        // Create Java ByteArray from bit stream to return cipher bits
+        jbyteArray jCipherBits = Format::asByteArray(env, cppCipherBits);
 
-        i++;
+        return jCipherBits;
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
 
-        // Destructor for huffmanCoding is called implicitly as it goes out of scope here
+        return nullptr;
+    }
+}
 
-        // Free allocated memory
-        delete[] probabilities;
+extern "C" JNIEXPORT jobjectArray JNICALL Java_org_vonderheidt_hips_utils_Huffman_decodeAll(JNIEnv* env, jobject /* thiz */, jobjectArray jContexts, jobjectArray jCoverTexts, jint jMinBitsPerToken, jint jMaxBitsPerToken, jlong jCtx) {
+    try {
+        auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+        StegoEngine& engine = StegoEngine::get(cppCtx);
 
-        // End decoding early if we are only searching for the start signal
-        if (jNumberOfCipherBits > 0 && cppCipherBits.size() >= jNumberOfCipherBits) {
-            // Discard any incomplete byte at the end because decryption works on byte arrays
-            cppCipherBits.resize(jNumberOfCipherBits);
-            break;
-        }
-    }
+        // Measure the stages of this call if profiling is enabled, see LlamaCpp.getStats
+        Profiler::Operation operation("Huffman.decodeAll", cppCtx);
 
-    // Create Java ByteArray from bit vector to return cipher bits
-    jbyteArray jCipherBits = Format::asByteArray(env, cppCipherBits);
+        // Tokenize contexts and cover texts, pairing them up by index
+        std::vector<llama_tokens> contextTokens = LlamaCppJni::tokenizeAll(env, jContexts, cppCtx);
+        std::vector<llama_tokens> coverTextTokens = LlamaCppJni::tokenizeAll(env, jCoverTexts, cppCtx, true);
 
-    return jCipherBits;
-}
+        std::vector<MultiSequenceDecoder::Job> jobs(std::min(contextTokens.size(), coverTextTokens.size()));
 
-std::vector<std::pair<llama_token, double>> Huffman::getTopProbabilities(double* probabilities, jint jBitsPerToken, const llama_model* model) {
-    // Vector of token-probability pairs
-    // Use vector because unlike Kotlin, C++ sorts maps only by keys and not by values
-    std::vector<std::pair<llama_token, double>> topProbabilities;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            jobs[i].contextTokens = std::move(contextTokens[i]);
+            jobs[i].coverTextTokens = std::move(coverTextTokens[i]);
+        }
 
-    // Fill vector with pairs constructed from probabilities array, effectively maps token IDs to their probabilities to not lose them when sorting
-    // Reserve memory ahead of time and construct pairs in place with emplace_back(), better performance than just using push_back(std::pair<>()) in loop
-    topProbabilities.reserve(LlamaCpp::getVocabSize(model));
+        // Decode all cover texts in shared batches, every one with its own coder
+        MultiSequenceDecoder decoder(engine);
 
-    for (int32_t token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        topProbabilities.emplace_back(token, probabilities[token]);
-    }
+        std::vector<std::optional<BitStream>> cppCipherBits = decoder.decode(jobs, [&]() { return std::make_unique<HuffmanCoder>(jMinBitsPerToken, jMaxBitsPerToken); });
 
-    // Sort tokens descending based on probabilities
-    std::sort(
-        topProbabilities.begin(),
-        topProbabilities.end(),
-        [](const auto& pair1, const auto& pair2) { return pair1.second > pair2.second; }
-    );
+        // Create Java array of ByteArrays, null for cover texts that couldn't be decoded
+        jobjectArray jCipherBits = Format::asByteArrays(env, cppCipherBits);
 
-    // Only keep tokens with top 2^bitsPerToken probabilities
-    topProbabilities.resize(1 << jBitsPerToken);
+        return jCipherBits;
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
 
-    return topProbabilities;
+        return nullptr;
+    }
 }
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include "HuffmanCoder.h"
+#include "Profiler.h"
+#include "Selection.h"
+
+void HuffmanCoder::selectTopProbabilities(StegoWorkspace& workspace) const {
+    std::vector<double>& probabilities = workspace.probabilities;
+    std::vector<std::pair<llama_token, double>>& topProbabilities = workspace.topProbabilities;
+
+    // Get top 2^maxBitsPerToken probabilities for last token of prompt (= height of Huffman tree)
+    // Only these are selected instead of sorting the whole vocabulary
+    Selection::getTopProbabilities(probabilities.data(), static_cast<int32_t>(probabilities.size()), 1 << maxBitsPerToken, topProbabilities);
+
+    if (minBitsPerToken == maxBitsPerToken) {
+        return;
+    }
+
+    // Adaptive mode: Add bits until the top 2^bitsPerToken tokens cover enough probability mass
+    // Top probabilities are sorted, so they are summed up in the same order by encoder and decoder
+    int bitsPerToken = minBitsPerToken;
+    double probabilityMass = 0;
+    size_t numberOfSummedTokens = 0;
+
+    while (bitsPerToken < maxBitsPerToken) {
+        size_t numberOfTokens = std::min(static_cast<size_t>(1) << bitsPerToken, topProbabilities.size());
+
+        for (; numberOfSummedTokens < numberOfTokens; numberOfSummedTokens++) {
+            probabilityMass += topProbabilities[numberOfSummedTokens].second;
+        }
+
+        if (probabilityMass >= ADAPTIVE_PROBABILITY_MASS) {
+            break;
+        }
+
+        bitsPerToken++;
+    }
+
+    // Top 2^bitsPerToken of the sorted top probabilities are the top 2^bitsPerToken of the whole vocabulary
+    topProbabilities.resize(std::min(static_cast<size_t>(1) << bitsPerToken, topProbabilities.size()));
+}
+
+llama_token HuffmanCoder::encodeToken(StegoWorkspace& workspace, BitReader& cipherBitReader) {
+    Profiler::Scope scope(Profiler::Stage::Coding);
+
+    selectTopProbabilities(workspace);
+
+    // Construct Huffman tree from top probabilities, reusing the pooled nodes of the workspace
+    // Traversal needs the codes of all tokens
+    HuffmanCoding& huffmanCoding = workspace.huffmanCoding;
+
+    huffmanCoding.buildHuffmanTree(workspace.topProbabilities);
+    huffmanCoding.mergeHuffmanNodes();
+    huffmanCoding.generateHuffmanCodes();
+
+    // Traverse Huffman tree based on bits of secret message to sample next token, therefore encoding information in it
+    // Every time a turn is made when traversing the Huffman tree, another bit is encoded, so the reader consumes as many bits as the code is long
+    // Token containing the right bits of information in its path is then found
+    int rank = huffmanCoding.traverseHuffmanTree(cipherBitReader);
+
+    return huffmanCoding.getToken(rank);
+}
+
+bool HuffmanCoder::decodeToken(StegoWorkspace& workspace, llama_token coverTextToken, bool /* isLastToken */, BitStream& cipherBits) {
+    Profiler::Scope scope(Profiler::Stage::Coding);
+
+    selectTopProbabilities(workspace);
+
+    // Top probabilities are sorted, so the position of the cover text token is its rank
+    // Encoding only picks tokens of the Huffman tree (the greedy tail picks the most likely one), so any other token means that the cover text can't be decoded
+    // Fails before the tree is built, instead of silently decoding nothing for it like Stegasuras does
+    const std::vector<std::pair<llama_token, double>>& topProbabilities = workspace.topProbabilities;
+
+    auto iterator = std::find_if(topProbabilities.begin(), topProbabilities.end(), [coverTextToken](const std::pair<llama_token, double>& pair) { return pair.first == coverTextToken; });
+
+    if (iterator == topProbabilities.end()) {
+        return false;
+    }
+
+    auto rank = static_cast<int>(iterator - topProbabilities.begin());
+
+    // Code lengths depend on all top probabilities, but only the code of the cover text token is needed
+    HuffmanCoding& huffmanCoding = workspace.huffmanCoding;
+
+    huffmanCoding.buildHuffmanTree(topProbabilities);
+    huffmanCoding.mergeHuffmanNodes();
+
+    HuffmanCode huffmanCode = huffmanCoding.getHuffmanCode(rank);
+
+    cipherBits.write(huffmanCode.code, huffmanCode.length);
+
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef HUFFMAN_CODER_H
+#define HUFFMAN_CODER_H
+
+#include <algorithm>
+#include "llama.h"
+#include "Coder.h"
+
+/**
+ * Class that represents steganography using Huffman encoding.
+ *
+ * Corresponds to Stegasuras methods `encode_huffman` and `decode_huffman` in `huffman.py`.
+ */
+class HuffmanCoder : public Coder {
+private:
+    /**
+     * Probability mass the Huffman tree needs to cover before adaptive mode stops adding bits.
+     * Comparable to the nucleus of top-p sampling: peaked distributions reach it with few tokens, flat ones only with many.
+     */
+    static constexpr double ADAPTIVE_PROBABILITY_MASS = 0.9;
+
+    /**
+     * Minimum and maximum number of bits to encode/decode per cover text token (= height of Huffman tree). Parameter `bits_per_word` from Stegasuras was renamed to `bitsPerToken`.
+     * Equal for a fixed number of bits, otherwise the number is chosen per token in between (adaptive mode).
+     */
+    int minBitsPerToken;
+    int maxBitsPerToken;
+
+    /**
+     * Function to select the top probabilities for the last token of the prompt (= leaves of the Huffman tree) and store them in the workspace.
+     *
+     * In adaptive mode, selects the top 2^maxBitsPerToken probabilities and keeps the smallest top 2^bitsPerToken of them that cover `ADAPTIVE_PROBABILITY_MASS`,
+     * with at least 2^minBitsPerToken. Only depends on the probabilities and sums them up in a fixed order, so encoder and decoder always choose the same number of bits.
+     *
+     * @param workspace Workspace of the engine, `probabilities` is filled for the current step.
+     */
+    void selectTopProbabilities(StegoWorkspace& workspace) const;
+
+public:
+    /**
+     * Constructor for a Huffman coder with a fixed number of bits per token.
+     *
+     * @param bitsPerToken Number of bits to encode/decode per cover text token (= height of Huffman tree). Determined by Settings object.
+     */
+    explicit HuffmanCoder(int bitsPerToken) : HuffmanCoder(bitsPerToken, bitsPerToken) {}
+
+    /**
+     * Constructor for a Huffman coder that chooses the number of bits per token based on the probabilities (adaptive mode).
+     *
+     * @param minBitsPerToken Minimum number of bits to encode/decode per cover text token. Determined by Settings object.
+     * @param maxBitsPerToken Maximum number of bits to encode/decode per cover text token, at most 5. Determined by Settings object.
+     */
+    HuffmanCoder(int minBitsPerToken, int maxBitsPerToken) : minBitsPerToken(minBitsPerToken), maxBitsPerToken(std::max(minBitsPerToken, maxBitsPerToken)) {}
+
+    llama_token encodeToken(StegoWorkspace& workspace, BitReader& cipherBitReader) override;
+
+    /**
+     * Function to recover the bits of the secret message encoded in a cover text token.
+     *
+     * Looks up the rank of the token among the top probabilities first, so that tokens outside of the Huffman tree fail before any tree is built.
+     * Otherwise only the code lengths are determined and the code of this token is derived from them, the codes of the other tokens aren't generated.
+     *
+     * @param workspace Workspace of the engine, `probabilities` is filled for the current step.
+     * @param coverTextToken ID of the cover text token.
+     * @param isLastToken Boolean that is true if this is the last cover text token, false otherwise.
+     * @param cipherBits Bit stream to append the decoded bits to.
+     * @return Boolean that is true if the token is in the Huffman tree, false otherwise (e.g. foreign or edited cover text, or decoding with the wrong context).
+     */
+    bool decodeToken(StegoWorkspace& workspace, llama_token coverTextToken, bool isLastToken, BitStream& cipherBits) override;
+};
+
+#endif
@@ -1,98 +1,178 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 #include "HuffmanCoding.h"
 
-HuffmanCoding::HuffmanCoding() { }
+void HuffmanCoding::buildHuffmanTree(const std::vector<std::pair<llama_token, double>>& tokenProbabilities) {
+    if (tokenProbabilities.empty() || tokenProbabilities.size() > MAX_NUMBER_OF_LEAVES) {
+        throw std::invalid_argument("Huffman tree needs between 1 and " + std::to_string(MAX_NUMBER_OF_LEAVES) + " tokens");
+    }
 
-HuffmanCoding::~HuffmanCoding() {
-    // Run delete until Huffman tree is empty
-    while(!huffmanTree.empty()) {
-        // Poll top node from Huffman tree
-        HuffmanNode* huffmanNode = huffmanTree.top();
-        huffmanTree.pop();
+    numberOfLeaves = static_cast<int>(tokenProbabilities.size());
 
-        // Recursively delete left and right subtrees
-        deleteHuffmanNode(huffmanNode);
+    // Create a leaf for every entry, indexed by its rank
+    for (int rank = 0; rank < numberOfLeaves; rank++) {
+        tokens[rank] = tokenProbabilities[rank].first;
+        probabilities[rank] = tokenProbabilities[rank].second;
     }
 }
 
-void HuffmanCoding::deleteHuffmanNode(HuffmanNode *huffmanNode) {
-    // Recursion ends at bottom of Huffman tree
-    if (huffmanNode == nullptr) {
-        return;
+void HuffmanCoding::mergeHuffmanNodes() {
+    // Two-queue construction:
+    // Leaves are sorted descending, so the leaf queue is walked from the last rank upwards to poll the least likely leaf first
+    // Merged nodes are created with non-decreasing probabilities, so they form a second sorted queue in order of their indices
+    int nextLeaf = numberOfLeaves - 1;
+    int nextMergedNode = numberOfLeaves;
+    int numberOfNodes = numberOfLeaves;
+
+    // Poll the least likely node from either queue, preferring leaves in case of ties
+    auto pollHuffmanNode = [&]() {
+        if (nextLeaf >= 0 && (nextMergedNode == numberOfNodes || probabilities[nextLeaf] <= probabilities[nextMergedNode])) {
+            return nextLeaf--;
+        }
+
+        return nextMergedNode++;
+    };
+
+    // Run merge until only 1 node is left
+    for (int merge = 0; merge < numberOfLeaves - 1; merge++) {
+        int left = pollHuffmanNode();
+        int right = pollHuffmanNode();
+
+        // Create a new parent node for them, combining their probabilities, and insert it into the queue of merged nodes
+        probabilities[numberOfNodes] = probabilities[left] + probabilities[right];
+        parents[left] = numberOfNodes;
+        parents[right] = numberOfNodes;
+
+        numberOfNodes++;
     }
 
-    // Recursively traverse left and right subtrees to delete child nodes first
-    deleteHuffmanNode(huffmanNode->left);
-    deleteHuffmanNode(huffmanNode->right);
+    // Root is the last node created and has depth 0
+    // Parents always have larger indices than their children, so walking the nodes backwards visits every parent before its children
+    int root = numberOfNodes - 1;
+    depths[root] = 0;
 
-    // Now it is safe to delete the given node
-    delete huffmanNode;
+    for (int node = root - 1; node >= 0; node--) {
+        depths[node] = depths[parents[node]] + 1;
+    }
 }
 
-void HuffmanCoding::buildHuffmanTree(const std::vector<std::pair<llama_token, double>>& tokenProbabilities) {
-    // Loop through the mapping
-    for (const auto& [token, probability] : tokenProbabilities) {
-        // Create a new node for every entry
-        // Use "new" to allocate memory on heap instead of stack, so nodes aren't deleted when function exits => Now we need a destructor
-        auto huffmanNode = new HuffmanNode(token, probability, nullptr, nullptr);
-
-        // Insert it into the Huffman tree
-        huffmanTree.push(huffmanNode);
+void HuffmanCoding::generateHuffmanCodes() {
+    // Count how many leaves have each code length
+    numberOfCodesPerLength.fill(0);
+    maxCodeLength = 0;
+
+    for (int rank = 0; rank < numberOfLeaves; rank++) {
+        numberOfCodesPerLength[depths[rank]]++;
+        maxCodeLength = std::max(maxCodeLength, static_cast<int>(depths[rank]));
     }
-}
 
-void HuffmanCoding::mergeHuffmanNodes() {
-    // Run merge until only 1 node is left
-    while (huffmanTree.size() > 1) {
-        // Poll two nodes from the Huffman tree
-        HuffmanNode* left = huffmanTree.top();
-        huffmanTree.pop();
+    // Canonical codes: Codes of the same length are consecutive numbers in order of rank, shorter codes are numerically smaller prefixes of longer ones
+    // Same construction as in DEFLATE (RFC 1951, section 3.2.2)
+    std::array<uint32_t, MAX_NUMBER_OF_LEAVES> nextCode {};
+    std::array<int, MAX_NUMBER_OF_LEAVES> nextCanonicalIndex {};
+
+    uint32_t code = 0;
+    int canonicalIndex = numberOfCodesPerLength[0];
+
+    for (int length = 1; length <= maxCodeLength; length++) {
+        code = (code + (length > 1 ? numberOfCodesPerLength[length - 1] : 0)) << 1;
+        nextCode[length] = code;
+
+        nextCanonicalIndex[length] = canonicalIndex;
+        canonicalIndex += numberOfCodesPerLength[length];
+    }
 
-        HuffmanNode* right = huffmanTree.top();
-        huffmanTree.pop();
+    for (int rank = 0; rank < numberOfLeaves; rank++) {
+        uint8_t length = depths[rank];
 
-        // Create a new parent node for them, combining their probabilities
-        // Use "new" to allocate memory on heap instead of stack, so nodes aren't deleted when function exits => Now we need a destructor
-        auto mergedHuffmanNode = new HuffmanNode(-1, left->probability + right->probability, left, right);
+        // Single leaf is the root itself and has an empty code
+        if (length == 0) {
+            huffmanCodes[rank] = {0, 0};
+            canonicalRanks[0] = rank;
+            continue;
+        }
 
-        // Insert the new node into the Huffman tree
-        huffmanTree.push(mergedHuffmanNode);
+        huffmanCodes[rank] = {nextCode[length]++, length};
+        canonicalRanks[nextCanonicalIndex[length]++] = rank;
     }
 }
 
-HuffmanNode* HuffmanCoding::generateHuffmanCodes() {
-    // Poll the Huffman tree once to get the root node
-    HuffmanNode* root = huffmanTree.top();
-    huffmanTree.pop();
+HuffmanCode HuffmanCoding::getHuffmanCode(int rank) const {
+    uint8_t length = depths[rank];
+
+    // Single leaf is the root itself and has an empty code
+    if (length == 0) {
+        return {0, 0};
+    }
+
+    // Count how many leaves have each code length, and how many leaves with the same code length are ranked before this one
+    std::array<int, MAX_NUMBER_OF_LEAVES> numberOfCodes {};
+    uint32_t numberOfPrecedingCodes = 0;
 
-    // Initialize Huffman codes as an empty bit vector
-    std::vector<bool> currentHuffmanCode;
+    for (int otherRank = 0; otherRank < numberOfLeaves; otherRank++) {
+        numberOfCodes[depths[otherRank]]++;
 
-    // Call helper function to traverse Huffman tree and store Huffman code for every node
-    generateHuffmanCodesRecursively(root, currentHuffmanCode);
+        if (otherRank < rank && depths[otherRank] == length) {
+            numberOfPrecedingCodes++;
+        }
+    }
+
+    // First code of the length, same construction as in generateHuffmanCodes
+    uint32_t code = 0;
+
+    for (int otherLength = 1; otherLength <= length; otherLength++) {
+        code = (code + (otherLength > 1 ? numberOfCodes[otherLength - 1] : 0)) << 1;
+    }
 
-    // Return the root node polled above
-    return root;
+    // Codes of the same length are consecutive numbers in order of rank
+    return {code + numberOfPrecedingCodes, length};
 }
 
-void HuffmanCoding::generateHuffmanCodesRecursively(HuffmanNode* currentHuffmanNode, std::vector<bool> currentHuffmanCode) {
-    // If the current node doesn't exist, there is nothing to do (i.e. recursion ends at the bottom of the Huffman tree)
-    if (currentHuffmanNode == nullptr) {
-        return;
+int HuffmanCoding::getRank(llama_token token) const {
+    // At most 32 leaves, so a linear search is faster than any lookup structure
+    for (int rank = 0; rank < numberOfLeaves; rank++) {
+        if (tokens[rank] == token) {
+            return rank;
+        }
     }
 
-    // If the current node exists and has an element (i.e. is not one of the nodes inserted during merging), set its Huffman code to the current Huffman code
-    if (currentHuffmanNode->token != -1) {
-        huffmanCodes[currentHuffmanNode->token] = currentHuffmanCode;
+    return -1;
+}
 
-        return;
+int HuffmanCoding::traverseHuffmanTree(BitReader& bitReader) const {
+    // Single leaf is the root itself, no bits need to be read
+    if (maxCodeLength == 0) {
+        return canonicalRanks[0];
     }
 
-    // Traverse left and right subtrees of the current node, appending 0 or 1 respectively to set Huffman codes there
-    currentHuffmanCode.push_back(false); // Append 0
-    generateHuffmanCodesRecursively(currentHuffmanNode->left, currentHuffmanCode);
-    currentHuffmanCode.pop_back();
+    // Read the longest possible code at once, bits after the end are read as 0
+    // Needed in case (length of cipher bits) % (bits per token) != 0
+    uint64_t bits = bitReader.peek(maxCodeLength);
+
+    // Take one bit per level and check if the code taken so far is one of the codes of that length
+    // Every time a turn is made when traversing the Huffman tree, another bit is consumed
+    // Corresponds to the canonical decoder in zlib's puff.c
+    uint32_t code = 0;
+    uint32_t firstCode = 0;
+    int canonicalIndex = 0;
+
+    for (int length = 1; length <= maxCodeLength; length++) {
+        code |= (bits >> (maxCodeLength - length)) & 1;
+
+        uint32_t count = numberOfCodesPerLength[length];
+
+        if (code - firstCode < count) {
+            bitReader.consume(length);
+
+            return canonicalRanks[canonicalIndex + (code - firstCode)];
+        }
+
+        canonicalIndex += static_cast<int>(count);
+        firstCode = (firstCode + count) << 1;
+        code <<= 1;
+    }
 
-    currentHuffmanCode.push_back(true); // Append 1
-    generateHuffmanCodesRecursively(currentHuffmanNode->right, currentHuffmanCode);
-    currentHuffmanCode.pop_back();
+    // Unreachable for a complete Huffman tree, every bit sequence ends at a leaf after at most maxCodeLength bits
+    throw std::logic_error("Huffman tree is incomplete");
 }
@@ -1,92 +1,142 @@
 #ifndef HUFFMAN_CODING_H
 #define HUFFMAN_CODING_H
 
-#include <queue>
-#include <unordered_map>
+#include <array>
+#include <cstdint>
+#include <utility>
 #include <vector>
-#include "HuffmanNode.h"
+#include "llama.h"
+#include "BitStream.h"
 
 /**
- * Struct to define comparison logic for nodes in a Huffman tree based on their probabilities.
+ * Struct that represents a canonical Huffman code, packed as the code bits (right-aligned, MSB first) and their number.
  */
-struct Compare {
-    /**
-     * Operator to compare nodes in a Huffman tree with each other based on their probabilities.
-     *
-     * Corresponds to Stegasuras methods `__lt__` and `__eq__` of class `HeapNode` in `huffman.py`.
-     *
-     * @param left Pointer to a Huffman node.
-     * @param right Pointer to another Huffman node.
-     * @return Boolean that is true if the probability of `left` is less than the probability of `right`, false otherwise.
-     */
-    bool operator()(HuffmanNode* left, HuffmanNode* right) {
-        return left->probability < right->probability;
-    }
+struct HuffmanCode {
+    uint32_t code = 0;
+    uint8_t length = 0;
 };
 
 /**
  * Class that represents the Huffman coding of a set of tokens based on their probabilities.
  *
- * Corresponds to Stegasuras class `HuffmanCoding` in `huffman.py`. Attribute `heap` was renamed to `huffmanTree`, `codes` to `huffmanCodes`.
+ * Corresponds to Stegasuras class `HuffmanCoding` in `huffman.py`. Attribute `heap` was replaced by a flat, index-based node array, attribute `codes` was renamed to `huffmanCodes`.
+ *
+ * Unlike Stegasuras, the Huffman tree is built in linear time with two queues, which is possible because the tokens are already sorted by their probabilities.
+ * All nodes live in fixed-size arrays that are reused for every token, so neither building the tree nor encoding/decoding allocates memory.
+ * Codes are canonical, i.e. they only depend on the code lengths and the ranks of the tokens, not on the shape of the tree.
  */
 class HuffmanCoding {
+public:
+    /**
+     * Maximum number of tokens (= leaves of the Huffman tree), i.e. bitsPerToken can be at most 5.
+     * With at most 32 leaves, no code can be longer than 31 bits, so every code fits into 32 bits.
+     */
+    static constexpr int MAX_NUMBER_OF_LEAVES = 32;
+
 private:
-    std::priority_queue<HuffmanNode*, std::vector<HuffmanNode*>, Compare> huffmanTree;
+    static constexpr int MAX_NUMBER_OF_NODES = 2 * MAX_NUMBER_OF_LEAVES - 1;
+
+    int numberOfLeaves = 0;
 
     /**
-     * Helper function for generateHuffmanCodes. Traverses the Huffman tree recursively and stores the Huffman code for every node.
-     *
-     * Corresponds to Stegasuras method `make_codes_helper` of class `HuffmanCoding` in `huffman.py`. Parameter `root` was renamed to `currentHuffmanNode`, `current_code` to `currentHuffmanCode`.
-     *
-     * @param currentHuffmanNode Initially, root node of the Huffman tree. In recursive calls, left and right child nodes of itself.
-     * @param currentHuffmanCode Huffman code of the current Huffman node.
+     * Token IDs of the leaves, indexed by rank (0 = most likely token).
      */
-    void generateHuffmanCodesRecursively(HuffmanNode* currentHuffmanNode, std::vector<bool> currentHuffmanCode);
+    std::array<llama_token, MAX_NUMBER_OF_LEAVES> tokens {};
 
     /**
-     * Helper function for the destructor. Traverses the Huffman tree recursively to delete left and right child nodes first before deleting the given Huffman node.
-     *
-     * @param huffmanNode Pointer to a Huffman node to be deleted.
+     * Probabilities of all nodes. Leaves are indexed by rank, merged nodes follow in the order they were created, so the root is always the last node.
      */
-    void deleteHuffmanNode(HuffmanNode* huffmanNode);
+    std::array<double, MAX_NUMBER_OF_NODES> probabilities {};
 
-public:
-    std::unordered_map<llama_token, std::vector<bool>> huffmanCodes;
+    /**
+     * Index of the parent node of every node. A parent is always created after its children, so it always has a larger index.
+     */
+    std::array<int, MAX_NUMBER_OF_NODES> parents {};
 
     /**
-     * Constructor for a Huffman coding. Does not take any parameters as attributes `huffmanTree` and `huffmanCodes` are initialized as empty by default.
+     * Depth of every node in the Huffman tree, which is the code length for leaves.
      */
-    HuffmanCoding();
+    std::array<uint8_t, MAX_NUMBER_OF_NODES> depths {};
 
     /**
-     * Destructor for a Huffman coding.
+     * Number of leaves with every possible code length.
      */
-    ~HuffmanCoding();
+    std::array<int, MAX_NUMBER_OF_LEAVES> numberOfCodesPerLength {};
+
+    /**
+     * Ranks of the leaves, sorted by code length first and by rank second (= order of canonical codes).
+     */
+    std::array<int, MAX_NUMBER_OF_LEAVES> canonicalRanks {};
+
+    int maxCodeLength = 0;
+
+public:
+    /**
+     * Canonical Huffman codes of the leaves, indexed by rank.
+     */
+    std::array<HuffmanCode, MAX_NUMBER_OF_LEAVES> huffmanCodes {};
 
     /**
      * Function to build the Huffman tree, given a mapping of tokens and their probabilities.
      *
      * Corresponds to Stegasuras method `make_heap` of class `HuffmanCoding` in `huffman.py`. Parameter `frequency` was renamed to `tokenProbabilities`.
      *
-     * @param tokenProbabilities Mapping of tokens and their probabilities.
+     * @param tokenProbabilities Mapping of tokens and their probabilities, sorted descending by probabilities (as returned by `Selection::getTopProbabilities`).
+     * @throws std::invalid_argument If the mapping is empty or contains more than `MAX_NUMBER_OF_LEAVES` tokens.
      */
     void buildHuffmanTree(const std::vector<std::pair<llama_token, double>>& tokenProbabilities);
 
     /**
-     * Function to merge all nodes in a Huffman tree.
+     * Function to merge all nodes in a Huffman tree. Determines the code length of every token.
      *
      * Corresponds to Stegasuras method `merge_nodes` of class `HuffmanCoding` in `huffman.py`.
      */
     void mergeHuffmanNodes();
 
     /**
-     * Function to generate Huffman codes on a given Huffman tree.
+     * Function to generate canonical Huffman codes on a given Huffman tree.
      *
      * Corresponds to Stegasuras method `make_codes` of class `HuffmanCoding` in `huffman.py`.
+     */
+    void generateHuffmanCodes();
+
+    /**
+     * Function to get the canonical Huffman code of a single leaf, without generating the codes of all leaves.
+     *
+     * Only needs the code lengths, i.e. can be called right after `mergeHuffmanNodes`. Returns the same code as `generateHuffmanCodes` stores for the leaf.
+     *
+     * @param rank Rank of the token (0 = most likely token).
+     * @return The canonical Huffman code of the token.
+     */
+    HuffmanCode getHuffmanCode(int rank) const;
+
+    /**
+     * Function to get the token ID of a leaf in the Huffman tree.
+     *
+     * @param rank Rank of the token (0 = most likely token).
+     * @return The token ID.
+     */
+    llama_token getToken(int rank) const {
+        return tokens[rank];
+    }
+
+    /**
+     * Function to get the rank of a token in the Huffman tree.
+     *
+     * @param token A token ID.
+     * @return Rank of the token, -1 if it isn't a leaf of the Huffman tree.
+     */
+    int getRank(llama_token token) const;
+
+    /**
+     * Function to traverse the Huffman tree based on the next bits of a bit stream.
+     *
+     * Walks the canonical code tables instead of a pointer-based tree. Bits after the end of the bit stream are read as 0.
      *
-     * @return Pointer to root node of the Huffman tree.
+     * @param bitReader Reader of a bit stream. Consumes as many bits as the code that was found is long.
+     * @return Rank of the token whose Huffman code was read.
      */
-    HuffmanNode* generateHuffmanCodes();
+    int traverseHuffmanTree(BitReader& bitReader) const;
 };
 
 #endif
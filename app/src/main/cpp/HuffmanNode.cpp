@@ -1,10 +0,0 @@
-#include "HuffmanNode.h"
-
-HuffmanNode::HuffmanNode(
-    llama_token token,
-    double probability,
-    HuffmanNode* left,
-    HuffmanNode* right
-)
-: token(token), probability(probability), left(left), right(right)
-{ }
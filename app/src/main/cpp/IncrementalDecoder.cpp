@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "IncrementalDecoder.h"
+#include "CodingPipeline.h"
+
+IncrementalDecoder::IncrementalDecoder(StegoEngine& engine, Coder& coder, const llama_tokens& contextTokens, size_t numberOfCipherBits, bool isResumed)
+    : engine(engine),
+      coder(coder),
+      numberOfCipherBits(numberOfCipherBits),
+      processedTokens(engine.getPromptTokens(contextTokens, isResumed)) {
+    coder.reset();
+}
+
+void IncrementalDecoder::feed(const llama_tokens& coverTextTokens, bool isLastFeed) {
+    if (isFinished) {
+        return;
+    }
+
+    pendingTokens.insert(pendingTokens.end(), coverTextTokens.begin(), coverTextTokens.end());
+
+    decodePendingTokens(isLastFeed);
+
+    if (isLastFeed) {
+        isFinished = true;
+    }
+}
+
+void IncrementalDecoder::decodePendingTokens(bool includesLastToken) {
+    // Last token stays pending until it is known whether it is the last one of the cover text
+    size_t numberOfTokens = includesLastToken ? pendingTokens.size() : (pendingTokens.empty() ? 0 : pendingTokens.size() - 1);
+
+    if (numberOfTokens == 0) {
+        return;
+    }
+
+    Session& session = engine.getSession();
+    const int32_t vocabSize = engine.vocabInfo.vocabSize;
+    const auto maxChunkSize = static_cast<size_t>(session.getBatchCapacity());
+
+    // Coding can only run ahead if decoding doesn't stop early, and only overlaps with decoding if there is more than one chunk
+    // First chunk is the single row of the prefill, so a pipeline only pays off for the worker thread if at least one full chunk follows it
+    // Short feeds (e.g. a few tokens from a streaming decoder) are decoded directly
+    if (numberOfCipherBits == 0 && numberOfTokens > 1 + CodingPipeline::calculateMaxNumberOfRows(engine) && CodingPipeline::isAvailable(engine.getContext())) {
+        decodePendingTokensPipelined(numberOfTokens, includesLastToken);
+
+        return;
+    }
+
+    // If decoding can stop early, start with small chunks and double them, so that few tokens after the stop are decoded in vain
+    size_t chunkSize = numberOfCipherBits > 0 ? std::min<size_t>(16, maxChunkSize) : maxChunkSize;
+
+    // Logits for the first pending token come from the last processed token
+    // Session reuses the cached tokens, so only that last token is decoded if nothing else used the context since the last feed
+    const float* logits = session.prefill(processedTokens);
+    size_t numberOfRows = 1;
+    size_t i = 0;
+
+    // Teacher forcing: Row j of the current chunk holds the logits for pending token i + j
+    // Every further chunk feeds the pending tokens before the ones it predicts
+    while (true) {
+        for (size_t row = 0; row < numberOfRows; row++, i++) {
+            engine.calculateProbabilities(logits + row * vocabSize, coder.getTemperature());
+
+            bool isLastToken = includesLastToken && i == pendingTokens.size() - 1;
+
+            if (!coder.decodeToken(engine.workspace, pendingTokens[i], isLastToken, cipherBits)) {
+                throw std::invalid_argument("Cover text cannot be decoded: token mismatch at position " + std::to_string(numberOfDecodedTokens + i));
+            }
+
+            processedTokens.push_back(pendingTokens[i]);
+
+            // Stop early if we are only searching for the start signal
+            if (numberOfCipherBits > 0 && cipherBits.size() >= numberOfCipherBits) {
+                // Discard any incomplete byte at the end because decryption works on byte arrays
+                cipherBits.resize(numberOfCipherBits);
+
+                numberOfDecodedTokens += i + 1;
+                pendingTokens.clear();
+                isFinished = true;
+
+                return;
+            }
+        }
+
+        if (i == numberOfTokens) {
+            break;
+        }
+
+        numberOfRows = std::min(chunkSize, numberOfTokens - i);
+        logits = session.appendAll(&pendingTokens[i - 1], static_cast<int32_t>(numberOfRows));
+
+        chunkSize = std::min(2 * chunkSize, maxChunkSize);
+    }
+
+    // Keep the token that is still pending
+    numberOfDecodedTokens += numberOfTokens;
+    pendingTokens.erase(pendingTokens.begin(), pendingTokens.begin() + static_cast<long>(numberOfTokens));
+}
+
+void IncrementalDecoder::decodePendingTokensPipelined(size_t numberOfTokens, bool includesLastToken) {
+    Session& session = engine.getSession();
+    const int32_t vocabSize = engine.vocabInfo.vocabSize;
+
+    size_t firstFailedPosition = numberOfTokens;
+
+    {
+        CodingPipeline pipeline(engine);
+
+        // Every chunk fills one slot, so the worker codes it while the next chunk is decoded
+        const size_t chunkSize = pipeline.getMaxNumberOfRows();
+
+        // Same teacher forcing as in decodePendingTokens, only handing the rows to the worker instead of coding them
+        const float* logits = session.prefill(processedTokens);
+        size_t numberOfRows = 1;
+        size_t i = 0;
+
+        while (true) {
+            for (size_t row = 0; row < numberOfRows; row++, i++) {
+                bool isLastToken = includesLastToken && i == pendingTokens.size() - 1;
+
+                pipeline.add(logits + row * vocabSize, {&coder, &cipherBits, pendingTokens[i], isLastToken, 0, i});
+            }
+
+            pipeline.flush();
+
+            // No need to decode further chunks once a token turned out to be undecodable
+            if (i == numberOfTokens || !pipeline.getFailures().empty()) {
+                break;
+            }
+
+            numberOfRows = std::min(chunkSize, numberOfTokens - i);
+            logits = session.appendAll(&pendingTokens[i - 1], static_cast<int32_t>(numberOfRows));
+        }
+
+        const std::vector<std::pair<size_t, size_t>>& failures = pipeline.drain();
+
+        if (!failures.empty()) {
+            firstFailedPosition = failures.front().second;
+        }
+    }
+
+    // Tokens before the undecodable one are processed, same as in decodePendingTokens
+    processedTokens.insert(processedTokens.end(), pendingTokens.begin(), pendingTokens.begin() + static_cast<long>(firstFailedPosition));
+
+    if (firstFailedPosition < numberOfTokens) {
+        throw std::invalid_argument("Cover text cannot be decoded: token mismatch at position " + std::to_string(numberOfDecodedTokens + firstFailedPosition));
+    }
+
+    numberOfDecodedTokens += numberOfTokens;
+    pendingTokens.erase(pendingTokens.begin(), pendingTokens.begin() + static_cast<long>(numberOfTokens));
+}
+
+BitStream IncrementalDecoder::pull(size_t maxNumberOfBits) {
+    size_t numberOfBits = std::min(maxNumberOfBits, getNumberOfAvailableBits());
+
+    BitStream bits;
+    bits.reserve(numberOfBits);
+    bits.append(cipherBits, numberOfPulledBits);
+    bits.resize(numberOfBits);
+
+    numberOfPulledBits += numberOfBits;
+
+    return bits;
+}
@@ -0,0 +1,124 @@
+#ifndef INCREMENTAL_DECODER_H
+#define INCREMENTAL_DECODER_H
+
+#include <cstddef>
+#include "llama.h"
+#include "common.h"
+#include "BitStream.h"
+#include "Coder.h"
+#include "StegoEngine.h"
+
+/**
+ * Class that represents a decoder of cover text tokens that are fed incrementally, e.g. one message of a split cover text at a time.
+ *
+ * Keeps the state of the coder and the tokens decoded so far between calls, so that the next tokens continue where the last ones ended without replaying them.
+ * Cipher bits become available as soon as the coder fixes them (for arithmetic coding: as soon as the interval settles), so prefix checks like
+ * searching for the start signal can stop after a few tokens.
+ *
+ * The last fed token is only decoded once it is known whether more tokens follow, as arithmetic decoding writes more bits for the very last token.
+ */
+class IncrementalDecoder {
+private:
+    StegoEngine& engine;
+    Coder& coder;
+
+    /**
+     * Number of cipher bits after which decoding stops, 0 to decode all tokens.
+     */
+    size_t numberOfCipherBits;
+
+    /**
+     * Token IDs of the prompt followed by all decoded cover text tokens. The next token is predicted from the logits of the last one.
+     */
+    llama_tokens processedTokens;
+
+    /**
+     * Fed cover text tokens that weren't decoded yet.
+     */
+    llama_tokens pendingTokens;
+
+    size_t numberOfDecodedTokens = 0;
+    BitStream cipherBits;
+    size_t numberOfPulledBits = 0;
+    bool isFinished = false;
+
+    /**
+     * Function to decode the pending tokens.
+     *
+     * @param includesLastToken Boolean that is true if the last pending token is the last cover text token, false if more tokens can follow.
+     * @throws std::invalid_argument If a cover text token can't be decoded.
+     */
+    void decodePendingTokens(bool includesLastToken);
+
+    /**
+     * Function to decode the first pending tokens with a `CodingPipeline`, i.e. to code the tokens of a chunk while the next chunk is decoded.
+     *
+     * @param numberOfTokens Number of pending tokens to decode, more than one chunk.
+     * @param includesLastToken Boolean that is true if the last pending token is the last cover text token, false if more tokens can follow.
+     * @throws std::invalid_argument If a cover text token can't be decoded.
+     */
+    void decodePendingTokensPipelined(size_t numberOfTokens, bool includesLastToken);
+
+public:
+    /**
+     * Constructor for an incremental decoder. Resets the coder.
+     *
+     * @param engine Engine of the context to decode with.
+     * @param coder Coder that maps the tokens to cipher bits, needs to outlive the decoder.
+     * @param contextTokens Token IDs of the context.
+     * @param numberOfCipherBits Number of cipher bits after which decoding stops, 0 to decode all tokens.
+     * @param isResumed Boolean that is true if decoding continues after the tokens processed by the previous run (i.e. context tokens are ignored), false otherwise.
+     */
+    IncrementalDecoder(StegoEngine& engine, Coder& coder, const llama_tokens& contextTokens, size_t numberOfCipherBits, bool isResumed);
+
+    /**
+     * Function to feed cover text tokens to the decoder. Decodes all of them except the last one, unless this is the last feed.
+     *
+     * Does nothing once decoding is complete.
+     *
+     * @param coverTextTokens Token IDs of the next part of the cover text.
+     * @param isLastFeed Boolean that is true if no more tokens follow, false otherwise.
+     * @throws std::invalid_argument If a cover text token can't be decoded.
+     */
+    void feed(const llama_tokens& coverTextTokens, bool isLastFeed);
+
+    /**
+     * Function to signal that no more tokens follow, decoding the last fed token.
+     *
+     * @throws std::invalid_argument If the last cover text token can't be decoded.
+     */
+    void finish() {
+        feed({}, true);
+    }
+
+    /**
+     * Function to take cipher bits that were decoded but not pulled yet.
+     *
+     * @param maxNumberOfBits Maximum number of bits to take.
+     * @return The bits, in order of decoding.
+     */
+    BitStream pull(size_t maxNumberOfBits);
+
+    /**
+     * @return Number of cipher bits that were decoded but not pulled yet.
+     */
+    size_t getNumberOfAvailableBits() const {
+        return cipherBits.size() - numberOfPulledBits;
+    }
+
+    /**
+     * @return Boolean that is true if all tokens were decoded or enough cipher bits were found, false otherwise.
+     */
+    bool isComplete() const {
+        return isFinished;
+    }
+
+    /**
+     * @return All cipher bits decoded so far, including the pulled ones.
+     */
+    const BitStream& getCipherBits() const {
+        return cipherBits;
+    }
+};
+
+#endif
@@ -1,6 +1,13 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 #include "LlamaCpp.h"
+#include "Profiler.h"
+#include "VocabInfo.h"
 
 std::string LlamaCpp::detokenize(const llama_tokens& tokens, const llama_context* ctx) {
+    Profiler::Scope scope(Profiler::Stage::Detokenization);
+
     // Detokenize vector of tokens to C++ string
     // See common.cpp: common_detokenize calls llama_detokenize, with parameters "remove_special = false" hard-coded and "unparse_special = special" passed through
     std::string string = common_detokenize(ctx, tokens, true);
@@ -16,102 +23,60 @@ std::string LlamaCpp::detokenize(const llama_token& token, const llama_context*
     return string;
 }
 
-bool LlamaCpp::isSpecial(llama_token token, const llama_model* model) {
-    // Get vocabulary of the LLM
-    const llama_vocab* vocab = llama_model_get_vocab(model);
-
-    // Check if token is special
-    bool isSpecial = llama_vocab_is_eog(vocab, token) || llama_vocab_is_control(vocab, token);
-
-    return isSpecial;
-}
-
-bool LlamaCpp::isEndOfGeneration(llama_token token, const llama_model* model) {
-    // Check if token is eog token
-    const llama_vocab* vocab = llama_model_get_vocab(model);
-    bool isEog = llama_vocab_is_eog(vocab, token);
-
-    return isEog;
-}
-
-jbyteArray LlamaCpp::detokenize(JNIEnv* env, const llama_tokens& tokens, const llama_context* ctx) {
-    // Detokenize tokens to C++ string
-    std::string cppString = LlamaCpp::detokenize(tokens, ctx);
-
-    // Initialize Java byte array to store UTF-8 encoding of the C++ string
-    jbyteArray jByteArray = env->NewByteArray((int32_t) cppString.size());
-
-    // Fill the Java byte array and return it
-    env->SetByteArrayRegion(jByteArray, 0, (int32_t) cppString.size(), reinterpret_cast<const jbyte*>(cppString.data()));
-
-    return jByteArray;
-}
-
 void LlamaCpp::suppressSpecialTokens(double* probabilities, const llama_model* model) {
+    Profiler::Scope scope(Profiler::Stage::SpecialTokenSuppression);
+
     // Suppress special tokens by setting their probabilities to 0
-    for (llama_token token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        if (LlamaCpp::isSpecial(token, model)) {
-            probabilities[token] = 0;
-        }
+    // Only loop over the special tokens found when the LLM was loaded, not over the whole vocabulary
+    for (llama_token token : VocabInfo::get(model).specialTokens) {
+        probabilities[token] = 0;
     }
 }
 
 bool LlamaCpp::isEndOfSentence(llama_token token, const llama_context* ctx) {
-    // Detokenize the token and check if it ends with a punctuation mark (covers "?" vs " ?" etc)
-    std::string detokenization = LlamaCpp::detokenize(token, ctx);
-
-    bool isSentenceFinished = detokenization.back() == '.'
-                              || detokenization.back() == '?'
-                              || detokenization.back() == '!';
+    // Detokenization was already checked for a punctuation mark at the end (covers "?" vs " ?" etc) when the LLM was loaded
+    bool isSentenceFinished = VocabInfo::get(llama_get_model(ctx)).endOfSentenceMask[token];
 
     return isSentenceFinished;
 }
 
 llama_token LlamaCpp::getEndOfGeneration(const llama_model* model) {
-    llama_tokens eogTokens;
-
-    for (int32_t token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        if (LlamaCpp::isEndOfGeneration(token, model)) {
-            eogTokens.push_back(token);
-        }
-    }
+    llama_token eogToken = VocabInfo::get(model).endOfGeneration;
 
-    return eogTokens.front();
+    return eogToken;
 }
 
-llama_token LlamaCpp::getAsciiNul(const llama_model* model, const llama_context* ctx) {
-    // Only checks if detokenization contains the ASCII NUL character
-    // Checking if it is equal to it would require constructing a string that only contains the NUL char, which conflicts with C/C++ strings being NUL-terminated
-    // TODO llama.cpp's common_detokenize seems to return a string that only contains the NUL char, figure out how they do it
-    for (int32_t token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        if (LlamaCpp::detokenize(token, ctx).find('\0') != std::string::npos) {
-            return token;
-        }
+llama_token LlamaCpp::getAsciiNul(const llama_model* model) {
+    // Token containing the ASCII NUL character was already searched for when the LLM was loaded
+    llama_token asciiNul = VocabInfo::get(model).asciiNul;
+
+    if (asciiNul == -1) {
+        throw std::runtime_error("LLM vocabulary doesn't contain ASCII NUL character");
     }
 
-    throw std::runtime_error("LLM vocabulary doesn't contain ASCII NUL character");
+    return asciiNul;
 }
 
 // TODO Downward concat of split cover text
 //  LlamaCpp::getAscii{Stx,Etx} are to get start and stop signal
-llama_token LlamaCpp::getAsciiStx(const llama_model* model, const llama_context* ctx) {
-    for (int32_t token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        if (LlamaCpp::detokenize(token, ctx) == "\x02") {
-            return token;
-        }
+llama_token LlamaCpp::getAsciiStx(const llama_model* model) {
+    llama_token asciiStx = VocabInfo::get(model).asciiStx;
+
+    if (asciiStx == -1) {
+        throw std::runtime_error("LLM vocabulary doesn't contain ASCII STX character");
     }
 
-    throw std::runtime_error("LLM vocabulary doesn't contain ASCII STX character");
+    return asciiStx;
 }
 
-llama_token LlamaCpp::getAsciiEtx(const llama_model* model, const llama_context* ctx) {
-    for (int32_t token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        if (LlamaCpp::detokenize(token, ctx) == "\x03") {
-            return token;
-        }
+llama_token LlamaCpp::getAsciiEtx(const llama_model* model) {
+    llama_token asciiEtx = VocabInfo::get(model).asciiEtx;
+
+    if (asciiEtx == -1) {
+        throw std::runtime_error("LLM vocabulary doesn't contain ASCII ETX character");
     }
 
-    throw std::runtime_error("LLM vocabulary doesn't contain ASCII ETX character");
+    return asciiEtx;
 }
 
 int32_t LlamaCpp::getVocabSize(const llama_model* model) {
@@ -121,59 +86,45 @@ int32_t LlamaCpp::getVocabSize(const llama_model* model) {
     return n_vocab;
 }
 
-llama_tokens LlamaCpp::tokenize(JNIEnv* env, jbyteArray jByteArray, const llama_context* ctx) {
-    // Convert Java byte array storing UTF-8 encoding of string to be tokenized to C++ string
-    jboolean isCopy = true;
-    jbyte* jBytes = env->GetByteArrayElements(jByteArray, &isCopy);
+llama_tokens LlamaCpp::tokenize(const char* text, size_t length, const llama_context* ctx) {
+    const llama_vocab* vocab = llama_model_get_vocab(llama_get_model(ctx));
 
-    std::string cppString(reinterpret_cast<char*>(jBytes), env->GetArrayLength(jByteArray));
+    // Same as common_tokenize with parameters "add_special = false" and "parse_special = true"
+    // Every token covers at least one byte, so the number of bytes is enough space, otherwise llama_tokenize returns the negated number of tokens
+    llama_tokens tokens(length);
+    int32_t numberOfTokens = llama_tokenize(vocab, text, static_cast<int32_t>(length), tokens.data(), static_cast<int32_t>(tokens.size()), false, true);
 
-    // Tokenize string, save tokens as llama_tokens (equivalent to std::vector<llama_token>, with llama_token equivalent to int32_t)
-    // See common.cpp: common_tokenize(ctx, ...) calls common_tokenize(vocab, ...), which calls llama_tokenize, always passing parameters {add,parse}_special through
-    llama_tokens tokens = common_tokenize(ctx, cppString, false, true);
+    if (numberOfTokens < 0) {
+        tokens.resize(-numberOfTokens);
+        numberOfTokens = llama_tokenize(vocab, text, static_cast<int32_t>(length), tokens.data(), static_cast<int32_t>(tokens.size()), false, true);
+    }
 
-    // Release memory allocated above again
-    env->ReleaseByteArrayElements(jByteArray, jBytes, 0);
+    tokens.resize(std::max(numberOfTokens, 0));
 
     return tokens;
 }
 
-float* LlamaCpp::getLogits(llama_tokens tokens, llama_context* ctx) {
+void LlamaCpp::decode(const Batch& batch, llama_context* ctx) {
+    Profiler::Scope scope(Profiler::Stage::Decode);
+
     // Get model the context was created with
     const llama_model* model = llama_get_model(ctx);
 
-    // C++ allows accessing illegal array indices and returns garbage values, doesn't throw IndexOutOfBoundsException like Java/Kotlin
-    // Manually ensure that indices stay within dimensions n_tokens x n_vocab of the logit matrix
-    int32_t n_tokens = tokens.size();
-
-    // Store tokens to be processed in batch data structure
-    // llama.cpp example cited below stores multiple tokens from tokenization of the prompt in the first run, single last sampled token in subsequent runs
-    // TODO
-    //  llama.cpp docs: "NOTE: this is a helper function to facilitate transition to the new batch API - avoid using it"
-    //  But is used like this in https://github.com/ggml-org/llama.cpp/blob/master/examples/simple/simple.cpp
-    llama_batch batch = llama_batch_get_one(tokens.data(), n_tokens);
-
     // Check if model architecture is encoder-decoder or decoder-only
     if (llama_model_has_encoder(model)) {
-        // Run encoder to calculate logits for the next token
-        // Return value of llama_encode only indicates success/error, actual result is stored internally in cppCtx
-        int32_t encode = llama_encode(ctx, batch);
-    }
-
-    // Run decoder to calculate logits for the next token
-    // Return value of llama_decode only indicates success/error, actual result is stored internally in cppCtx
-    int32_t decode = llama_decode(ctx, batch);
-
-    // Get pointer to the logit matrix
-    float* logits = llama_get_logits(ctx);
-
-    return logits;
-}
+        // Run encoder first, result is stored internally in ctx
+        int32_t encode = llama_encode(ctx, batch.get());
 
-float* LlamaCpp::getLogits(llama_token token, llama_context* ctx) {
-    llama_tokens tokens = std::vector<llama_token>{token};
+        if (encode != 0) {
+            throw std::runtime_error("llama_encode failed with status " + std::to_string(encode));
+        }
+    }
 
-    float* logits = LlamaCpp::getLogits(tokens, ctx);
+    // Run decoder to calculate logits, result is stored internally in ctx
+    // Return value is 0 on success, 1 if no memory slot was found for the batch, negative on errors
+    int32_t decode = llama_decode(ctx, batch.get());
 
-    return logits;
+    if (decode != 0) {
+        throw std::runtime_error("llama_decode failed with status " + std::to_string(decode));
+    }
 }
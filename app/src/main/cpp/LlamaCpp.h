@@ -1,20 +1,20 @@
 #ifndef LLAMACPP_H
 #define LLAMACPP_H
 
-#include <jni.h>
+#include <string>
+#include <vector>
 #include "llama.h"
 #include "common.h"
+#include "Batch.h"
 
 /**
  * Class that represents llama.cpp.
  */
 class LlamaCpp {
-private:
+public:
     /**
      * Wrapper for the `common_detokenize` function of llama.cpp. Detokenizes a vector of token IDs into a C++ string.
      *
-     * Helper for the public `detokenize` function.
-     *
      * @param tokens Vector of token IDs.
      * @param ctx Memory address of the context.
      * @return Detokenization as a C++ string.
@@ -31,33 +31,14 @@ private:
     static std::string detokenize(const llama_token& token, const llama_context* ctx);
 
     /**
-     * Wrapper for the `llama_vocab_is_eog` and `llama_vocab_is_control` functions of llama.cpp. Checks if a token is a special token.
+     * Wrapper for the `llama_tokenize` function of llama.cpp. Tokenizes a UTF-8 encoded string the same way as `common_tokenize`, but without copying it into a C++ string first.
      *
-     * @param token Token ID to check.
-     * @param model Memory address of the LLM.
-     * @return Boolean that is true if the token is special, false otherwise.
-     */
-    static bool isSpecial(llama_token token, const llama_model* model);
-
-    /**
-     * Wrapper for the `llama_vocab_is_eog` function of llama.cpp. Checks if a token is an end-of-generation (eog) token.
-     *
-     * @param token Token ID to check.
-     * @param model Memory address of the LLM.
-     * @return Boolean that is true if the token is an eog token, false otherwise.
-     */
-    static bool isEndOfGeneration(llama_token token, const llama_model* model);
-
-public:
-    /**
-     * Wrapper for the `common_detokenize` function of llama.cpp. Detokenizes a vector of token IDs into a Java string (byte array storing UTF-8 encoded string to bypass JNI errors).
-     *
-     * @param env The JNI environment.
-     * @param tokens Vector of token IDs.
+     * @param text Pointer to the UTF-8 encoded string, doesn't need to be null-terminated.
+     * @param length Number of bytes of the string.
      * @param ctx Memory address of the context.
-     * @return Detokenization as a Java string (byte array storing UTF-8 encoded string to bypass JNI errors).
+     * @return Tokenization as a vector of token IDs.
      */
-    static jbyteArray detokenize(JNIEnv* env, const llama_tokens& tokens, const llama_context* ctx);
+    static llama_tokens tokenize(const char* text, size_t length, const llama_context* ctx);
 
     /**
      * Function to suppress special tokens, i.e. end-of-generation (eog) and control tokens.
@@ -65,6 +46,8 @@ public:
      * Suppressing eog tokens is needed to avoid early termination when generating a cover text.
      * Additionally suppressing control tokens is needed to avoid artefacts when generating a conversation of cover texts.
      *
+     * Only touches the special tokens listed in the vocabulary metadata of the LLM, doesn't loop over the whole vocabulary.
+     *
      * @param probabilities Probabilities for the last token of the prompt (= last row of logits matrix after normalization).
      * @param model Memory address of the LLM.
      */
@@ -75,6 +58,8 @@ public:
      *
      * Corresponds to Stegasuras method `is_sent_finish` in `utils.py`.
      *
+     * Looks up the precomputed mask in the vocabulary metadata of the LLM instead of detokenizing the token again.
+     *
      * @param token Token ID to check.
      * @param ctx Memory address of the context.
      * @return Boolean that is true if the token ends with `.`, `!` or `?`, false otherwise.
@@ -94,11 +79,10 @@ public:
      * Function to get the token ID of the ASCII NUL character in the vocabulary of the LLM.
      *
      * @param model Memory address of the LLM.
-     * @param ctx Memory address of the context.
      * @return Token ID of the ASCII NUL character.
      * @throws std::runtime_error If the LLM vocabulary doesn't contain the ASCII NUL character.
      */
-    static llama_token getAsciiNul(const llama_model* model, const llama_context* ctx);
+    static llama_token getAsciiNul(const llama_model* model);
 
     // TODO Downward concat of split cover text
     //  LlamaCpp::getAscii{Stx,Etx} are to get start and stop signal
@@ -106,21 +90,19 @@ public:
      * Function to get the token ID of the ASCII STX (start-of-text) character in the vocabulary of the LLM.
      *
      * @param model Memory address of the LLM.
-     * @param ctx Memory address of the context.
      * @return Token ID of the ASCII STX character.
      * @throws std::runtime_error If the LLM vocabulary doesn't contain the ASCII STX character.
      */
-    static llama_token getAsciiStx(const llama_model* model, const llama_context* ctx);
+    static llama_token getAsciiStx(const llama_model* model);
 
     /**
      * Function to get the token ID of the ASCII ETX (end-of-text) character in the vocabulary of the LLM.
      *
      * @param model Memory address of the LLM.
-     * @param ctx Memory address of the context.
      * @return Token ID of the ASCII ETX character.
      * @throws std::runtime_error If the LLM vocabulary doesn't contain the ASCII ETX character.
      */
-    static llama_token getAsciiEtx(const llama_model* model, const llama_context* ctx);
+    static llama_token getAsciiEtx(const llama_model* model);
 
     /**
      * Wrapper for the `llama_vocab_n_tokens` function of llama.cpp. Gets the vocabulary size `n_vocab` of the LLM (i.e. the number of available tokens).
@@ -131,34 +113,16 @@ public:
     static int32_t getVocabSize(const llama_model* model);
 
     /**
-     * Wrapper for the `common_tokenize` function of llama.cpp. Tokenizes a Java string (byte array storing UTF-8 encoded string to bypass JNI errors) into a vector of token IDs.
-     *
-     * @param env The JNI environment.
-     * @param jByteArray Java string to be tokenized (byte array storing UTF-8 encoded string to bypass JNI errors).
-     * @param ctx Memory address of the context.
-     * @return Tokenization as a vector of token IDs.
-     */
-    static llama_tokens tokenize(JNIEnv* env, jbyteArray jByteArray, const llama_context* ctx);
-
-    /**
-     * Function to calculate the logit matrix (i.e. predictions for every token in the prompt).
-     *
-     * Only the last row of the `n_tokens` x `n_vocab` matrix is actually needed as it contains the logits corresponding to the last token of the prompt.
+     * Wrapper for the `llama_decode` function of llama.cpp. Calculates the logits for the tokens of a batch that have their output flag set.
      *
-     * @param tokens Token IDs from tokenization of the prompt.
-     * @param ctx Memory address of the context.
-     * @return The last row of the logit matrix.
-     */
-    static float* getLogits(llama_tokens tokens, llama_context* ctx);
-
-    /**
-     * Function to calculate a vector of logits (i.e. predictions for the last sampled token).
+     * Runs the encoder first if the model architecture is encoder-decoder.
+     * Logits are stored internally in the context, get them via `llama_get_logits_ith` until the next decode.
      *
-     * @param token Token ID of the last sampled token.
+     * @param batch Batch of at most `llama_n_batch` tokens, llama.cpp splits it further into micro-batches of `llama_n_ubatch` tokens.
      * @param ctx Memory address of the context.
-     * @return A vector of logits.
+     * @throws std::runtime_error If llama.cpp fails to encode or decode the batch (e.g. because the memory of the context is full).
      */
-    static float* getLogits(llama_token token, llama_context* ctx);
+    static void decode(const Batch& batch, llama_context* ctx);
 };
 
 #endif
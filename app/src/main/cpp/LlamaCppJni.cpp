@@ -0,0 +1,63 @@
+#include <string>
+#include <vector>
+#include "LlamaCppJni.h"
+#include "CoverTextCache.h"
+#include "LlamaCpp.h"
+#include "Profiler.h"
+
+jbyteArray LlamaCppJni::detokenize(JNIEnv* env, const llama_tokens& tokens, const llama_context* ctx, bool isCoverText) {
+    // Detokenize tokens to C++ string
+    std::string cppString = LlamaCpp::detokenize(tokens, ctx);
+
+    // Keep the token IDs next to the cover text, so that decoding it on this device doesn't need to tokenize it again
+    if (isCoverText) {
+        CoverTextCache::put(llama_get_model(ctx), cppString, tokens);
+    }
+
+    // Initialize Java byte array to store UTF-8 encoding of the C++ string
+    jbyteArray jByteArray = env->NewByteArray((int32_t) cppString.size());
+
+    // Fill the Java byte array and return it
+    env->SetByteArrayRegion(jByteArray, 0, (int32_t) cppString.size(), reinterpret_cast<const jbyte*>(cppString.data()));
+
+    return jByteArray;
+}
+
+llama_tokens LlamaCppJni::tokenize(JNIEnv* env, jbyteArray jByteArray, const llama_context* ctx, bool isCoverText) {
+    Profiler::Scope scope(Profiler::Stage::Tokenization);
+
+    // Pin the Java byte array storing the UTF-8 encoding of the string instead of copying it, no JNI calls are allowed until it is released
+    auto length = static_cast<size_t>(env->GetArrayLength(jByteArray));
+    auto* bytes = static_cast<const char*>(env->GetPrimitiveArrayCritical(jByteArray, nullptr));
+
+    // Tokenize string, save tokens as llama_tokens (equivalent to std::vector<llama_token>, with llama_token equivalent to int32_t)
+    // Cover texts that were encoded on this device are looked up instead, they then decode with exactly the tokens they were generated as
+    llama_tokens tokens;
+
+    if (!isCoverText || !CoverTextCache::get(llama_get_model(ctx), bytes, length, tokens)) {
+        tokens = LlamaCpp::tokenize(bytes, length, ctx);
+    }
+
+    // Bytes were only read, so they don't need to be copied back
+    env->ReleasePrimitiveArrayCritical(jByteArray, const_cast<char*>(bytes), JNI_ABORT);
+
+    return tokens;
+}
+
+std::vector<llama_tokens> LlamaCppJni::tokenizeAll(JNIEnv* env, jobjectArray jByteArrays, const llama_context* ctx, bool isCoverText) {
+    jsize length = env->GetArrayLength(jByteArrays);
+
+    std::vector<llama_tokens> tokens;
+    tokens.reserve(length);
+
+    // Delete local references right away, JNI only guarantees a limited number of them per call
+    for (jsize i = 0; i < length; i++) {
+        auto jByteArray = static_cast<jbyteArray>(env->GetObjectArrayElement(jByteArrays, i));
+
+        tokens.push_back(LlamaCppJni::tokenize(env, jByteArray, ctx, isCoverText));
+
+        env->DeleteLocalRef(jByteArray);
+    }
+
+    return tokens;
+}
@@ -0,0 +1,52 @@
+#ifndef LLAMACPP_JNI_H
+#define LLAMACPP_JNI_H
+
+#include <vector>
+#include <jni.h>
+#include "llama.h"
+#include "common.h"
+
+/**
+ * Class that represents the JNI overloads of the tokenization functions of `LlamaCpp`.
+ *
+ * Part of the JNI layer rather than of the core, so that the core (and the benchmarks linking it) don't need JNI headers.
+ */
+class LlamaCppJni {
+public:
+    /**
+     * Wrapper for the `common_detokenize` function of llama.cpp. Detokenizes a vector of token IDs into a Java string (byte array storing UTF-8 encoded string to bypass JNI errors).
+     *
+     * @param env The JNI environment.
+     * @param tokens Vector of token IDs.
+     * @param ctx Memory address of the context.
+     * @param isCoverText Boolean that is true if the tokens are an encoded cover text, which is then stored in the `CoverTextCache` together with them.
+     * @return Detokenization as a Java string (byte array storing UTF-8 encoded string to bypass JNI errors).
+     */
+    static jbyteArray detokenize(JNIEnv* env, const llama_tokens& tokens, const llama_context* ctx, bool isCoverText = false);
+
+    /**
+     * Wrapper for the `common_tokenize` function of llama.cpp. Tokenizes a Java string (byte array storing UTF-8 encoded string to bypass JNI errors) into a vector of token IDs.
+     *
+     * Tokenizes the bytes in place while the Java array is pinned via `GetPrimitiveArrayCritical`, so they aren't copied.
+     *
+     * @param env The JNI environment.
+     * @param jByteArray Java string to be tokenized (byte array storing UTF-8 encoded string to bypass JNI errors).
+     * @param ctx Memory address of the context.
+     * @param isCoverText Boolean that is true if the string is a cover text, which then uses the token IDs it was generated as if it is in the `CoverTextCache`.
+     * @return Tokenization as a vector of token IDs.
+     */
+    static llama_tokens tokenize(JNIEnv* env, jbyteArray jByteArray, const llama_context* ctx, bool isCoverText = false);
+
+    /**
+     * Function to tokenize an array of Java strings (byte arrays storing UTF-8 encoded strings to bypass JNI errors), see `tokenize`.
+     *
+     * @param env The JNI environment.
+     * @param jByteArrays Java array of Java strings to be tokenized.
+     * @param ctx Memory address of the context.
+     * @param isCoverText Boolean that is true if the strings are cover texts, see `tokenize`.
+     * @return Tokenizations as vectors of token IDs, in order of the array.
+     */
+    static std::vector<llama_tokens> tokenizeAll(JNIEnv* env, jobjectArray jByteArrays, const llama_context* ctx, bool isCoverText = false);
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <deque>
+#include "MultiSequenceDecoder.h"
+#include "CodingPipeline.h"
+#include "LlamaCpp.h"
+
+MultiSequenceDecoder::MultiSequenceDecoder(StegoEngine& engine)
+    : engine(engine),
+      batch(engine.getSession().getBatchCapacity()) {}
+
+void MultiSequenceDecoder::fillBatch(std::vector<Stream>& streams, std::vector<size_t>& batchRows, size_t maxNumberOfLogitRows) {
+    batch.clear();
+    batchRows.clear();
+
+    size_t numberOfLogitRows = 0;
+
+    // Take one token from every stream per turn until the batch is full or all streams are fed
+    bool isTokenAdded = true;
+
+    while (isTokenAdded && batch.size() < batch.getCapacity()) {
+        isTokenAdded = false;
+
+        for (size_t i = 0; i < streams.size() && batch.size() < batch.getCapacity(); i++) {
+            Stream& stream = streams[i];
+
+            if (stream.isFailed || stream.numberOfFedTokens == stream.tokens.size()) {
+                continue;
+            }
+
+            // Logits are needed from the last prompt token onwards, as they predict the cover text tokens
+            size_t position = stream.numberOfFedTokens;
+            bool hasLogits = position + 1 >= stream.promptLength;
+
+            if (hasLogits && numberOfLogitRows == maxNumberOfLogitRows) {
+                continue;
+            }
+
+            stream.numberOfFedTokens++;
+            numberOfLogitRows += hasLogits ? 1 : 0;
+
+            batch.add(stream.tokens[position], static_cast<llama_pos>(position), stream.sequenceId, hasLogits);
+            batchRows.push_back(i);
+
+            isTokenAdded = true;
+        }
+    }
+}
+
+std::vector<std::optional<BitStream>> MultiSequenceDecoder::decode(const std::vector<Job>& jobs, const std::function<std::unique_ptr<Coder>()>& createCoder) {
+    std::vector<std::optional<BitStream>> results(jobs.size());
+
+    llama_context* ctx = engine.getContext();
+    llama_memory_t memory = llama_get_memory(ctx);
+
+    // Without additional sequences, cover texts can only be decoded one after another through the session
+    auto numberOfSequences = static_cast<llama_seq_id>(llama_n_seq_max(ctx));
+
+    if (numberOfSequences <= FIRST_SEQUENCE_ID) {
+        for (size_t job = 0; job < jobs.size(); job++) {
+            std::unique_ptr<Coder> coder = createCoder();
+
+            try {
+                results[job] = engine.decode(jobs[job].contextTokens, jobs[job].coverTextTokens, *coder, 0, false);
+            }
+            catch (const std::invalid_argument&) {
+                results[job].reset();
+            }
+        }
+
+        return results;
+    }
+
+    // Sequences share the memory of the context with the session, so only start a job if its tokens still fit
+    size_t memoryBudget = llama_n_ctx(ctx) > engine.getSession().getHistory().size() ? llama_n_ctx(ctx) - engine.getSession().getHistory().size() : 0;
+    size_t memoryInUse = 0;
+
+    std::deque<size_t> pendingJobs;
+    std::vector<llama_seq_id> freeSequenceIds;
+
+    for (size_t job = 0; job < jobs.size(); job++) {
+        // Nothing to decode for an empty cover text, nothing to predict it from for an empty context
+        if (jobs[job].coverTextTokens.empty()) {
+            results[job] = BitStream();
+        }
+        else if (!jobs[job].contextTokens.empty()) {
+            pendingJobs.push_back(job);
+        }
+    }
+
+    for (llama_seq_id sequenceId = numberOfSequences - 1; sequenceId >= FIRST_SEQUENCE_ID; sequenceId--) {
+        freeSequenceIds.push_back(sequenceId);
+    }
+
+    std::vector<Stream> streams;
+    std::vector<size_t> batchRows;
+
+    // Code the rows of a batch on a worker while the next batch is decoded, if the backend leaves a core free for it
+    // Coders of finished streams are kept until the worker is done with them, so the pipeline is declared after them and destroyed first
+    std::vector<std::unique_ptr<Coder>> retiredCoders;
+    std::optional<CodingPipeline> pipeline;
+    size_t numberOfHandledFailures = 0;
+
+    if (CodingPipeline::isAvailable(ctx)) {
+        pipeline.emplace(engine);
+    }
+
+    size_t maxNumberOfLogitRows = pipeline ? pipeline->getMaxNumberOfRows() : static_cast<size_t>(batch.getCapacity());
+
+    // Remove the tokens of a stream from memory and free its sequence
+    auto finishStream = [&](Stream& stream) {
+        llama_memory_seq_rm(memory, stream.sequenceId, -1, -1);
+
+        freeSequenceIds.push_back(stream.sequenceId);
+        memoryInUse -= stream.tokens.size();
+
+        if (pipeline) {
+            retiredCoders.push_back(std::move(stream.coder));
+        }
+    };
+
+    try {
+        while (!pendingJobs.empty() || !streams.empty()) {
+            // Assign pending jobs to free sequences as long as their tokens fit into memory
+            while (!pendingJobs.empty() && !freeSequenceIds.empty()) {
+                const Job& job = jobs[pendingJobs.front()];
+                size_t numberOfTokens = job.contextTokens.size() + job.coverTextTokens.size() - 1;
+
+                if (memoryInUse + numberOfTokens > memoryBudget) {
+                    // Job doesn't even fit on its own, so it can't be decoded
+                    if (streams.empty()) {
+                        pendingJobs.pop_front();
+                        continue;
+                    }
+
+                    break;
+                }
+
+                Stream stream;
+                stream.job = pendingJobs.front();
+                stream.sequenceId = freeSequenceIds.back();
+                stream.coder = createCoder();
+                stream.coder->reset();
+                stream.tokens = job.contextTokens;
+                stream.tokens.insert(stream.tokens.end(), job.coverTextTokens.begin(), job.coverTextTokens.end() - 1);
+                stream.promptLength = job.contextTokens.size();
+
+                freeSequenceIds.pop_back();
+                pendingJobs.pop_front();
+                memoryInUse += numberOfTokens;
+
+                results[stream.job] = BitStream();
+                streams.push_back(std::move(stream));
+            }
+
+            if (streams.empty()) {
+                break;
+            }
+
+            fillBatch(streams, batchRows, maxNumberOfLogitRows);
+
+            // One forward pass advances all active streams
+            LlamaCpp::decode(batch, ctx);
+
+            // Walk the rows in order, so every coder sees its cover text tokens in order
+            for (int32_t row = 0; row < batch.size(); row++) {
+                Stream& stream = streams[batchRows[row]];
+
+                if (stream.isFailed || !batch.get().logits[row]) {
+                    continue;
+                }
+
+                const llama_tokens& coverTextTokens = jobs[stream.job].coverTextTokens;
+                size_t i = stream.numberOfDecodedTokens++;
+                bool isLastToken = i == coverTextTokens.size() - 1;
+
+                if (pipeline) {
+                    pipeline->add(llama_get_logits_ith(ctx, row), {stream.coder.get(), &*results[stream.job], coverTextTokens[i], isLastToken, stream.job, i});
+                    continue;
+                }
+
+                engine.calculateProbabilities(llama_get_logits_ith(ctx, row), stream.coder->getTemperature());
+
+                if (!stream.coder->decodeToken(engine.workspace, coverTextTokens[i], isLastToken, *results[stream.job])) {
+                    stream.isFailed = true;
+                    results[stream.job].reset();
+                }
+            }
+
+            // Failures of the worker are only known a batch later, so failed streams might get one more batch in vain
+            // Results are reset once the worker is done, as it could still write to them
+            if (pipeline) {
+                pipeline->flush();
+
+                const std::vector<std::pair<size_t, size_t>>& failures = pipeline->getFailures();
+
+                for (; numberOfHandledFailures < failures.size(); numberOfHandledFailures++) {
+                    size_t failedJob = failures[numberOfHandledFailures].first;
+
+                    for (Stream& stream : streams) {
+                        if (stream.job == failedJob) {
+                            stream.isFailed = true;
+                        }
+                    }
+                }
+            }
+
+            // Free the sequences of finished streams for the next jobs
+            for (auto iterator = streams.begin(); iterator != streams.end();) {
+                if (iterator->isFailed || iterator->numberOfDecodedTokens == jobs[iterator->job].coverTextTokens.size()) {
+                    finishStream(*iterator);
+                    iterator = streams.erase(iterator);
+                }
+                else {
+                    iterator++;
+                }
+            }
+        }
+
+        if (pipeline) {
+            for (const std::pair<size_t, size_t>& failure : pipeline->drain()) {
+                results[failure.first].reset();
+            }
+        }
+    }
+    catch (...) {
+        // Leave the memory as it was before, i.e. only with the tokens of the session
+        for (Stream& stream : streams) {
+            finishStream(stream);
+        }
+
+        throw;
+    }
+
+    return results;
+}
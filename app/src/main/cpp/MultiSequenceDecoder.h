@@ -0,0 +1,91 @@
+#ifndef MULTI_SEQUENCE_DECODER_H
+#define MULTI_SEQUENCE_DECODER_H
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "llama.h"
+#include "common.h"
+#include "Batch.h"
+#include "BitStream.h"
+#include "Coder.h"
+#include "StegoEngine.h"
+
+/**
+ * Class that represents a decoder of many cover texts at once, e.g. the whole history of a conversation.
+ *
+ * Every cover text gets its own sequence in the memory of the context, and their tokens are interleaved in shared batches (continuous batching):
+ * Every decode advances all active cover texts, and a finished cover text frees its sequence for the next one right away.
+ * Cover text tokens are teacher-forced like in `IncrementalDecoder`, so prompt and cover text of a pair are just one stream of tokens.
+ * If the backend leaves a core free, the rows of a batch are coded by a `CodingPipeline` while the next batch is decoded.
+ *
+ * Sequence 0 belongs to the session of the context and is left untouched.
+ */
+class MultiSequenceDecoder {
+public:
+    /**
+     * Struct that represents a cover text together with the context it was encoded with.
+     */
+    struct Job {
+        llama_tokens contextTokens;
+        llama_tokens coverTextTokens;
+    };
+
+private:
+    /**
+     * First sequence ID used for cover texts, sequence 0 belongs to the session.
+     */
+    static constexpr llama_seq_id FIRST_SEQUENCE_ID = 1;
+
+    /**
+     * Struct that represents a job that is currently assigned to a sequence.
+     */
+    struct Stream {
+        size_t job;
+        llama_seq_id sequenceId;
+        std::unique_ptr<Coder> coder;
+
+        /**
+         * Prompt tokens followed by all cover text tokens except the last one, as nothing is predicted from it.
+         */
+        llama_tokens tokens;
+
+        size_t promptLength;
+        size_t numberOfFedTokens = 0;
+        size_t numberOfDecodedTokens = 0;
+        bool isFailed = false;
+    };
+
+    StegoEngine& engine;
+    Batch batch;
+
+    /**
+     * Function to add tokens of all active streams to the batch, taking turns so that every stream advances.
+     *
+     * @param streams Active streams.
+     * @param batchRows Filled with the stream index of every token in the batch.
+     * @param maxNumberOfLogitRows Maximum number of tokens in the batch that need logits. Streams whose next token needs logits wait once it is reached.
+     */
+    void fillBatch(std::vector<Stream>& streams, std::vector<size_t>& batchRows, size_t maxNumberOfLogitRows);
+
+public:
+    /**
+     * Constructor for a multi-sequence decoder.
+     *
+     * @param engine Engine of the context to decode with. Context needs `n_seq_max` > 1 to decode more than one cover text at a time.
+     */
+    explicit MultiSequenceDecoder(StegoEngine& engine);
+
+    /**
+     * Function to decode cover texts into cipher bits.
+     *
+     * @param jobs Cover texts together with their contexts.
+     * @param createCoder Function to create a new coder for every cover text.
+     * @return Cipher bits of every cover text in order of the jobs, empty if the cover text couldn't be decoded (e.g. wrong context).
+     * @throws std::runtime_error If llama.cpp fails to decode a batch.
+     */
+    std::vector<std::optional<BitStream>> decode(const std::vector<Job>& jobs, const std::function<std::unique_ptr<Coder>()>& createCoder);
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <cstdio>
+#include "Profiler.h"
+
+#if defined(HIPS_ENABLE_PROFILING) && defined(__ANDROID__)
+#include <android/trace.h>
+#endif
+
+namespace {
+    /**
+     * Names of the stages, in order of `Profiler::Stage`. Used as JSON keys and ATrace section names.
+     */
+    constexpr std::array<const char*, Profiler::NUMBER_OF_STAGES> STAGE_NAMES = {
+        "tokenization",
+        "prefill",
+        "decode",
+        "softmax",
+        "specialTokenSuppression",
+        "selection",
+        "coding",
+        "detokenization"
+    };
+
+    [[maybe_unused]] uint64_t getNanoseconds(std::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    [[maybe_unused]] void beginTraceSection([[maybe_unused]] const char* name) {
+#if defined(HIPS_ENABLE_PROFILING) && defined(__ANDROID__)
+        if (ATrace_isEnabled()) {
+            ATrace_beginSection(name);
+        }
+#endif
+    }
+
+    [[maybe_unused]] void endTraceSection() {
+#if defined(HIPS_ENABLE_PROFILING) && defined(__ANDROID__)
+        if (ATrace_isEnabled()) {
+            ATrace_endSection();
+        }
+#endif
+    }
+}
+
+std::atomic<bool> Profiler::isProfilingEnabled = false;
+thread_local Profiler::Stats Profiler::currentStats;
+std::mutex Profiler::lastStatsMutex;
+Profiler::Stats Profiler::lastStats;
+
+#ifdef HIPS_ENABLE_PROFILING
+Profiler::Scope::Scope(Stage stage) : stage(stage), isActive(isProfilingEnabled.load(std::memory_order_relaxed)) {
+    if (isActive) {
+        beginTraceSection(STAGE_NAMES[static_cast<size_t>(stage)]);
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+Profiler::Scope::~Scope() {
+    if (isActive) {
+        StageStats& stageStats = currentStats.stages[static_cast<size_t>(stage)];
+        stageStats.numberOfCalls++;
+        stageStats.nanoseconds += getNanoseconds(start);
+
+        endTraceSection();
+    }
+}
+
+Profiler::Operation::Operation(const char* name, llama_context* ctx) : name(name), ctx(ctx), isActive(isProfilingEnabled.load(std::memory_order_relaxed)) {
+    if (isActive) {
+        currentStats = Stats();
+        currentStats.operation = name;
+
+        // Performance data of llama.cpp accumulates over the lifetime of the context otherwise
+        llama_perf_context_reset(ctx);
+
+        beginTraceSection(name);
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+Profiler::Operation::~Operation() {
+    if (isActive) {
+        currentStats.nanoseconds = getNanoseconds(start);
+        currentStats.perf = llama_perf_context(ctx);
+
+        endTraceSection();
+
+        std::lock_guard<std::mutex> lock(lastStatsMutex);
+        lastStats = currentStats;
+    }
+}
+#endif
+
+void Profiler::setEnabled([[maybe_unused]] bool isEnabled) {
+#ifdef HIPS_ENABLE_PROFILING
+    isProfilingEnabled = isEnabled;
+#endif
+}
+
+bool Profiler::isEnabled() {
+    return isProfilingEnabled;
+}
+
+std::string Profiler::getLastStatsAsJson() {
+    Stats stats;
+
+    {
+        std::lock_guard<std::mutex> lock(lastStatsMutex);
+        stats = lastStats;
+    }
+
+    if (!isEnabled() || stats.operation[0] == '\0') {
+        return isEnabled() ? "{\"isEnabled\":true}" : "{\"isEnabled\":false}";
+    }
+
+    // Operation names and stage names are literals without characters that need escaping, so the JSON can be formatted directly
+    char buffer[256];
+    std::string json = "{\"isEnabled\":true";
+
+    std::snprintf(buffer, sizeof(buffer), ",\"operation\":\"%s\",\"ms\":%.3f,\"stages\":{", stats.operation, static_cast<double>(stats.nanoseconds) / 1e6);
+    json += buffer;
+
+    for (size_t i = 0; i < NUMBER_OF_STAGES; i++) {
+        std::snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"calls\":%llu,\"ms\":%.3f}", i > 0 ? "," : "", STAGE_NAMES[i],
+                      static_cast<unsigned long long>(stats.stages[i].numberOfCalls), static_cast<double>(stats.stages[i].nanoseconds) / 1e6);
+        json += buffer;
+    }
+
+    std::snprintf(buffer, sizeof(buffer), "},\"llama\":{\"promptEvalMs\":%.3f,\"promptTokens\":%d,\"evalMs\":%.3f,\"evalTokens\":%d,\"reusedTokens\":%d}}",
+                  stats.perf.t_p_eval_ms, stats.perf.n_p_eval, stats.perf.t_eval_ms, stats.perf.n_eval, stats.perf.n_reused);
+    json += buffer;
+
+    return json;
+}
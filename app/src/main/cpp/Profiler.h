@@ -0,0 +1,134 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "llama.h"
+
+/**
+ * Class that represents lightweight instrumentation of the hot path, i.e. scoped timers and call counters per stage of an operation.
+ *
+ * Only compiled in if `HIPS_ENABLE_PROFILING` is defined (CMake option of the same name), otherwise all scopes are empty and optimized away.
+ * Even when compiled in, stages are only measured while profiling is enabled at runtime via `setEnabled`.
+ * On Android, every stage also shows up as an ATrace section in system traces (e.g. Perfetto) while tracing is active.
+ *
+ * Stages can be nested (e.g. decodes during a prefill, selection during coding), so their times don't add up to the time of the operation.
+ * Every thread measures its own operation, the stats of the last finished operation of any thread are kept.
+ */
+class Profiler {
+public:
+    /**
+     * Stages of encoding/decoding.
+     */
+    enum class Stage {
+        Tokenization,
+        Prefill,
+        Decode,
+        Softmax,
+        SpecialTokenSuppression,
+        Selection,
+        Coding,
+        Detokenization,
+        Count
+    };
+
+    static constexpr size_t NUMBER_OF_STAGES = static_cast<size_t>(Stage::Count);
+
+    /**
+     * Class that represents the time spent in a stage from construction to destruction.
+     */
+    class Scope {
+#ifdef HIPS_ENABLE_PROFILING
+    private:
+        Stage stage;
+        bool isActive;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit Scope(Stage stage);
+        ~Scope();
+#else
+    public:
+        explicit Scope(Stage /* stage */) {}
+#endif
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    /**
+     * Class that represents an operation called via JNI (e.g. `Arithmetic.encode`) from construction to destruction.
+     * Resets the stats of the calling thread and the performance data of llama.cpp, and publishes both as the stats of the last operation when done.
+     */
+    class Operation {
+#ifdef HIPS_ENABLE_PROFILING
+    private:
+        const char* name;
+        llama_context* ctx;
+        bool isActive;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        /**
+         * @param name Name of the operation, has to outlive the operation (e.g. a string literal).
+         * @param ctx Memory address of the context the operation runs on.
+         */
+        Operation(const char* name, llama_context* ctx);
+        ~Operation();
+#else
+    public:
+        Operation(const char* /* name */, llama_context* /* ctx */) {}
+#endif
+        Operation(const Operation&) = delete;
+        Operation& operator=(const Operation&) = delete;
+    };
+
+private:
+    struct StageStats {
+        uint64_t numberOfCalls = 0;
+        uint64_t nanoseconds = 0;
+    };
+
+    struct Stats {
+        const char* operation = "";
+        uint64_t nanoseconds = 0;
+        std::array<StageStats, NUMBER_OF_STAGES> stages {};
+        llama_perf_context_data perf {};
+    };
+
+    static std::atomic<bool> isProfilingEnabled;
+
+    /**
+     * Stats of the operation that is currently running on this thread.
+     */
+    static thread_local Stats currentStats;
+
+    static std::mutex lastStatsMutex;
+    static Stats lastStats;
+
+public:
+    /**
+     * Function to enable or disable profiling at runtime. Has no effect if profiling isn't compiled in.
+     *
+     * @param isEnabled Boolean that is true if stages should be measured, false otherwise.
+     */
+    static void setEnabled(bool isEnabled);
+
+    /**
+     * @return Boolean that is true if profiling is compiled in and enabled, false otherwise.
+     */
+    static bool isEnabled();
+
+    /**
+     * Function to get the stats of the last finished operation as JSON, e.g.
+     * `{"isEnabled":true,"operation":"Arithmetic.encode","ms":812.4,"stages":{"decode":{"calls":121,"ms":640.2},...},"llama":{"promptEvalMs":95.1,...}}`.
+     *
+     * @return The stats as a JSON object, only containing `isEnabled` if profiling is disabled or no operation has finished yet.
+     */
+    static std::string getLastStatsAsJson();
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include "Selection.h"
+#include "Profiler.h"
+
+template <int K>
+void Selection::getTopProbabilities(const double* probabilities, int32_t vocabSize, int k, std::vector<std::pair<llama_token, double>>& topProbabilities) {
+    // Buffer of the current top K, sorted by rank
+    // Probabilities are never negative, so the initial entries are beaten by every token (and only remain if the vocabulary has less than K tokens)
+    std::array<llama_token, K> topTokens;
+    std::array<double, K> topValues;
+
+    topTokens.fill(-1);
+    topValues.fill(-1.0);
+
+    // Tokens are scanned in ascending order, so a token with the same probability as an earlier one is ranked after it, i.e. only a larger probability beats an entry
+    // Insertion sort from the back, as a new token usually only beats the last few entries
+    auto insert = [&](llama_token token) {
+        double probability = probabilities[token];
+
+        if (probability <= topValues[K - 1]) {
+            return;
+        }
+
+        int position = K - 1;
+
+        for (; position > 0 && probability > topValues[position - 1]; position--) {
+            topTokens[position] = topTokens[position - 1];
+            topValues[position] = topValues[position - 1];
+        }
+
+        topTokens[position] = token;
+        topValues[position] = probability;
+    };
+
+    // Compare whole blocks against the threshold first, only blocks that contain a token above it are inserted token by token
+    // Branchless OR of the comparisons is vectorized, unlike an early exit
+    llama_token token = 0;
+
+    for (; token + BLOCK_SIZE <= vocabSize; token += BLOCK_SIZE) {
+        double threshold = topValues[K - 1];
+        bool isAboveThreshold = false;
+
+        for (int32_t i = 0; i < BLOCK_SIZE; i++) {
+            isAboveThreshold |= probabilities[token + i] > threshold;
+        }
+
+        if (isAboveThreshold) {
+            for (int32_t i = 0; i < BLOCK_SIZE; i++) {
+                insert(token + i);
+            }
+        }
+    }
+
+    for (; token < vocabSize; token++) {
+        insert(token);
+    }
+
+    // Top k are the first k entries of the top K
+    topProbabilities.reserve(k);
+
+    for (int i = 0; i < k; i++) {
+        topProbabilities.emplace_back(topTokens[i], topValues[i]);
+    }
+}
+
+void Selection::getTopProbabilities(const double* probabilities, int32_t vocabSize, int k, std::vector<std::pair<llama_token, double>>& topProbabilities) {
+    Profiler::Scope scope(Profiler::Stage::Selection);
+
+    // Can't select more tokens than there are in the vocabulary
+    k = std::min(k, static_cast<int>(vocabSize));
+
+    topProbabilities.clear();
+
+    if (k <= 0) {
+        return;
+    }
+
+    // Runtime dispatch to the kernels with fixed-size buffers, every k of Huffman steganography has its own
+    if (k <= FIXED_SELECTION_LIMIT) {
+        if (k <= 2) {
+            getTopProbabilities<2>(probabilities, vocabSize, k, topProbabilities);
+        }
+        else if (k <= 4) {
+            getTopProbabilities<4>(probabilities, vocabSize, k, topProbabilities);
+        }
+        else if (k <= 8) {
+            getTopProbabilities<8>(probabilities, vocabSize, k, topProbabilities);
+        }
+        else if (k <= 16) {
+            getTopProbabilities<16>(probabilities, vocabSize, k, topProbabilities);
+        }
+        else {
+            getTopProbabilities<32>(probabilities, vocabSize, k, topProbabilities);
+        }
+    }
+    else if (k <= HEAP_SELECTION_LIMIT) {
+        // Bounded heap of size k, with the lowest ranked of the current top k at the front
+        // std::*_heap put the largest element w.r.t. the comparator at the front, so isRankedBefore makes it the lowest ranked one
+        topProbabilities.reserve(k);
+
+        for (llama_token token = 0; token < vocabSize; token++) {
+            std::pair<llama_token, double> pair = {token, probabilities[token]};
+
+            if (static_cast<int>(topProbabilities.size()) < k) {
+                topProbabilities.push_back(pair);
+                std::push_heap(topProbabilities.begin(), topProbabilities.end(), isRankedBefore);
+            }
+            // Most tokens are rejected by this single comparison, so the heap is rarely touched once it is full
+            else if (isRankedBefore(pair, topProbabilities.front())) {
+                std::pop_heap(topProbabilities.begin(), topProbabilities.end(), isRankedBefore);
+                topProbabilities.back() = pair;
+                std::push_heap(topProbabilities.begin(), topProbabilities.end(), isRankedBefore);
+            }
+        }
+
+        // Turns the heap into a vector sorted by rank
+        std::sort_heap(topProbabilities.begin(), topProbabilities.end(), isRankedBefore);
+    }
+    else {
+        // Fill vector with pairs constructed from probabilities array, effectively maps token IDs to their probabilities to not lose them when sorting
+        topProbabilities.reserve(vocabSize);
+
+        for (llama_token token = 0; token < vocabSize; token++) {
+            topProbabilities.emplace_back(token, probabilities[token]);
+        }
+
+        // Partition around the k-th ranked token in linear time, then only sort the top k
+        std::nth_element(topProbabilities.begin(), topProbabilities.begin() + (k - 1), topProbabilities.end(), isRankedBefore);
+        topProbabilities.resize(k);
+        std::sort(topProbabilities.begin(), topProbabilities.end(), isRankedBefore);
+    }
+}
+
+std::vector<std::pair<llama_token, double>> Selection::getTopProbabilities(const double* probabilities, int32_t vocabSize, int k) {
+    std::vector<std::pair<llama_token, double>> topProbabilities;
+
+    Selection::getTopProbabilities(probabilities, vocabSize, k, topProbabilities);
+
+    return topProbabilities;
+}
+
+llama_token Selection::getTopProbability(const double* probabilities, int32_t vocabSize) {
+    Profiler::Scope scope(Profiler::Stage::Selection);
+
+    llama_token topToken = 0;
+
+    // Strict comparison keeps the lowest token ID in case of ties, same as isRankedBefore
+    for (llama_token token = 1; token < vocabSize; token++) {
+        if (probabilities[token] > probabilities[topToken]) {
+            topToken = token;
+        }
+    }
+
+    return topToken;
+}
+
+llama_token Selection::getTopLogit(const float* logits, int32_t vocabSize, const std::vector<bool>& excludedTokenMask) {
+    Profiler::Scope scope(Profiler::Stage::Selection);
+
+    llama_token topToken = -1;
+
+    // Strict comparison keeps the lowest token ID in case of ties, same as getTopProbability
+    for (llama_token token = 0; token < vocabSize; token++) {
+        if (!excludedTokenMask[token] && (topToken == -1 || logits[token] > logits[topToken])) {
+            topToken = token;
+        }
+    }
+
+    // Same fallback as getTopProbability if every token is excluded
+    return topToken == -1 ? 0 : topToken;
+}
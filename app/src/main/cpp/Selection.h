@@ -0,0 +1,106 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <array>
+#include <utility>
+#include <vector>
+#include "llama.h"
+
+/**
+ * Class that represents the selection of the most likely tokens from a probability distribution over the vocabulary.
+ *
+ * Shared by Arithmetic and Huffman steganography, so that neither needs to sort the whole vocabulary for every token.
+ */
+class Selection {
+private:
+    /**
+     * Maximum k for which a kernel with a fixed-size buffer is used, i.e. every k of Huffman steganography (at most 2^5 tokens).
+     */
+    static constexpr int FIXED_SELECTION_LIMIT = 32;
+
+    /**
+     * Maximum k for which a bounded heap is used. Larger k use `std::nth_element` over the whole vocabulary instead.
+     */
+    static constexpr int HEAP_SELECTION_LIMIT = 64;
+
+    /**
+     * Number of probabilities that the fixed-size kernel compares against its threshold at once, so that the comparisons can be vectorized.
+     */
+    static constexpr int32_t BLOCK_SIZE = 8;
+
+    /**
+     * Function to get the top k probabilities with a sorted buffer of fixed size K, instantiated for every power of 2 up to `FIXED_SELECTION_LIMIT`.
+     *
+     * Buffer and threshold stay in registers (or at least on the stack) and are only touched by the few tokens that beat the threshold,
+     * the vocabulary is scanned in blocks that are compared against the threshold without branches.
+     * Returns the same top k as the other strategies, as the top K contain the top k and the buffer is ordered by `isRankedBefore`.
+     *
+     * @tparam K Size of the buffer, at least k.
+     * @param probabilities Probabilities for the last token of the prompt (= last row of logits matrix after normalization).
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM.
+     * @param k Number of tokens to select, at most the vocabulary size.
+     * @param topProbabilities Vector to store the top k probabilities and the corresponding token IDs in, sorted descending. Is empty.
+     */
+    template <int K>
+    static void getTopProbabilities(const double* probabilities, int32_t vocabSize, int k, std::vector<std::pair<llama_token, double>>& topProbabilities);
+
+public:
+    /**
+     * Function to compare two token-probability pairs. Orders descending by probability, ties are broken by ascending token ID.
+     *
+     * Needed so that every selection strategy returns the same order, independent of the sorting algorithm or standard library used.
+     *
+     * @param pair1 A token-probability pair.
+     * @param pair2 Another token-probability pair.
+     * @return Boolean that is true if `pair1` is ranked before `pair2`, false otherwise.
+     */
+    static bool isRankedBefore(const std::pair<llama_token, double>& pair1, const std::pair<llama_token, double>& pair2) {
+        return pair1.second > pair2.second || (pair1.second == pair2.second && pair1.first < pair2.first);
+    }
+
+    /**
+     * Function to get the top k probabilities for the last token of the prompt. Keeps track of the corresponding token IDs in a vector.
+     *
+     * Dispatches small k (rounded up to a power of 2) to a kernel with a fixed-size buffer, selects the top k in O(n_vocab * log k) with a bounded heap for medium k
+     * and in O(n_vocab) with `std::nth_element` for large k. Only the top k are sorted.
+     *
+     * @param probabilities Probabilities for the last token of the prompt (= last row of logits matrix after normalization).
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM.
+     * @param k Number of tokens to select. Is capped at the vocabulary size.
+     * @param topProbabilities Vector to store the top k probabilities and the corresponding token IDs in, sorted descending. Existing content is overwritten.
+     */
+    static void getTopProbabilities(const double* probabilities, int32_t vocabSize, int k, std::vector<std::pair<llama_token, double>>& topProbabilities);
+
+    /**
+     * Function to get the top k probabilities for the last token of the prompt. Keeps track of the corresponding token IDs in a vector.
+     *
+     * @param probabilities Probabilities for the last token of the prompt (= last row of logits matrix after normalization).
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM.
+     * @param k Number of tokens to select. Is capped at the vocabulary size.
+     * @return Vector of top k probabilities and the corresponding token IDs, sorted descending.
+     */
+    static std::vector<std::pair<llama_token, double>> getTopProbabilities(const double* probabilities, int32_t vocabSize, int k);
+
+    /**
+     * Function to get the most likely token for the last token of the prompt. Linear scan, no sorting or allocation.
+     *
+     * @param probabilities Probabilities for the last token of the prompt (= last row of logits matrix after normalization).
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM.
+     * @return ID of the most likely token. Ties are broken by lowest token ID.
+     */
+    static llama_token getTopProbability(const double* probabilities, int32_t vocabSize);
+
+    /**
+     * Function to get the most likely token directly from the logits, skipping excluded tokens. Linear scan, no softmax needed.
+     *
+     * Picks the same token as `getTopProbability` after softmax and suppression of the excluded tokens, as softmax doesn't change the order of the tokens.
+     *
+     * @param logits Logits for the next token.
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM.
+     * @param excludedTokenMask Bitmask over the vocabulary that is true for tokens that can't be picked (e.g. special tokens).
+     * @return ID of the most likely token that isn't excluded. Ties are broken by lowest token ID.
+     */
+    static llama_token getTopLogit(const float* logits, int32_t vocabSize, const std::vector<bool>& excludedTokenMask);
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "Session.h"
+#include "LlamaCpp.h"
+#include "Profiler.h"
+
+namespace {
+    /**
+     * Function to get the length of the common prefix of two token vectors.
+     */
+    size_t getCommonPrefixLength(const llama_tokens& tokens1, const llama_tokens& tokens2) {
+        auto mismatch = std::mismatch(tokens1.begin(), tokens1.begin() + static_cast<long>(std::min(tokens1.size(), tokens2.size())), tokens2.begin());
+
+        return static_cast<size_t>(mismatch.first - tokens1.begin());
+    }
+}
+
+float* Session::prefill(const llama_tokens& tokens) {
+    Profiler::Scope scope(Profiler::Stage::Prefill);
+
+    // Logits of the last token are returned, so there has to be one (e.g. not the case for an empty context or a resumed run without cached tokens)
+    if (tokens.empty()) {
+        throw std::invalid_argument("Prompt cannot be empty");
+    }
+
+    // Length of the common prefix of the prompt and the cached tokens
+    size_t numberOfCachedTokens = getCommonPrefixLength(history, tokens);
+
+    // A snapshot might share more of the prompt than the cached tokens do
+    restoreBestSnapshot(tokens, numberOfCachedTokens);
+
+    // Logits of the last token are needed, so at least that one has to be decoded
+    if (numberOfCachedTokens == tokens.size()) {
+        numberOfCachedTokens--;
+    }
+
+    // Remove cached tokens from the first position that differs onwards
+    if (numberOfCachedTokens < history.size()) {
+        llama_memory_t memory = llama_get_memory(ctx);
+
+        // Memory of some architectures (e.g. recurrent LLMs) can't remove a part of a sequence, start over in that case
+        if (!llama_memory_seq_rm(memory, SEQUENCE_ID, static_cast<llama_pos>(numberOfCachedTokens), -1)) {
+            llama_memory_clear(memory, true);
+            numberOfCachedTokens = 0;
+        }
+
+        history.resize(numberOfCachedTokens);
+    }
+
+    // Decode only the new suffix of the prompt, only its last token needs logits
+    size_t numberOfNewTokens = tokens.size() - numberOfCachedTokens;
+
+    float* logits = decode(tokens.data() + numberOfCachedTokens, numberOfNewTokens, false);
+
+    // Keep the state after long prefills, copying it doesn't invalidate the logits
+    if (numberOfNewTokens >= MIN_SNAPSHOT_TOKENS) {
+        saveSnapshot();
+    }
+
+    return logits;
+}
+
+float* Session::append(llama_token token) {
+    float* logits = decode(&token, 1, false);
+
+    return logits;
+}
+
+float* Session::appendAll(const llama_token* tokens, int32_t numberOfTokens) {
+    float* logits = decode(tokens, static_cast<size_t>(numberOfTokens), true);
+
+    return logits;
+}
+
+float* Session::decode(const llama_token* tokens, size_t numberOfTokens, bool hasAllLogits) {
+    auto chunkSize = static_cast<size_t>(batch.getCapacity());
+    size_t contextSize = llama_n_ctx(ctx);
+
+    // llama.cpp would fail to find free memory for tokens after the end of the context window
+    if (history.size() + numberOfTokens > contextSize) {
+        throw std::length_error("Context window of " + std::to_string(contextSize) + " tokens can't fit " + std::to_string(numberOfTokens) + " more tokens after " + std::to_string(history.size()) + " cached ones");
+    }
+
+    if (hasAllLogits && numberOfTokens > chunkSize) {
+        throw std::length_error("All logits are only available for up to " + std::to_string(chunkSize) + " tokens");
+    }
+
+    // llama_decode accepts at most n_batch tokens per call and splits them further into micro-batches of n_ubatch tokens
+    for (size_t chunkStart = 0; chunkStart < numberOfTokens; chunkStart += chunkSize) {
+        size_t chunkEnd = std::min(chunkStart + chunkSize, numberOfTokens);
+
+        // Positions continue after the cached tokens, logits are only calculated where needed
+        batch.clear();
+
+        for (size_t i = chunkStart; i < chunkEnd; i++) {
+            batch.add(tokens[i], static_cast<llama_pos>(history.size() + (i - chunkStart)), SEQUENCE_ID, hasAllLogits || i == numberOfTokens - 1);
+        }
+
+        try {
+            LlamaCpp::decode(batch, ctx);
+        }
+        catch (const std::runtime_error&) {
+            // Failed decode can leave a part of the chunk in memory, remove it so that memory and history stay in sync
+            llama_memory_seq_rm(llama_get_memory(ctx), SEQUENCE_ID, static_cast<llama_pos>(history.size()), -1);
+
+            throw;
+        }
+
+        history.insert(history.end(), tokens + chunkStart, tokens + chunkEnd);
+    }
+
+    // All tokens are outputs, so rows of the logit matrix are in order of the tokens
+    // Otherwise only the last token is an output, so the logit matrix has a single row
+    float* logits = hasAllLogits ? llama_get_logits(ctx) : llama_get_logits_ith(ctx, -1);
+
+    return logits;
+}
+
+void Session::truncate(size_t numberOfTokens) {
+    if (numberOfTokens >= history.size()) {
+        return;
+    }
+
+    if (llama_memory_seq_rm(llama_get_memory(ctx), SEQUENCE_ID, static_cast<llama_pos>(numberOfTokens), -1)) {
+        history.resize(numberOfTokens);
+
+        return;
+    }
+
+    // Start over and decode the kept tokens again, so that memory and history stay in sync
+    llama_tokens keptTokens(history.begin(), history.begin() + static_cast<long>(numberOfTokens));
+
+    clear();
+
+    if (!keptTokens.empty()) {
+        decode(keptTokens.data(), keptTokens.size(), false);
+    }
+}
+
+void Session::clear() {
+    llama_memory_clear(llama_get_memory(ctx), true);
+
+    history.clear();
+}
+
+bool Session::saveSnapshot() {
+    size_t size = llama_state_seq_get_size(ctx, SEQUENCE_ID);
+
+    if (size > MAX_SNAPSHOT_BYTES) {
+        return false;
+    }
+
+    // Replace existing snapshot of the same tokens
+    auto existing = std::find_if(snapshots.begin(), snapshots.end(), [this](const Snapshot& snapshot) { return snapshot.tokens == history; });
+
+    if (existing != snapshots.end()) {
+        snapshotBytes -= existing->state.size();
+        snapshots.erase(existing);
+    }
+
+    // Drop least recently used snapshots until the new one fits
+    while (snapshotBytes + size > MAX_SNAPSHOT_BYTES && !snapshots.empty()) {
+        auto leastRecentlyUsed = std::min_element(snapshots.begin(), snapshots.end(), [](const Snapshot& snapshot1, const Snapshot& snapshot2) { return snapshot1.lastUse < snapshot2.lastUse; });
+
+        snapshotBytes -= leastRecentlyUsed->state.size();
+        snapshots.erase(leastRecentlyUsed);
+    }
+
+    Snapshot snapshot;
+    snapshot.tokens = history;
+    snapshot.state.resize(size);
+    snapshot.state.resize(llama_state_seq_get_data(ctx, snapshot.state.data(), size, SEQUENCE_ID));
+    snapshot.lastUse = ++numberOfUses;
+
+    snapshotBytes += snapshot.state.size();
+    snapshots.push_back(std::move(snapshot));
+
+    return true;
+}
+
+bool Session::restoreSnapshot(const llama_tokens& tokens) {
+    auto iterator = std::find_if(snapshots.begin(), snapshots.end(), [&tokens](const Snapshot& snapshot) { return snapshot.tokens == tokens; });
+
+    if (iterator == snapshots.end()) {
+        return false;
+    }
+
+    // Setting the state replaces the whole sequence, 0 means that it failed and left the sequence empty
+    size_t read = llama_state_seq_set_data(ctx, iterator->state.data(), iterator->state.size(), SEQUENCE_ID);
+
+    if (read == 0) {
+        clear();
+
+        return false;
+    }
+
+    history = iterator->tokens;
+    iterator->lastUse = ++numberOfUses;
+
+    return true;
+}
+
+void Session::clearSnapshots() {
+    snapshots.clear();
+    snapshotBytes = 0;
+}
+
+void Session::restoreBestSnapshot(const llama_tokens& tokens, size_t& numberOfCachedTokens) {
+    const Snapshot* bestSnapshot = nullptr;
+    size_t bestCommonPrefixLength = numberOfCachedTokens;
+
+    for (const Snapshot& snapshot : snapshots) {
+        size_t commonPrefixLength = getCommonPrefixLength(snapshot.tokens, tokens);
+
+        if (commonPrefixLength > bestCommonPrefixLength) {
+            bestSnapshot = &snapshot;
+            bestCommonPrefixLength = commonPrefixLength;
+        }
+    }
+
+    // Copy tokens first, restoring updates the snapshot
+    if (bestSnapshot != nullptr) {
+        llama_tokens snapshotTokens = bestSnapshot->tokens;
+
+        numberOfCachedTokens = restoreSnapshot(snapshotTokens) ? bestCommonPrefixLength : 0;
+    }
+}
@@ -0,0 +1,178 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <cstdint>
+#include <vector>
+#include "llama.h"
+#include "common.h"
+#include "Batch.h"
+
+/**
+ * Class that represents the conversation state of a context, i.e. the tokens whose keys and values are stored in its memory (KV cache).
+ *
+ * Every prompt is compared against the cached tokens first. Only the part after their common prefix is removed from memory and decoded again,
+ * so consecutive messages of a conversation don't need to prefill the whole conversation every time.
+ *
+ * Additionally keeps in-memory snapshots of the state after prefilling long prompts (e.g. the conversation prefix), so that switching back to a prompt
+ * after a different one evicted it from memory only restores the snapshot instead of prefilling it again.
+ *
+ * Long conversations are kept within the context window by `LlamaCpp.formatChat`, which keeps the system prompt and evicts the oldest messages in steps
+ * of half the window. Between two evictions the prompts of a conversation share their prefix, so only the new messages are decoded.
+ * Evicted messages aren't cut out of memory by shifting the positions of the tokens after them: Their keys and values still depend on the evicted
+ * messages, so the logits would depend on the history of the session instead of only on the prompt, and a decoder without that history couldn't reproduce them.
+ *
+ * Encoder and decoder compute the same logits only if llama.cpp results don't depend on how the tokens were split into batches.
+ * This holds for the CPU backend up to rounding of the last bits, which could only flip the rounding of a probability right at a boundary.
+ */
+class Session {
+private:
+    /**
+     * Sequence ID the session stores its tokens in.
+     */
+    static constexpr llama_seq_id SEQUENCE_ID = 0;
+
+    /**
+     * Minimum number of decoded prompt tokens for taking a snapshot. Shorter prompts are faster to prefill again than to copy.
+     */
+    static constexpr size_t MIN_SNAPSHOT_TOKENS = 32;
+
+    /**
+     * Maximum memory of all snapshots together. Least recently used snapshots are dropped first.
+     */
+    static constexpr size_t MAX_SNAPSHOT_BYTES = 64 * 1024 * 1024;
+
+    /**
+     * Struct that represents the state of the sequence after prefilling a prompt.
+     */
+    struct Snapshot {
+        llama_tokens tokens;
+        std::vector<uint8_t> state;
+        uint64_t lastUse = 0;
+    };
+
+    llama_context* ctx;
+
+    /**
+     * Batch that is reused for every decode, allocated once with `llama_n_batch` tokens.
+     */
+    Batch batch;
+
+    /**
+     * Token IDs that are currently stored in the memory of the context, in order of their positions.
+     */
+    llama_tokens history;
+
+    std::vector<Snapshot> snapshots;
+    size_t snapshotBytes = 0;
+    uint64_t numberOfUses = 0;
+
+    /**
+     * Function to restore the snapshot that shares the longest prefix with a prompt, if that prefix is longer than the one shared with the cached tokens.
+     *
+     * @param tokens Token IDs of the prompt.
+     * @param numberOfCachedTokens Length of the common prefix of the prompt and the cached tokens. Is updated if a snapshot was restored.
+     */
+    void restoreBestSnapshot(const llama_tokens& tokens, size_t& numberOfCachedTokens);
+
+    /**
+     * Function to decode tokens after the cached tokens, splitting them into chunks that fit into the batch.
+     *
+     * Tokens are stored at the positions after the cached tokens, so positions always match the history.
+     * If decoding fails, the tokens of the failed chunk are removed from memory again, so that memory and history stay in sync.
+     *
+     * @param tokens Pointer to the token IDs, must not be empty.
+     * @param numberOfTokens Number of token IDs. At most the batch capacity if all logits are needed.
+     * @param hasAllLogits Boolean that is true if the logits for every token are needed, false if only the ones for the last token are needed.
+     * @return The logit matrix, i.e. one row per token if all logits are needed, or the single row of the last token otherwise.
+     * @throws std::length_error If the tokens don't fit into the context window after the cached tokens.
+     * @throws std::runtime_error If llama.cpp fails to decode the tokens.
+     */
+    float* decode(const llama_token* tokens, size_t numberOfTokens, bool hasAllLogits);
+
+public:
+    /**
+     * Constructor for a session. Assumes that the memory of the context is empty.
+     *
+     * @param ctx Memory address of the context.
+     */
+    explicit Session(llama_context* ctx) : ctx(ctx), batch(static_cast<int32_t>(llama_n_batch(ctx))) {}
+
+    /**
+     * Function to calculate the logits for the last token of a prompt, reusing the longest prefix of it that is already stored in memory.
+     *
+     * If the whole prompt is stored already, its last token is decoded again as its logits are overwritten by every decode.
+     *
+     * @param tokens Token IDs of the prompt, must not be empty.
+     * @return The last row of the logit matrix.
+     * @throws std::invalid_argument If the prompt is empty.
+     */
+    float* prefill(const llama_tokens& tokens);
+
+    /**
+     * Function to calculate the logits for a token appended to the cached tokens.
+     *
+     * @param token ID of the token.
+     * @return A vector of logits.
+     */
+    float* append(llama_token token);
+
+    /**
+     * Function to calculate the logits for every token of an array appended to the cached tokens, using a single decode.
+     *
+     * @param tokens Pointer to the token IDs.
+     * @param numberOfTokens Number of token IDs, at most `getBatchCapacity`.
+     * @return The logit matrix with one row per token.
+     */
+    float* appendAll(const llama_token* tokens, int32_t numberOfTokens);
+
+    /**
+     * Function to remove the cached tokens after a position from memory, e.g. rejected draft tokens.
+     *
+     * Memory of some architectures (e.g. recurrent LLMs) can't remove a part of a sequence, the kept tokens are decoded again in that case.
+     *
+     * @param numberOfTokens Number of cached tokens to keep. Does nothing if it isn't less than the number of cached tokens.
+     */
+    void truncate(size_t numberOfTokens);
+
+    /**
+     * Function to remove all tokens from memory. Keeps the snapshots.
+     */
+    void clear();
+
+    /**
+     * Function to take a snapshot of the current state, i.e. to copy the memory of the sequence via `llama_state_seq_get_data`.
+     * Replaces an existing snapshot of the same tokens. Drops least recently used snapshots if the memory limit is exceeded.
+     *
+     * @return Boolean that is true if the snapshot was taken, false if it exceeds the memory limit by itself.
+     */
+    bool saveSnapshot();
+
+    /**
+     * Function to restore a snapshot, i.e. to copy it back into the memory of the sequence via `llama_state_seq_set_data`.
+     *
+     * @param tokens Token IDs of the snapshot.
+     * @return Boolean that is true if a snapshot of these tokens existed and was restored, false otherwise.
+     */
+    bool restoreSnapshot(const llama_tokens& tokens);
+
+    /**
+     * Function to drop all snapshots.
+     */
+    void clearSnapshots();
+
+    /**
+     * @return Maximum number of tokens that can be decoded at once.
+     */
+    int32_t getBatchCapacity() const {
+        return batch.getCapacity();
+    }
+
+    /**
+     * @return Token IDs that are currently stored in the memory of the context.
+     */
+    const llama_tokens& getHistory() const {
+        return history;
+    }
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Class that represents a lock-free, bounded queue between exactly one producer thread and one consumer thread.
+ *
+ * Head is only written by the consumer, tail only by the producer. Release stores publish the element together with the index and are paired with acquire loads
+ * on the other thread, so neither side ever needs a lock. Both indices are on separate cache lines to avoid false sharing.
+ *
+ * @tparam T Type of the elements, should be cheap to copy (e.g. an index).
+ * @tparam CAPACITY Maximum number of elements, has to be a power of 2.
+ */
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+private:
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity has to be a power of 2");
+
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::array<T, CAPACITY> elements {};
+
+    /**
+     * Number of elements popped so far, only written by the consumer.
+     */
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head {0};
+
+    /**
+     * Number of elements pushed so far, only written by the producer.
+     */
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail {0};
+
+public:
+    /**
+     * Function to append an element. May only be called by the producer.
+     *
+     * @param element The element.
+     * @return Boolean that is true if the element was appended, false if the queue is full.
+     */
+    bool push(const T& element) {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+
+        if (currentTail - head.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+
+        elements[currentTail & (CAPACITY - 1)] = element;
+        tail.store(currentTail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Function to remove the oldest element. May only be called by the consumer.
+     *
+     * @param element Is set to the oldest element if there is one.
+     * @return Boolean that is true if an element was removed, false if the queue is empty.
+     */
+    bool pop(T& element) {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+
+        if (currentHead == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        element = elements[currentHead & (CAPACITY - 1)];
+        head.store(currentHead + 1, std::memory_order_release);
+
+        return true;
+    }
+};
+
+#endif
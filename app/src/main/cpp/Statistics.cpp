@@ -1,24 +1,278 @@
 #include <cmath>
+#include <cstring>
 #include "Statistics.h"
-#include "LlamaCpp.h"
+#include "Profiler.h"
 
-double* Statistics::softmax(float* logits, const llama_model* model) {
-    // Use "new" to allocate memory on heap instead of stack, so probabilities aren't deleted when function exits
-    // => Now we need to call the destructor after softmax is used (default array destructor, no need to implement one)
-    auto probabilities = new double[LlamaCpp::getVocabSize(model)];
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define STATISTICS_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define STATISTICS_USE_SSE2
+#endif
 
-    // Calculate normalization factor for denominator
-    // Uses exponential function since it's strictly monotonous in growth, doesn't change ranking of tokens
-    double denominator = 0.0;
+// All code paths below use 4 float lanes (NEON and SSE2 both have 128 bit registers)
+// AVX is deliberately not used: 8 lanes would change the order in which exponentials are summed, so x86_64 senders and arm64 receivers would no longer agree bit for bit
+namespace {
+    // Exponential function is approximated like Cephes expf: exp(x) = 2^n * exp(r) with n = round(x / ln(2)) and |r| <= ln(2)/2, exp(r) via polynomial
+    // Arguments below the lower bound would produce denormals, they are flushed to 0 instead
+    constexpr float EXP_LOWER_BOUND = -87.0f;
+    constexpr float LOG2E = 1.44269504088896341f;
+    constexpr float LN2_HI = 0.693359375f;
+    constexpr float LN2_LO = -2.12194440e-4f;
+    constexpr float P0 = 1.9875691500e-4f;
+    constexpr float P1 = 1.3981999507e-3f;
+    constexpr float P2 = 8.3334519073e-3f;
+    constexpr float P3 = 4.1665795894e-2f;
+    constexpr float P4 = 1.6666665459e-1f;
+    constexpr float P5 = 5.0000001201e-1f;
 
-    for (int32_t token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        denominator += exp(logits[token]);
+    /**
+     * Scalar version of the exponential function approximation. Uses exactly the same operations in the same order as the vectorized versions.
+     *
+     * @param x Argument of the exponential function, expected to be <= 0.
+     * @return Approximation of exp(x).
+     */
+    inline float exponential(float x) {
+        if (x < EXP_LOWER_BOUND) {
+            return 0.0f;
+        }
+
+        float n = std::floor(x * LOG2E + 0.5f);
+
+        float r = x - n * LN2_HI;
+        r = r - n * LN2_LO;
+
+        float p = P0;
+        p = p * r + P1;
+        p = p * r + P2;
+        p = p * r + P3;
+        p = p * r + P4;
+        p = p * r + P5;
+
+        float y = p * r;
+        y = y * r;
+        y = y + r;
+        y = y + 1.0f;
+
+        // Construct 2^n directly from its IEEE 754 bit pattern
+        int32_t bits = (static_cast<int32_t>(n) + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+
+        return y * scale;
+    }
+
+#if defined(STATISTICS_USE_NEON)
+    inline float32x4_t exponential(float32x4_t x) {
+        uint32x4_t isUnderflow = vcltq_f32(x, vdupq_n_f32(EXP_LOWER_BOUND));
+
+        float32x4_t n = vrndmq_f32(vaddq_f32(vmulq_f32(x, vdupq_n_f32(LOG2E)), vdupq_n_f32(0.5f)));
+
+        float32x4_t r = vsubq_f32(x, vmulq_f32(n, vdupq_n_f32(LN2_HI)));
+        r = vsubq_f32(r, vmulq_f32(n, vdupq_n_f32(LN2_LO)));
+
+        float32x4_t p = vdupq_n_f32(P0);
+        p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(P1));
+        p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(P2));
+        p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(P3));
+        p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(P4));
+        p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(P5));
+
+        float32x4_t y = vmulq_f32(p, r);
+        y = vmulq_f32(y, r);
+        y = vaddq_f32(y, r);
+        y = vaddq_f32(y, vdupq_n_f32(1.0f));
+
+        int32x4_t bits = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+        float32x4_t result = vmulq_f32(y, vreinterpretq_f32_s32(bits));
+
+        return vbslq_f32(isUnderflow, vdupq_n_f32(0.0f), result);
+    }
+#elif defined(STATISTICS_USE_SSE2)
+    inline __m128 exponential(__m128 x) {
+        __m128 isUnderflow = _mm_cmplt_ps(x, _mm_set1_ps(EXP_LOWER_BOUND));
+
+        // SSE2 has no floor instruction, so truncate and correct arguments that were rounded up
+        __m128 t = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(LOG2E)), _mm_set1_ps(0.5f));
+        __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+        n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, t), _mm_set1_ps(1.0f)));
+
+        __m128 r = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(LN2_HI)));
+        r = _mm_sub_ps(r, _mm_mul_ps(n, _mm_set1_ps(LN2_LO)));
+
+        __m128 p = _mm_set1_ps(P0);
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(P1));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(P2));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(P3));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(P4));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(P5));
+
+        __m128 y = _mm_mul_ps(p, r);
+        y = _mm_mul_ps(y, r);
+        y = _mm_add_ps(y, r);
+        y = _mm_add_ps(y, _mm_set1_ps(1.0f));
+
+        __m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+        __m128 result = _mm_mul_ps(y, _mm_castsi128_ps(bits));
+
+        return _mm_andnot_ps(isUnderflow, result);
+    }
+#endif
+
+    /**
+     * Function to find the largest logit. Needed to subtract it before exponentiation, so that no exponential can overflow.
+     */
+    float getMaximum(const float* logits, int32_t vocabSize) {
+        int32_t token = 0;
+        float maximum = -INFINITY;
+
+#if defined(STATISTICS_USE_NEON)
+        float32x4_t maximums = vdupq_n_f32(-INFINITY);
+
+        for (; token + 4 <= vocabSize; token += 4) {
+            maximums = vmaxq_f32(maximums, vld1q_f32(logits + token));
+        }
+
+        maximum = vmaxvq_f32(maximums);
+#elif defined(STATISTICS_USE_SSE2)
+        __m128 maximums = _mm_set1_ps(-INFINITY);
+
+        for (; token + 4 <= vocabSize; token += 4) {
+            maximums = _mm_max_ps(maximums, _mm_loadu_ps(logits + token));
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, maximums);
+
+        maximum = std::fmax(std::fmax(lanes[0], lanes[1]), std::fmax(lanes[2], lanes[3]));
+#endif
+
+        // Remaining logits (or all of them if no SIMD is available), order doesn't matter for the maximum
+        for (; token < vocabSize; token++) {
+            maximum = std::fmax(maximum, logits[token]);
+        }
+
+        return maximum;
     }
 
-    // Normalize logits to probabilities
-    for (int32_t token = 0; token < LlamaCpp::getVocabSize(model); token++) {
-        probabilities[token] = exp(logits[token]) / denominator;
+    // Overloads to store 4 exponentials either as float or as double
+#if defined(STATISTICS_USE_NEON)
+    inline void store(float* destination, float32x4_t exponentials) {
+        vst1q_f32(destination, exponentials);
     }
 
-    return probabilities;
+    inline void store(double* destination, float32x4_t exponentials) {
+        vst1q_f64(destination, vcvt_f64_f32(vget_low_f32(exponentials)));
+        vst1q_f64(destination + 2, vcvt_high_f64_f32(exponentials));
+    }
+#elif defined(STATISTICS_USE_SSE2)
+    inline void store(float* destination, __m128 exponentials) {
+        _mm_storeu_ps(destination, exponentials);
+    }
+
+    inline void store(double* destination, __m128 exponentials) {
+        _mm_storeu_pd(destination, _mm_cvtps_pd(exponentials));
+        _mm_storeu_pd(destination + 2, _mm_cvtps_pd(_mm_movehl_ps(exponentials, exponentials)));
+    }
+#endif
+
+    /**
+     * Function to store exp((logit - maximum) / temperature) for every logit and to sum them up in the same pass.
+     *
+     * Every lane sums every 4th exponential in double precision, remaining exponentials are summed separately.
+     * Lanes are combined in a fixed order, so all code paths produce the same sum.
+     */
+    template <typename T>
+    double exponentiate(const float* logits, int32_t vocabSize, float maximum, float inverseTemperature, T* exponentials) {
+        int32_t token = 0;
+        double laneSums[4] = {0.0, 0.0, 0.0, 0.0};
+
+#if defined(STATISTICS_USE_NEON)
+        float32x4_t maximums = vdupq_n_f32(maximum);
+        float32x4_t inverseTemperatures = vdupq_n_f32(inverseTemperature);
+        float64x2_t sumsLow = vdupq_n_f64(0.0);
+        float64x2_t sumsHigh = vdupq_n_f64(0.0);
+
+        for (; token + 4 <= vocabSize; token += 4) {
+            float32x4_t x = vmulq_f32(vsubq_f32(vld1q_f32(logits + token), maximums), inverseTemperatures);
+            float32x4_t e = exponential(x);
+
+            store(exponentials + token, e);
+
+            sumsLow = vaddq_f64(sumsLow, vcvt_f64_f32(vget_low_f32(e)));
+            sumsHigh = vaddq_f64(sumsHigh, vcvt_high_f64_f32(e));
+        }
+
+        vst1q_f64(laneSums, sumsLow);
+        vst1q_f64(laneSums + 2, sumsHigh);
+#elif defined(STATISTICS_USE_SSE2)
+        __m128 maximums = _mm_set1_ps(maximum);
+        __m128 inverseTemperatures = _mm_set1_ps(inverseTemperature);
+        __m128d sumsLow = _mm_setzero_pd();
+        __m128d sumsHigh = _mm_setzero_pd();
+
+        for (; token + 4 <= vocabSize; token += 4) {
+            __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(logits + token), maximums), inverseTemperatures);
+            __m128 e = exponential(x);
+
+            store(exponentials + token, e);
+
+            sumsLow = _mm_add_pd(sumsLow, _mm_cvtps_pd(e));
+            sumsHigh = _mm_add_pd(sumsHigh, _mm_cvtps_pd(_mm_movehl_ps(e, e)));
+        }
+
+        _mm_storeu_pd(laneSums, sumsLow);
+        _mm_storeu_pd(laneSums + 2, sumsHigh);
+#else
+        for (; token + 4 <= vocabSize; token += 4) {
+            for (int lane = 0; lane < 4; lane++) {
+                float e = exponential((logits[token + lane] - maximum) * inverseTemperature);
+
+                exponentials[token + lane] = e;
+                laneSums[lane] += static_cast<double>(e);
+            }
+        }
+#endif
+
+        double remainderSum = 0.0;
+
+        for (; token < vocabSize; token++) {
+            float e = exponential((logits[token] - maximum) * inverseTemperature);
+
+            exponentials[token] = e;
+            remainderSum += static_cast<double>(e);
+        }
+
+        return ((laneSums[0] + laneSums[1]) + (laneSums[2] + laneSums[3])) + remainderSum;
+    }
+
+    template <typename T>
+    void softmax(const float* logits, int32_t vocabSize, T* probabilities, float temperature) {
+        // Subtracting the maximum doesn't change the probabilities, but keeps every exponential in (0, 1]
+        float maximum = getMaximum(logits, vocabSize);
+
+        // Calculate normalization factor for denominator in the same pass as the exponentials, so each is only computed once
+        // Uses exponential function since it's strictly monotonous in growth, doesn't change ranking of tokens
+        double denominator = exponentiate(logits, vocabSize, maximum, 1.0f / temperature, probabilities);
+
+        // Normalize exponentials to probabilities, simple loop is auto-vectorized by the compiler
+        T inverseDenominator = static_cast<T>(1.0 / denominator);
+
+        for (int32_t token = 0; token < vocabSize; token++) {
+            probabilities[token] *= inverseDenominator;
+        }
+    }
+}
+
+void Statistics::softmax(const float* logits, int32_t vocabSize, double* probabilities, float temperature) {
+    Profiler::Scope scope(Profiler::Stage::Softmax);
+
+    ::softmax(logits, vocabSize, probabilities, temperature);
+}
+
+void Statistics::softmax(const float* logits, int32_t vocabSize, float* probabilities, float temperature) {
+    Profiler::Scope scope(Profiler::Stage::Softmax);
+
+    ::softmax(logits, vocabSize, probabilities, temperature);
 }
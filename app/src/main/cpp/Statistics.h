@@ -9,13 +9,28 @@
 class Statistics {
 public:
     /**
-     * Function to normalize logits to probabilities.
+     * Function to normalize logits to probabilities, scaling the logits with 1/temperature first.
+     *
+     * Doesn't allocate any memory, but writes into a buffer provided by the caller so that it can be reused for every token.
+     * Uses NEON on arm64-v8a and SSE2 on x86_64 to compute the maximum, exponentials and their sum in vectorized passes.
+     * Both use the same exponential approximation and lane structure as the scalar fallback, so results are identical across ABIs.
+     *
+     * @param logits An array of logits.
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM (= length of logits and probabilities).
+     * @param probabilities Buffer of length `vocabSize` to store the probabilities in.
+     * @param temperature The temperature parameter for token sampling. Must be greater than 0.
+     */
+    static void softmax(const float* logits, int32_t vocabSize, double* probabilities, float temperature = 1.0f);
+
+    /**
+     * Function to normalize logits to probabilities, scaling the logits with 1/temperature first. Float32 version of the function above.
      *
      * @param logits An array of logits.
-     * @param model Memory address of the LLM.
-     * @return The array of probabilities.
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM (= length of logits and probabilities).
+     * @param probabilities Buffer of length `vocabSize` to store the probabilities in.
+     * @param temperature The temperature parameter for token sampling. Must be greater than 0.
      */
-    static double* softmax(float* logits, const llama_model* model);
+    static void softmax(const float* logits, int32_t vocabSize, float* probabilities, float temperature = 1.0f);
 };
 
 #endif
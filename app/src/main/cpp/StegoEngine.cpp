@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "StegoEngine.h"
+#include "IncrementalDecoder.h"
+#include "LlamaCpp.h"
+#include "Selection.h"
+#include "Statistics.h"
+
+std::mutex StegoEngine::registryMutex;
+std::unordered_map<const llama_context*, std::unique_ptr<StegoEngine>> StegoEngine::registry;
+
+StegoEngine::StegoEngine(llama_context* ctx)
+    : ctx(ctx),
+      model(llama_get_model(ctx)),
+      vocabInfo(VocabInfo::get(model)),
+      workspace(vocabInfo.vocabSize),
+      session(ctx) {}
+
+void StegoEngine::load(llama_context* ctx) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    if (registry.find(ctx) == registry.end()) {
+        registry.emplace(ctx, std::make_unique<StegoEngine>(ctx));
+    }
+}
+
+void StegoEngine::unload(const llama_context* ctx) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    registry.erase(ctx);
+}
+
+StegoEngine& StegoEngine::get(llama_context* ctx) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    auto iterator = registry.find(ctx);
+
+    if (iterator == registry.end()) {
+        iterator = registry.emplace(ctx, std::make_unique<StegoEngine>(ctx)).first;
+    }
+
+    return *iterator->second;
+}
+
+void StegoEngine::calculateProbabilities(const llama_tokens& contextTokens, llama_token lastToken, bool isFirstRun, float temperature) {
+    // Call llama.cpp to calculate the logit matrix similar to https://github.com/ggml-org/llama.cpp/blob/master/examples/simple/simple.cpp:
+    // Needs only next tokens to be processed to store in a batch, i.e. contextTokens in first run and last cover text token in subsequent runs, rest is managed internally in ctx
+    // Session only decodes the part of the context tokens that isn't cached from the previous run
+    // Only last row of logit matrix is needed as it contains logits corresponding to last token of the prompt
+    float* logits = isFirstRun ? session.prefill(contextTokens) : session.append(lastToken);
+
+    calculateProbabilities(logits, temperature);
+}
+
+void StegoEngine::calculateProbabilities(const float* logits, float temperature) {
+    // Normalize logits to probabilities, scaling logits with 1/temperature in the same pass
+    Statistics::softmax(logits, vocabInfo.vocabSize, workspace.probabilities.data(), temperature);
+
+    // Suppress special tokens to avoid early termination before all bits of secret message are encoded
+    LlamaCpp::suppressSpecialTokens(workspace.probabilities.data(), model);
+}
+
+llama_tokens StegoEngine::getPromptTokens(const llama_tokens& contextTokens, bool isResumed) const {
+    // Resumed run continues after the last token of the previous run, which is decoded again to get its logits
+    // Nothing to resume from if the session is empty, so fall back to the context tokens then
+    if (isResumed && !session.getHistory().empty()) {
+        return session.getHistory();
+    }
+
+    return contextTokens;
+}
+
+llama_tokens StegoEngine::draftTokens(llama_token lastToken, size_t maxNumberOfTokens) const {
+    const llama_tokens& history = session.getHistory();
+
+    // Search in the cached tokens followed by the last token
+    size_t numberOfTokens = history.size() + 1;
+    auto getToken = [&history, lastToken](size_t position) { return position < history.size() ? history[position] : lastToken; };
+
+    llama_tokens draft;
+
+    for (size_t lookupSize = std::min(MAX_LOOKUP_SIZE, numberOfTokens - 1); lookupSize > 0; lookupSize--) {
+        size_t lookupStart = numberOfTokens - lookupSize;
+
+        // Search backwards so that the most recent occurrence is found first, every occurrence is followed by at least one token
+        for (size_t start = lookupStart; start-- > 0;) {
+            bool isMatch = true;
+
+            for (size_t i = 0; i < lookupSize && isMatch; i++) {
+                isMatch = getToken(start + i) == getToken(lookupStart + i);
+            }
+
+            if (isMatch) {
+                for (size_t position = start + lookupSize; position < numberOfTokens && draft.size() < maxNumberOfTokens; position++) {
+                    draft.push_back(getToken(position));
+                }
+
+                return draft;
+            }
+        }
+    }
+
+    return draft;
+}
+
+llama_tokens StegoEngine::encode(const llama_tokens& contextTokens, const BitStream& cipherBits, Coder& coder, bool shouldFinishLastSentence, bool isResumed, EncodeListener* listener) {
+    // Initialize vector to store cover text tokens
+    llama_tokens coverTextTokens;
+
+    coder.reset();
+
+    // Initialize variables and flags for loop
+    llama_tokens promptTokens = getPromptTokens(contextTokens, isResumed);
+
+    BitReader cipherBitReader(cipherBits);
+    bool isLastSentenceFinished = false;
+    bool isStopped = false;
+
+    bool isFirstRun = true;             // llama.cpp batch needs to store context tokens in first run, but only last sampled token in subsequent runs
+    llama_token sampledToken = -1;      // Will always be overwritten with last cover text token
+
+    // Removing rejected draft tokens from the memory of recurrent LLMs means decoding everything again, so don't draft for them
+    bool isDraftingEnabled = !llama_model_is_recurrent(model);
+    size_t maxNumberOfDraftTokens = std::min(MAX_DRAFT_TOKENS, static_cast<size_t>(session.getBatchCapacity() - 1));
+
+    // Append picked token to cover text tokens, return false if encoding stops after it
+    auto pickToken = [&](llama_token token) {
+        coverTextTokens.push_back(token);
+
+        if (coder.isEndOfStream(token)) {
+            return false;
+        }
+
+        // Stream the token and check for cancellation once per step
+        return listener == nullptr || listener->onToken(token);
+    };
+
+    // Sample tokens until all bits of secret message are encoded and last sentence is finished (if requested)
+    while (!isStopped && (cipherBitReader.hasRemainingBits() || (shouldFinishLastSentence && !isLastSentenceFinished))) {
+        // Coder samples tokens to encode bits of secret message into them
+        if (cipherBitReader.hasRemainingBits()) {
+            calculateProbabilities(promptTokens, sampledToken, isFirstRun, coder.getTemperature());
+
+            sampledToken = coder.encodeToken(workspace, cipherBitReader);
+
+            isStopped = !pickToken(sampledToken);
+        }
+        // Greedy sampling to pick most likely tokens until last sentence is finished
+        else {
+            // Feed the last token followed by the draft, every row of the logit matrix then predicts the token after the corresponding fed token
+            llama_tokens fedTokens;
+            const float* logits;
+
+            if (isFirstRun) {
+                logits = session.prefill(promptTokens);
+            }
+            else {
+                fedTokens.push_back(sampledToken);
+
+                if (isDraftingEnabled) {
+                    llama_tokens draft = draftTokens(sampledToken, maxNumberOfDraftTokens);
+
+                    fedTokens.insert(fedTokens.end(), draft.begin(), draft.end());
+                }
+
+                logits = fedTokens.size() == 1 ? session.append(sampledToken) : session.appendAll(fedTokens.data(), static_cast<int32_t>(fedTokens.size()));
+            }
+
+            // Accept draft tokens as long as they are the predicted ones, the first prediction that differs is picked instead
+            size_t numberOfRows = std::max(fedTokens.size(), static_cast<size_t>(1));
+            size_t row = 0;
+
+            for (;; row++) {
+                // Softmax doesn't change the order of the tokens, so the most likely token can be picked from the logits directly
+                sampledToken = Selection::getTopLogit(logits + row * static_cast<size_t>(vocabInfo.vocabSize), vocabInfo.vocabSize, vocabInfo.specialTokenMask);
+
+                // Update flags
+                isLastSentenceFinished = vocabInfo.endOfSentenceMask[sampledToken];
+                isStopped = !pickToken(sampledToken);
+
+                if (isStopped || isLastSentenceFinished || row + 1 == numberOfRows || fedTokens[row + 1] != sampledToken) {
+                    break;
+                }
+            }
+
+            // Remove the fed tokens after the last accepted one, so that memory again holds every cover text token except the last one
+            session.truncate(session.getHistory().size() - (numberOfRows - 1 - row));
+        }
+
+        // Update flag
+        isFirstRun = false;
+    }
+
+    return coverTextTokens;
+}
+
+BitStream StegoEngine::decode(const llama_tokens& contextTokens, const llama_tokens& coverTextTokens, Coder& coder, int numberOfCipherBits, bool isResumed) {
+    // Feed all cover text tokens at once, so the incremental decoder teacher-forces them in as few chunks as possible
+    IncrementalDecoder decoder(*this, coder, contextTokens, static_cast<size_t>(std::max(0, numberOfCipherBits)), isResumed);
+
+    decoder.feed(coverTextTokens, true);
+
+    return decoder.getCipherBits();
+}
@@ -0,0 +1,179 @@
+#ifndef STEGO_ENGINE_H
+#define STEGO_ENGINE_H
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "llama.h"
+#include "common.h"
+#include "BitStream.h"
+#include "Coder.h"
+#include "EncodeListener.h"
+#include "Session.h"
+#include "StegoWorkspace.h"
+#include "VocabInfo.h"
+
+/**
+ * Class that represents the steganography pipeline of a context, shared by all coders.
+ *
+ * Runs the steps that are the same for every mode (logits, softmax, suppression of special tokens, greedy tail) and delegates mapping bits to tokens and back to a `Coder`.
+ * Keeps a session of the context, so that consecutive calls only decode the tokens that differ from the previous call.
+ * Doesn't depend on JNI, so it can also be used from native tools.
+ */
+class StegoEngine {
+private:
+    // Decode with the workspace and session of the engine
+    friend class BestOfEncoder;
+    friend class CodingPipeline;
+    friend class IncrementalDecoder;
+    friend class MultiSequenceDecoder;
+
+    /**
+     * Mutex to guard the registry, as contexts can be loaded and unloaded from different threads.
+     */
+    static std::mutex registryMutex;
+
+    /**
+     * Registry that maps the memory address of every loaded context to its engine.
+     */
+    static std::unordered_map<const llama_context*, std::unique_ptr<StegoEngine>> registry;
+
+    /**
+     * Maximum number of tokens at the end of the cover text that are looked up in the earlier tokens to draft the greedy tail.
+     */
+    static constexpr size_t MAX_LOOKUP_SIZE = 3;
+
+    /**
+     * Maximum number of draft tokens verified per decode of the greedy tail.
+     */
+    static constexpr size_t MAX_DRAFT_TOKENS = 8;
+
+    llama_context* ctx;
+    const llama_model* model;
+    const VocabInfo& vocabInfo;
+    StegoWorkspace workspace;
+    Session session;
+
+    /**
+     * Function to calculate the probabilities for the next token and store them in the workspace.
+     *
+     * @param contextTokens Token IDs of the context, only processed in the first run. Cached tokens of the session are reused.
+     * @param lastToken ID of the last cover text token, processed in all subsequent runs.
+     * @param isFirstRun Boolean that is true if the context tokens need to be processed, false otherwise.
+     * @param temperature Temperature to scale the logits with.
+     */
+    void calculateProbabilities(const llama_tokens& contextTokens, llama_token lastToken, bool isFirstRun, float temperature);
+
+    /**
+     * Function to normalize a row of logits to probabilities and store them in the workspace.
+     *
+     * @param logits Logits for the next token.
+     * @param temperature Temperature to scale the logits with.
+     */
+    void calculateProbabilities(const float* logits, float temperature);
+
+    /**
+     * Function to get the tokens to prefill in the first run.
+     *
+     * @param contextTokens Token IDs of the context.
+     * @param isResumed Boolean that is true if the run continues after the cached tokens of the session, false otherwise.
+     * @return The context tokens, or the cached tokens of the session if the run is resumed.
+     */
+    llama_tokens getPromptTokens(const llama_tokens& contextTokens, bool isResumed) const;
+
+    /**
+     * Function to draft the next tokens of the greedy tail by prompt lookup, i.e. by finding the most recent earlier occurrence of the last tokens
+     * in the cached tokens and proposing the tokens that followed it. Longer matches are tried first.
+     *
+     * @param lastToken ID of the last cover text token, which isn't cached yet.
+     * @param maxNumberOfTokens Maximum number of draft tokens.
+     * @return Token IDs of the draft, empty if the last tokens don't occur earlier.
+     */
+    llama_tokens draftTokens(llama_token lastToken, size_t maxNumberOfTokens) const;
+
+public:
+    /**
+     * Constructor for an engine. Allocates the workspace and looks up the vocabulary metadata of the LLM of the context.
+     *
+     * @param ctx Memory address of the context.
+     */
+    explicit StegoEngine(llama_context* ctx);
+
+    /**
+     * Function to create the engine of a context and store it in the registry. Does nothing if it is already stored.
+     *
+     * @param ctx Memory address of the context.
+     */
+    static void load(llama_context* ctx);
+
+    /**
+     * Function to remove the engine of a context from the registry. Needs to be called before the context is unloaded.
+     *
+     * @param ctx Memory address of the context.
+     */
+    static void unload(const llama_context* ctx);
+
+    /**
+     * Function to get the engine of a context. Creates it first if the context was loaded without calling `StegoEngine::load`.
+     *
+     * @param ctx Memory address of the context.
+     * @return The engine of the context.
+     */
+    static StegoEngine& get(llama_context* ctx);
+
+    /**
+     * @return Memory address of the context.
+     */
+    llama_context* getContext() const {
+        return ctx;
+    }
+
+    /**
+     * @return The session of the context.
+     */
+    Session& getSession() {
+        return session;
+    }
+
+    /**
+     * @return Memory address of the LLM.
+     */
+    const llama_model* getModel() const {
+        return model;
+    }
+
+    /**
+     * Function to encode cipher bits into cover text tokens.
+     *
+     * The greedy tail is deterministic, so it is sped up by speculative decoding: Tokens drafted by prompt lookup are verified with a single decode,
+     * and picked by an argmax over the logits instead of softmax, suppression of special tokens and selection. Picks the same tokens as without drafting.
+     *
+     * @param contextTokens Token IDs of the context.
+     * @param cipherBits Cipher bits to encode.
+     * @param coder Coder that maps the cipher bits to tokens.
+     * @param shouldFinishLastSentence Boolean that is true if the last sentence is finished by greedy sampling after all bits are encoded, false if encoding stops immediately.
+     * @param isResumed Boolean that is true if the run continues after the tokens processed by the previous run (i.e. context tokens are ignored), false otherwise.
+     * @param listener Listener to notify about every picked token, can cancel encoding. Optional.
+     * @return Token IDs of the cover text, up to the last picked token if encoding was cancelled.
+     */
+    llama_tokens encode(const llama_tokens& contextTokens, const BitStream& cipherBits, Coder& coder, bool shouldFinishLastSentence, bool isResumed, EncodeListener* listener = nullptr);
+
+    /**
+     * Function to decode cover text tokens into cipher bits.
+     *
+     * As all cover text tokens are known up front, they are teacher-forced: Instead of one decode per token, chunks of up to `llama_n_batch` tokens
+     * are decoded at once with logits for every position, and the coder walks the rows of the resulting logit matrix.
+     * Same as feeding all tokens to an `IncrementalDecoder` at once.
+     *
+     * @param contextTokens Token IDs of the context.
+     * @param coverTextTokens Token IDs of the cover text.
+     * @param coder Coder that maps the tokens to cipher bits.
+     * @param numberOfCipherBits Number of cipher bits after which decoding stops early, 0 to decode all cover text tokens.
+     * @param isResumed Boolean that is true if the run continues after the tokens processed by the previous run (i.e. context tokens are ignored), false otherwise.
+     * @return The cipher bits.
+     * @throws std::invalid_argument If a cover text token can't be decoded.
+     */
+    BitStream decode(const llama_tokens& contextTokens, const llama_tokens& coverTextTokens, Coder& coder, int numberOfCipherBits, bool isResumed);
+};
+
+#endif
@@ -0,0 +1,11 @@
+#include "StegoWorkspace.h"
+
+StegoWorkspace::StegoWorkspace(int32_t vocabSize) {
+    // Probabilities are written by index, so the buffer needs its full length
+    probabilities.resize(vocabSize);
+
+    // Other buffers are cleared and refilled in every step, so only reserve memory for the worst case (top k = n_vocab)
+    topProbabilities.reserve(vocabSize);
+    roundedProbabilities.reserve(vocabSize);
+    cumulatedProbabilities.reserve(vocabSize);
+}
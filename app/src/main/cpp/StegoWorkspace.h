@@ -0,0 +1,58 @@
+#ifndef STEGO_WORKSPACE_H
+#define STEGO_WORKSPACE_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "llama.h"
+#include "HuffmanCoding.h"
+
+/**
+ * Class that represents the buffers needed in every step of steganography encoding/decoding.
+ *
+ * Owned by the `StegoEngine` of a context and sized once based on the vocabulary size of its LLM, so that the encode/decode loops don't need to allocate memory for every token.
+ */
+class StegoWorkspace {
+public:
+    /**
+     * Probabilities for the last token of the prompt (= last row of logits matrix after normalization). Has length `n_vocab`.
+     */
+    std::vector<double> probabilities;
+
+    /**
+     * Top probabilities and the corresponding token IDs, selected from `probabilities`. Has capacity `n_vocab`.
+     */
+    std::vector<std::pair<llama_token, double>> topProbabilities;
+
+    /**
+     * Top probabilities quantized to integer frequencies that fill the current interval of arithmetic coding. Has capacity `n_vocab`.
+     */
+    std::vector<std::pair<llama_token, long long>> roundedProbabilities;
+
+    /**
+     * Cumulated probabilities (= sub-intervals of the current interval) of arithmetic coding. Has capacity `n_vocab`.
+     */
+    std::vector<std::pair<llama_token, long long>> cumulatedProbabilities;
+
+    /**
+     * Huffman coding with pooled nodes, rebuilt in every step of Huffman encoding/decoding.
+     */
+    HuffmanCoding huffmanCoding;
+
+    /**
+     * Logit rows of the slots of a `CodingPipeline`. Allocated by the first pipeline of the engine and reused by all later ones.
+     * Isn't value-initialized, so only the pages of rows that are actually copied are touched.
+     */
+    std::unique_ptr<float[]> pipelineLogits;
+    size_t pipelineLogitsSize = 0;
+
+    /**
+     * Constructor for a workspace. Allocates all buffers for the given vocabulary size.
+     *
+     * @param vocabSize Vocabulary size `n_vocab` of the LLM.
+     */
+    explicit StegoWorkspace(int32_t vocabSize);
+};
+
+#endif
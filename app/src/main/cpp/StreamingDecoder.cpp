@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <jni.h>
+#include "ArithmeticCoder.h"
+#include "BitStream.h"
+#include "Profiler.h"
+#include "common.h"
+#include "Exceptions.h"
+#include "Format.h"
+#include "HuffmanCoder.h"
+#include "IncrementalDecoder.h"
+#include "LlamaCppJni.h"
+#include "StegoEngine.h"
+
+namespace {
+    /**
+     * Struct that represents a streaming decoder as seen from Kotlin, i.e. the incremental decoder together with the coder it owns.
+     */
+    struct StreamingDecoder {
+        std::unique_ptr<Coder> coder;
+        IncrementalDecoder decoder;
+
+        StreamingDecoder(StegoEngine& engine, std::unique_ptr<Coder> coder, const llama_tokens& contextTokens, size_t numberOfCipherBits, bool isResumed)
+            : coder(std::move(coder)),
+              decoder(engine, *this->coder, contextTokens, numberOfCipherBits, isResumed) {}
+    };
+
+    /**
+     * Function to create a streaming decoder on the heap and return its memory address to Kotlin.
+     */
+    jlong create(JNIEnv* env, jbyteArray jContext, std::unique_ptr<Coder> coder, llama_context* cppCtx, jint jNumberOfCipherBits, jboolean jIsResumed) {
+        StegoEngine& engine = StegoEngine::get(cppCtx);
+
+        llama_tokens contextTokens = LlamaCppJni::tokenize(env, jContext, cppCtx);
+
+        auto numberOfCipherBits = static_cast<size_t>(jNumberOfCipherBits > 0 ? jNumberOfCipherBits : 0);
+        auto cppDecoder = new StreamingDecoder(engine, std::move(coder), contextTokens, numberOfCipherBits, jIsResumed);
+
+        return reinterpret_cast<jlong>(cppDecoder);
+    }
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_org_vonderheidt_hips_utils_StreamingDecoder_createArithmetic(JNIEnv* env, jobject /* thiz */, jbyteArray jContext, jfloat jTemperature, jint jTopK, jint jPrecision, jlong jCtx, jint jNumberOfCipherBits, jboolean jIsResumed) {
+    try {
+        auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+
+        // Only used for steganography, binary conversion still goes through Arithmetic.decode
+        auto coder = std::make_unique<ArithmeticCoder>(llama_get_model(cppCtx), jTemperature, jTopK, jPrecision, false);
+
+        return create(env, jContext, std::move(coder), cppCtx, jNumberOfCipherBits, jIsResumed);
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
+
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_org_vonderheidt_hips_utils_StreamingDecoder_createHuffman(JNIEnv* env, jobject /* thiz */, jbyteArray jContext, jint jMinBitsPerToken, jint jMaxBitsPerToken, jlong jCtx, jint jNumberOfCipherBits, jboolean jIsResumed) {
+    try {
+        auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+
+        auto coder = std::make_unique<HuffmanCoder>(jMinBitsPerToken, jMaxBitsPerToken);
+
+        return create(env, jContext, std::move(coder), cppCtx, jNumberOfCipherBits, jIsResumed);
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
+
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_StreamingDecoder_feed(JNIEnv* env, jobject /* thiz */, jlong jDecoder, jbyteArray jCoverText, jlong jCtx, jboolean jIsLastFeed) {
+    auto cppDecoder = reinterpret_cast<StreamingDecoder*>(jDecoder);
+    auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+
+    // Measure the stages of this call if profiling is enabled, see LlamaCpp.getStats
+    Profiler::Operation operation("StreamingDecoder.feed", cppCtx);
+
+    try {
+        llama_tokens coverTextTokens = LlamaCppJni::tokenize(env, jCoverText, cppCtx);
+
+        cppDecoder->decoder.feed(coverTextTokens, jIsLastFeed);
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
+    }
+}
+
+extern "C" JNIEXPORT jbyteArray JNICALL Java_org_vonderheidt_hips_utils_StreamingDecoder_pull(JNIEnv* env, jobject /* thiz */, jlong jDecoder, jint jMaxNumberOfBits) {
+    try {
+        auto cppDecoder = reinterpret_cast<StreamingDecoder*>(jDecoder);
+
+        // Only pull complete bytes, the rest stays available for the next call
+        size_t numberOfBits = std::min(static_cast<size_t>(jMaxNumberOfBits > 0 ? jMaxNumberOfBits : 0), cppDecoder->decoder.getNumberOfAvailableBits());
+        numberOfBits -= numberOfBits % 8;
+
+        BitStream cppCipherBits = cppDecoder->decoder.pull(numberOfBits);
+
+        return Format::asByteArray(env, cppCipherBits);
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
+
+        return nullptr;
+    }
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_StreamingDecoder_getNumberOfAvailableBits(JNIEnv* /* env */, jobject /* thiz */, jlong jDecoder) {
+    auto cppDecoder = reinterpret_cast<StreamingDecoder*>(jDecoder);
+
+    return static_cast<jint>(cppDecoder->decoder.getNumberOfAvailableBits());
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_org_vonderheidt_hips_utils_StreamingDecoder_isComplete(JNIEnv* /* env */, jobject /* thiz */, jlong jDecoder) {
+    auto cppDecoder = reinterpret_cast<StreamingDecoder*>(jDecoder);
+
+    return cppDecoder->decoder.isComplete();
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_StreamingDecoder_destroy(JNIEnv* /* env */, jobject /* thiz */, jlong jDecoder) {
+    delete reinterpret_cast<StreamingDecoder*>(jDecoder);
+}
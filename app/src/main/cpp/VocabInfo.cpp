@@ -0,0 +1,102 @@
+#include "VocabInfo.h"
+
+std::mutex VocabInfo::registryMutex;
+std::unordered_map<const llama_model*, std::unique_ptr<VocabInfo>> VocabInfo::registry;
+
+VocabInfo::VocabInfo(const llama_model* model) {
+    // Get vocabulary of the LLM
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+
+    vocabSize = llama_vocab_n_tokens(vocab);
+
+    // Reserve memory ahead of time as every vector covers the whole vocabulary
+    specialTokenMask.resize(vocabSize, false);
+    endOfSentenceMask.resize(vocabSize, false);
+    detokenizations.reserve(vocabSize);
+
+    // FNV-1a hash over all detokenizations for the fingerprint
+    uint64_t hash = 14695981039346656037ULL;
+
+    // Scan the vocabulary once, so that no function needs to loop over it again
+    for (llama_token token = 0; token < vocabSize; token++) {
+        // Detokenize the token the same way as LlamaCpp::detokenize does
+        // See common.cpp: common_detokenize calls llama_detokenize, with parameters "remove_special = false" hard-coded and "unparse_special = special" passed through
+        detokenizations.push_back(common_detokenize(vocab, std::vector<llama_token>{token}, true));
+
+        const std::string& detokenization = detokenizations.back();
+
+        for (char character : detokenization) {
+            hash = (hash ^ static_cast<uint8_t>(character)) * 1099511628211ULL;
+        }
+
+        // Hash the length as well, so that moving a byte from one token to the next changes the hash
+        hash = (hash ^ detokenization.size()) * 1099511628211ULL;
+
+        // Check if token is special, i.e. end-of-generation (eog) or control token
+        bool isEog = llama_vocab_is_eog(vocab, token);
+
+        if (isEog || llama_vocab_is_control(vocab, token)) {
+            specialTokenMask[token] = true;
+            specialTokens.push_back(token);
+        }
+
+        // If the token has multiple eog tokens, keep the first one
+        if (isEog && endOfGeneration == -1) {
+            endOfGeneration = token;
+        }
+
+        // Check if detokenization ends with a punctuation mark (covers "?" vs " ?" etc)
+        // Some tokens detokenize to an empty string, so check that first instead of calling back() on it
+        endOfSentenceMask[token] = !detokenization.empty()
+                                   && (detokenization.back() == '.'
+                                       || detokenization.back() == '?'
+                                       || detokenization.back() == '!');
+
+        // Only checks if detokenization contains the ASCII NUL character
+        // Checking if it is equal to it would require constructing a string that only contains the NUL char, which conflicts with C/C++ strings being NUL-terminated
+        if (asciiNul == -1 && detokenization.find('\0') != std::string::npos) {
+            asciiNul = token;
+        }
+
+        if (asciiStx == -1 && detokenization == "\x02") {
+            asciiStx = token;
+        }
+
+        if (asciiEtx == -1 && detokenization == "\x03") {
+            asciiEtx = token;
+        }
+    }
+
+    hash = (hash ^ llama_model_n_params(model)) * 1099511628211ULL;
+
+    // Fold the upper half of the hash into the lower one
+    fingerprint = static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+void VocabInfo::load(const llama_model* model) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    if (registry.find(model) == registry.end()) {
+        registry.emplace(model, std::make_unique<VocabInfo>(model));
+    }
+}
+
+void VocabInfo::unload(const llama_model* model) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    registry.erase(model);
+}
+
+const VocabInfo& VocabInfo::get(const llama_model* model) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    auto iterator = registry.find(model);
+
+    // Fall back to building the metadata now if the LLM wasn't loaded via JNI (e.g. in native tools)
+    if (iterator == registry.end()) {
+        iterator = registry.emplace(model, std::make_unique<VocabInfo>(model)).first;
+    }
+
+    // Metadata is stored via unique_ptr, so the reference stays valid even if the registry rehashes
+    return *iterator->second;
+}
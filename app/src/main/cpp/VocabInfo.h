@@ -0,0 +1,114 @@
+#ifndef VOCAB_INFO_H
+#define VOCAB_INFO_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "llama.h"
+#include "common.h"
+
+/**
+ * Class that represents metadata about the vocabulary of an LLM.
+ *
+ * Built once per LLM when it is loaded, so that encode/decode loops only need constant-time lookups instead of scanning the whole vocabulary for every token.
+ */
+class VocabInfo {
+private:
+    /**
+     * Mutex to guard the registry, as LLMs can be loaded and unloaded from different threads.
+     */
+    static std::mutex registryMutex;
+
+    /**
+     * Registry that maps the memory address of every loaded LLM to its vocabulary metadata.
+     */
+    static std::unordered_map<const llama_model*, std::unique_ptr<VocabInfo>> registry;
+
+public:
+    /**
+     * Vocabulary size `n_vocab` of the LLM (i.e. the number of available tokens).
+     */
+    int32_t vocabSize = 0;
+
+    /**
+     * Bitmask over the vocabulary that is true for special tokens, i.e. end-of-generation (eog) and control tokens.
+     */
+    std::vector<bool> specialTokenMask;
+
+    /**
+     * Token IDs of all special tokens. Allows suppressing them without looping over the whole vocabulary.
+     */
+    llama_tokens specialTokens;
+
+    /**
+     * Bitmask over the vocabulary that is true for tokens whose detokenization ends with `.`, `!` or `?`.
+     */
+    std::vector<bool> endOfSentenceMask;
+
+    /**
+     * Detokenization of every single token in the vocabulary.
+     */
+    std::vector<std::string> detokenizations;
+
+    /**
+     * ID of the first end-of-generation (eog) token, -1 if the LLM doesn't have one.
+     */
+    llama_token endOfGeneration = -1;
+
+    /**
+     * ID of the first token whose detokenization contains the ASCII NUL character, -1 if the vocabulary doesn't contain one.
+     */
+    llama_token asciiNul = -1;
+
+    /**
+     * ID of the first token whose detokenization is the ASCII STX (start-of-text) character, -1 if the vocabulary doesn't contain one.
+     */
+    llama_token asciiStx = -1;
+
+    /**
+     * ID of the first token whose detokenization is the ASCII ETX (end-of-text) character, -1 if the vocabulary doesn't contain one.
+     */
+    llama_token asciiEtx = -1;
+
+    /**
+     * Fingerprint of the LLM, i.e. a hash of its vocabulary and its number of parameters folded to 32 bits.
+     * Stored in the header of arithmetic compression, so that decompression can check it uses the same LLM. 32 bits make it practically impossible for 2 LLMs to collide,
+     * which would decompress garbage instead of failing.
+     * LLMs of one family share a vocabulary, so the number of parameters tells e.g. a 1B and a 3B LLM apart.
+     */
+    uint32_t fingerprint = 0;
+
+    /**
+     * Constructor for the vocabulary metadata of an LLM. Scans the whole vocabulary once.
+     *
+     * @param model Memory address of the LLM.
+     */
+    explicit VocabInfo(const llama_model* model);
+
+    /**
+     * Function to build the vocabulary metadata of an LLM and store it in the registry. Does nothing if it is already stored.
+     *
+     * @param model Memory address of the LLM.
+     */
+    static void load(const llama_model* model);
+
+    /**
+     * Function to remove the vocabulary metadata of an LLM from the registry. Needs to be called before the LLM is unloaded.
+     *
+     * @param model Memory address of the LLM.
+     */
+    static void unload(const llama_model* model);
+
+    /**
+     * Function to get the vocabulary metadata of an LLM. Builds it first if the LLM was loaded without calling `VocabInfo::load`.
+     *
+     * @param model Memory address of the LLM.
+     * @return Vocabulary metadata of the LLM.
+     */
+    static const VocabInfo& get(const llama_model* model);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "WarmStart.h"
+#include "Batch.h"
+#include "LlamaCpp.h"
+
+void WarmStart::prefetch(const char* path) {
+    int file = open(path, O_RDONLY);
+
+    if (file == -1) {
+        return;
+    }
+
+    struct stat fileStatus {};
+
+    if (fstat(file, &fileStatus) == 0 && fileStatus.st_size > 0) {
+        auto size = static_cast<size_t>(fileStatus.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+
+        // Readahead continues after unmapping, as it fills the page cache rather than the mapping
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, size, MADV_WILLNEED);
+            munmap(mapping, size);
+        }
+    }
+
+    close(file);
+}
+
+void WarmStart::warmup(llama_context* ctx) {
+    const llama_vocab* vocab = llama_model_get_vocab(llama_get_model(ctx));
+
+    // Same tokens as llama.cpp uses, falling back to token 0 if the LLM has neither
+    llama_token bos = llama_vocab_bos(vocab);
+    llama_token eos = llama_vocab_eos(vocab);
+
+    Batch batch(2);
+    batch.add(bos != -1 ? bos : 0, 0, 0, eos == -1);
+
+    if (eos != -1) {
+        batch.add(eos, 1, 0, true);
+    }
+
+    try {
+        LlamaCpp::decode(batch, ctx);
+        llama_synchronize(ctx);
+    }
+    catch (const std::runtime_error&) {
+        // Ignore, see docs
+    }
+
+    // Leave the context as if it was just created
+    llama_memory_clear(llama_get_memory(ctx), true);
+    llama_perf_context_reset(ctx);
+}
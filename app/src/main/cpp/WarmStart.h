@@ -0,0 +1,32 @@
+#ifndef WARM_START_H
+#define WARM_START_H
+
+#include "llama.h"
+
+/**
+ * Class that represents the steps to get the LLM ready before the first encode/decode, so that it doesn't pay for cold pages and the first graph.
+ */
+class WarmStart {
+public:
+    /**
+     * Function to start reading the LLM file into the page cache in the background, via `madvise(MADV_WILLNEED)` on a temporary mapping.
+     *
+     * Page cache is shared by all mappings of the file, so pages read ahead are already resident when llama.cpp maps the file itself.
+     * Returns immediately, the kernel reads the pages asynchronously. Does nothing if the file can't be mapped.
+     *
+     * @param path Path to the LLM (.gguf file).
+     */
+    static void prefetch(const char* path);
+
+    /**
+     * Function to decode a tiny batch once, so that llama.cpp allocates its compute buffers and backends initialize their kernels.
+     * Same as the warmup of `common_init_from_params` in llama.cpp. Clears the memory of the context afterwards.
+     *
+     * Best effort, a failed warmup is ignored as the first real decode only pays the costs instead.
+     *
+     * @param ctx Memory address of the context, memory has to be empty.
+     */
+    static void warmup(llama_context* ctx);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "ArithmeticCoder.h"
+#include "BitStream.h"
+#include "Statistics.h"
+#include "StegoWorkspace.h"
+
+// Round trip check of the integer arithmetic of ArithmeticCoder, run on synthetic probabilities so it doesn't need an LLM
+// Encodes random bits into tokens and decodes them again with a second coder, which has to recover the bits exactly
+// Covers the precisions of the benchmarks (16, 26, 40) over 300 distributions each, from flat to practically certain, and the whole vocabulary as well as small top k
+//
+// Usage: hips_arithmetic_check (exits with 1 if any round trip fails)
+
+namespace {
+    /**
+     * Number of distributions, i.e. round trips, per precision.
+     */
+    constexpr int NUMBER_OF_DISTRIBUTIONS = 300;
+
+    /**
+     * Number of random bits that are encoded per round trip.
+     */
+    constexpr int NUMBER_OF_BITS = 64;
+
+    /**
+     * Struct that represents the parameters of one distribution. Logits of every step are derived from the seed, so encoder and decoder see the same probabilities.
+     */
+    struct Distribution {
+        uint32_t seed;
+        int32_t vocabSize;
+        int topK;
+        float scale;
+    };
+
+    /**
+     * Function to get the parameters of a distribution.
+     *
+     * Vocabulary sizes range from tiny to the one of Llama 2, Gumbel scales from almost flat to practically certain next tokens.
+     *
+     * @param index Index of the distribution.
+     * @return The parameters.
+     */
+    Distribution getDistribution(int index) {
+        static const int32_t vocabSizes[] = {2, 256, 4096, 32000};
+        static const float scales[] = {0.1f, 1.0f, 2.0f, 4.0f, 8.0f};
+
+        int32_t vocabSize = vocabSizes[index % 4];
+        int topK = (index / 4) % 3 == 0 ? std::min(vocabSize, 50) : vocabSize;
+
+        return {static_cast<uint32_t>(index), vocabSize, topK, scales[(index / 12) % 5]};
+    }
+
+    /**
+     * Function to fill the probabilities of a workspace for one step, same as `StegoEngine::calculateProbabilities` but with synthetic logits.
+     */
+    void fillProbabilities(StegoWorkspace& workspace, const Distribution& distribution, int step) {
+        std::mt19937 generator(distribution.seed * 7919u + static_cast<uint32_t>(step));
+        std::extreme_value_distribution<float> gumbel(0.0f, distribution.scale);
+
+        std::vector<float> logits(distribution.vocabSize);
+
+        // Logits of an LLM are always finite, the Gumbel distribution can reach infinity for extreme draws
+        for (float& logit : logits) {
+            logit = std::clamp(gumbel(generator), -100.0f, 100.0f);
+        }
+
+        Statistics::softmax(logits.data(), distribution.vocabSize, workspace.probabilities.data());
+    }
+
+    /**
+     * Function to encode random bits and decode them again.
+     *
+     * @param precision Number of bits to encode the top k tokens with.
+     * @param distribution Parameters of the distribution.
+     * @return Boolean that is true if the decoded bits start with the encoded ones, false otherwise.
+     */
+    bool roundTrip(int precision, const Distribution& distribution) {
+        std::mt19937 generator(distribution.seed);
+        std::uniform_int_distribution<int> bitDistribution(0, 1);
+
+        BitStream cipherBits;
+
+        for (int i = 0; i < NUMBER_OF_BITS; i++) {
+            cipherBits.write(bitDistribution(generator), 1);
+        }
+
+        StegoWorkspace workspace(distribution.vocabSize);
+
+        // Encode like StegoEngine, i.e. until all cipher bits are consumed
+        ArithmeticCoder encoder(1.0f, distribution.topK, precision, false, -1);
+        encoder.reset();
+
+        BitReader cipherBitReader(cipherBits);
+        std::vector<llama_token> coverTextTokens;
+
+        while (cipherBitReader.hasRemainingBits()) {
+            fillProbabilities(workspace, distribution, static_cast<int>(coverTextTokens.size()));
+            coverTextTokens.push_back(encoder.encodeToken(workspace, cipherBitReader));
+        }
+
+        // Decode with a fresh coder, last token emits the bottom of the interval as the remaining bits
+        ArithmeticCoder decoder(1.0f, distribution.topK, precision, false, -1);
+        decoder.reset();
+
+        BitStream decodedBits;
+
+        for (size_t i = 0; i < coverTextTokens.size(); i++) {
+            fillProbabilities(workspace, distribution, static_cast<int>(i));
+
+            if (!decoder.decodeToken(workspace, coverTextTokens[i], i == coverTextTokens.size() - 1, decodedBits)) {
+                return false;
+            }
+        }
+
+        if (decodedBits.size() < cipherBits.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < cipherBits.size(); i++) {
+            if (decodedBits.peek(i, 1) != cipherBits.peek(i, 1)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main() {
+    int numberOfFailures = 0;
+
+    for (int precision : {16, 26, 40}) {
+        for (int index = 0; index < NUMBER_OF_DISTRIBUTIONS; index++) {
+            Distribution distribution = getDistribution(index);
+
+            if (!roundTrip(precision, distribution)) {
+                std::fprintf(stderr, "Round trip failed: precision %d, vocabulary size %d, top k %d, scale %.1f, seed %u\n", precision, distribution.vocabSize, distribution.topK, distribution.scale, distribution.seed);
+                numberOfFailures++;
+            }
+        }
+    }
+
+    std::printf("%d of %d round trips failed\n", numberOfFailures, 3 * NUMBER_OF_DISTRIBUTIONS);
+
+    return numberOfFailures == 0 ? 0 : 1;
+}
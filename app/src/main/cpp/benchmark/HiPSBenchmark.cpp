@@ -0,0 +1,323 @@
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "ArithmeticCoder.h"
+#include "BitStream.h"
+#include "HuffmanCoder.h"
+#include "HuffmanCoding.h"
+#include "Selection.h"
+#include "Statistics.h"
+#include "StegoWorkspace.h"
+
+namespace {
+    /**
+     * Vocabulary sizes of common LLM families, e.g. Llama 2 (32k), Llama 3 (128k) and Gemma (256k).
+     */
+    void addVocabSizes(benchmark::internal::Benchmark* benchmark) {
+        for (int64_t vocabSize : {32000, 128256, 256000}) {
+            benchmark->Arg(vocabSize);
+        }
+    }
+
+    /**
+     * Function to generate synthetic logits that resemble the ones of an LLM, i.e. few likely tokens and a long tail of unlikely ones.
+     *
+     * Logits follow a Gumbel distribution, so after softmax the probabilities are roughly Zipf-like. Fixed seed keeps runs comparable.
+     *
+     * @param vocabSize Number of logits.
+     * @return The logits.
+     */
+    std::vector<float> generateLogits(int32_t vocabSize) {
+        std::mt19937 generator(42);
+        std::extreme_value_distribution<float> distribution(0.0f, 2.0f);
+
+        std::vector<float> logits(vocabSize);
+
+        for (float& logit : logits) {
+            logit = distribution(generator);
+        }
+
+        return logits;
+    }
+
+    /**
+     * Function to generate random bits.
+     *
+     * @param numberOfBytes Number of bytes of bits.
+     * @return The bytes.
+     */
+    std::vector<uint8_t> generateBytes(size_t numberOfBytes) {
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> distribution(0, 255);
+
+        std::vector<uint8_t> bytes(numberOfBytes);
+
+        for (uint8_t& byte : bytes) {
+            byte = static_cast<uint8_t>(distribution(generator));
+        }
+
+        return bytes;
+    }
+
+    /**
+     * Function to fill the probabilities of a workspace from synthetic logits, same as `StegoEngine::calculateProbabilities`.
+     */
+    void fillProbabilities(StegoWorkspace& workspace, int32_t vocabSize) {
+        std::vector<float> logits = generateLogits(vocabSize);
+
+        Statistics::softmax(logits.data(), vocabSize, workspace.probabilities.data());
+    }
+}
+
+static void BM_SoftmaxDouble(benchmark::State& state) {
+    auto vocabSize = static_cast<int32_t>(state.range(0));
+
+    std::vector<float> logits = generateLogits(vocabSize);
+    std::vector<double> probabilities(vocabSize);
+
+    for (auto _ : state) {
+        Statistics::softmax(logits.data(), vocabSize, probabilities.data(), 0.9f);
+        benchmark::DoNotOptimize(probabilities.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * vocabSize);
+}
+BENCHMARK(BM_SoftmaxDouble)->Apply(addVocabSizes);
+
+static void BM_SoftmaxFloat(benchmark::State& state) {
+    auto vocabSize = static_cast<int32_t>(state.range(0));
+
+    std::vector<float> logits = generateLogits(vocabSize);
+    std::vector<float> probabilities(vocabSize);
+
+    for (auto _ : state) {
+        Statistics::softmax(logits.data(), vocabSize, probabilities.data(), 0.9f);
+        benchmark::DoNotOptimize(probabilities.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * vocabSize);
+}
+BENCHMARK(BM_SoftmaxFloat)->Apply(addVocabSizes);
+
+static void BM_TopK(benchmark::State& state) {
+    auto vocabSize = static_cast<int32_t>(state.range(0));
+    auto k = static_cast<int>(state.range(1));
+
+    StegoWorkspace workspace(vocabSize);
+    fillProbabilities(workspace, vocabSize);
+
+    for (auto _ : state) {
+        Selection::getTopProbabilities(workspace.probabilities.data(), vocabSize, k, workspace.topProbabilities);
+        benchmark::DoNotOptimize(workspace.topProbabilities.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * vocabSize);
+}
+// Small k (Huffman, fixed-size kernels), medium k (heap selection) and large k (arithmetic coding with a reduced topK, partial sort)
+BENCHMARK(BM_TopK)->ArgsProduct({{32000, 128256, 256000}, {2, 32, 64, 300, 2000}});
+
+static void BM_ArgMax(benchmark::State& state) {
+    auto vocabSize = static_cast<int32_t>(state.range(0));
+
+    StegoWorkspace workspace(vocabSize);
+    fillProbabilities(workspace, vocabSize);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Selection::getTopProbability(workspace.probabilities.data(), vocabSize));
+    }
+
+    state.SetItemsProcessed(state.iterations() * vocabSize);
+}
+BENCHMARK(BM_ArgMax)->Apply(addVocabSizes);
+
+static void BM_HuffmanCoding(benchmark::State& state) {
+    auto bitsPerToken = static_cast<int>(state.range(0));
+    int32_t vocabSize = 32000;
+
+    // Top tokens are selected once, only building the tree and its codes is measured
+    StegoWorkspace workspace(vocabSize);
+    fillProbabilities(workspace, vocabSize);
+    Selection::getTopProbabilities(workspace.probabilities.data(), vocabSize, 1 << bitsPerToken, workspace.topProbabilities);
+
+    HuffmanCoding& huffmanCoding = workspace.huffmanCoding;
+
+    for (auto _ : state) {
+        huffmanCoding.buildHuffmanTree(workspace.topProbabilities);
+        huffmanCoding.mergeHuffmanNodes();
+        huffmanCoding.generateHuffmanCodes();
+        benchmark::DoNotOptimize(huffmanCoding.huffmanCodes.data());
+    }
+}
+BENCHMARK(BM_HuffmanCoding)->DenseRange(1, 5);
+
+static void BM_HuffmanEncodeToken(benchmark::State& state) {
+    auto vocabSize = static_cast<int32_t>(state.range(0));
+    auto bitsPerToken = static_cast<int>(state.range(1));
+
+    StegoWorkspace workspace(vocabSize);
+    fillProbabilities(workspace, vocabSize);
+
+    std::vector<uint8_t> bytes = generateBytes(1024);
+    BitStream cipherBits = BitStream::fromBytes(bytes.data(), bytes.size());
+
+    HuffmanCoder coder(bitsPerToken);
+
+    // Selection, tree and code lookup per token, the reader starts over when all bits are encoded
+    std::optional<BitReader> cipherBitReader(cipherBits);
+
+    for (auto _ : state) {
+        if (!cipherBitReader->hasRemainingBits()) {
+            cipherBitReader.emplace(cipherBits);
+        }
+
+        benchmark::DoNotOptimize(coder.encodeToken(workspace, *cipherBitReader));
+    }
+}
+BENCHMARK(BM_HuffmanEncodeToken)->ArgsProduct({{32000, 128256, 256000}, {1, 3, 5}});
+
+static void BM_HuffmanDecodeToken(benchmark::State& state) {
+    auto vocabSize = static_cast<int32_t>(state.range(0));
+    auto bitsPerToken = static_cast<int>(state.range(1));
+
+    StegoWorkspace workspace(vocabSize);
+    fillProbabilities(workspace, vocabSize);
+
+    // Cover text tokens cycle through the Huffman tree and one token outside of it
+    Selection::getTopProbabilities(workspace.probabilities.data(), vocabSize, (1 << bitsPerToken) + 1, workspace.topProbabilities);
+    std::vector<std::pair<llama_token, double>> coverTextTokens = workspace.topProbabilities;
+
+    HuffmanCoder coder(bitsPerToken);
+    BitStream cipherBits;
+
+    // Selection, rank lookup, code lengths and the code of a single token per token
+    size_t i = 0;
+
+    for (auto _ : state) {
+        if (cipherBits.size() > 1 << 16) {
+            cipherBits = BitStream();
+        }
+
+        benchmark::DoNotOptimize(coder.decodeToken(workspace, coverTextTokens[i % coverTextTokens.size()].first, false, cipherBits));
+        i++;
+    }
+}
+BENCHMARK(BM_HuffmanDecodeToken)->ArgsProduct({{32000, 128256, 256000}, {1, 3, 5}});
+
+static void BM_ArithmeticEncodeToken(benchmark::State& state) {
+    auto vocabSize = static_cast<int32_t>(state.range(0));
+    auto precision = static_cast<int>(state.range(1));
+
+    StegoWorkspace workspace(vocabSize);
+    fillProbabilities(workspace, vocabSize);
+
+    std::vector<uint8_t> bytes = generateBytes(1024);
+    BitStream cipherBits = BitStream::fromBytes(bytes.data(), bytes.size());
+
+    // Default settings consider the whole vocabulary (precision ~ log2(n_vocab)), binary conversion uses precision 40
+    ArithmeticCoder coder(1.0f, vocabSize, precision, false, -1);
+
+    // Threshold, selection, rounding, sub-intervals and narrowing of the interval per token
+    std::optional<BitReader> cipherBitReader(cipherBits);
+
+    for (auto _ : state) {
+        if (!cipherBitReader->hasRemainingBits()) {
+            cipherBitReader.emplace(cipherBits);
+            coder.reset();
+        }
+
+        benchmark::DoNotOptimize(coder.encodeToken(workspace, *cipherBitReader));
+    }
+}
+BENCHMARK(BM_ArithmeticEncodeToken)->ArgsProduct({{32000, 128256, 256000}, {16, 26, 40}});
+
+static void BM_NumberOfSameBitsFromBeginning(benchmark::State& state) {
+    std::mt19937_64 generator(42);
+    std::vector<long long> numbers(1024);
+
+    for (long long& number : numbers) {
+        number = static_cast<long long>(generator() >> 24);
+    }
+
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ArithmeticCoder::numberOfSameBitsFromBeginning(numbers[i % 1024], numbers[(i + 1) % 1024], 40));
+        i++;
+    }
+}
+BENCHMARK(BM_NumberOfSameBitsFromBeginning);
+
+// Format converts between Java ByteArrays and bit streams with BitStream::{fromBytes,toBytes}, so these measure Format without the JNI copies
+static void BM_BitStreamFromBytes(benchmark::State& state) {
+    std::vector<uint8_t> bytes = generateBytes(state.range(0));
+
+    for (auto _ : state) {
+        BitStream bitStream = BitStream::fromBytes(bytes.data(), bytes.size());
+        benchmark::DoNotOptimize(bitStream.size());
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BitStreamFromBytes)->RangeMultiplier(8)->Range(64, 32768);
+
+static void BM_BitStreamToBytes(benchmark::State& state) {
+    std::vector<uint8_t> bytes = generateBytes(state.range(0));
+    BitStream bitStream = BitStream::fromBytes(bytes.data(), bytes.size());
+
+    for (auto _ : state) {
+        bitStream.toBytes(bytes.data(), bytes.size());
+        benchmark::DoNotOptimize(bytes.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BitStreamToBytes)->RangeMultiplier(8)->Range(64, 32768);
+
+static void BM_BitStreamPadding(benchmark::State& state) {
+    std::vector<uint8_t> bytes = generateBytes(state.range(0));
+    BitStream bitStream = BitStream::fromBytes(bytes.data(), bytes.size());
+    bitStream.resize(bitStream.size() - 3);
+
+    // Same steps as Format::asByteArrayWithPadding and Format::asBitStreamWithoutPadding
+    for (auto _ : state) {
+        size_t paddingLength = (8 - (bitStream.size() % 8)) % 8;
+
+        BitStream paddedBitStream;
+        paddedBitStream.reserve(8 + paddingLength + bitStream.size());
+        paddedBitStream.write(paddingLength, 8);
+        paddedBitStream.write(0, static_cast<int>(paddingLength));
+        paddedBitStream.append(bitStream);
+
+        BitStream unpaddedBitStream;
+        unpaddedBitStream.append(paddedBitStream, 8 + static_cast<size_t>(paddedBitStream.peek(0, 8)));
+
+        benchmark::DoNotOptimize(unpaddedBitStream.size());
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BitStreamPadding)->RangeMultiplier(8)->Range(64, 32768);
+
+static void BM_BitStreamWrite(benchmark::State& state) {
+    auto n = static_cast<int>(state.range(0));
+
+    // Arithmetic decoding writes a few fixed bits per token
+    for (auto _ : state) {
+        BitStream bitStream;
+        bitStream.reserve(4096 * n);
+
+        for (int i = 0; i < 4096; i++) {
+            bitStream.write(static_cast<uint64_t>(i), n);
+        }
+
+        benchmark::DoNotOptimize(bitStream.size());
+    }
+
+    state.SetItemsProcessed(state.iterations() * 4096);
+}
+BENCHMARK(BM_BitStreamWrite)->Arg(1)->Arg(5)->Arg(26);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,550 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "llama.h"
+#include "common.h"
+#include "ArithmeticCoder.h"
+#include "BitStream.h"
+#include "EngineConfig.h"
+#include "HuffmanCoder.h"
+#include "LlamaCpp.h"
+#include "StegoEngine.h"
+#include "VocabInfo.h"
+
+// End-to-end benchmark of the steganography pipeline against a real LLM
+// Runs the same steps as Steganography.{encode,decode} in Kotlin (prepare, compress, encrypt, encode, decode, decrypt, decompress, unprepare)
+// for every combination of settings over a fixed corpus, checks that every secret message survives the round trip and reports latency and capacity
+//
+// Usage: hips_round_trip --model <path.gguf> [--corpus <file.tsv>] [--modes arithmetic,huffman] [--conversion arithmetic|utf8]
+//                        [--temperatures 1.0] [--top-k 0] [--precisions 0] [--bits-per-token 1,2,3] [--threads 0] [--context-size 0] [--csv <file.csv>]
+//
+// Corpus files have one entry per line: the secret message, followed by the prior chat messages (oldest first, alternating speakers), separated by tabs
+
+namespace {
+    /**
+     * Default system prompt of the app, see `Settings.kt`.
+     */
+    const char* SYSTEM_PROMPT = "Let's do a role play. You and I are friends, texting with each other. We talk about what we did on the weekend. "
+                                "Be brief and casual, but friendly and engaging. Use a few emojis and phrases typical for chat messages, but not too many. "
+                                "Do not use any hashtags. Split your output in paragraphs every 2-3 sentences.";
+
+    /**
+     * Struct that represents a secret message together with the chat it is hidden in.
+     */
+    struct CorpusEntry {
+        std::string secretMessage;
+        std::vector<std::string> priorMessages;
+    };
+
+    /**
+     * Struct that represents one combination of settings. Top k and precision of 0 mean the defaults of the app (whole vocabulary, ceil(log2(topK)) bits).
+     */
+    struct Setting {
+        bool isArithmetic;
+        float temperature;
+        int topK;
+        int precision;
+        int bitsPerToken;
+    };
+
+    /**
+     * Struct that represents the measurements of one round trip.
+     */
+    struct Measurement {
+        bool isCorrect = false;
+        double compressMs = 0.0;
+        double prefillMs = 0.0;
+        double encodeMs = 0.0;
+        double decodeMs = 0.0;
+        size_t numberOfCipherBits = 0;
+        size_t numberOfCoverTextTokens = 0;
+        size_t coverTextLength = 0;
+    };
+
+    /**
+     * Built-in corpus of short, medium and long secret messages in chats of different lengths.
+     */
+    std::vector<CorpusEntry> getDefaultCorpus() {
+        return {
+            {"Meet me at 8.", {}},
+            {"The package is in the locker at the train station, code 4711.", {"Hey, how was your weekend?"}},
+            {"Don't trust the new guy, he has been asking about the project all week.", {"Hey, how was your weekend?", "Pretty chill, went hiking on Saturday! You?"}},
+            {"Abort the plan, they know about Friday. We need another way to get the documents out of the building before the audit starts on Monday.",
+             {"Hey, how was your weekend?", "Pretty chill, went hiking on Saturday! You?", "Nice! I mostly stayed in and watched movies."}},
+        };
+    }
+
+    /**
+     * Function to read a corpus from a file.
+     *
+     * @param path Path to the file.
+     * @return The corpus.
+     * @throws std::runtime_error If the file can't be read.
+     */
+    std::vector<CorpusEntry> readCorpus(const std::string& path) {
+        std::ifstream file(path);
+
+        if (!file) {
+            throw std::runtime_error("Corpus " + path + " can't be read");
+        }
+
+        std::vector<CorpusEntry> corpus;
+        std::string line;
+
+        while (std::getline(file, line)) {
+            if (line.empty()) {
+                continue;
+            }
+
+            std::istringstream fields(line);
+            std::string field;
+
+            CorpusEntry entry;
+            std::getline(fields, entry.secretMessage, '\t');
+
+            while (std::getline(fields, field, '\t')) {
+                entry.priorMessages.push_back(field);
+            }
+
+            corpus.push_back(std::move(entry));
+        }
+
+        return corpus;
+    }
+
+    /**
+     * Function to split a comma-separated list.
+     */
+    std::vector<std::string> split(const std::string& list) {
+        std::vector<std::string> items;
+        std::istringstream stream(list);
+        std::string item;
+
+        while (std::getline(stream, item, ',')) {
+            items.push_back(item);
+        }
+
+        return items;
+    }
+
+    double getMilliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @return Peak resident set size of the process in MiB.
+     */
+    double getPeakRss() {
+        rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+
+        // Linux and Android report kilobytes
+        return static_cast<double>(usage.ru_maxrss) / 1024.0;
+    }
+
+    /**
+     * Function to format a message with the chat template of the LLM, same as `LlamaCpp.addMessage` in Kotlin.
+     */
+    std::string addMessage(const llama_model* model, const char* role, const std::string& content, bool appendAssistant) {
+        const char* tmpl = llama_model_chat_template(model, nullptr);
+        llama_chat_message message = {role, content.c_str()};
+
+        std::vector<char> formatted(2 * content.size() + 256);
+        int32_t length = llama_chat_apply_template(tmpl, &message, 1, appendAssistant, formatted.data(), static_cast<int32_t>(formatted.size()));
+
+        if (length > static_cast<int32_t>(formatted.size())) {
+            formatted.resize(length);
+            length = llama_chat_apply_template(tmpl, &message, 1, appendAssistant, formatted.data(), static_cast<int32_t>(formatted.size()));
+        }
+
+        return length > 0 ? std::string(formatted.data(), length) : content;
+    }
+
+    /**
+     * Function to format the context of a chat, same as `LlamaCpp.formatChat` in Kotlin with the LLM taking on the role of the sender.
+     * Evicts the oldest messages in steps of half the window once the chat exceeds the fixed limit of 1536 tokens (`MAX_CHAT_TOKENS` in Kotlin).
+     */
+    std::string formatChat(const llama_context* ctx, const std::vector<std::string>& priorMessages) {
+        const llama_model* model = llama_get_model(ctx);
+        const llama_vocab* vocab = llama_model_get_vocab(model);
+
+        // Messages alternate between the sender (assistant) and the receiver (user), the last one was sent by the receiver
+        auto getRole = [&priorMessages](size_t i) { return (priorMessages.size() - 1 - i) % 2 == 0 ? "user" : "assistant"; };
+        auto countTokens = [vocab](const std::string& text) { return static_cast<long>(common_tokenize(vocab, text, false, true).size()); };
+
+        long numberOfAvailableTokens = 1536L - countTokens(addMessage(model, "system", SYSTEM_PROMPT, false));
+        std::vector<long> numberOfMessageTokens;
+
+        for (size_t i = 0; i < priorMessages.size(); i++) {
+            numberOfMessageTokens.push_back(countTokens(addMessage(model, getRole(i), priorMessages[i], false)));
+        }
+
+        long numberOfExcessTokens = -numberOfAvailableTokens;
+        size_t numberOfEvictedMessages = 0;
+
+        for (long numberOfTokens : numberOfMessageTokens) {
+            numberOfExcessTokens += numberOfTokens;
+        }
+
+        if (numberOfExcessTokens > 0) {
+            long stepSize = std::max(numberOfAvailableTokens / 2, 1L);
+            long numberOfTokensToEvict = (numberOfExcessTokens + stepSize - 1) / stepSize * stepSize;
+
+            for (long numberOfEvictedTokens = 0; numberOfEvictedTokens < numberOfTokensToEvict && numberOfEvictedMessages < priorMessages.size(); numberOfEvictedMessages++) {
+                numberOfEvictedTokens += numberOfMessageTokens[numberOfEvictedMessages];
+            }
+        }
+
+        std::string context = addMessage(model, "system", SYSTEM_PROMPT, numberOfEvictedMessages == priorMessages.size());
+
+        for (size_t i = numberOfEvictedMessages; i < priorMessages.size(); i++) {
+            context += addMessage(model, getRole(i), priorMessages[i], i == priorMessages.size() - 1);
+        }
+
+        return context;
+    }
+
+    /**
+     * Function to add the start and stop signal to a secret message, same as `Steganography.prepare` in Kotlin.
+     */
+    std::string prepare(const std::string& secretMessage) {
+        return "\x02" + secretMessage + "\x03";
+    }
+
+    /**
+     * Function to remove the start and stop signal from a prepared secret message, same as `Steganography.unprepare` in Kotlin.
+     *
+     * @return The secret message, empty if a signal is missing.
+     */
+    std::string unprepare(const std::string& preparedSecretMessage) {
+        size_t start = preparedSecretMessage.find('\x02');
+        size_t stop = start != std::string::npos ? preparedSecretMessage.find('\x03', start + 1) : std::string::npos;
+
+        return stop != std::string::npos ? preparedSecretMessage.substr(start + 1, stop - start - 1) : "";
+    }
+
+    /**
+     * Function to drop the bits of an incomplete last byte, same as converting a bit stream to a Java ByteArray.
+     */
+    BitStream asWholeBytes(const BitStream& bitStream) {
+        BitStream wholeBytes;
+        wholeBytes.append(bitStream);
+        wholeBytes.resize(bitStream.size() / 8 * 8);
+
+        return wholeBytes;
+    }
+
+    /**
+     * Class that represents the pipeline of the app on a single context.
+     */
+    class Pipeline {
+    private:
+        llama_context* ctx;
+        StegoEngine& engine;
+        bool isArithmeticConversion;
+
+        /**
+         * Function to start every step with a cold session, as encoder and decoder run on different devices.
+         */
+        void clearSession() {
+            engine.getSession().clear();
+            engine.getSession().clearSnapshots();
+            llama_perf_context_reset(ctx);
+        }
+
+        /**
+         * Same as `Arithmetic.compress` and `Format::asByteArrayWithPadding`.
+         */
+        BitStream compress(const std::string& preparedSecretMessage) {
+            llama_tokens contextTokens = {LlamaCpp::getEndOfGeneration(engine.getModel())};
+            llama_tokens secretMessageTokens = common_tokenize(ctx, preparedSecretMessage, false, true);
+
+            ArithmeticCoder coder(engine.getModel(), 1.0f, LlamaCpp::getVocabSize(engine.getModel()), 40, true);
+            BitStream plainBits = engine.decode(contextTokens, secretMessageTokens, coder, 0, false);
+
+            size_t paddingLength = (8 - (plainBits.size() % 8)) % 8;
+
+            BitStream paddedPlainBits;
+            paddedPlainBits.write(paddingLength, 8);
+            paddedPlainBits.write(0, static_cast<int>(paddingLength));
+            paddedPlainBits.append(plainBits);
+
+            return paddedPlainBits;
+        }
+
+        /**
+         * Same as `Format::asBitStreamWithoutPadding` and `Arithmetic.decompress`.
+         */
+        std::string decompress(const BitStream& paddedPlainBits) {
+            BitStream plainBits;
+            plainBits.append(paddedPlainBits, 8 + static_cast<size_t>(paddedPlainBits.peek(0, 8)));
+
+            llama_tokens contextTokens = {LlamaCpp::getEndOfGeneration(engine.getModel())};
+
+            ArithmeticCoder coder(engine.getModel(), 1.0f, LlamaCpp::getVocabSize(engine.getModel()), 40, true);
+            llama_tokens secretMessageTokens = engine.encode(contextTokens, plainBits, coder, false, false);
+
+            return common_detokenize(ctx, secretMessageTokens, true);
+        }
+
+        std::unique_ptr<Coder> createCoder(const Setting& setting) const {
+            if (!setting.isArithmetic) {
+                return std::make_unique<HuffmanCoder>(setting.bitsPerToken);
+            }
+
+            int topK = setting.topK > 0 ? setting.topK : LlamaCpp::getVocabSize(engine.getModel());
+            int precision = setting.precision > 0 ? setting.precision : static_cast<int>(std::ceil(std::log2(static_cast<double>(topK))));
+
+            return std::make_unique<ArithmeticCoder>(engine.getModel(), setting.temperature, topK, precision, false);
+        }
+
+    public:
+        Pipeline(llama_context* ctx, bool isArithmeticConversion) : ctx(ctx), engine(StegoEngine::get(ctx)), isArithmeticConversion(isArithmeticConversion) {}
+
+        Measurement run(const CorpusEntry& entry, const Setting& setting) {
+            Measurement measurement;
+
+            // Steps 0 to 2, encryption is a no-op in the app for now
+            clearSession();
+            auto start = std::chrono::steady_clock::now();
+
+            std::string preparedSecretMessage = prepare(entry.secretMessage);
+            BitStream cipherBits = isArithmeticConversion ? compress(preparedSecretMessage) : BitStream::fromBytes(reinterpret_cast<const uint8_t*>(preparedSecretMessage.data()), preparedSecretMessage.size());
+
+            measurement.compressMs = getMilliseconds(start);
+            measurement.numberOfCipherBits = cipherBits.size();
+
+            // Step 3
+            std::string context = formatChat(ctx, entry.priorMessages);
+            llama_tokens contextTokens = common_tokenize(ctx, context, false, true);
+
+            clearSession();
+            start = std::chrono::steady_clock::now();
+
+            std::unique_ptr<Coder> encoder = createCoder(setting);
+            llama_tokens coverTextTokens = engine.encode(contextTokens, cipherBits, *encoder, true, false);
+
+            measurement.encodeMs = getMilliseconds(start);
+            measurement.prefillMs = llama_perf_context(ctx).t_p_eval_ms;
+
+            // Cover text is sent as a string, so the receiver has to tokenize it again
+            // Special tokens are rendered as text, same as LlamaCpp::detokenize
+            std::string coverText = common_detokenize(ctx, coverTextTokens, true);
+            llama_tokens receivedCoverTextTokens = common_tokenize(ctx, coverText, false, true);
+
+            measurement.numberOfCoverTextTokens = coverTextTokens.size();
+            measurement.coverTextLength = coverText.size();
+
+            // Inverse of step 3
+            clearSession();
+            start = std::chrono::steady_clock::now();
+
+            BitStream decodedCipherBits;
+
+            try {
+                std::unique_ptr<Coder> decoder = createCoder(setting);
+                decodedCipherBits = asWholeBytes(engine.decode(contextTokens, receivedCoverTextTokens, *decoder, 0, false));
+            }
+            catch (const std::invalid_argument&) {
+                // Retokenization of the cover text differs from the picked tokens
+                measurement.decodeMs = getMilliseconds(start);
+
+                return measurement;
+            }
+
+            measurement.decodeMs = getMilliseconds(start);
+
+            // Inverse of steps 2 to 0
+            clearSession();
+
+            std::string decodedPreparedSecretMessage;
+
+            if (isArithmeticConversion) {
+                decodedPreparedSecretMessage = decompress(decodedCipherBits);
+            }
+            else {
+                std::vector<uint8_t> bytes(decodedCipherBits.size() / 8);
+                decodedCipherBits.toBytes(bytes.data(), bytes.size());
+
+                decodedPreparedSecretMessage.assign(bytes.begin(), bytes.end());
+            }
+
+            measurement.isCorrect = unprepare(decodedPreparedSecretMessage) == entry.secretMessage;
+
+            return measurement;
+        }
+    };
+
+    void printUsage() {
+        std::fprintf(stderr,
+            "Usage: hips_round_trip --model <path.gguf> [--corpus <file.tsv>] [--modes arithmetic,huffman] [--conversion arithmetic|utf8]\n"
+            "                       [--temperatures 1.0] [--top-k 0] [--precisions 0] [--bits-per-token 1,2,3] [--threads 0] [--context-size 0] [--csv <file.csv>]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string modelPath;
+    std::string corpusPath;
+    std::string csvPath;
+    std::vector<std::string> modes = {"arithmetic", "huffman"};
+    std::vector<std::string> temperatures = {"1.0"};
+    std::vector<std::string> topKs = {"0"};
+    std::vector<std::string> precisions = {"0"};
+    std::vector<std::string> bitsPerTokens = {"1", "2", "3"};
+    bool isArithmeticConversion = true;
+
+    EngineConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+
+        if (argument == "--model") { modelPath = value; }
+        else if (argument == "--corpus") { corpusPath = value; }
+        else if (argument == "--csv") { csvPath = value; }
+        else if (argument == "--modes") { modes = split(value); }
+        else if (argument == "--conversion") { isArithmeticConversion = value != "utf8"; }
+        else if (argument == "--temperatures") { temperatures = split(value); }
+        else if (argument == "--top-k") { topKs = split(value); }
+        else if (argument == "--precisions") { precisions = split(value); }
+        else if (argument == "--bits-per-token") { bitsPerTokens = split(value); }
+        else if (argument == "--threads") { config.numberOfThreads = std::stoi(value); }
+        else if (argument == "--context-size") { config.contextSize = static_cast<uint32_t>(std::stoul(value)); }
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (modelPath.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<CorpusEntry> corpus = corpusPath.empty() ? getDefaultCorpus() : readCorpus(corpusPath);
+
+    // Every combination of settings that applies to the mode
+    std::vector<Setting> settings;
+
+    for (const std::string& mode : modes) {
+        if (mode == "huffman") {
+            for (const std::string& bitsPerToken : bitsPerTokens) {
+                settings.push_back({false, 1.0f, 0, 0, std::stoi(bitsPerToken)});
+            }
+
+            continue;
+        }
+
+        for (const std::string& temperature : temperatures) {
+            for (const std::string& topK : topKs) {
+                for (const std::string& precision : precisions) {
+                    settings.push_back({true, std::stof(temperature), std::stoi(topK), std::stoi(precision), 0});
+                }
+            }
+        }
+    }
+
+    // Load LLM and context the same way the app does
+    llama_backend_init();
+
+    llama_model* model = llama_model_load_from_file(modelPath.c_str(), config.toModelParams());
+
+    if (model == nullptr) {
+        std::fprintf(stderr, "LLM %s can't be loaded\n", modelPath.c_str());
+        return 1;
+    }
+
+    VocabInfo::load(model);
+
+    config.resolve();
+
+    llama_context_params params = config.toContextParams(model);
+    params.no_perf = false;
+
+    llama_context* ctx = llama_init_from_model(model, params);
+
+    if (ctx == nullptr) {
+        std::fprintf(stderr, "Context can't be created\n");
+        return 1;
+    }
+
+    StegoEngine::load(ctx);
+
+    Pipeline pipeline(ctx, isArithmeticConversion);
+
+    std::FILE* csv = csvPath.empty() ? nullptr : std::fopen(csvPath.c_str(), "w");
+
+    if (csv != nullptr) {
+        std::fprintf(csv, "mode,temperature,topK,precision,bitsPerToken,entry,correct,compressMs,prefillMs,encodeMs,decodeMs,cipherBits,coverTextTokens,coverTextLength\n");
+    }
+
+    std::printf("%-10s %5s %6s %4s %3s | %4s %9s %9s %9s %9s %9s %7s %7s %8s\n",
+                "mode", "temp", "topK", "prec", "bpt", "ok", "compMs", "prefillMs", "tokenMs", "encTok/s", "decTok/s", "bits/tk", "tokens", "peakMiB");
+
+    for (const Setting& setting : settings) {
+        int numberOfCorrectRoundTrips = 0;
+        Measurement total;
+
+        for (size_t entry = 0; entry < corpus.size(); entry++) {
+            Measurement measurement = pipeline.run(corpus[entry], setting);
+
+            numberOfCorrectRoundTrips += measurement.isCorrect;
+            total.compressMs += measurement.compressMs;
+            total.prefillMs += measurement.prefillMs;
+            total.encodeMs += measurement.encodeMs;
+            total.decodeMs += measurement.decodeMs;
+            total.numberOfCipherBits += measurement.numberOfCipherBits;
+            total.numberOfCoverTextTokens += measurement.numberOfCoverTextTokens;
+            total.coverTextLength += measurement.coverTextLength;
+
+            if (csv != nullptr) {
+                std::fprintf(csv, "%s,%.2f,%d,%d,%d,%zu,%d,%.2f,%.2f,%.2f,%.2f,%zu,%zu,%zu\n",
+                             setting.isArithmetic ? "arithmetic" : "huffman", setting.temperature, setting.topK, setting.precision, setting.bitsPerToken, entry,
+                             measurement.isCorrect, measurement.compressMs, measurement.prefillMs, measurement.encodeMs, measurement.decodeMs,
+                             measurement.numberOfCipherBits, measurement.numberOfCoverTextTokens, measurement.coverTextLength);
+            }
+        }
+
+        // Per-token latency excludes the prefill, capacity is measured in cipher bits (i.e. after compression) per cover text token
+        auto numberOfTokens = static_cast<double>(std::max<size_t>(1, total.numberOfCoverTextTokens));
+
+        std::printf("%-10s %5.2f %6d %4d %3d | %2d/%-2zu %9.1f %9.1f %9.2f %9.1f %9.1f %7.2f %7.1f %8.1f\n",
+                    setting.isArithmetic ? "arithmetic" : "huffman", setting.temperature, setting.topK, setting.precision, setting.bitsPerToken,
+                    numberOfCorrectRoundTrips, corpus.size(),
+                    total.compressMs / static_cast<double>(corpus.size()),
+                    total.prefillMs / static_cast<double>(corpus.size()),
+                    (total.encodeMs - total.prefillMs) / numberOfTokens,
+                    numberOfTokens / (total.encodeMs / 1000.0),
+                    numberOfTokens / (total.decodeMs / 1000.0),
+                    static_cast<double>(total.numberOfCipherBits) / numberOfTokens,
+                    numberOfTokens / static_cast<double>(corpus.size()),
+                    getPeakRss());
+        std::fflush(stdout);
+    }
+
+    if (csv != nullptr) {
+        std::fclose(csv);
+    }
+
+    StegoEngine::unload(ctx);
+    llama_free(ctx);
+    VocabInfo::unload(model);
+    llama_model_free(model);
+
+    return 0;
+}
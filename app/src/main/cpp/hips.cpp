@@ -17,37 +17,57 @@
 //    }
 
 // Notation: <system libs>, "user libs"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <jni.h>
 #include "llama.h"
 #include "common.h"
+#include "ContextPool.h"
+#include "CoverTextCache.h"
+#include "EngineConfig.h"
+#include "Exceptions.h"
+#include "Profiler.h"
+#include "StegoEngine.h"
+#include "VocabInfo.h"
+#include "WarmStart.h"
+
+namespace {
+    /**
+     * Function to load the LLM into memory and scan its vocabulary.
+     *
+     * @param path Path to the LLM (.gguf file).
+     * @param config Model parameters.
+     * @return Memory address of the LLM, null if it can't be loaded.
+     */
+    llama_model* loadModel(const char* path, const EngineConfig& config) {
+        llama_model* model = llama_model_load_from_file(path, config.toModelParams());
+
+        // Scan the vocabulary once now, so that encode/decode loops only need constant-time lookups
+        if (model != nullptr) {
+            VocabInfo::load(model);
+        }
+
+        return model;
+    }
 
-/**
- * Function to load the LLM into memory.
- *
- * @param env The JNI environment.
- * @param thiz Java object this function was called with.
- * @param jPath Path to the LLM (.gguf file).
- * @return Memory address of the LLM.
- */
-extern "C" JNIEXPORT jlong JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_loadModel(JNIEnv* env, jobject /* thiz */, jstring jPath) {
-    // Convert path to LLM from Java string to C++ string using the JNI environment
-    // Set isCopy == true to copy Java string so it doesn't get overwritten in memory
-    jboolean isCopy = true;
-    const char* cppPath = env -> GetStringUTFChars(jPath, &isCopy);
-
-    // Use the LLM with default parameters
-    llama_model_params params = llama_model_default_params();
-
-    // Load the LLM into memory and save pointer to it
-    llama_model* cppModel = llama_model_load_from_file(cppPath, params);
-
-    // Release the memory allocated to the C++ path
-    env -> ReleaseStringUTFChars(jPath, cppPath);
-
-    // Cast C++ pointer (64 bit memory address) to Java long (also 64 bit) to return it via JNI
-    auto jModel = reinterpret_cast<jlong>(cppModel);
-
-    return jModel;
+    /**
+     * Function to load a pool of contexts into memory, warming up every context.
+     *
+     * @param model Memory address of the LLM.
+     * @param config Context parameters, already resolved.
+     * @param numberOfContexts Number of contexts.
+     * @return Memory address of the pool, null if a context can't be created.
+     */
+    ContextPool* loadPool(llama_model* model, const EngineConfig& config, int numberOfContexts) {
+        try {
+            return new ContextPool(model, config, numberOfContexts);
+        }
+        catch (const std::runtime_error&) {
+            return nullptr;
+        }
+    }
 }
 
 /**
@@ -61,66 +81,63 @@ extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_unloa
     // Cast memory address of LLM from Java long to C++ pointer
     auto cppModel = reinterpret_cast<llama_model*>(jModel);
 
+    // Drop vocabulary metadata and cached cover texts of the LLM first as its memory address can be reused afterwards
+    VocabInfo::unload(cppModel);
+    CoverTextCache::unload(cppModel);
+
     // Unload LLM from memory
     llama_model_free(cppModel);
 }
 
 /**
- * Function to load the context into memory.
+ * Function to unload a pool of contexts from memory. All leased contexts need to be released first.
  *
  * @param env The JNI environment.
  * @param thiz Java object this function was called with.
- * @param jModel Memory address of the LLM.
- * @return Memory address of the context.
+ * @param jPool Memory address of the pool.
  */
-extern "C" JNIEXPORT jlong JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_loadCtx(JNIEnv* /* env */, jobject /* thiz */, jlong jModel) {
-    // Cast memory address of the LLM from Java long to C++ pointer
-    auto cppModel = reinterpret_cast<llama_model*>(jModel);
-
-    // Use default parameters for the context
-    llama_context_params params = llama_context_default_params();
-
-    // Create context with the LLM (=> context knows its state) and save pointer to it
-    llama_context* cppCtx = llama_init_from_model(cppModel, params);
-
-    // Cast C++ pointer to Java long to return it
-    auto jCtx = reinterpret_cast<jlong>(cppCtx);
-
-    return jCtx;
+extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_unloadPool(JNIEnv* /* env */, jobject /* thiz */, jlong jPool) {
+    // Unload contexts and their steganography engines from memory
+    delete reinterpret_cast<ContextPool*>(jPool);
 }
 
 /**
- * Function to unload the context from memory.
+ * Function to lease a context of the pool. Blocks until one is free if all are in use.
  *
  * @param env The JNI environment.
  * @param thiz Java object this function was called with.
- * @param jCtx Memory address of the context.
+ * @param jPool Memory address of the pool.
+ * @param jRole Role of the lease (0 = steganography, 1 = binary conversion), contexts prefer the role they served last to keep KV caches warm.
+ * @return Memory address of the leased context.
  */
-extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_unloadCtx(JNIEnv* /* env */, jobject /* thiz */, jlong jCtx) {
-    // Cast memory address of context from Java long to C++ pointer
-    auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+extern "C" JNIEXPORT jlong JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_acquireCtx(JNIEnv* env, jobject /* thiz */, jlong jPool, jint jRole) {
+    try {
+        auto cppPool = reinterpret_cast<ContextPool*>(jPool);
+
+        llama_context* cppCtx = cppPool -> acquire(jRole);
 
-    // Unload context from memory
-    llama_free(cppCtx);
+        return reinterpret_cast<jlong>(cppCtx);
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
+
+        return 0;
+    }
 }
 
 /**
- * Function to load the sampler into memory.
- *
- * Currently only supports greedy sampler for Huffman encoding.
+ * Function to return a leased context to the pool.
  *
  * @param env The JNI environment.
  * @param thiz Java object this function was called with.
- * @return Memory address of the sampler.
+ * @param jPool Memory address of the pool.
+ * @param jCtx Memory address of the leased context.
  */
-extern "C" JNIEXPORT jlong JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_loadSmpl(JNIEnv* /* env */, jobject /* thiz */) {
-    // Initialize greedy sampler (no sampler chain needed when using only a single sampler)
-    llama_sampler* cppSmpl = llama_sampler_init_greedy();
-
-    // Convert C++ pointer to Java long to return it
-    auto jSmpl = reinterpret_cast<jlong>(cppSmpl);
+extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_releaseCtx(JNIEnv* /* env */, jobject /* thiz */, jlong jPool, jlong jCtx) {
+    auto cppPool = reinterpret_cast<ContextPool*>(jPool);
 
-    return jSmpl;
+    cppPool -> release(reinterpret_cast<llama_context*>(jCtx));
 }
 
 /**
@@ -139,6 +156,144 @@ extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_unloa
     llama_sampler_free(cppSmpl);
 }
 
+/**
+ * Function to load the LLM, a pool of contexts and the sampler on a background thread, so that app start doesn't wait for it.
+ *
+ * Reads the LLM file ahead into the page cache first (if it is memory-mapped) and warms up every context (see `ContextPool`).
+ * Optionally loads a second, smaller LLM with a single context for arithmetic compression, so that converting the secret message doesn't need the large LLM.
+ * Calls `onReady(model, pool, smpl, compressionModel, compressionPool)` of the listener on the background thread when done.
+ * Memory addresses of the LLM, the pool and the sampler are 0 if anything failed, the ones of the compression LLM and its pool if it wasn't requested or failed.
+ *
+ * @param env The JNI environment.
+ * @param thiz Java object this function was called with.
+ * @param jPath Path to the LLM (.gguf file).
+ * @param jCompressionPath Path to the compression LLM (.gguf file), null to use the LLM for compression too.
+ * @param jNumberOfGpuLayers Number of layers to offload to the GPU.
+ * @param jUseMmap Boolean that is true if the LLM should be memory-mapped instead of read into memory, false otherwise.
+ * @param jUseMlock Boolean that is true if the LLM should be locked in memory so it can't be swapped out, false otherwise.
+ * @param jNumberOfContexts Number of contexts, i.e. number of jobs that can run concurrently.
+ * @param jNumberOfThreads Number of threads to split among the leased contexts, 0 for auto.
+ * @param jContextSize Maximum number of tokens in every context, 0 for the default.
+ * @param jBatchSize Maximum number of tokens per call to llama_decode, 0 for the default.
+ * @param jMicroBatchSize Maximum number of tokens per physical batch, 0 for the default.
+ * @param jIsFlashAttentionEnabled Boolean that is true if flash attention should be used, false otherwise.
+ * @param jKVCacheType Ordinal of the KV cache type (0 = default, i.e. F16, 1 = F16, 2 = Q8_0, 3 = Q4_0).
+ * @param jListener Kotlin listener with a method `onReady(Long, Long, Long, Long, Long)`.
+ */
+extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_startAsync(JNIEnv* env, jobject /* thiz */, jstring jPath, jstring jCompressionPath, jint jNumberOfGpuLayers, jboolean jUseMmap, jboolean jUseMlock, jint jNumberOfContexts, jint jNumberOfThreads, jint jContextSize, jint jBatchSize, jint jMicroBatchSize, jboolean jIsFlashAttentionEnabled, jint jKVCacheType, jobject jListener) {
+    // Copy everything the background thread needs, as the arguments of this call become invalid when it returns
+    jboolean isCopy = true;
+    const char* cppPathChars = env -> GetStringUTFChars(jPath, &isCopy);
+    std::string cppPath = cppPathChars;
+    env -> ReleaseStringUTFChars(jPath, cppPathChars);
+
+    std::string cppCompressionPath;
+
+    if (jCompressionPath != nullptr) {
+        const char* cppCompressionPathChars = env -> GetStringUTFChars(jCompressionPath, &isCopy);
+        cppCompressionPath = cppCompressionPathChars;
+        env -> ReleaseStringUTFChars(jCompressionPath, cppCompressionPathChars);
+    }
+
+    EngineConfig config;
+    config.numberOfGpuLayers = jNumberOfGpuLayers;
+    config.useMmap = jUseMmap;
+    config.useMlock = jUseMlock;
+    config.numberOfThreads = jNumberOfThreads;
+    config.contextSize = static_cast<uint32_t>(std::max(0, jContextSize));
+    config.batchSize = static_cast<uint32_t>(std::max(0, jBatchSize));
+    config.microBatchSize = static_cast<uint32_t>(std::max(0, jMicroBatchSize));
+    config.isFlashAttentionEnabled = jIsFlashAttentionEnabled;
+    config.kvCacheType = jKVCacheType;
+    config.resolve();
+
+    int numberOfContexts = jNumberOfContexts;
+
+    // Local references are only valid on this thread, the JavaVM pointer is valid on every thread
+    JavaVM* vm = nullptr;
+    env -> GetJavaVM(&vm);
+
+    jobject listener = env -> NewGlobalRef(jListener);
+
+    std::thread([vm, listener, cppPath, cppCompressionPath, config, numberOfContexts]() {
+        // Pages read ahead now don't fault in one by one during the first decodes
+        if (config.useMmap) {
+            WarmStart::prefetch(cppPath.c_str());
+        }
+
+        llama_model* cppModel = loadModel(cppPath.c_str(), config);
+        ContextPool* cppPool = cppModel != nullptr ? loadPool(cppModel, config, numberOfContexts) : nullptr;
+        llama_sampler* cppSmpl = nullptr;
+
+        if (cppPool != nullptr) {
+            cppSmpl = llama_sampler_init_greedy();
+        }
+        // Don't leave a half-loaded LLM behind
+        else if (cppModel != nullptr) {
+            VocabInfo::unload(cppModel);
+            llama_model_free(cppModel);
+            cppModel = nullptr;
+        }
+
+        // Compression LLM is optional, compression falls back to the LLM if it is missing or fails to load
+        llama_model* cppCompressionModel = nullptr;
+        ContextPool* cppCompressionPool = nullptr;
+
+        if (cppPool != nullptr && !cppCompressionPath.empty()) {
+            // Compression runs one job at a time and never decodes multiple sequences
+            EngineConfig compressionConfig = config;
+            compressionConfig.numberOfSequences = 1;
+
+            if (compressionConfig.useMmap) {
+                WarmStart::prefetch(cppCompressionPath.c_str());
+            }
+
+            cppCompressionModel = loadModel(cppCompressionPath.c_str(), compressionConfig);
+            cppCompressionPool = cppCompressionModel != nullptr ? loadPool(cppCompressionModel, compressionConfig, 1) : nullptr;
+
+            if (cppCompressionPool == nullptr && cppCompressionModel != nullptr) {
+                VocabInfo::unload(cppCompressionModel);
+                llama_model_free(cppCompressionModel);
+                cppCompressionModel = nullptr;
+            }
+        }
+
+        // Attach this thread to the JVM to call the listener, detach it again afterwards
+        JNIEnv* threadEnv = nullptr;
+        vm -> AttachCurrentThread(&threadEnv, nullptr);
+
+        jclass listenerClass = threadEnv -> GetObjectClass(listener);
+        jmethodID onReady = threadEnv -> GetMethodID(listenerClass, "onReady", "(JJJJJ)V");
+
+        threadEnv -> CallVoidMethod(listener, onReady, reinterpret_cast<jlong>(cppModel), reinterpret_cast<jlong>(cppPool), reinterpret_cast<jlong>(cppSmpl), reinterpret_cast<jlong>(cppCompressionModel), reinterpret_cast<jlong>(cppCompressionPool));
+
+        // Exception of the listener can't propagate anywhere from a background thread
+        if (threadEnv -> ExceptionCheck()) {
+            threadEnv -> ExceptionDescribe();
+            threadEnv -> ExceptionClear();
+        }
+
+        threadEnv -> DeleteLocalRef(listenerClass);
+        threadEnv -> DeleteGlobalRef(listener);
+
+        vm -> DetachCurrentThread();
+    }).detach();
+}
+
+/**
+ * Function to get the fingerprint of the LLM, i.e. a hash of its vocabulary and its number of parameters folded to 32 bits.
+ *
+ * @param env The JNI environment.
+ * @param thiz Java object this function was called with.
+ * @param jModel Memory address of the LLM.
+ * @return Fingerprint of the LLM, as a signed integer with the same bits.
+ */
+extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_getFingerprint(JNIEnv* /* env */, jobject /* thiz */, jlong jModel) {
+    auto cppModel = reinterpret_cast<llama_model*>(jModel);
+
+    return static_cast<jint>(VocabInfo::get(cppModel).fingerprint);
+}
+
 /**
  * Function to get the vocabulary size `n_vocab` of the LLM (i.e. the number of available tokens).
  *
@@ -158,6 +313,54 @@ extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_getVo
     return n_vocab;
 }
 
+/**
+ * Function to get the context size `n_ctx` of the contexts of a pool (i.e. the maximum number of tokens per context).
+ *
+ * @param env The JNI environment.
+ * @param thiz Java object this function was called with.
+ * @param jPool Memory address of the pool.
+ * @return Context size of the contexts.
+ */
+extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_getContextSize(JNIEnv* /* env */, jobject /* thiz */, jlong jPool) {
+    auto cppPool = reinterpret_cast<ContextPool*>(jPool);
+
+    return static_cast<jint>(cppPool -> getContextSize());
+}
+
+/**
+ * Function to count the tokens of a string, tokenized the same way as contexts and cover texts.
+ *
+ * @param env The JNI environment.
+ * @param thiz Java object this function was called with.
+ * @param jText Byte array storing a UTF-8 encoded string.
+ * @param jModel Memory address of the LLM.
+ * @return Number of tokens of the string.
+ */
+extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_countTokens(JNIEnv* env, jobject /* thiz */, jbyteArray jText, jlong jModel) {
+    try {
+        auto cppModel = reinterpret_cast<llama_model*>(jModel);
+
+        // Convert Java byte array storing UTF-8 encoding of string to C++ string
+        jboolean isCopy = true;
+        jbyte* jBytes = env -> GetByteArrayElements(jText, &isCopy);
+
+        std::string cppString(reinterpret_cast<char*>(jBytes), env -> GetArrayLength(jText));
+
+        env -> ReleaseByteArrayElements(jText, jBytes, JNI_ABORT);
+
+        // Same flags as LlamaCpp::tokenize, so that the count matches the tokens the context is decoded with
+        llama_tokens tokens = common_tokenize(llama_model_get_vocab(cppModel), cppString, false, true);
+
+        return static_cast<jint>(tokens.size());
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
+
+        return 0;
+    }
+}
+
 /**
  * Function to detokenize an array of token IDs into a byte array storing a UTF-8 encoded string.
  *
@@ -168,34 +371,42 @@ extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_getVo
  * @return Detokenization as a byte array storing a UTF-8 encoded string.
  */
 extern "C" JNIEXPORT jbyteArray JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_detokenize(JNIEnv* env, jobject /* thiz */, jintArray jTokens, jlong jCtx) {
-    // Cast memory address of the context from Java long to C++ pointer
-    auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+    try {
+        // Cast memory address of the context from Java long to C++ pointer
+        auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+
+        // Initialize C++ array for token IDs and fill it
+        jsize jTokensSize = env -> GetArrayLength(jTokens);
 
-    // Initialize C++ array for token IDs and fill it
-    jsize jTokensSize = env -> GetArrayLength(jTokens);
+        llama_tokens cppTokens(jTokensSize);
 
-    llama_tokens cppTokens(jTokensSize);
+        env -> GetIntArrayRegion(jTokens, 0, jTokensSize, reinterpret_cast<jint*>(cppTokens.data()));
 
-    env -> GetIntArrayRegion(jTokens, 0, jTokensSize, reinterpret_cast<jint*>(cppTokens.data()));
+        // Detokenize array of tokens to C++ string
+        // See common.cpp: common_detokenize calls llama_detokenize, with parameters "remove_special = false" hard-coded and "unparse_special = special" passed through
+        std::basic_string<char> cppString = common_detokenize(cppCtx, cppTokens, true);
 
-    // Detokenize array of tokens to C++ string
-    // See common.cpp: common_detokenize calls llama_detokenize, with parameters "remove_special = false" hard-coded and "unparse_special = special" passed through
-    std::basic_string<char> cppString = common_detokenize(cppCtx, cppTokens, true);
+        // Initial solution was to convert cppString to a jstring object using the NewStringUTF function before returning it
+        // JNI docs for NewStringUTF say: "Constructs a new java.lang.String object from an array of characters in modified UTF-8 encoding."
+        // This crashes when the system prompt tells the LLM to generate emojis
+        // Alternatively there is the NewString function, about which JNI docs say: "Constructs a new java.lang.String object from an array of Unicode characters."
+        // Looks like it removes need for wrapper function on Kotlin side, but requires conversion on C++ side
+        // See https://stackoverflow.com/questions/32205446/getting-true-utf-8-characters-in-java-jni for details
 
-    // Initial solution was to convert cppString to a jstring object using the NewStringUTF function before returning it
-    // JNI docs for NewStringUTF say: "Constructs a new java.lang.String object from an array of characters in modified UTF-8 encoding."
-    // This crashes when the system prompt tells the LLM to generate emojis
-    // Alternatively there is the NewString function, about which JNI docs say: "Constructs a new java.lang.String object from an array of Unicode characters."
-    // Looks like it removes need for wrapper function on Kotlin side, but requires conversion on C++ side
-    // See https://stackoverflow.com/questions/32205446/getting-true-utf-8-characters-in-java-jni for details
+        // Initialize Java byte array to store UTF-8 encoding of the C++ string
+        jbyteArray jByteArray = env -> NewByteArray((int32_t) cppString.size());
 
-    // Initialize Java byte array to store UTF-8 encoding of the C++ string
-    jbyteArray jByteArray = env -> NewByteArray((int32_t) cppString.size());
+        // Fill the Java array with the bytes of the C++ string and return it
+        env -> SetByteArrayRegion(jByteArray, 0, (int32_t) cppString.size(), reinterpret_cast<const jbyte*>(cppString.data()));
 
-    // Fill the Java array with the bytes of the C++ string and return it
-    env -> SetByteArrayRegion(jByteArray, 0, (int32_t) cppString.size(), reinterpret_cast<const jbyte*>(cppString.data()));
+        return jByteArray;
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
 
-    return jByteArray;
+        return nullptr;
+    }
 }
 
 /**
@@ -208,36 +419,28 @@ extern "C" JNIEXPORT jbyteArray JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp
  * @param jSmpl Memory address of the sampler.
  * @return ID of the next token.
  */
-extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_sample(JNIEnv* /* env */, jobject /* thiz */, jint lastToken, jlong jCtx, jlong jSmpl) {
-    // Cast memory addresses of context and sampler from Java long to C++ pointers
-    // Casting the last token ID from jint to llama_token is not necessary since both is just int32_t
-    auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
-    auto cppSmpl = reinterpret_cast<llama_sampler*>(jSmpl);
+extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_sample(JNIEnv* env, jobject /* thiz */, jint lastToken, jlong jCtx, jlong jSmpl) {
+    try {
+        // Cast memory addresses of context and sampler from Java long to C++ pointers
+        // Casting the last token ID from jint to llama_token is not necessary since both is just int32_t
+        auto cppCtx = reinterpret_cast<llama_context*>(jCtx);
+        auto cppSmpl = reinterpret_cast<llama_sampler*>(jSmpl);
 
-    // Create a batch containing only the last token
-    // TODO
-    //  llama.cpp docs: "NOTE: this is a helper function to facilitate transition to the new batch API - avoid using it"
-    //  But is used like this in https://github.com/ggml-org/llama.cpp/blob/master/examples/simple/simple.cpp
-    llama_batch batch = llama_batch_get_one(&lastToken, 1);
+        // Run the LLM on the last token via the session of the context, so that the cached tokens stay in sync with its memory
+        StegoEngine::get(cppCtx).getSession().append(lastToken);
 
-    // Check if model architecture is encoder-decoder or decoder-only
-    const llama_model* model = llama_get_model(cppCtx);
+        // Sample next token from logits with given sampler and return it
+        // Again, casting the next token ID is not necessary
+        llama_token nextToken = llama_sampler_sample(cppSmpl, cppCtx, -1);
 
-    if (llama_model_has_encoder(model)) {
-        // Run encoder to calculate logits for the next token
-        // Return value of llama_encode only indicates success/error, actual result is stored internally in cppCtx
-        int32_t encode = llama_encode(cppCtx, batch);
+        return nextToken;
     }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
 
-    // Run decoder to calculate logits for the next token
-    // Return value of llama_decode only indicates success/error, actual result is stored internally in cppCtx
-    int32_t decode = llama_decode(cppCtx, batch);
-
-    // Sample next token from logits with given sampler and return it
-    // Again, casting the next token ID is not necessary
-    llama_token nextToken = llama_sampler_sample(cppSmpl, cppCtx, -1);
-
-    return nextToken;
+        return -1;
+    }
 }
 
 /**
@@ -255,59 +458,94 @@ extern "C" JNIEXPORT jint JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_sampl
  * @return The message formatted as llama.cpp chat message.
  */
 extern "C" JNIEXPORT jstring JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_addMessage(JNIEnv* env, jobject /* thiz */, jstring jRole, jstring jContent, jboolean jAppendAssistant, jlong jModel) {
-    // Mostly follows https://github.com/ggml-org/llama.cpp/blob/master/examples/simple-chat/simple-chat.cpp
+    try {
+        // Mostly follows https://github.com/ggml-org/llama.cpp/blob/master/examples/simple-chat/simple-chat.cpp
 
-    // Convert role and content of the message from Java strings to C++ strings using the JNI environment
-    jboolean isCopy = true;
-    const char* cppRole = env -> GetStringUTFChars(jRole, &isCopy);
-    const char* cppContent = env -> GetStringUTFChars(jContent, &isCopy);
+        // Convert role and content of the message from Java strings to C++ strings using the JNI environment
+        jboolean isCopy = true;
+        const char* cppRole = env -> GetStringUTFChars(jRole, &isCopy);
+        const char* cppContent = env -> GetStringUTFChars(jContent, &isCopy);
 
-    // Cast appendAssistant boolean
-    // static_cast because casting booleans is type safe, unlike reinterpret_cast for casting C++ pointers to Java long
-    auto cppAppendAssistant = static_cast<jboolean>(jAppendAssistant);
+        // Cast appendAssistant boolean
+        // static_cast because casting booleans is type safe, unlike reinterpret_cast for casting C++ pointers to Java long
+        auto cppAppendAssistant = static_cast<jboolean>(jAppendAssistant);
 
-    // Cast memory addresses of the LLM from Java long to C++ pointers
-    auto cppModel = reinterpret_cast<llama_model*>(jModel);
+        // Cast memory addresses of the LLM from Java long to C++ pointers
+        auto cppModel = reinterpret_cast<llama_model*>(jModel);
 
-    // Create vector of chars to store the formatted chat
-    std::vector<char> formatted;
-    // "int prev_len = 0;" isn't overwritten in this implementation
+        // Create vector of chars to store the formatted chat
+        std::vector<char> formatted;
+        // "int prev_len = 0;" isn't overwritten in this implementation
 
-    // Get default chat template of the LLM
-    // Defines syntax the LLM uses to differentiate system prompt, user and assistant messages
-    const char* tmpl = llama_model_chat_template(cppModel, nullptr);
+        // Get default chat template of the LLM
+        // Defines syntax the LLM uses to differentiate system prompt, user and assistant messages
+        const char* tmpl = llama_model_chat_template(cppModel, nullptr);
 
-    // Create chat message from role and content
-    llama_chat_message message = {cppRole, cppContent};
+        // Create chat message from role and content
+        llama_chat_message message = {cppRole, cppContent};
 
-    // Create vector of chat messages store the chat messages
-    std::vector<llama_chat_message> chat;
+        // Create vector of chat messages store the chat messages
+        std::vector<llama_chat_message> chat;
 
-    // Append the new message to the chat
-    chat.push_back(message);
+        // Append the new message to the chat
+        chat.push_back(message);
 
-    // Apply chat template to messages to format them into a single prompt string
-    // Last parameter is current size of buffer for formatted string, return value is required size
-    int32_t new_len = llama_chat_apply_template(tmpl, chat.data(), chat.size(), cppAppendAssistant, formatted.data(), (int32_t) formatted.size());
+        // Apply chat template to messages to format them into a single prompt string
+        // Last parameter is current size of buffer for formatted string, return value is required size
+        int32_t new_len = llama_chat_apply_template(tmpl, chat.data(), chat.size(), cppAppendAssistant, formatted.data(), (int32_t) formatted.size());
 
-    // Check if current size of buffer is enough
-    if (new_len > (int) formatted.size()) {
-        // Resize buffer if needed
-        formatted.resize(new_len);
+        // Check if current size of buffer is enough
+        if (new_len > (int) formatted.size()) {
+            // Resize buffer if needed
+            formatted.resize(new_len);
+
+            // Apply chat template again with resized buffer
+            new_len = llama_chat_apply_template(tmpl, chat.data(), chat.size(), cppAppendAssistant, formatted.data(), (int32_t) formatted.size());
+        }
+
+        // Extract prompt to generate the response by removing previous messages
+        std::string cppPrompt(formatted.begin() /* + prev_len */, formatted.begin() + new_len);
+
+        // Release C++ strings for role and content from memory
+        env -> ReleaseStringUTFChars(jRole, cppRole);
+        env -> ReleaseStringUTFChars(jContent, cppContent);
+
+        // Convert prompt from C++ string to Java string and return it
+        jstring jPrompt = env -> NewStringUTF(cppPrompt.c_str());
+
+        return jPrompt;
+    }
+    catch (const std::exception& exception) {
+        // Throw Kotlin/Java exception instead of C++ exception because we need to catch it on the Kotlin side
+        Exceptions::throwInJava(env, exception);
 
-        // Apply chat template again with resized buffer
-        new_len = llama_chat_apply_template(tmpl, chat.data(), chat.size(), cppAppendAssistant, formatted.data(), (int32_t) formatted.size());
+        return nullptr;
     }
+}
 
-    // Extract prompt to generate the response by removing previous messages
-    std::string cppPrompt(formatted.begin() /* + prev_len */, formatted.begin() + new_len);
+/**
+ * Function to enable or disable native profiling at runtime. Has no effect if the library was built without `HIPS_ENABLE_PROFILING`.
+ *
+ * @param env The JNI environment.
+ * @param thiz Java object this function was called with.
+ * @param jIsEnabled Boolean that is true if the stages of every operation should be measured, false otherwise.
+ */
+extern "C" JNIEXPORT void JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_setProfilingEnabled(JNIEnv* /* env */, jobject /* thiz */, jboolean jIsEnabled) {
+    Profiler::setEnabled(jIsEnabled);
+}
 
-    // Release C++ strings for role and content from memory
-    env -> ReleaseStringUTFChars(jRole, cppRole);
-    env -> ReleaseStringUTFChars(jContent, cppContent);
+/**
+ * Function to get the stats of the last native operation (e.g. `Arithmetic.encode`), i.e. time and number of calls per stage and the performance data of llama.cpp.
+ *
+ * @param env The JNI environment.
+ * @param thiz Java object this function was called with.
+ * @return The stats as a JSON object.
+ */
+extern "C" JNIEXPORT jstring JNICALL Java_org_vonderheidt_hips_utils_LlamaCpp_getStats(JNIEnv* env, jobject /* thiz */) {
+    std::string cppStats = Profiler::getLastStatsAsJson();
 
-    // Convert prompt from C++ string to Java string and return it
-    jstring jPrompt = env -> NewStringUTF(cppPrompt.c_str());
+    // JSON only contains ASCII characters, so modified UTF-8 of NewStringUTF is fine
+    jstring jStats = env -> NewStringUTF(cppStats.c_str());
 
-    return jPrompt;
-}
\ No newline at end of file
+    return jStats;
+}
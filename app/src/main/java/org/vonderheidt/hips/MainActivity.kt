@@ -8,8 +8,6 @@ import androidx.compose.foundation.layout.padding
 import androidx.compose.material3.Scaffold
 import androidx.compose.ui.Modifier
 import androidx.lifecycle.lifecycleScope
-import kotlinx.coroutines.CoroutineScope
-import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.launch
 import org.vonderheidt.hips.data.HiPSDataStore
 import org.vonderheidt.hips.data.HiPSDatabase
@@ -43,7 +41,7 @@ class MainActivity : ComponentActivity() {
 
         // Load LLM on app startup
         if (LLM.isDownloaded()) {
-            CoroutineScope(Dispatchers.IO).launch { LlamaCpp.startInstance() }
+            LlamaCpp.startInstanceAsync()
         }
 
         // Instantiate Room database on app startup
@@ -12,6 +12,7 @@ import androidx.datastore.preferences.preferencesDataStore
 import kotlinx.coroutines.flow.first
 import kotlinx.coroutines.flow.map
 import org.vonderheidt.hips.utils.ConversionMode
+import org.vonderheidt.hips.utils.KVCacheType
 import org.vonderheidt.hips.utils.SteganographyMode
 
 /**
@@ -31,7 +32,23 @@ object HiPSDataStore {
     private val topK = intPreferencesKey("topK")
     private val precision = intPreferencesKey("precision")
     private val bitsPerToken = intPreferencesKey("bitsPerToken")
+    private val adaptiveBitsPerToken = booleanPreferencesKey("adaptiveBitsPerToken")
+    private val minBitsPerToken = intPreferencesKey("minBitsPerToken")
+    private val maxBitsPerToken = intPreferencesKey("maxBitsPerToken")
+    private val numberOfCandidates = intPreferencesKey("numberOfCandidates")
+    private val useCompressionModel = booleanPreferencesKey("useCompressionModel")
     private val splitCoverTexts = booleanPreferencesKey("splitCoverTexts")
+    private val numberOfContexts = intPreferencesKey("numberOfContexts")
+    private val numberOfThreads = intPreferencesKey("numberOfThreads")
+    private val contextSize = intPreferencesKey("contextSize")
+    private val batchSize = intPreferencesKey("batchSize")
+    private val microBatchSize = intPreferencesKey("microBatchSize")
+    // Keys of flash attention and KV cache type were renamed when their defaults were pinned, so values stored by earlier versions (e.g. "Auto") are dropped
+    private val flashAttention = booleanPreferencesKey("isFlashAttentionEnabled")
+    private val kvCacheType = stringPreferencesKey("kvCacheTypeName")
+    private val gpuLayers = intPreferencesKey("gpuLayers")
+    private val useMmap = booleanPreferencesKey("useMmap")
+    private val useMlock = booleanPreferencesKey("useMlock")
 
     // Annotate the variable referencing the DataStore instance as volatile so that r/w to it is atomic and immediately visible to all threads
     // Avoids race conditions, i.e. multiple threads trying to start the DataStore simultaneously
@@ -99,6 +116,23 @@ object HiPSDataStore {
                 Settings.precision = precision
                 Settings.bitsPerToken = bitsPerToken
                 Settings.splitCoverTexts = splitCoverTexts
+
+                // Engine, adaptive Huffman, candidate and compression LLM settings were added later, so keep the defaults for any that aren't stored yet instead of resetting all settings
+                settings[numberOfContexts]?.let { Settings.numberOfContexts = it }
+                settings[numberOfThreads]?.let { Settings.numberOfThreads = it }
+                settings[contextSize]?.let { Settings.contextSize = it }
+                settings[batchSize]?.let { Settings.batchSize = it }
+                settings[microBatchSize]?.let { Settings.microBatchSize = it }
+                settings[flashAttention]?.let { Settings.flashAttention = it }
+                settings[kvCacheType]?.let { Settings.kvCacheType = KVCacheType.valueOf(it) }
+                settings[gpuLayers]?.let { Settings.gpuLayers = it }
+                settings[useMmap]?.let { Settings.useMmap = it }
+                settings[useMlock]?.let { Settings.useMlock = it }
+                settings[adaptiveBitsPerToken]?.let { Settings.adaptiveBitsPerToken = it }
+                settings[minBitsPerToken]?.let { Settings.minBitsPerToken = it }
+                settings[maxBitsPerToken]?.let { Settings.maxBitsPerToken = it }
+                settings[numberOfCandidates]?.let { Settings.numberOfCandidates = it }
+                settings[useCompressionModel]?.let { Settings.useCompressionModel = it }
             }
             // Otherwise (i.e. upon installation of this app), store default settings and return them
             else {
@@ -122,6 +156,21 @@ object HiPSDataStore {
             settings[precision] = Settings.precision
             settings[bitsPerToken] = Settings.bitsPerToken
             settings[splitCoverTexts] = Settings.splitCoverTexts
+            settings[numberOfContexts] = Settings.numberOfContexts
+            settings[numberOfThreads] = Settings.numberOfThreads
+            settings[contextSize] = Settings.contextSize
+            settings[batchSize] = Settings.batchSize
+            settings[microBatchSize] = Settings.microBatchSize
+            settings[flashAttention] = Settings.flashAttention
+            settings[kvCacheType] = Settings.kvCacheType.name
+            settings[gpuLayers] = Settings.gpuLayers
+            settings[useMmap] = Settings.useMmap
+            settings[useMlock] = Settings.useMlock
+            settings[adaptiveBitsPerToken] = Settings.adaptiveBitsPerToken
+            settings[minBitsPerToken] = Settings.minBitsPerToken
+            settings[maxBitsPerToken] = Settings.maxBitsPerToken
+            settings[numberOfCandidates] = Settings.numberOfCandidates
+            settings[useCompressionModel] = Settings.useCompressionModel
         }
     }
 }
\ No newline at end of file
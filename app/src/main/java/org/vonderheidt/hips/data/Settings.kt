@@ -1,6 +1,7 @@
 package org.vonderheidt.hips.data
 
 import org.vonderheidt.hips.utils.ConversionMode
+import org.vonderheidt.hips.utils.KVCacheType
 import org.vonderheidt.hips.utils.LlamaCpp
 import org.vonderheidt.hips.utils.SteganographyMode
 import kotlin.math.ceil
@@ -12,6 +13,7 @@ import kotlin.math.log2
 object Settings {
     // Define default values
     private val defaultConversionMode = ConversionMode.Arithmetic
+    private val defaultUseCompressionModel = false  // Compress with the optional smaller LLM, sender and receiver need the same value and both need it downloaded
     private val defaultSystemPrompt = """
         Let's do a role play.
         You and I are friends, texting with each other.
@@ -27,10 +29,27 @@ object Settings {
     private val defaultTopK = 0             // Only used if LLM is not in memory
     private val defaultPrecision = 0        // Only used if LLM is not in memory
     private val defaultBitsPerToken = 2
+    private val defaultAdaptiveBitsPerToken = false     // Choose bits per token between min and max based on the probabilities instead of using bitsPerToken
+    private val defaultMinBitsPerToken = 1
+    private val defaultMaxBitsPerToken = 4
+    private val defaultNumberOfCandidates = 1   // Encode this many candidate cover texts at once and send the most natural one
     private val defaultSplitCoverTexts = true
+    private val defaultNumberOfContexts = 2     // Steganography and binary conversion can run concurrently
+    private val defaultNumberOfThreads = 0      // 0 = auto, chosen based on the cores of the device
+    // Context size, batch sizes, flash attention and KV cache type change the logits, so sender and receiver need the same values (like bitsPerToken)
+    // Defaults are fixed instead of chosen based on the device, 0 (or KVCacheType.Default) means the fixed default of EngineConfig
+    private val defaultContextSize = 0          // 0 = 2048 tokens
+    private val defaultBatchSize = 0            // 0 = 512 tokens
+    private val defaultMicroBatchSize = 0       // 0 = 512 tokens
+    private val defaultFlashAttention = false   // Enabling it must be supported by the backend of both devices
+    private val defaultKVCacheType = KVCacheType.Default
+    private val defaultGpuLayers = 0
+    private val defaultUseMmap = true
+    private val defaultUseMlock = false
 
     // Initialize current values with defaults
     var conversionMode = defaultConversionMode
+    var useCompressionModel = defaultUseCompressionModel
     var systemPrompt = defaultSystemPrompt
     var numberOfMessages = defaultNumberOfMessages
     var steganographyMode = defaultSteganographyMode
@@ -38,7 +57,21 @@ object Settings {
     var topK = defaultTopK
     var precision = defaultPrecision
     var bitsPerToken = defaultBitsPerToken
+    var adaptiveBitsPerToken = defaultAdaptiveBitsPerToken
+    var minBitsPerToken = defaultMinBitsPerToken
+    var maxBitsPerToken = defaultMaxBitsPerToken
+    var numberOfCandidates = defaultNumberOfCandidates
     var splitCoverTexts = defaultSplitCoverTexts
+    var numberOfContexts = defaultNumberOfContexts
+    var numberOfThreads = defaultNumberOfThreads
+    var contextSize = defaultContextSize
+    var batchSize = defaultBatchSize
+    var microBatchSize = defaultMicroBatchSize
+    var flashAttention = defaultFlashAttention
+    var kvCacheType = defaultKVCacheType
+    var gpuLayers = defaultGpuLayers
+    var useMmap = defaultUseMmap
+    var useMlock = defaultUseMlock
 
     /**
      * Function to reset the settings to their default values.
@@ -49,12 +82,27 @@ object Settings {
     fun reset(general: Boolean, llm: Boolean) {
         if (general) {
             conversionMode = defaultConversionMode
+            useCompressionModel = defaultUseCompressionModel
             systemPrompt = defaultSystemPrompt
             numberOfMessages = defaultNumberOfMessages
             steganographyMode = defaultSteganographyMode
             temperature = defaultTemperature
             bitsPerToken = defaultBitsPerToken
+            adaptiveBitsPerToken = defaultAdaptiveBitsPerToken
+            minBitsPerToken = defaultMinBitsPerToken
+            maxBitsPerToken = defaultMaxBitsPerToken
+            numberOfCandidates = defaultNumberOfCandidates
             splitCoverTexts = defaultSplitCoverTexts
+            numberOfContexts = defaultNumberOfContexts
+            numberOfThreads = defaultNumberOfThreads
+            contextSize = defaultContextSize
+            batchSize = defaultBatchSize
+            microBatchSize = defaultMicroBatchSize
+            flashAttention = defaultFlashAttention
+            kvCacheType = defaultKVCacheType
+            gpuLayers = defaultGpuLayers
+            useMmap = defaultUseMmap
+            useMlock = defaultUseMlock
         }
         if (llm) {
             topK = if (LlamaCpp.isInMemory()) LlamaCpp.getVocabSize() else defaultTopK
@@ -64,6 +64,7 @@ import org.vonderheidt.hips.navigation.Screen
 import org.vonderheidt.hips.utils.LlamaCpp
 import org.vonderheidt.hips.utils.Steganography
 import org.vonderheidt.hips.utils.SteganographyMode
+import java.util.concurrent.CancellationException
 
 /**
  * Function that defines the conversation screen.
@@ -80,10 +81,12 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
     var isAlice by rememberSaveable { mutableStateOf(true) }
     var isPlainText by rememberSaveable { mutableStateOf(false) }
     var isEncoding by rememberSaveable { mutableStateOf(false) }
+    var isEncodingCancelled by rememberSaveable { mutableStateOf(false) }
+    var coverTextPreview by rememberSaveable { mutableStateOf("") }
     var isDecoding by rememberSaveable { mutableStateOf(false) }
     var isSecretMessageVisible by rememberSaveable { mutableStateOf(false) }
-    var messageToDecode by rememberSaveable { mutableStateOf<Message?>(null) }
-    var secretMessage by rememberSaveable { mutableStateOf("") }
+    var messagesToDecode by rememberSaveable { mutableStateOf(listOf<Message>()) }
+    var secretMessages by rememberSaveable { mutableStateOf(listOf<String?>()) }
 
     // Database
     val db = HiPSDatabase.getInstance()
@@ -116,10 +119,10 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
             IconButton(
                 onClick = {
                     // Reset state variables, just like when decode button is hidden, otherwise app crashes when pressing the back button while a secret message is visible
-                    // Only "messageToDecode = null" is actually needed, but reset others too for consistency
+                    // Only "messagesToDecode = listOf()" is actually needed, but reset others too for consistency
                     isSecretMessageVisible = false
-                    secretMessage = ""
-                    messageToDecode = null
+                    secretMessages = listOf()
+                    messagesToDecode = listOf()
                     selectedMessages = listOf()
 
                     // Navigate back to home screen
@@ -179,55 +182,89 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                                 Toast.makeText(currentLocalContext, "Arithmetic coding needs topK > 0 and precision > 0", Toast.LENGTH_LONG).show()
                                 return@IconButton
                             }
-                            // Only 1 message can be decoded at a time
-                            if (selectedMessages.size != 1) {
-                                Toast.makeText(currentLocalContext, "Only 1 message can be decoded at a time", Toast.LENGTH_LONG).show()
+                            // Split cover texts span multiple messages, so only 1 of them can be decoded at a time
+                            if (Settings.splitCoverTexts && selectedMessages.size != 1) {
+                                Toast.makeText(currentLocalContext, "Only 1 message can be decoded at a time when cover texts are split", Toast.LENGTH_LONG).show()
                                 return@IconButton
                             }
 
                             // Update state variables
                             isDecoding = true
-                            messageToDecode = selectedMessages[0]
+                            messagesToDecode = selectedMessages
 
-                            CoroutineScope(Dispatchers.Default).launch {
-                                // Decoding needs to reproduce the state the message was encoded in
-                                var priorMessages = messages.subList(fromIndex = 0, toIndex = messages.indexOf(messageToDecode))    // Start inclusive, end exclusive
-
-                                var context = LlamaCpp.formatChat(priorMessages, isAlice = messageToDecode!!.senderID == User.Alice.id)
-                                var coverText = messageToDecode!!.content
+                            // Multiple messages are decoded together in shared batches, which is faster than decoding them one after another
+                            if (messagesToDecode.size > 1) {
+                                CoroutineScope(Dispatchers.Default).launch {
+                                    secretMessages = try {
+                                        // Decoding every message needs to reproduce the state it was encoded in
+                                        val contexts = messagesToDecode.map { message ->
+                                            val priorMessages = messages.subList(fromIndex = 0, toIndex = messages.indexOf(message))    // Start inclusive, end exclusive
 
-                                if (Settings.splitCoverTexts) {
-                                    var isFirstMessageOfSplit = Steganography.isFirstMessageOfSplit(context, coverText)
-
-                                    while (!isFirstMessageOfSplit) {
-                                        // Prepend prior message
-                                        val messageToPrepend = priorMessages.last()
-                                        priorMessages = priorMessages.dropLast(1)
+                                            LlamaCpp.formatChat(priorMessages, isAlice = message.senderID == User.Alice.id)
+                                        }
 
-                                        context = LlamaCpp.formatChat(priorMessages, isAlice = messageToDecode!!.senderID == User.Alice.id)
-                                        coverText = messageToPrepend.content + "\n\n" + coverText
+                                        Steganography.decodeAll(contexts, messagesToDecode.map { it.content })
+                                    }
+                                    catch (exception: Exception) {
+                                        messagesToDecode.map { null }
+                                    }
 
-                                        // Update loop variable
-                                        isFirstMessageOfSplit = Steganography.isFirstMessageOfSplit(context, coverText)
+                                    // Messages that couldn't be decoded keep showing their cover text
+                                    if (secretMessages.any { it == null }) {
+                                        withContext(Dispatchers.Main) {
+                                            Toast.makeText(currentLocalContext, "Some messages couldn't be decoded", Toast.LENGTH_LONG).show()
+                                        }
                                     }
+
+                                    // Update state variables
+                                    isDecoding = false
+                                    isSecretMessageVisible = true
                                 }
 
+                                return@IconButton
+                            }
+
+                            val messageToDecode = messagesToDecode[0]
+
+                            CoroutineScope(Dispatchers.Default).launch {
                                 // See if message can be decoded, show toast otherwise
                                 try {
+                                    // Decoding needs to reproduce the state the message was encoded in
+                                    var priorMessages = messages.subList(fromIndex = 0, toIndex = messages.indexOf(messageToDecode))    // Start inclusive, end exclusive
+
+                                    var context = LlamaCpp.formatChat(priorMessages, isAlice = messageToDecode.senderID == User.Alice.id)
+                                    var coverText = messageToDecode.content
+
+                                    if (Settings.splitCoverTexts) {
+                                        var isFirstMessageOfSplit = Steganography.isFirstMessageOfSplit(context, coverText)
+
+                                        while (!isFirstMessageOfSplit) {
+                                            // Prepend prior message
+                                            val messageToPrepend = priorMessages.last()
+                                            priorMessages = priorMessages.dropLast(1)
+
+                                            context = LlamaCpp.formatChat(priorMessages, isAlice = messageToDecode.senderID == User.Alice.id)
+                                            coverText = messageToPrepend.content + "\n\n" + coverText
+
+                                            // Update loop variable
+                                            isFirstMessageOfSplit = Steganography.isFirstMessageOfSplit(context, coverText)
+                                        }
+                                    }
+
                                     // TODO Downward concat of split cover text
                                     //  The following if is is a simpler solution that doesn't need decoding to be resumable, so we don't have to overcomplicate state management of the LLM
                                     //  But this approach may decode significantly more cover text than needed, as we just concat all subsequent messages of the same user (i.e. until end-of-turn in the conversation)
                                     if (Settings.splitCoverTexts) {
                                         if (messages.indexOf(messageToDecode) + 1 < messages.size) {
                                             for (messageToAppend in messages.subList(messages.indexOf(messageToDecode) + 1, messages.size)) {
-                                                if (messageToAppend.senderID == messageToDecode!!.senderID) {
+                                                if (messageToAppend.senderID == messageToDecode.senderID) {
                                                     coverText += "\n\n" + messageToAppend.content
                                                 }
                                             }
                                         }
                                     }
 
-                                    secretMessage = Steganography.decode(context, coverText)
+                                    secretMessages = listOf(Steganography.decode(context, coverText))
 
                                     // TODO Downward concat of split cover text
                                     //  The following if is how I wanted downward concat to work, but it seems to be more complex than I thought - see all other places marked with the above to-do.
@@ -261,6 +298,8 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                                     */
                                 }
                                 catch (exception: Exception) {
+                                    secretMessages = listOf(null)
+
                                     withContext(Dispatchers.Main) {
                                         Toast.makeText(currentLocalContext, "Message couldn't be decoded", Toast.LENGTH_LONG).show()
                                     }
@@ -274,8 +313,8 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                         else {
                             // Reset state variables
                             isSecretMessageVisible = false
-                            secretMessage = ""
-                            messageToDecode = null
+                            secretMessages = listOf()
+                            messagesToDecode = listOf()
                             selectedMessages = listOf()
                         }
                     },
@@ -306,10 +345,10 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                         messages = messages.dropLast(selectedMessages.size)
                         selectedMessages = listOf()
 
-                        // Reset state variables, just like when decode button is hidden, otherwise secretMessage is still visible after deleting other messages
+                        // Reset state variables, just like when decode button is hidden, otherwise secret messages are still visible after deleting other messages
                         isSecretMessageVisible = false
-                        secretMessage = ""
-                        messageToDecode = null
+                        secretMessages = listOf()
+                        messagesToDecode = listOf()
                         // "selectedMessages = listOf()" is redundant
                     },
                     enabled = !(isEncoding || isDecoding)
@@ -365,8 +404,8 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                                         // Reset state variables, just like when decode button is hidden, otherwise secret message is still visible when last message is unselected
                                         if (selectedMessages.isEmpty()) {
                                             isSecretMessageVisible = false
-                                            secretMessage = ""
-                                            messageToDecode = null
+                                            secretMessages = listOf()
+                                            messagesToDecode = listOf()
                                             // "selectedMessages = listOf()" is redundant
                                         }
                                     }
@@ -374,7 +413,7 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                             }
                     ) {
                         // Show loading animation while message is being decoded
-                        if (isDecoding && message == messageToDecode) {
+                        if (isDecoding && message in messagesToDecode) {
                             CircularProgressIndicator(
                                 modifier = modifier
                                     .padding(8.dp)
@@ -385,7 +424,7 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                         // Show cover text or, if decoding was successful, secret message
                         else {
                             Text(
-                                text = if (isSecretMessageVisible && message == messageToDecode) secretMessage else message.content,
+                                text = (if (isSecretMessageVisible) secretMessages.getOrNull(messagesToDecode.indexOf(message)) else null) ?: message.content,
                                 color = Color.White
                             )
                         }
@@ -394,6 +433,34 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
 
                 Spacer(modifier = modifier.height(8.dp))
             }
+
+            // Show the cover text while it is being generated, faded until it is sent
+            if (isEncoding && coverTextPreview.isNotEmpty()) {
+                item {
+                    Row(
+                        modifier = modifier.fillMaxWidth(),
+                        horizontalArrangement = if (isAlice) Arrangement.End else Arrangement.Start
+                    ) {
+                        Box(
+                            modifier = modifier
+                                .fillMaxWidth(0.9f)
+                                .background(
+                                    color = if (isAlice) Color(0xFF00695C) else Color(0xFFAD1457),
+                                    shape = RoundedCornerShape(4.dp)
+                                )
+                                .graphicsLayer(alpha = 0.5f)
+                                .padding(8.dp)
+                        ) {
+                            Text(
+                                text = coverTextPreview,
+                                color = Color.White
+                            )
+                        }
+                    }
+
+                    Spacer(modifier = modifier.height(8.dp))
+                }
+            }
         }
 
         Row(
@@ -425,13 +492,18 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
             // Colour corresponds to user a new message is being sent as
             Box {
                 IconButton(
-                    onClick = { /* See onTap of Icon */ },
+                    onClick = {
+                        // Tapping the loading animation cancels encoding, otherwise see onTap of Icon
+                        if (isEncoding) {
+                            isEncodingCancelled = true
+                        }
+                    },
                     modifier = modifier
                         .background(
                             color = if (isAlice) Color(0xFF00695C) else Color(0xFFAD1457),
                             shape = CircleShape
                         ),
-                    enabled = !(isEncoding || isDecoding)
+                    enabled = !isDecoding
                 ) {
                     // Show loading animation while encoding
                     if (isEncoding) {
@@ -472,14 +544,16 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                                             return@detectTapGestures
                                         }
 
-                                        // Update state variable
+                                        // Update state variables
                                         isEncoding = true
+                                        isEncodingCancelled = false
+                                        coverTextPreview = ""
 
                                         // Reset state variables, just like when decode button is hidden, otherwise secret message is still visible after send button is pressed
                                         if (selectedMessages.isNotEmpty()) {
                                             isSecretMessageVisible = false
-                                            secretMessage = ""
-                                            messageToDecode = null
+                                            secretMessages = listOf()
+                                            messagesToDecode = listOf()
                                             selectedMessages = listOf()
                                         }
 
@@ -489,11 +563,36 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
 
                                         // Launch coroutine so UI in main thread isn't blocked
                                         CoroutineScope(Dispatchers.Default).launch {
-                                            // Apply chat template to system prompt and prior messages
-                                            val context = LlamaCpp.formatChat(messages, isAlice)
-
                                             // Generate cover text and update database
-                                            val newCoverText = if (isPlainText) newSecretMessage else Steganography.encode(context, newSecretMessage)
+                                            // Cover text is streamed into the preview while it is being generated, encoding stops at the next token once it is cancelled
+                                            val newCoverText = try {
+                                                // Apply chat template to system prompt and prior messages
+                                                val context = LlamaCpp.formatChat(messages, isAlice)
+
+                                                if (isPlainText) newSecretMessage else Steganography.encode(context, newSecretMessage) { chunk ->
+                                                    coverTextPreview += chunk
+
+                                                    !isEncodingCancelled
+                                                }
+                                            }
+                                            catch (exception: CancellationException) {
+                                                null
+                                            }
+                                            catch (exception: Exception) {
+                                                withContext(Dispatchers.Main) {
+                                                    Toast.makeText(currentLocalContext, "Cover text couldn't be generated", Toast.LENGTH_LONG).show()
+                                                }
+
+                                                null
+                                            }
+
+                                            // Keep the secret message in the input field to edit or send it again
+                                            if (newCoverText == null) {
+                                                coverTextPreview = ""
+                                                isEncoding = false
+
+                                                return@launch
+                                            }
 
                                             // Split cover text into paragraphs based on settings
                                             val paragraphs = if (!isPlainText && Settings.splitCoverTexts) Steganography.split(newCoverText) else listOf(newCoverText)
@@ -513,6 +612,7 @@ fun ConversationScreen(navController: NavController, modifier: Modifier) {
                                             // Update state variables
                                             newSecretMessage = ""
                                             isAlice = !isAlice
+                                            coverTextPreview = ""
                                             isEncoding = false
                                         }
                                     }
@@ -61,6 +61,7 @@ import org.vonderheidt.hips.utils.LLM
 import org.vonderheidt.hips.utils.LlamaCpp
 import org.vonderheidt.hips.utils.Steganography
 import org.vonderheidt.hips.utils.SteganographyMode
+import java.util.concurrent.CancellationException
 
 /**
  * Function that defines the home screen.
@@ -78,6 +79,7 @@ fun HomeScreen(navController: NavController, modifier: Modifier) {
     var selectedMode by rememberSaveable { mutableIntStateOf(0) }
     var isOutputVisible by rememberSaveable { mutableStateOf(false) }
     var isLoading by rememberSaveable { mutableStateOf(false) }
+    var isEncodingCancelled by rememberSaveable { mutableStateOf(false) }
     var coverText by rememberSaveable { mutableStateOf("") }
 
     // Start button
@@ -274,6 +276,11 @@ fun HomeScreen(navController: NavController, modifier: Modifier) {
             // Start button
             Button(
                 onClick = {
+                    // Button cancels encoding while the cover text is being generated
+                    if (isLoading) {
+                        isEncodingCancelled = true
+                        return@Button
+                    }
                     // Check if LLM is loaded
                     if (!LlamaCpp.isInMemory()) {
                         Toast.makeText(currentLocalContext, "Load LLM into memory first", Toast.LENGTH_LONG).show()
@@ -299,8 +306,10 @@ fun HomeScreen(navController: NavController, modifier: Modifier) {
                     }
 
                     // Hide old output when start button is pressed again, show loading animation
-                    isOutputVisible = false
+                    // Cover text is shown while it is being generated, secret message only when decoding is finished
+                    isOutputVisible = selectedMode == 0
                     isLoading = true
+                    isEncodingCancelled = false
 
                     // Call encode or decode function as coroutine, depending on mode selected
                     // Use Dispatchers.Default since LLM inference is CPU-bound
@@ -311,27 +320,58 @@ fun HomeScreen(navController: NavController, modifier: Modifier) {
                         var formattedContext = context
 
                         // System prompt is added transparently, roles are assumed to be strictly alternating, number of messages used as context is 1
-                        if (isConversation) {
-                            // Alice encodes her secret message with Bob's last message as context
-                            if (selectedMode == 0) {
-                                val priorMessages = listOf(
-                                    Message(senderID = User.Bob.id, receiverID = User.Alice.id, content = context)
-                                )
-
-                                formattedContext = LlamaCpp.formatChat(priorMessages, isAlice = true, numberOfMessages = 1)
-                            }
-                            // Alice decodes Bob's cover text with her last message as context
-                            else {
-                                val priorMessages = listOf(
-                                    Message(senderID = User.Alice.id, receiverID = User.Bob.id, content = context)
-                                )
+                        // Context can't be formatted if the context window of the LLM is too small
+                        try {
+                            if (isConversation) {
+                                // Alice encodes her secret message with Bob's last message as context
+                                if (selectedMode == 0) {
+                                    val priorMessages = listOf(
+                                        Message(senderID = User.Bob.id, receiverID = User.Alice.id, content = context)
+                                    )
+
+                                    formattedContext = LlamaCpp.formatChat(priorMessages, isAlice = true, numberOfMessages = 1)
+                                }
+                                // Alice decodes Bob's cover text with her last message as context
+                                else {
+                                    val priorMessages = listOf(
+                                        Message(senderID = User.Alice.id, receiverID = User.Bob.id, content = context)
+                                    )
 
-                                formattedContext = LlamaCpp.formatChat(priorMessages, isAlice = false, numberOfMessages = 1)
+                                    formattedContext = LlamaCpp.formatChat(priorMessages, isAlice = false, numberOfMessages = 1)
+                                }
                             }
                         }
+                        catch (exception: Exception) {
+                            withContext(Dispatchers.Main) {
+                                Toast.makeText(currentLocalContext, "Context couldn't be formatted", Toast.LENGTH_LONG).show()
+                            }
+
+                            isLoading = false
+                            isOutputVisible = false
+                            return@launch
+                        }
 
                         if (selectedMode == 0) {
-                            coverText = Steganography.encode(formattedContext, secretMessage)
+                            coverText = ""
+
+                            // Stream the cover text into the output, encoding stops at the next token once it is cancelled
+                            try {
+                                coverText = Steganography.encode(formattedContext, secretMessage) { chunk ->
+                                    coverText += chunk
+
+                                    !isEncodingCancelled
+                                }
+                            }
+                            catch (exception: CancellationException) {
+                                coverText = ""
+                            }
+                            catch (exception: Exception) {
+                                coverText = ""
+
+                                withContext(Dispatchers.Main) {
+                                    Toast.makeText(currentLocalContext, "Cover text couldn't be generated", Toast.LENGTH_LONG).show()
+                                }
+                            }
                         }
                         else {
                             // Try-catch should only be necessary when conversation switch is set
@@ -347,12 +387,13 @@ fun HomeScreen(navController: NavController, modifier: Modifier) {
 
                         // Hide loading animation, show new output only when encode or decode is finished
                         isLoading = false
-                        isOutputVisible = true
+                        isOutputVisible = selectedMode == 1 || coverText.isNotEmpty()
                     }
                 },
                 shape = RoundedCornerShape(4.dp)
             ) {
-                Text(text = "Start")
+                // Only encoding can be cancelled, decoding is not streamed
+                Text(text = if (isLoading && selectedMode == 0) "Cancel" else "Start")
             }
         }
 
@@ -380,7 +421,7 @@ fun HomeScreen(navController: NavController, modifier: Modifier) {
                     text = coverText,
                     modifier = modifier
                         .fillMaxWidth(0.8f)
-                        .clickable {
+                        .clickable(enabled = !isLoading) {
                             // Copy cover text to clipboard
                             val clip = ClipData.newPlainText("Cover text", coverText)
                             clipboardManager.setPrimaryClip(clip)
@@ -19,6 +19,7 @@ import androidx.compose.material.icons.Icons
 import androidx.compose.material.icons.automirrored.outlined.ArrowBack
 import androidx.compose.material.icons.outlined.CheckCircle
 import androidx.compose.material.icons.outlined.Clear
+import androidx.compose.material.icons.outlined.Info
 import androidx.compose.material.icons.outlined.Key
 import androidx.compose.material.icons.outlined.Lock
 import androidx.compose.material.icons.outlined.Pause
@@ -35,6 +36,7 @@ import androidx.compose.material3.IconButton
 import androidx.compose.material3.MultiChoiceSegmentedButtonRow
 import androidx.compose.material3.OutlinedTextField
 import androidx.compose.material3.RadioButton
+import androidx.compose.material3.RangeSlider
 import androidx.compose.material3.SegmentedButton
 import androidx.compose.material3.SegmentedButtonDefaults
 import androidx.compose.material3.Slider
@@ -83,8 +85,10 @@ import kotlin.math.roundToInt
 fun SettingsScreen(navController: NavController, modifier: Modifier) {
     // State variables
     var isDownloaded by rememberSaveable { mutableStateOf(LLM.isDownloaded()) }
+    var isCompressionModelDownloaded by rememberSaveable { mutableStateOf(LLM.isCompressionModelDownloaded()) }
     var isInMemory by rememberSaveable { mutableStateOf(LlamaCpp.isInMemory()) }
     var selectedConversionMode by rememberSaveable { mutableStateOf(Settings.conversionMode) }
+    var selectedUseCompressionModel by rememberSaveable { mutableStateOf(Settings.useCompressionModel) }
     var systemPrompt by rememberSaveable { mutableStateOf(Settings.systemPrompt) }
     var selectedNumberOfMessages by rememberSaveable { mutableIntStateOf(Settings.numberOfMessages) }
     var selectedSteganographyMode by rememberSaveable { mutableStateOf(Settings.steganographyMode) }
@@ -92,6 +96,10 @@ fun SettingsScreen(navController: NavController, modifier: Modifier) {
     var selectedTopK by rememberSaveable { mutableIntStateOf(Settings.topK) }
     var selectedPrecision by remember { mutableIntStateOf(Settings.precision) }
     var selectedBitsPerToken by rememberSaveable { mutableIntStateOf(Settings.bitsPerToken) }
+    var selectedAdaptiveBitsPerToken by rememberSaveable { mutableStateOf(Settings.adaptiveBitsPerToken) }
+    var selectedMinBitsPerToken by rememberSaveable { mutableIntStateOf(Settings.minBitsPerToken) }
+    var selectedMaxBitsPerToken by rememberSaveable { mutableIntStateOf(Settings.maxBitsPerToken) }
+    var selectedNumberOfCandidates by rememberSaveable { mutableIntStateOf(Settings.numberOfCandidates) }
     var selectedSplitCoverTexts by rememberSaveable { mutableStateOf(Settings.splitCoverTexts) }
     val selectedResetModes = remember { mutableStateListOf(0, 1) }
 
@@ -233,6 +241,44 @@ fun SettingsScreen(navController: NavController, modifier: Modifier) {
             }
 
             Spacer(modifier = modifier.height(16.dp))
+
+            // Optional compression LLM download
+            Row(
+                modifier = modifier.fillMaxWidth(0.9f)
+            ) {
+                Icon(
+                    imageVector = if (isCompressionModelDownloaded) Icons.Outlined.CheckCircle else Icons.Outlined.Info,
+                    contentDescription = if (isCompressionModelDownloaded) "Check mark" else "Info"
+                )
+
+                Spacer(modifier = modifier.width(16.dp))
+
+                if (isCompressionModelDownloaded) {
+                    Text(text = "The smaller LLM for Arithmetic compression has been downloaded. Select it in the conversion settings, it is used after the LLM is started again.")
+                }
+                else {
+                    Text(text = "Optionally, download a smaller LLM to speed up Arithmetic compression. Secret messages can only be decompressed if the receiver has downloaded and selected it too.")
+                }
+            }
+
+            Spacer(modifier = modifier.height(16.dp))
+
+            Row {
+                Button(
+                    onClick = {
+                        if (!isCompressionModelDownloaded) {
+                            LLM.downloadCompressionModel(currentLocalContext)
+                            isCompressionModelDownloaded = true
+                        }
+                    },
+                    enabled = !isCompressionModelDownloaded,
+                    shape = RoundedCornerShape(4.dp)
+                ) {
+                    Text(text = "Download")
+                }
+            }
+
+            Spacer(modifier = modifier.height(16.dp))
         }
 
         // Conversion settings
@@ -292,6 +338,31 @@ fun SettingsScreen(navController: NavController, modifier: Modifier) {
                         Text(text = conversionMode.toString())
                     }
                 }
+
+                Spacer(modifier = modifier.height(16.dp))
+
+                // Select compression LLM, has to match the one of the receiver
+                Row (
+                    modifier = modifier.fillMaxWidth(),
+                    horizontalArrangement = Arrangement.SpaceBetween,
+                    verticalAlignment = Alignment.CenterVertically
+                ) {
+                    Text(text = "Compress with smaller LLM")
+
+                    Switch(
+                        checked = selectedUseCompressionModel,
+                        onCheckedChange = {
+                            // Update state variable
+                            selectedUseCompressionModel = !selectedUseCompressionModel
+
+                            // Update DataStore
+                            Settings.useCompressionModel = selectedUseCompressionModel
+                            coroutineScope.launch { HiPSDataStore.writeSettings() }
+                        },
+                        // Can always be turned off, but only turned on once the compression LLM is downloaded
+                        enabled = isCompressionModelDownloaded || selectedUseCompressionModel
+                    )
+                }
             }
         }
 
@@ -517,8 +588,8 @@ fun SettingsScreen(navController: NavController, modifier: Modifier) {
                             Spacer(modifier = modifier.height(16.dp))
 
                             // Again, do int conversion here as slider only allows floats
-                            // Don't expose 64 bit precision from Arithmetic compression in UI for steganography, encoding would take ages and offer no benefit with vocabulary sizes of current LLMs
-                            // Using 64 bits internally also avoids integer overflows at 31-32 bits
+                            // Don't expose 40 bit precision from Arithmetic compression in UI for steganography, encoding would take ages and offer no benefit with vocabulary sizes of current LLMs
+                            // Using 64 bit integers internally also avoids integer overflows at 31-32 bits, precision above 47 would overflow the scale factor (see ArithmeticCoder::calculateSubintervals)
                             Slider(
                                 value = selectedPrecision.toFloat(),
                                 onValueChange = {
@@ -552,29 +623,110 @@ fun SettingsScreen(navController: NavController, modifier: Modifier) {
 
                         Spacer(modifier = modifier.height(16.dp))
 
-                        // Again, do int conversion here as slider only allows floats
-                        Slider(
-                            value = selectedBitsPerToken.toFloat(),
-                            onValueChange = {
-                                // Update state variable
-                                selectedBitsPerToken = it.toInt()
+                        Row (
+                            modifier = modifier.fillMaxWidth(),
+                            horizontalArrangement = Arrangement.SpaceBetween,
+                            verticalAlignment = Alignment.CenterVertically
+                        ) {
+                            Text(text = "Adapt to the LLM")
 
-                                // Update DataStore
-                                Settings.bitsPerToken = it.toInt()
-                                coroutineScope.launch { HiPSDataStore.writeSettings() }
-                            },
-                            valueRange = 1f..4f,
-                            steps = 2
-                        )
+                            Switch(
+                                checked = selectedAdaptiveBitsPerToken,
+                                onCheckedChange = {
+                                    // Update state variable
+                                    selectedAdaptiveBitsPerToken = !selectedAdaptiveBitsPerToken
 
-                        Spacer(modifier = modifier.height(8.dp))
+                                    // Update DataStore
+                                    Settings.adaptiveBitsPerToken = selectedAdaptiveBitsPerToken
+                                    coroutineScope.launch { HiPSDataStore.writeSettings() }
+                                }
+                            )
+                        }
 
-                        Text(
-                            text = "$selectedBitsPerToken " + if (selectedBitsPerToken == 1) "bit/token" else "bits/token",
-                            modifier = modifier.align(Alignment.CenterHorizontally)
-                        )
+                        Spacer(modifier = modifier.height(16.dp))
+
+                        if (selectedAdaptiveBitsPerToken) {
+                            Text(text = "Every token encodes more bits where the LLM is unsure about the next token, and fewer where it is sure. Set the bounds.")
+
+                            Spacer(modifier = modifier.height(16.dp))
+
+                            // Again, do int conversion here as slider only allows floats
+                            RangeSlider(
+                                value = selectedMinBitsPerToken.toFloat()..selectedMaxBitsPerToken.toFloat(),
+                                onValueChange = {
+                                    // Update state variables
+                                    selectedMinBitsPerToken = it.start.toInt()
+                                    selectedMaxBitsPerToken = it.endInclusive.toInt()
+
+                                    // Update DataStore
+                                    Settings.minBitsPerToken = selectedMinBitsPerToken
+                                    Settings.maxBitsPerToken = selectedMaxBitsPerToken
+                                    coroutineScope.launch { HiPSDataStore.writeSettings() }
+                                },
+                                valueRange = 1f..4f,
+                                steps = 2
+                            )
+
+                            Spacer(modifier = modifier.height(8.dp))
+
+                            Text(
+                                text = "$selectedMinBitsPerToken to $selectedMaxBitsPerToken bits/token",
+                                modifier = modifier.align(Alignment.CenterHorizontally)
+                            )
+                        }
+                        else {
+                            // Again, do int conversion here as slider only allows floats
+                            Slider(
+                                value = selectedBitsPerToken.toFloat(),
+                                onValueChange = {
+                                    // Update state variable
+                                    selectedBitsPerToken = it.toInt()
+
+                                    // Update DataStore
+                                    Settings.bitsPerToken = it.toInt()
+                                    coroutineScope.launch { HiPSDataStore.writeSettings() }
+                                },
+                                valueRange = 1f..4f,
+                                steps = 2
+                            )
+
+                            Spacer(modifier = modifier.height(8.dp))
+
+                            Text(
+                                text = "$selectedBitsPerToken " + if (selectedBitsPerToken == 1) "bit/token" else "bits/token",
+                                modifier = modifier.align(Alignment.CenterHorizontally)
+                            )
+                        }
                     }
                 }
+
+                Spacer(modifier = modifier.height(16.dp))
+
+                // Select number of candidates, shared by all steganography modes
+                Text(text = "Select the number of candidate cover texts to encode at once. The most natural one is sent. More candidates take longer.")
+
+                Spacer(modifier = modifier.height(16.dp))
+
+                Slider(
+                    value = selectedNumberOfCandidates.toFloat(),
+                    onValueChange = {
+                        // Update state variable
+                        selectedNumberOfCandidates = it.toInt()
+
+                        // Update DataStore
+                        Settings.numberOfCandidates = it.toInt()
+                        coroutineScope.launch { HiPSDataStore.writeSettings() }
+                    },
+                    valueRange = 1f..4f,
+                    steps = 2
+                )
+
+                Spacer(modifier = modifier.height(8.dp))
+
+                Text(
+                    text = "$selectedNumberOfCandidates " + if (selectedNumberOfCandidates == 1) "candidate" else "candidates",
+                    modifier = modifier.align(Alignment.CenterHorizontally)
+                )
             }
         }
 
@@ -698,6 +850,7 @@ fun SettingsScreen(navController: NavController, modifier: Modifier) {
 
                             // Update state variables
                             selectedConversionMode = Settings.conversionMode
+                            selectedUseCompressionModel = Settings.useCompressionModel
                             systemPrompt = Settings.systemPrompt
                             selectedNumberOfMessages = Settings.numberOfMessages
                             selectedSteganographyMode = Settings.steganographyMode
@@ -705,6 +858,10 @@ fun SettingsScreen(navController: NavController, modifier: Modifier) {
                             selectedPrecision = Settings.precision
                             selectedTopK = Settings.topK
                             selectedBitsPerToken = Settings.bitsPerToken
+                            selectedAdaptiveBitsPerToken = Settings.adaptiveBitsPerToken
+                            selectedMinBitsPerToken = Settings.minBitsPerToken
+                            selectedMaxBitsPerToken = Settings.maxBitsPerToken
+                            selectedNumberOfCandidates = Settings.numberOfCandidates
                             selectedSplitCoverTexts = Settings.splitCoverTexts
                         },
                         shape = RoundedCornerShape(4.dp)
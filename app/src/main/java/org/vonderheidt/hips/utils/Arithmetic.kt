@@ -1,29 +1,67 @@
 package org.vonderheidt.hips.utils
 
 import org.vonderheidt.hips.data.Settings
+import java.util.concurrent.CancellationException
 
 /**
  * Object (i.e. singleton class) that represents steganography using arithmetic encoding.
  */
 object Arithmetic {
+    // Number of bytes of the header of a compressed secret message, stores the fingerprint of the LLM big-endian
+    private const val FINGERPRINT_SIZE = 4
+
     /**
      * Function to compress the secret message using arithmetic *decoding*. Wrapper for function `decode` of object `Arithmetic`.
      *
+     * Uses the compression LLM if it is selected in the settings, the LLM otherwise. First 4 bytes of the result store the fingerprint of the LLM, so that decompression can use the same one.
+     *
      * @param preparedSecretMessage A prepared secret message.
-     * @return The compressed, 0-padded binary representation of the prepared secret message.
+     * @return The compressed, 0-padded binary representation of the prepared secret message, preceded by the fingerprint of the LLM.
+     * @throws IllegalStateException If the compression LLM is selected but isn't loaded.
      */
     fun compress(preparedSecretMessage: String): ByteArray {
         // Stegasuras:
         // Arithmetic compression is just decoding with empty context
         // Parameters temperature, topK and precision are not taken from settings, but hard-coded to use the unmodulated LLM
         // While topK is set to the vocabulary size of the LLM, precision is set as high as possible so (ideally) no tokens have probability < 1/2^precision
-        return decode(
-            context = "".toByteArray(charset = Charsets.UTF_8),
-            coverText = preparedSecretMessage.toByteArray(charset = Charsets.UTF_8),
-            temperature = 1.0f,
-            topK = LlamaCpp.getVocabSize(),
-            precision = 40
-        )
+        return LlamaCpp.withCompressionCtx { ctx, model ->
+            val paddedPlainBits = decode(
+                context = "".toByteArray(charset = Charsets.UTF_8),
+                coverText = preparedSecretMessage.toByteArray(charset = Charsets.UTF_8),
+                temperature = 1.0f,
+                topK = LlamaCpp.getVocabSize(model),
+                precision = 40,
+                ctx = ctx
+            )
+
+            val fingerprint = LlamaCpp.getFingerprint(model)
+            val header = ByteArray(FINGERPRINT_SIZE) { i -> (fingerprint ushr (8 * (FINGERPRINT_SIZE - 1 - i))).toByte() }
+
+            header + paddedPlainBits
+        }
+    }
+
+    /**
+     * Function to get the fingerprint of the LLM a secret message was compressed with.
+     *
+     * Callers that resume decompression keep it from the first call and pass it to subsequent calls of `decompress`, as only the first part of the secret message has the header.
+     *
+     * @param paddedPlainBits The compressed, 0-padded binary representation of a prepared secret message, preceded by the fingerprint of the LLM.
+     * @return Fingerprint of the LLM.
+     * @throws IllegalArgumentException If the secret message is too short to store the fingerprint.
+     */
+    fun getFingerprint(paddedPlainBits: ByteArray): Int {
+        if (paddedPlainBits.size < FINGERPRINT_SIZE) {
+            throw IllegalArgumentException("Compressed secret message is missing the fingerprint of the LLM")
+        }
+
+        var fingerprint = 0
+
+        for (i in 0 until FINGERPRINT_SIZE) {
+            fingerprint = (fingerprint shl 8) or (paddedPlainBits[i].toInt() and 0xFF)
+        }
+
+        return fingerprint
     }
 
     // TODO Downward concat of split cover text
@@ -31,22 +69,41 @@ object Arithmetic {
     /**
      * Function to decompress the secret message using arithmetic *encoding*. Wrapper for function `encode` of object `Arithmetic`.
      *
-     * @param paddedPlainBits The compressed, 0-padded binary representation of a prepared secret message.
+     * @param paddedPlainBits The compressed, 0-padded binary representation of a prepared secret message, preceded by the fingerprint of the LLM unless decompression is resumed.
      * @param isResumed Boolean that is true if this call of the `decompress` function resumes where the last call terminated, false otherwise.
+     * @param fingerprint Fingerprint of the LLM read by the first call (see `getFingerprint`), only needed if decompression is resumed.
      * @return The prepared secret message.
+     * @throws IllegalArgumentException If the secret message was compressed with an LLM that isn't loaded, or no fingerprint is passed to resumed decompression.
      */
-    fun decompress(paddedPlainBits: ByteArray, isResumed: Boolean = false): String {
+    fun decompress(paddedPlainBits: ByteArray, isResumed: Boolean = false, fingerprint: Int? = null): String {
+        // Read the fingerprint from the header, resumed decompression continues without one and gets it from the caller instead
+        val selectedFingerprint: Int
+        val bits: ByteArray
+
+        if (isResumed) {
+            selectedFingerprint = fingerprint ?: throw IllegalArgumentException("Resumed decompression needs the fingerprint of the LLM read by the first call")
+            bits = paddedPlainBits
+        }
+        else {
+            selectedFingerprint = getFingerprint(paddedPlainBits)
+            bits = paddedPlainBits.copyOfRange(FINGERPRINT_SIZE, paddedPlainBits.size)
+        }
+
         // Stegasuras:
         // Arithmetic decompression is just encoding with empty context
         // Same parameters as compression
-        val preparedSecretMessageBytes = encode(
-            context = "".toByteArray(charset = Charsets.UTF_8),
-            cipherBits = paddedPlainBits,
-            temperature = 1.0f,
-            topK = LlamaCpp.getVocabSize(),
-            precision = 40,
-            isResumed = isResumed
-        )
+        val preparedSecretMessageBytes = LlamaCpp.withCompressionCtx(selectedFingerprint) { ctx, model ->
+            encode(
+                context = "".toByteArray(charset = Charsets.UTF_8),
+                cipherBits = bits,
+                temperature = 1.0f,
+                topK = LlamaCpp.getVocabSize(model),
+                precision = 40,
+                numberOfCandidates = 1,
+                ctx = ctx,
+                isResumed = isResumed
+            )
+        }!!     // Can be asserted not null because only a listener can cancel encoding
 
         val preparedSecretMessage = String(bytes = preparedSecretMessageBytes, charset = Charsets.UTF_8)
 
@@ -61,14 +118,22 @@ object Arithmetic {
      * @param context The context to encode the secret message with.
      * @param cipherBits The encrypted binary representation of the secret message.
      * @param isResumed Boolean that is true if this call of the `encode` function resumes where the last call terminated, false otherwise.
+     * @param listener Listener to stream the cover text to while it is being generated, can cancel encoding. Optional.
      * @return A cover text containing the secret message.
+     * @throws CancellationException If the listener cancelled encoding.
+     * @throws IllegalArgumentException If the context and the cover text don't fit into the context window.
+     * @throws IllegalStateException If llama.cpp fails to decode a batch.
      */
-    fun encode(context: String, cipherBits: ByteArray, isResumed: Boolean = false): String {
-        val coverTextBytes = encode(
-            context = context.toByteArray(charset = Charsets.UTF_8),
-            cipherBits = cipherBits,
-            isResumed = isResumed
-        )
+    fun encode(context: String, cipherBits: ByteArray, isResumed: Boolean = false, listener: CoverTextListener? = null): String {
+        val coverTextBytes = LlamaCpp.withCtx { ctx ->
+            encode(
+                context = context.toByteArray(charset = Charsets.UTF_8),
+                cipherBits = cipherBits,
+                ctx = ctx,
+                isResumed = isResumed,
+                listener = listener?.let { NativeCoverTextListener(it) }
+            )
+        } ?: throw CancellationException("Encoding was cancelled")
 
         val coverText = String(bytes = coverTextBytes, charset = Charsets.UTF_8)
 
@@ -87,18 +152,46 @@ object Arithmetic {
      * @return The encrypted binary representation of the secret message.
      * @throws IllegalArgumentException If `numberOfCipherBits` is not a multiple of 8.
      * @throws IllegalArgumentException If a cover text token could not be predicted (e.g. partial decoding with wrong context when trying to find start signal in split cover text).
+     * @throws IllegalStateException If llama.cpp fails to decode a batch.
      */
     fun decode(context: String, coverText: String, numberOfCipherBits: Int = -1, isResumed: Boolean = false): ByteArray {
         if (numberOfCipherBits > 0 && numberOfCipherBits % 8 != 0) {
             throw IllegalArgumentException("numberOfCipherBits has to be multiple of 8, but is $numberOfCipherBits")
         }
 
-        return decode(
-            context = context.toByteArray(charset = Charsets.UTF_8),
-            coverText = coverText.toByteArray(charset = Charsets.UTF_8),
-            numberOfCipherBits = numberOfCipherBits,
-            isResumed = isResumed
-        )
+        return LlamaCpp.withCtx { ctx ->
+            decode(
+                context = context.toByteArray(charset = Charsets.UTF_8),
+                coverText = coverText.toByteArray(charset = Charsets.UTF_8),
+                ctx = ctx,
+                numberOfCipherBits = numberOfCipherBits,
+                isResumed = isResumed
+            )
+        }
+    }
+
+    /**
+     * Function to decode multiple cover texts into (the encrypted binary representations of) their secret messages using arithmetic decoding.
+     *
+     * Cover texts are decoded together in shared batches, which is faster than decoding them one after another (e.g. for a whole conversation).
+     *
+     * @param contexts The contexts to decode the cover texts with, one per cover text.
+     * @param coverTexts The cover texts containing a secret message.
+     * @return The encrypted binary representations of the secret messages, null for cover texts that couldn't be decoded with their context.
+     * @throws IllegalArgumentException If the number of contexts and cover texts differ.
+     */
+    fun decodeAll(contexts: List<String>, coverTexts: List<String>): List<ByteArray?> {
+        if (contexts.size != coverTexts.size) {
+            throw IllegalArgumentException("Number of contexts (${contexts.size}) and cover texts (${coverTexts.size}) has to be equal")
+        }
+
+        return LlamaCpp.withCtx { ctx ->
+            decodeAll(
+                contexts = contexts.map { it.toByteArray(charset = Charsets.UTF_8) }.toTypedArray(),
+                coverTexts = coverTexts.map { it.toByteArray(charset = Charsets.UTF_8) }.toTypedArray(),
+                ctx = ctx
+            )
+        }.toList()
     }
 
     /**
@@ -113,11 +206,13 @@ object Arithmetic {
      * @param temperature The temperature parameter for token sampling. Determined by Settings object.
      * @param topK Number of most likely tokens to consider. Must be less than or equal to the vocabulary size `n_vocab` of the LLM. Determined by Settings object.
      * @param precision Number of bits to encode the top k tokens with. Determined by Settings object.
+     * @param numberOfCandidates Number of candidate cover texts to encode at once, the one with the highest log-probability is returned. Determined by Settings object. Ignored for decompression and resumed encoding.
      * @param ctx Memory address of the context.
      * @param isResumed Boolean that is true if this call of the `encode` function resumes where the last call terminated, false otherwise.
-     * @return A cover text containing the secret message (byte array storing UTF-8 encoded string to bypass JNI errors).
+     * @param listener Listener to stream the cover text to while it is being generated, or once it is picked if there are multiple candidates. Optional.
+     * @return A cover text containing the secret message (byte array storing UTF-8 encoded string to bypass JNI errors), null if the listener cancelled encoding.
      */
-    private external fun encode(context: ByteArray, cipherBits: ByteArray, temperature: Float = Settings.temperature, topK: Int = Settings.topK, precision: Int = Settings.precision, ctx: Long = LlamaCpp.getCtx(), isResumed: Boolean = false) : ByteArray
+    private external fun encode(context: ByteArray, cipherBits: ByteArray, temperature: Float = Settings.temperature, topK: Int = Settings.topK, precision: Int = Settings.precision, numberOfCandidates: Int = Settings.numberOfCandidates, ctx: Long, isResumed: Boolean = false, listener: NativeCoverTextListener? = null) : ByteArray?
 
     /**
      * Function to decode a cover text into (the encrypted binary representation of) the secret message using arithmetic decoding.
@@ -137,5 +232,20 @@ object Arithmetic {
      * @return The encrypted binary representation of the secret message.
      * @throws IllegalArgumentException If a cover text token could not be predicted (e.g. partial decoding with wrong context when trying to find start signal in split cover text).
      */
-    private external fun decode(context: ByteArray, coverText: ByteArray, temperature: Float = Settings.temperature, topK: Int = Settings.topK, precision: Int = Settings.precision, ctx: Long = LlamaCpp.getCtx(), numberOfCipherBits: Int = -1, isResumed: Boolean = false) : ByteArray
+    private external fun decode(context: ByteArray, coverText: ByteArray, temperature: Float = Settings.temperature, topK: Int = Settings.topK, precision: Int = Settings.precision, ctx: Long, numberOfCipherBits: Int = -1, isResumed: Boolean = false) : ByteArray
+
+    /**
+     * Function to decode multiple cover texts into (the encrypted binary representations of) their secret messages using arithmetic decoding.
+     *
+     * Helper for the public `decodeAll` function to bypass JNI errors with strings.
+     *
+     * @param contexts The contexts to decode the cover texts with (byte arrays storing UTF-8 encoded strings to bypass JNI errors).
+     * @param coverTexts The cover texts containing a secret message (byte arrays storing UTF-8 encoded strings to bypass JNI errors).
+     * @param temperature The temperature parameter for token sampling. Determined by Settings object.
+     * @param topK Number of most likely tokens to consider. Must be less than or equal to the vocabulary size `n_vocab` of the LLM. Determined by Settings object.
+     * @param precision Number of bits to encode the top k tokens with. Determined by Settings object.
+     * @param ctx Memory address of the context.
+     * @return The encrypted binary representations of the secret messages, null for cover texts that couldn't be decoded with their context.
+     */
+    private external fun decodeAll(contexts: Array<ByteArray>, coverTexts: Array<ByteArray>, temperature: Float = Settings.temperature, topK: Int = Settings.topK, precision: Int = Settings.precision, ctx: Long): Array<ByteArray?>
 }
\ No newline at end of file
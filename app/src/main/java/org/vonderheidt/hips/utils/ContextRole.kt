@@ -0,0 +1,11 @@
+package org.vonderheidt.hips.utils
+
+/**
+ * Class to enumerate the roles a context of the pool can be leased for. Ordinals are passed to llama.cpp via JNI.
+ *
+ * Contexts prefer the role they served last, so jobs of the same role find their tokens still cached and don't evict the ones of other roles.
+ */
+enum class ContextRole {
+    Steganography,
+    Conversion
+}
@@ -0,0 +1,33 @@
+package org.vonderheidt.hips.utils
+
+/**
+ * Interface for a listener that receives the cover text while it is being generated, e.g. to show it to the user token by token.
+ */
+fun interface CoverTextListener {
+    /**
+     * Function that is called whenever new characters of the cover text were generated. Is called on the thread that runs the encoding.
+     *
+     * Concatenation of all chunks is a preview of the cover text, the one returned by the encoding is authoritative (e.g. leading whitespaces can differ).
+     *
+     * @param chunk The new characters.
+     * @return Boolean that is true if encoding should continue, false if it should be cancelled (e.g. because the secret message was edited).
+     */
+    fun onChunk(chunk: String): Boolean
+}
+
+/**
+ * Class that adapts a cover text listener to the native side, which passes chunks as byte arrays storing UTF-8 encoded strings to bypass JNI errors.
+ *
+ * @param listener The listener to forward the chunks to.
+ */
+class NativeCoverTextListener(private val listener: CoverTextListener) {
+    /**
+     * Function that is called via JNI for every chunk of the cover text.
+     *
+     * @param chunk The new characters (byte array storing UTF-8 encoded string to bypass JNI errors).
+     * @return Boolean that is true if encoding should continue, false if it should be cancelled.
+     */
+    fun onChunk(chunk: ByteArray): Boolean {
+        return listener.onChunk(String(bytes = chunk, charset = Charsets.UTF_8))
+    }
+}
@@ -1,11 +1,30 @@
 package org.vonderheidt.hips.utils
 
 import org.vonderheidt.hips.data.Settings
+import java.util.concurrent.CancellationException
 
 /**
  * Object (i.e. singleton class) that represents steganography using Huffman encoding.
  */
 object Huffman {
+    /**
+     * Function to get the minimum number of bits to encode/decode per cover text token. Determined by Settings object.
+     *
+     * @return Minimum number of bits in adaptive mode, the fixed number of bits otherwise.
+     */
+    fun getMinBitsPerToken(): Int {
+        return if (Settings.adaptiveBitsPerToken) Settings.minBitsPerToken else Settings.bitsPerToken
+    }
+
+    /**
+     * Function to get the maximum number of bits to encode/decode per cover text token. Determined by Settings object.
+     *
+     * @return Maximum number of bits in adaptive mode, the fixed number of bits otherwise.
+     */
+    fun getMaxBitsPerToken(): Int {
+        return if (Settings.adaptiveBitsPerToken) Settings.maxBitsPerToken else Settings.bitsPerToken
+    }
+
     /**
      * Function to encode (the encrypted binary representation of) the secret message into a cover text using Huffman encoding.
      *
@@ -13,13 +32,21 @@ object Huffman {
      *
      * @param context The context to encode the secret message with.
      * @param cipherBits The encrypted binary representation of the secret message.
+     * @param listener Listener to stream the cover text to while it is being generated, can cancel encoding. Optional.
      * @return A cover text containing the secret message.
+     * @throws CancellationException If the listener cancelled encoding.
+     * @throws IllegalArgumentException If the context and the cover text don't fit into the context window.
+     * @throws IllegalStateException If llama.cpp fails to decode a batch.
      */
-    fun encode(context: String, cipherBits: ByteArray): String {
-        val coverTextBytes = encode(
-            context = context.toByteArray(charset = Charsets.UTF_8),
-            cipherBits = cipherBits
-        )
+    fun encode(context: String, cipherBits: ByteArray, listener: CoverTextListener? = null): String {
+        val coverTextBytes = LlamaCpp.withCtx { ctx ->
+            encode(
+                context = context.toByteArray(charset = Charsets.UTF_8),
+                cipherBits = cipherBits,
+                ctx = ctx,
+                listener = listener?.let { NativeCoverTextListener(it) }
+            )
+        } ?: throw CancellationException("Encoding was cancelled")
 
         val coverText = String(bytes = coverTextBytes, charset = Charsets.UTF_8)
 
@@ -39,18 +66,47 @@ object Huffman {
      * @param isResumed Boolean that is true if this call of the `decode` function resumes where the last call terminated, false otherwise.
      * @return The encrypted binary representation of the secret message.
      * @throws IllegalArgumentException If `numberOfCipherBits` is not a multiple of 8.
+     * @throws IllegalArgumentException If a cover text token is not in the Huffman tree (e.g. decoding with wrong context or an edited cover text).
+     * @throws IllegalStateException If llama.cpp fails to decode a batch.
      */
     fun decode(context: String, coverText: String, numberOfCipherBits: Int = -1, isResumed: Boolean = false): ByteArray {
         if (numberOfCipherBits > 0 && numberOfCipherBits % 8 != 0) {
             throw IllegalArgumentException("numberOfCipherBits has to be multiple of 8, but is $numberOfCipherBits")
         }
 
-        return decode(
-            context = context.toByteArray(charset = Charsets.UTF_8),
-            coverText = coverText.toByteArray(charset = Charsets.UTF_8),
-            numberOfCipherBits = numberOfCipherBits,
-            isResumed = isResumed
-        )
+        return LlamaCpp.withCtx { ctx ->
+            decode(
+                context = context.toByteArray(charset = Charsets.UTF_8),
+                coverText = coverText.toByteArray(charset = Charsets.UTF_8),
+                ctx = ctx,
+                numberOfCipherBits = numberOfCipherBits,
+                isResumed = isResumed
+            )
+        }
+    }
+
+    /**
+     * Function to decode multiple cover texts into (the encrypted binary representations of) their secret messages using Huffman decoding.
+     *
+     * Cover texts are decoded together in shared batches, which is faster than decoding them one after another (e.g. for a whole conversation).
+     *
+     * @param contexts The contexts to decode the cover texts with, one per cover text.
+     * @param coverTexts The cover texts containing a secret message.
+     * @return The encrypted binary representations of the secret messages, null for cover texts that couldn't be decoded with their context.
+     * @throws IllegalArgumentException If the number of contexts and cover texts differ.
+     */
+    fun decodeAll(contexts: List<String>, coverTexts: List<String>): List<ByteArray?> {
+        if (contexts.size != coverTexts.size) {
+            throw IllegalArgumentException("Number of contexts (${contexts.size}) and cover texts (${coverTexts.size}) has to be equal")
+        }
+
+        return LlamaCpp.withCtx { ctx ->
+            decodeAll(
+                contexts = contexts.map { it.toByteArray(charset = Charsets.UTF_8) }.toTypedArray(),
+                coverTexts = coverTexts.map { it.toByteArray(charset = Charsets.UTF_8) }.toTypedArray(),
+                ctx = ctx
+            )
+        }.toList()
     }
 
     /**
@@ -62,11 +118,14 @@ object Huffman {
      *
      * @param context The context to encode the secret message with (byte array storing UTF-8 encoded string to bypass JNI errors).
      * @param cipherBits The encrypted binary representation of the secret message.
-     * @param bitsPerToken Number of bits to encode/decode per cover text token (= height of Huffman tree). Determined by Settings object.
+     * @param minBitsPerToken Minimum number of bits to encode/decode per cover text token (= height of Huffman tree). Determined by Settings object.
+     * @param maxBitsPerToken Maximum number of bits to encode/decode per cover text token. Equal to the minimum unless adaptive mode is enabled. Determined by Settings object.
+     * @param numberOfCandidates Number of candidate cover texts to encode at once, the one with the highest log-probability is returned. Determined by Settings object.
      * @param ctx Memory address of the context.
-     * @return A cover text containing the secret message (byte array storing UTF-8 encoded string to bypass JNI errors).
+     * @param listener Listener to stream the cover text to while it is being generated, or once it is picked if there are multiple candidates. Optional.
+     * @return A cover text containing the secret message (byte array storing UTF-8 encoded string to bypass JNI errors), null if the listener cancelled encoding.
      */
-    private external fun encode(context: ByteArray, cipherBits: ByteArray, bitsPerToken: Int = Settings.bitsPerToken, ctx: Long = LlamaCpp.getCtx()): ByteArray
+    private external fun encode(context: ByteArray, cipherBits: ByteArray, minBitsPerToken: Int = getMinBitsPerToken(), maxBitsPerToken: Int = getMaxBitsPerToken(), numberOfCandidates: Int = Settings.numberOfCandidates, ctx: Long, listener: NativeCoverTextListener? = null): ByteArray?
 
     /**
      * Function to decode a cover text into (the encrypted binary representation of) the secret message using Huffman decoding.
@@ -77,11 +136,26 @@ object Huffman {
      *
      * @param context The context to decode the cover text with (byte array storing UTF-8 encoded string to bypass JNI errors).
      * @param coverText The cover text containing a secret message (byte array storing UTF-8 encoded string to bypass JNI errors).
-     * @param bitsPerToken Number of bits to encode/decode per cover text token (= height of Huffman tree). Determined by Settings object.
+     * @param minBitsPerToken Minimum number of bits to encode/decode per cover text token (= height of Huffman tree). Determined by Settings object.
+     * @param maxBitsPerToken Maximum number of bits to encode/decode per cover text token. Equal to the minimum unless adaptive mode is enabled. Determined by Settings object.
      * @param ctx Memory address of the context.
      * @param numberOfCipherBits Desired number of cipher bits to return. Only needed when searching for start signal in split cover text. Has to be multiple of 8 for decryption.
      * @param isResumed Boolean that is true if this call of the `decode` function resumes where the last call terminated, false otherwise.
      * @return The encrypted binary representation of the secret message.
      */
-    private external fun decode(context: ByteArray, coverText: ByteArray, bitsPerToken: Int = Settings.bitsPerToken, ctx: Long = LlamaCpp.getCtx(), numberOfCipherBits: Int = -1, isResumed: Boolean = false): ByteArray
+    private external fun decode(context: ByteArray, coverText: ByteArray, minBitsPerToken: Int = getMinBitsPerToken(), maxBitsPerToken: Int = getMaxBitsPerToken(), ctx: Long, numberOfCipherBits: Int = -1, isResumed: Boolean = false): ByteArray
+
+    /**
+     * Function to decode multiple cover texts into (the encrypted binary representations of) their secret messages using Huffman decoding.
+     *
+     * Helper for the public `decodeAll` function to bypass JNI errors with strings.
+     *
+     * @param contexts The contexts to decode the cover texts with (byte arrays storing UTF-8 encoded strings to bypass JNI errors).
+     * @param coverTexts The cover texts containing a secret message (byte arrays storing UTF-8 encoded strings to bypass JNI errors).
+     * @param minBitsPerToken Minimum number of bits to encode/decode per cover text token (= height of Huffman tree). Determined by Settings object.
+     * @param maxBitsPerToken Maximum number of bits to encode/decode per cover text token. Equal to the minimum unless adaptive mode is enabled. Determined by Settings object.
+     * @param ctx Memory address of the context.
+     * @return The encrypted binary representations of the secret messages, null for cover texts that couldn't be decoded with their context.
+     */
+    private external fun decodeAll(contexts: Array<ByteArray>, coverTexts: Array<ByteArray>, minBitsPerToken: Int = getMinBitsPerToken(), maxBitsPerToken: Int = getMaxBitsPerToken(), ctx: Long): Array<ByteArray?>
 }
\ No newline at end of file
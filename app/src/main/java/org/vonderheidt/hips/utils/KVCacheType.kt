@@ -0,0 +1,22 @@
+package org.vonderheidt.hips.utils
+
+/**
+ * Class to enumerate all data types of the KV cache. Ordinals are passed to llama.cpp via JNI, so the order must match `EngineConfig` in C++.
+ *
+ * @param displayName Display name of the KV cache type.
+ */
+enum class KVCacheType(private val displayName: String) {
+    Default("Default (F16)"),
+    F16("F16"),
+    Q8_0("Q8_0"),
+    Q4_0("Q4_0");
+
+    /**
+     * Function to get the display name of the KV cache type.
+     *
+     * @return Display name of the KV cache type.
+     */
+    override fun toString(): String {
+        return displayName
+    }
+}
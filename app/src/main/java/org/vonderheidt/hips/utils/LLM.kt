@@ -14,27 +14,73 @@ object LLM {
     private const val DOWNLOAD_LINK = "https://huggingface.co/hugging-quants/Llama-3.2-3B-Instruct-Q4_K_M-GGUF/resolve/main/llama-3.2-3b-instruct-q4_k_m.gguf"
     private const val FILE_NAME = "llama-3.2-3b-instruct-q4_k_m.gguf"
 
+    // Optional smaller LLM for arithmetic compression, which only needs to predict the secret message and not to chat
+    private const val COMPRESSION_DOWNLOAD_LINK = "https://huggingface.co/hugging-quants/Llama-3.2-1B-Instruct-Q4_K_M-GGUF/resolve/main/llama-3.2-1b-instruct-q4_k_m.gguf"
+    private const val COMPRESSION_FILE_NAME = "llama-3.2-1b-instruct-q4_k_m.gguf"
+
     /**
      * Function to check if the LLM has already been downloaded.
      */
     fun isDownloaded(): Boolean {
-        val downloadDir = Environment.getExternalStoragePublicDirectory(Environment.DIRECTORY_DOWNLOADS)
-        val file = File(downloadDir, FILE_NAME)
+        return isDownloaded(FILE_NAME)
+    }
 
-        return file.exists()
+    /**
+     * Function to check if the compression LLM has already been downloaded.
+     */
+    fun isCompressionModelDownloaded(): Boolean {
+        return isDownloaded(COMPRESSION_FILE_NAME)
     }
 
     /**
      * Function to download the LLM.
      */
     fun download(currentLocalContext: Context) {
+        download(currentLocalContext, DOWNLOAD_LINK, FILE_NAME)
+    }
+
+    /**
+     * Function to download the compression LLM.
+     */
+    fun downloadCompressionModel(currentLocalContext: Context) {
+        download(currentLocalContext, COMPRESSION_DOWNLOAD_LINK, COMPRESSION_FILE_NAME)
+    }
+
+    /**
+     * Function to get the path to the LLM (.gguf file).
+     */
+    fun getPath(): String {
+        return getPath(FILE_NAME)
+    }
+
+    /**
+     * Function to get the path to the compression LLM (.gguf file).
+     */
+    fun getCompressionPath(): String {
+        return getPath(COMPRESSION_FILE_NAME)
+    }
+
+    /**
+     * Function to check if a file has already been downloaded.
+     */
+    private fun isDownloaded(fileName: String): Boolean {
+        val downloadDir = Environment.getExternalStoragePublicDirectory(Environment.DIRECTORY_DOWNLOADS)
+        val file = File(downloadDir, fileName)
+
+        return file.exists()
+    }
+
+    /**
+     * Function to download a file.
+     */
+    private fun download(currentLocalContext: Context, downloadLink: String, fileName: String) {
         // Get access to Android's download manager
         val downloadManager = currentLocalContext.getSystemService(Context.DOWNLOAD_SERVICE) as DownloadManager
 
         // Define request to the download manager that downloads the file from the given URL
-        val request = DownloadManager.Request(DOWNLOAD_LINK.toUri())
-            .setTitle(FILE_NAME)
-            .setDestinationInExternalPublicDir(Environment.DIRECTORY_DOWNLOADS, FILE_NAME)
+        val request = DownloadManager.Request(downloadLink.toUri())
+            .setTitle(fileName)
+            .setDestinationInExternalPublicDir(Environment.DIRECTORY_DOWNLOADS, fileName)
             .setNotificationVisibility(DownloadManager.Request.VISIBILITY_VISIBLE_NOTIFY_COMPLETED)
 
         // Queue request and save download ID
@@ -53,11 +99,11 @@ object LLM {
     }
 
     /**
-     * Function to get the path to the LLM (.gguf file).
+     * Function to get the path to a file.
      */
-    fun getPath(): String {
+    private fun getPath(fileName: String): String {
         val downloadDir = Environment.getExternalStoragePublicDirectory(Environment.DIRECTORY_DOWNLOADS)
-        val path = "$downloadDir/$FILE_NAME"
+        val path = "$downloadDir/$fileName"
 
         return path
     }
@@ -3,6 +3,7 @@ package org.vonderheidt.hips.utils
 import org.vonderheidt.hips.data.Message
 import org.vonderheidt.hips.data.Settings
 import org.vonderheidt.hips.data.User
+import java.util.concurrent.CountDownLatch
 
 /**
  * Object (i.e. singleton class) to declare Kotlin external functions corresponding to llama.cpp functions.
@@ -10,24 +11,25 @@ import org.vonderheidt.hips.data.User
 object LlamaCpp {
     private val path = LLM.getPath()
 
-    // Annotate pointers to the LLM, its context and sampler as volatile so that r/w to them is atomic and immediately visible to all threads
-    // Avoids race conditions, i.e. multiple threads trying to load/unload the LLM, its context or sampler simultaneously
+    // Annotate pointers to the LLM, its contexts and sampler as volatile so that r/w to them is atomic and immediately visible to all threads
+    // Avoids race conditions, i.e. multiple threads trying to load/unload the LLM, its contexts or sampler simultaneously
     @Volatile
     private var model = 0L
 
+    // Native pool of contexts sharing the LLM, every job leases one so that e.g. decoding and encoding can run concurrently
+    // Native sessions keep the tokens of every context in memory across leases, resumed decoding/decompression continues from them
     @Volatile
-    private var ctx = 0L
+    private var pool = 0L
 
-    // TODO Downward concat of split cover text
-    //  Attributes {decode,decompress}Ctx are to manage separate ctx for resuming decoding and decompression
     @Volatile
-    private var decodeCtx = 0L
+    private var smpl = 0L
 
+    // Optional smaller LLM and its pool for arithmetic compression, 0 if it isn't downloaded or failed to load (only used if selected in the settings, or to decompress secret messages compressed with it)
     @Volatile
-    private var decompressCtx = 0L
+    private var compressionModel = 0L
 
     @Volatile
-    private var smpl = 0L
+    private var compressionPool = 0L
 
     /**
      * Function to check if LLM has already been loaded into memory.
@@ -36,12 +38,37 @@ object LlamaCpp {
      */
     fun isInMemory(): Boolean {
         return model != 0L
-                && ctx != 0L
+                && pool != 0L
                 && smpl != 0L
     }
 
+    // Latch of the background start that is currently running, null if there is none
+    // Listeners are called once it is done
+    @Volatile
+    private var startup: CountDownLatch? = null
+
+    private val readyListeners = mutableListOf<(isInMemory: Boolean) -> Unit>()
+
+    // Number of tokens of formatted chat messages by role and content, so that formatting a conversation only tokenizes the messages that are new since the last call
+    // Least recently used messages are evicted once it is full, it is cleared when the LLM is unloaded as the counts depend on its vocabulary
+    private const val TOKEN_COUNT_CACHE_SIZE = 1024
+
+    private val tokenCountCache = object : LinkedHashMap<Pair<String, String>, Int>(16, 0.75f, true) {
+        override fun removeEldestEntry(eldest: MutableMap.MutableEntry<Pair<String, String>, Int>?): Boolean {
+            return size > TOKEN_COUNT_CACHE_SIZE
+        }
+    }
+
+    // Maximum number of tokens of a formatted chat, i.e. of the context that a conversation is encoded/decoded with
+    // Fixed instead of derived from the context size or other local settings, so that every device evicts the same messages of a conversation
+    private const val MAX_CHAT_TOKENS = 1536
+
+    // Upper bound of the length of a cover text in tokens, chat messages are much shorter but the greedy tail of the last sentence can add a few tokens
+    // Chat and a cover text fit into the default context size of 2048 tokens (see EngineConfig)
+    private const val MAX_COVER_TEXT_TOKENS = 256
+
     /**
-     * Function to start the instance of the LLM in a thread-safe manner.
+     * Function to start the instance of the LLM in a thread-safe manner. Blocks until the LLM is loaded.
      *
      * Does not return a pointer to the LLM as the LlamaCpp object already stores this internally.
      */
@@ -51,21 +78,52 @@ object LlamaCpp {
             return
         }
 
-        // Otherwise, load the LLM and store its memory address
-        // Synchronized allows only one thread to execute the code inside {...}, so other threads can't load the LLM simultaneously
-        synchronized(lock = this) {
-            if (!isInMemory()) {
-                model = loadModel()
-                ctx = loadCtx()
-                smpl = loadSmpl()
+        // Otherwise, start it in the background (or join a start that is already running) and wait until it is done
+        val latch = CountDownLatch(1)
+
+        startInstanceAsync { latch.countDown() }
+
+        latch.await()
+    }
+
+    /**
+     * Function to start the instance of the LLM in the background in a thread-safe manner. Returns immediately.
+     *
+     * Native side reads the LLM file ahead into the page cache and runs a warmup decode on every context, so that the first job doesn't pay for it.
+     * A start that is already running is joined instead of loading the LLM a second time.
+     *
+     * @param onReady Function that is called when the LLM is loaded (or failed to load), on a native background thread. Gets a boolean that is true if the LLM is in memory, false otherwise.
+     */
+    fun startInstanceAsync(onReady: (isInMemory: Boolean) -> Unit = {}) {
+        // Synchronized allows only one thread to execute the code inside {...}, so other threads can't start loading the LLM simultaneously
+        val isLoaded = synchronized(lock = this) {
+            if (isInMemory()) {
+                return@synchronized true
             }
+
+            readyListeners.add(onReady)
+
+            if (startup == null) {
+                startup = CountDownLatch(1)
+                startAsync(listener = StartupListener)
+            }
+
+            false
+        }
+
+        // Call listener outside of synchronized so that it can use the LlamaCpp object itself
+        if (isLoaded) {
+            onReady(true)
         }
     }
 
     /**
-     * Function to stop the instance of the LLM in a thread-safe manner.
+     * Function to stop the instance of the LLM in a thread-safe manner. Waits for a background start to finish first.
      */
     fun stopInstance() {
+        // Unloading while the background thread is still loading would leak the LLM
+        startup?.await()
+
         // Mirrors startInstance
         if (!isInMemory()) {
             return
@@ -76,92 +134,146 @@ object LlamaCpp {
                 unloadSmpl()
                 smpl = 0L
 
-                // Unload context first as LLM is needed for context
-                unloadCtx()
-                ctx = 0L
+                // Unload contexts first as LLM is needed for context
+                unloadPool()
+                pool = 0L
 
                 unloadModel()
                 model = 0L
+
+                synchronized(lock = tokenCountCache) { tokenCountCache.clear() }
+
+                if (compressionModel != 0L) {
+                    unloadPool(pool = compressionPool)
+                    compressionPool = 0L
+
+                    unloadModel(model = compressionModel)
+                    compressionModel = 0L
+                }
             }
         }
     }
 
     /**
-     * Function to reset the instance of the LLM in a thread-safe manner.
-     *
-     * Needed to ensure reproducible results when switching between encode/decode mode or when encoding/decoding multiple times sequentially.
+     * Object (i.e. singleton class) that receives the result of a background start from the native side.
      */
-    fun resetInstance() {
-        // Mirrors startInstance
-        if (ctx == 0L) {
-            return
-        }
+    private object StartupListener {
+        /**
+         * Function that is called via JNI when the background start is done. Is called on a native background thread.
+         *
+         * @param model Memory address of the LLM, 0 if loading failed.
+         * @param pool Memory address of the pool, 0 if loading failed.
+         * @param smpl Memory address of the sampler, 0 if loading failed.
+         * @param compressionModel Memory address of the compression LLM, 0 if it wasn't downloaded or loading failed.
+         * @param compressionPool Memory address of the pool of the compression LLM, 0 if it wasn't downloaded or loading failed.
+         */
+        fun onReady(model: Long, pool: Long, smpl: Long, compressionModel: Long, compressionPool: Long) {
+            val listeners = synchronized(lock = LlamaCpp) {
+                LlamaCpp.model = model
+                LlamaCpp.pool = pool
+                LlamaCpp.smpl = smpl
+                LlamaCpp.compressionModel = compressionModel
+                LlamaCpp.compressionPool = compressionPool
+
+                startup?.countDown()
+                startup = null
+
+                readyListeners.toList().also { readyListeners.clear() }
+            }
 
-        synchronized(lock = this) {
-            if (ctx != 0L) {
-                unloadCtx()
-                ctx = 0L
+            val isInMemory = isInMemory()
 
-                ctx = loadCtx()
-            }
+            listeners.forEach { it(isInMemory) }
         }
     }
 
-    // TODO Remove when state management of LLM is translated to C++ as well
     /**
-     * Function to get the memory address of the context.
+     * Function to lease a context of the pool. Blocks until one is free if all are in use.
      *
-     * @return Memory address of the context.
-     */
-    fun getCtx(): Long {
-        return ctx
-    }
-
-    // TODO Downward concat of split cover text
-    //  Functions set{Ctx,DecodeCtx,DecompressCtx} and get{DecodeCtx,DecompressCtx} are to manage separate ctx for resuming decoding and decompression
-    /**
-     * Function to set the memory address of the context.
+     * Needs to be released via `releaseCtx` when the job is done, prefer `withCtx` unless the lease outlives a single call.
      *
-     * @param ctx Memory address of the desired context.
+     * @param role Role of the job, determines which context is preferred.
+     * @return Memory address of the leased context.
      */
-    fun setCtx(ctx: Long) {
-        this.ctx = ctx
+    fun acquireCtx(role: ContextRole = ContextRole.Steganography): Long {
+        return acquireCtx(pool = pool, role = role.ordinal)
     }
 
     /**
-     * Function to get the memory address of the context used for decoding a cover text into the encrypted binary representation of the secret message.
+     * Function to return a leased context to the pool.
      *
-     * @return Memory address of the context used for decoding a cover text into the encrypted binary representation of the secret message.
+     * @param ctx Memory address of the leased context.
      */
-    fun getDecodeCtx(): Long {
-        return decodeCtx
+    fun releaseCtx(ctx: Long) {
+        releaseCtx(pool = pool, ctx = ctx)
     }
 
     /**
-     * Function to set the memory address of the context used for decoding a cover text into the encrypted binary representation of the secret message.
+     * Function to run a job with a leased context, releasing it afterwards even if the job throws.
      *
-     * @param decodeCtx Memory address of the desired context used for decoding a cover text into the encrypted binary representation of the secret message. Defaults to current context of the llama.cpp instance.
+     * @param role Role of the job, determines which context is preferred.
+     * @param job The job, gets the memory address of the leased context.
+     * @return Result of the job.
      */
-    fun setDecodeCtx(decodeCtx: Long = ctx) {
-        this.decodeCtx = decodeCtx
+    fun <T> withCtx(role: ContextRole = ContextRole.Steganography, job: (ctx: Long) -> T): T {
+        val ctx = acquireCtx(role)
+
+        try {
+            return job(ctx)
+        }
+        finally {
+            releaseCtx(ctx)
+        }
     }
 
     /**
-     * Function to get the memory address of the context used for decompressing a secret message from its binary representation back into a string.
+     * Function to run a compression job with a leased context, releasing it afterwards even if the job throws.
+     *
+     * Without a fingerprint, uses the compression LLM if it is selected in the settings and the LLM otherwise, never depending on which LLMs happen to be downloaded.
      *
-     * @return Memory address of the context used for decompressing a secret message from its binary representation back into a string.
+     * @param fingerprint Fingerprint of the LLM the job needs (e.g. the one stored in the header of a compressed secret message), null to use the selected one.
+     * @param job The job, gets the memory addresses of the leased context and its LLM.
+     * @return Result of the job.
+     * @throws IllegalArgumentException If no loaded LLM has the fingerprint.
+     * @throws IllegalStateException If the compression LLM is selected but isn't loaded.
      */
-    fun getDecompressCtx(): Long {
-        return decompressCtx
+    fun <T> withCompressionCtx(fingerprint: Int? = null, job: (ctx: Long, model: Long) -> T): T {
+        val (selectedModel, selectedPool) = if (fingerprint == null) {
+            if (!Settings.useCompressionModel) {
+                model to pool
+            }
+            else if (compressionModel != 0L) {
+                compressionModel to compressionPool
+            }
+            else {
+                throw IllegalStateException("Compression LLM is selected but isn't loaded, download it and start the LLM again")
+            }
+        }
+        else {
+            listOf(compressionModel to compressionPool, model to pool)
+                .filter { (candidateModel, _) -> candidateModel != 0L }
+                .firstOrNull { (candidateModel, _) -> getFingerprint(candidateModel) == fingerprint }
+                ?: throw IllegalArgumentException("Secret message was compressed with an LLM that isn't loaded (fingerprint $fingerprint)")
+        }
+
+        val ctx = acquireCtx(pool = selectedPool, role = ContextRole.Conversion.ordinal)
+
+        try {
+            return job(ctx, selectedModel)
+        }
+        finally {
+            releaseCtx(pool = selectedPool, ctx = ctx)
+        }
     }
 
     /**
-     * Function to set the memory address of the context used for decompressing a secret message from its binary representation back into a string.
+     * Function to count the tokens of a string, tokenized the same way as contexts and cover texts are.
      *
-     * @param decompressCtx Memory address of the desired context used for decompressing a secret message from its binary representation back into a string. Defaults to current context of the llama.cpp instance.
+     * @param text A string.
+     * @return Number of tokens of the string.
      */
-    fun setDecompressCtx(decompressCtx: Long = ctx) {
-        this.decompressCtx = decompressCtx
+    fun countTokens(text: String): Int {
+        return countTokens(text.toByteArray(charset = Charsets.UTF_8))
     }
 
     /**
@@ -172,7 +284,7 @@ object LlamaCpp {
      */
     fun detokenize(tokens: IntArray): String {
         // Detokenize tokens into byte array storing UTF-8 encoded string first to bypass JNI errors
-        val byteArray = detokenize(tokens, ctx)
+        val byteArray = withCtx { ctx -> detokenize(tokens, ctx) }
 
         // Convert UTF-8 encoded string to Java/Kotlin string
         val string = String(bytes = byteArray, charset = Charsets.UTF_8)
@@ -229,6 +341,26 @@ object LlamaCpp {
         return "\u0003"
     }
 
+    /**
+     * Function to count the tokens of a formatted chat message without the special token for the assistant role. Cached, see `tokenCountCache`.
+     *
+     * @param role Role of the chat message (`system`, `user` or `assistant`).
+     * @param content Content of the chat message.
+     * @return Number of tokens of the formatted chat message.
+     */
+    private fun countMessageTokens(role: String, content: String): Int {
+        val key = Pair(role, content)
+
+        synchronized(lock = tokenCountCache) { tokenCountCache[key] }?.let { return it }
+
+        // Tokenize outside of the lock so that concurrent calls don't wait for each other, both would store the same count anyway
+        val numberOfTokens = countTokens(addMessage(role = role, content = content, appendAssistant = false))
+
+        synchronized(lock = tokenCountCache) { tokenCountCache[key] = numberOfTokens }
+
+        return numberOfTokens
+    }
+
     /**
      * Function to format a list of messages as a llama.cpp chat (i.e. apply the chat template of the LLM).
      * Creates the context needed to do steganography encoding/decoding in a conversation.
@@ -240,20 +372,37 @@ object LlamaCpp {
      * Effectively, the roles are constantly switched to make the LLM talk to itself without knowing it.
      * Roles don't need to be strictly alternating, multiple consecutive messages from the same role are fine.
      *
+     * Long conversations are kept within the context window of the LLM: The system prompt is always kept, the oldest messages are evicted once the formatted chat
+     * exceeds `maxNumberOfTokens`. They are evicted in steps of half the tokens available for messages, so that consecutive contexts of a conversation share their prefix
+     * until the next step and only the new messages need to be decoded. Encoder and decoder format the same messages with the same LLM and system prompt, and the token
+     * limit doesn't depend on the context size or the number of candidates of a device, so they agree on which messages are evicted.
+     *
      * @param priorMessages The list of messages prior to the one being encoded/decoded.
      * @param isAlice Boolean that is true if the LLM takes on the role of Alice, false otherwise.
      * @param numberOfMessages Number of messages from `priorMessages` to use as context. Determined by Settings object.
+     * @param maxNumberOfTokens Maximum number of tokens of the context. Defaults to a fixed limit that is the same on every device.
      * @return Context string for steganography encoding/decoding containing the messages formatted as chat.
+     * @throws IllegalStateException If the context size of the LLM can't fit a context of `maxNumberOfTokens` tokens and a cover text.
      */
-    fun formatChat(priorMessages: List<Message>, isAlice: Boolean, numberOfMessages: Int = if (Settings.numberOfMessages > 0) Settings.numberOfMessages else priorMessages.size): String {
-        // Always add system prompt to chat first
-        // Append special token for the assistant role if there are no other messages yet
-        var context = addMessage(role = Role.System.name, content = Settings.systemPrompt, appendAssistant = priorMessages.isEmpty())
+    fun formatChat(
+        priorMessages: List<Message>,
+        isAlice: Boolean,
+        numberOfMessages: Int = if (Settings.numberOfMessages > 0) Settings.numberOfMessages else priorMessages.size,
+        maxNumberOfTokens: Int = MAX_CHAT_TOKENS
+    ): String {
+        // Limit is the same on every device, so a device whose context is too small fails instead of evicting different messages than its peer
+        val contextSize = getContextSize()
+
+        if (contextSize < maxNumberOfTokens + MAX_COVER_TEXT_TOKENS) {
+            throw IllegalStateException("Context size ($contextSize tokens) can't fit a chat of $maxNumberOfTokens tokens and a cover text of $MAX_COVER_TEXT_TOKENS tokens")
+        }
 
         // Only use the last numberOfMessages messages as context
-        for (priorMessage in priorMessages.takeLast(numberOfMessages)) {
-            // Assign assistant/user roles to messages based on isAlice
-            val priorMessageRole = if (isAlice) {
+        val contextMessages = priorMessages.takeLast(numberOfMessages)
+
+        // Assign assistant/user roles to messages based on isAlice
+        val roles = contextMessages.map { priorMessage ->
+            if (isAlice) {
                 // Alice is assistant, Bob is user
                 if (priorMessage.senderID == User.Alice.id) { Role.Assistant.name }
                 else { Role.User.name }
@@ -263,10 +412,40 @@ object LlamaCpp {
                 if (priorMessage.senderID == User.Alice.id) { Role.User.name }
                 else { Role.Assistant.name }
             }
+        }
+
+        // Count tokens without the special token for the assistant role, so that a message counts the same whether it is the last one or not
+        // Counts are cached, so only messages that are new since the last call are tokenized
+        val numberOfSystemPromptTokens = countMessageTokens(role = Role.System.name, content = Settings.systemPrompt)
+        val numberOfMessageTokens = contextMessages.mapIndexed { index, priorMessage -> countMessageTokens(role = roles[index], content = priorMessage.content) }
+
+        // Evict oldest messages if the chat doesn't fit, rounding the number of evicted tokens up to a multiple of half the tokens available for messages
+        // Evicted messages then only change once the conversation has grown by another half
+        val numberOfAvailableTokens = maxNumberOfTokens - numberOfSystemPromptTokens
+        val numberOfExcessTokens = numberOfMessageTokens.sum() - numberOfAvailableTokens
+        var numberOfEvictedMessages = 0
+
+        if (numberOfExcessTokens > 0) {
+            val stepSize = maxOf(numberOfAvailableTokens / 2, 1)
+            val numberOfTokensToEvict = (numberOfExcessTokens + stepSize - 1) / stepSize * stepSize
+            var numberOfEvictedTokens = 0
+
+            while (numberOfEvictedTokens < numberOfTokensToEvict && numberOfEvictedMessages < contextMessages.size) {
+                numberOfEvictedTokens += numberOfMessageTokens[numberOfEvictedMessages]
+                numberOfEvictedMessages++
+            }
+        }
+
+        // Always add system prompt to chat first
+        // Append special token for the assistant role if there are no other messages (left)
+        var context = addMessage(role = Role.System.name, content = Settings.systemPrompt, appendAssistant = numberOfEvictedMessages == contextMessages.size)
+
+        for (index in numberOfEvictedMessages until contextMessages.size) {
+            val priorMessage = contextMessages[index]
 
             // Add message to chat
             // Append special token for the assistant role if current message is end of the context
-            context += addMessage(role = priorMessageRole, content = priorMessage.content, appendAssistant = priorMessage == priorMessages.last())
+            context += addMessage(role = roles[index], content = priorMessage.content, appendAssistant = priorMessage == priorMessages.last())
         }
 
         return context
@@ -275,12 +454,42 @@ object LlamaCpp {
     // Declare the native methods called via JNI as Kotlin external functions
 
     /**
-     * Wrapper for the `llama_model_load_from_file` function of llama.cpp. Loads the LLM into memory.
+     * Function to load the LLM, a pool of contexts sharing it and the sampler into memory on a native background thread.
+     *
+     * Reads the LLM file ahead into the page cache first if it is memory-mapped, and runs a warmup decode on every context.
+     * Also loads the compression LLM with a single context if a path to it is passed.
+     * Number of threads is chosen based on the cores of the device if it is 0. Other parameters that are 0 (or `KVCacheType.Default`) use the fixed defaults of `EngineConfig`,
+     * as they change the logits and have to be the same for sender and receiver.
      *
      * @param path Path to the LLM (.gguf file).
-     * @return Memory address of the LLM.
+     * @param compressionPath Path to the compression LLM (.gguf file), null to use the LLM for compression too.
+     * @param gpuLayers Number of layers to offload to the GPU.
+     * @param useMmap Boolean that is true if the LLM should be memory-mapped instead of read into memory, false otherwise.
+     * @param useMlock Boolean that is true if the LLM should be locked in memory so it can't be swapped out, false otherwise.
+     * @param numberOfContexts Number of contexts, i.e. number of jobs that can run concurrently.
+     * @param numberOfThreads Number of threads to split among the leased contexts.
+     * @param contextSize Maximum number of tokens in every context.
+     * @param batchSize Maximum number of tokens per call to `llama_decode`.
+     * @param microBatchSize Maximum number of tokens per physical batch.
+     * @param flashAttention Boolean that is true if flash attention should be used, false otherwise.
+     * @param kvCacheType Ordinal of the data type of the KV cache.
+     * @param listener Listener that gets the memory addresses of the LLM, the pool and the sampler when done.
      */
-    private external fun loadModel(path: String = this.path): Long
+    private external fun startAsync(
+        path: String = this.path,
+        compressionPath: String? = if (LLM.isCompressionModelDownloaded()) LLM.getCompressionPath() else null,
+        gpuLayers: Int = Settings.gpuLayers,
+        useMmap: Boolean = Settings.useMmap,
+        useMlock: Boolean = Settings.useMlock,
+        numberOfContexts: Int = Settings.numberOfContexts,
+        numberOfThreads: Int = Settings.numberOfThreads,
+        contextSize: Int = Settings.contextSize,
+        batchSize: Int = Settings.batchSize,
+        microBatchSize: Int = Settings.microBatchSize,
+        flashAttention: Boolean = Settings.flashAttention,
+        kvCacheType: Int = Settings.kvCacheType.ordinal,
+        listener: StartupListener
+    )
 
     /**
      * Wrapper for the `llama_model_free` function of llama.cpp. Unloads the LLM from memory.
@@ -290,28 +499,28 @@ object LlamaCpp {
     private external fun unloadModel(model: Long = this.model)
 
     /**
-     * Wrapper for the `llama_new_context_with_model` function of llama.cpp. Loads the context into memory.
+     * Wrapper for the `llama_free` function of llama.cpp. Unloads a pool of contexts from memory. All leased contexts need to be released first.
      *
-     * @param model Memory address of the LLM.
-     * @return Memory address of the context.
+     * @param pool Memory address of the pool.
      */
-    private external fun loadCtx(model: Long = this.model): Long
+    private external fun unloadPool(pool: Long = this.pool)
 
     /**
-     * Wrapper for the `llama_free` function of llama.cpp. Unloads the context from memory.
+     * Function to lease a context of the pool. Blocks until one is free if all are in use.
      *
-     * @param ctx Memory address of the context.
+     * @param pool Memory address of the pool.
+     * @param role Ordinal of the role of the job.
+     * @return Memory address of the leased context.
      */
-    private external fun unloadCtx(ctx: Long = this.ctx)
+    private external fun acquireCtx(pool: Long, role: Int): Long
 
     /**
-     * Wrapper for the `llama_sampler_init_*` functions of llama.cpp. Loads the sampler into memory.
-     *
-     * Currently only supports greedy sampler.
+     * Function to return a leased context to the pool.
      *
-     * @return Memory address of the sampler.
+     * @param pool Memory address of the pool.
+     * @param ctx Memory address of the leased context.
      */
-    private external fun loadSmpl(): Long
+    private external fun releaseCtx(pool: Long, ctx: Long)
 
     /**
      * Wrapper for the `llama_sampler_free` function of llama.cpp. Unloads the sampler from memory.
@@ -320,7 +529,7 @@ object LlamaCpp {
      */
     private external fun unloadSmpl(smpl: Long = this.smpl)
 
-    // Parameter ctx is optional since it has a default value, put it at the end to avoid conflicts
+    // Parameters with default values are put at the end to avoid conflicts
 
     /**
      * Wrapper for the `llama_vocab_n_tokens` function of llama.cpp. Gets the vocabulary size `n_vocab` of the LLM (i.e. the number of available tokens).
@@ -330,6 +539,33 @@ object LlamaCpp {
      */
     external fun getVocabSize(model: Long = this.model): Int
 
+    /**
+     * Function to get the fingerprint of the LLM, i.e. a hash of its vocabulary and its number of parameters folded to 32 bits.
+     *
+     * @param model Memory address of the LLM.
+     * @return Fingerprint of the LLM.
+     */
+    external fun getFingerprint(model: Long = this.model): Int
+
+    /**
+     * Wrapper for the `llama_n_ctx` function of llama.cpp. Gets the context size `n_ctx` of the contexts of the pool (i.e. the maximum number of tokens per context).
+     *
+     * @param pool Memory address of the pool.
+     * @return Context size of the contexts.
+     */
+    external fun getContextSize(pool: Long = this.pool): Int
+
+    /**
+     * Wrapper for the `common_tokenize` function of llama.cpp. Counts the tokens of a byte array storing a UTF-8 encoded string.
+     *
+     * Helper for the public `countTokens` function taking a string. Bypasses JNI errors caused by different character encodings.
+     *
+     * @param text Byte array storing a UTF-8 encoded string.
+     * @param model Memory address of the LLM.
+     * @return Number of tokens of the string.
+     */
+    private external fun countTokens(text: ByteArray, model: Long = this.model): Int
+
     /**
      * Wrapper for the `common_detokenize` function of llama.cpp. Detokenizes an array of token IDs into a byte array storing a UTF-8 encoded string.
      *
@@ -339,16 +575,16 @@ object LlamaCpp {
      * @param ctx Memory address of the context.
      * @return Detokenization as a byte array storing a UTF-8 encoded string.
      */
-    private external fun detokenize(tokens: IntArray, ctx: Long = this.ctx): ByteArray
+    private external fun detokenize(tokens: IntArray, ctx: Long): ByteArray
 
     /**
      * Wrapper for the `llama_sampler_sample` function of llama.cpp. Samples the next token based on the last one.
      *
      * @param lastToken ID of the last token.
-     * @param ctx Memory address of the context.
+     * @param ctx Memory address of a leased context.
      * @return ID of the next token.
      */
-    external fun sample(lastToken: Int, ctx: Long = this.ctx, smpl: Long = this.smpl): Int
+    external fun sample(lastToken: Int, ctx: Long, smpl: Long = this.smpl): Int
 
     /**
      * Wrapper for the `llama_chat_apply_template` function of llama.cpp. Formats a message as a llama.cpp chat message so that it can be added to a chat.
@@ -364,4 +600,23 @@ object LlamaCpp {
      * @return The message formatted as llama.cpp chat message.
      */
     private external fun addMessage(role: String, content: String, appendAssistant: Boolean, model: Long = this.model): String
+
+    /**
+     * Function to enable or disable native profiling at runtime. Only has an effect if the app was built with `-PhipsProfiling`.
+     *
+     * While enabled, every native operation measures the time spent in tokenization, prefill, decode, softmax, special token suppression, selection, coding and detokenization.
+     * Stages also show up as ATrace sections in system traces (e.g. Perfetto).
+     *
+     * @param isEnabled Boolean that is true if native operations should be measured, false otherwise.
+     */
+    external fun setProfilingEnabled(isEnabled: Boolean)
+
+    /**
+     * Function to get the stats of the last native operation (e.g. `Arithmetic.encode`), e.g. to parse them with `org.json.JSONObject`.
+     *
+     * Contains the total time, the time and number of calls per stage (stages can be nested) and the performance data of llama.cpp (prompt and generation time and tokens).
+     *
+     * @return The stats as a JSON string, only containing `isEnabled` if profiling is disabled or no operation has finished yet.
+     */
+    external fun getStats(): String
 }
\ No newline at end of file
@@ -13,20 +13,22 @@ object Steganography {
      * @param secretMessage The secret message to be encoded.
      * @param conversionMode Conversion mode, determined by Settings object.
      * @param steganographyMode Steganography mode, determined by Settings object.
+     * @param listener Listener to stream the cover text to while it is being generated, can cancel encoding. Optional.
      * @return A cover text containing the secret message.
+     * @throws java.util.concurrent.CancellationException If the listener cancelled encoding.
      */
     fun encode(
         context: String,
         secretMessage: String,
         conversionMode: ConversionMode = Settings.conversionMode,
-        steganographyMode: SteganographyMode = Settings.steganographyMode
+        steganographyMode: SteganographyMode = Settings.steganographyMode,
+        listener: CoverTextListener? = null
     ): String {
         // Step 0: Prepare secret message by appending ASCII NUL character
         val preparedSecretMessage = prepare(secretMessage)
 
         // Step 1: Convert secret message to a (compressed) binary representation
-        LlamaCpp.resetInstance()
-
+        // No reset of the LLM needed between steps, native sessions only decode the tokens that differ from the previous call
         val plainBits = when (conversionMode) {
             ConversionMode.Arithmetic -> { Arithmetic.compress(preparedSecretMessage) }
             ConversionMode.UTF8 -> { UTF8.encode(preparedSecretMessage) }
@@ -36,11 +38,9 @@ object Steganography {
         val cipherBits = Crypto.encrypt(plainBits)
 
         // Step 3: Encode encrypted binary representation of secret message into cover text
-        LlamaCpp.resetInstance()
-
         val coverText = when (steganographyMode) {
-            SteganographyMode.Arithmetic -> { Arithmetic.encode(context, cipherBits) }
-            SteganographyMode.Huffman -> { Huffman.encode(context, cipherBits) }
+            SteganographyMode.Arithmetic -> { Arithmetic.encode(context, cipherBits, listener = listener) }
+            SteganographyMode.Huffman -> { Huffman.encode(context, cipherBits, listener = listener) }
         }
 
         return coverText
@@ -114,19 +114,19 @@ object Steganography {
         // When using UTF-8 encoding, first byte is guaranteed to store first char, no more bytes to consider
         // But when using Arithmetic compression, padding length and padding are stored in first 2 bytes, so consider at least 3 bytes to find first char
         // => Trial-and-error showed that first 4 bytes need to be considered, otherwise Arithmetic decodes incomplete bit sequence to wrong char
-        val numberOfCipherBits = if (conversionMode == ConversionMode.UTF8) 8 else 32
+        // These 4 bytes follow the 4 header bytes storing the fingerprint of the compression LLM
+        val numberOfCipherBits = if (conversionMode == ConversionMode.UTF8) 8 else 64
         var isFirstMessageOfSplit: Boolean
 
         // Invert step 3
-        LlamaCpp.resetInstance()
-
         // Wrap this in try-catch because decoding with wrong context is likely to throw exceptions
         val partialCipherBits: ByteArray
 
+        // Streaming decoder stops as soon as enough cipher bits are fixed, usually after a few tokens
         try {
-            partialCipherBits = when (steganographyMode) {
-                SteganographyMode.Arithmetic -> { Arithmetic.decode(context, coverText, numberOfCipherBits) }
-                SteganographyMode.Huffman -> { Huffman.decode(context, coverText, numberOfCipherBits) }
+            partialCipherBits = StreamingDecoder(context, numberOfCipherBits, steganographyMode = steganographyMode).use { decoder ->
+                decoder.feed(coverText, isLastFeed = true)
+                decoder.pull(numberOfCipherBits)
             }
         }
         catch (exception: Exception) {
@@ -139,8 +139,6 @@ object Steganography {
         val partialPlainBits = Crypto.decrypt(partialCipherBits)
 
         // Invert step 1
-        LlamaCpp.resetInstance()
-
         val partialPreparedSecretMessage = when (conversionMode) {
             ConversionMode.Arithmetic -> { Arithmetic.decompress(partialPlainBits) }
             ConversionMode.UTF8 -> { UTF8.decode(partialPlainBits) }
@@ -169,7 +167,7 @@ object Steganography {
 
     // TODO Downward concat of split cover text
     //  Parameter isResumed in decode function is to differentiate first from subsequent calls of decode
-    //  Save and restore of {decode,decompress}Ctx is to resume decoding from last call of decode
+    //  Resumed decoding continues after the tokens cached by the last call of decode in the contexts its roles prefer, StreamingDecoder keeps its context leased to guarantee this
     /**
      * Function to decode secret message from cover text using given context.
      *
@@ -178,6 +176,7 @@ object Steganography {
      * @param conversionMode Conversion mode, determined by Settings object.
      * @param steganographyMode Steganography mode, determined by Settings object.
      * @param isResumed Boolean that is true if this call of the `decode` function resumes where the last call terminated, false otherwise.
+     * @param compressionFingerprint Fingerprint of the LLM the secret message was compressed with, kept by the caller from the first call. Only needed if decoding is resumed with Arithmetic compression.
      * @return The secret message.
      */
     fun decode(
@@ -185,53 +184,76 @@ object Steganography {
         coverText: String,
         conversionMode: ConversionMode = Settings.conversionMode,
         steganographyMode: SteganographyMode = Settings.steganographyMode,
-        isResumed: Boolean = false
+        isResumed: Boolean = false,
+        compressionFingerprint: Int? = null
     ): String {
         // Invert step 3
-        if (isResumed) {
-            // Restore ctx for decoding
-            LlamaCpp.setCtx(ctx = LlamaCpp.getDecodeCtx())
-        }
-        else {
-            // Reset ctx
-            LlamaCpp.resetInstance()
-        }
-
         val cipherBits = when (steganographyMode) {
             SteganographyMode.Arithmetic -> { Arithmetic.decode(context, coverText, isResumed = isResumed) }
             SteganographyMode.Huffman -> { Huffman.decode(context, coverText, isResumed = isResumed) }
         }
 
-        // Save ctx for decoding
-        LlamaCpp.setDecodeCtx(decodeCtx = LlamaCpp.getCtx())
-
         // Invert step 2
         val plainBits = Crypto.decrypt(cipherBits)
 
         // Invert step 1
-        if (isResumed) {
-            // Restore ctx for decompression
-            LlamaCpp.setCtx(ctx = LlamaCpp.getDecompressCtx())
-        }
-        else {
-            // Reset ctx
-            LlamaCpp.resetInstance()
-        }
-
         val preparedSecretMessage = when (conversionMode) {
-            ConversionMode.Arithmetic -> { Arithmetic.decompress(plainBits, isResumed = isResumed) }
+            ConversionMode.Arithmetic -> { Arithmetic.decompress(plainBits, isResumed = isResumed, fingerprint = compressionFingerprint) }
             ConversionMode.UTF8 -> { UTF8.decode(plainBits) }
         }
 
-        // Save ctx for decompression
-        LlamaCpp.setDecompressCtx(decompressCtx = LlamaCpp.getCtx())
-
         // Invert step 0
         val secretMessage = unprepare(preparedSecretMessage)
 
         return secretMessage
     }
 
+    /**
+     * Function to decode the secret messages from multiple cover texts, e.g. from all messages of a conversation.
+     *
+     * Inverts step 3 for all cover texts at once, which decodes them in shared batches instead of one after another.
+     *
+     * @param contexts The contexts to decode the cover texts with, one per cover text.
+     * @param coverTexts The cover texts containing a secret message.
+     * @param conversionMode Conversion mode, determined by Settings object.
+     * @param steganographyMode Steganography mode, determined by Settings object.
+     * @return The secret messages, null for cover texts that couldn't be decoded (e.g. because they don't contain a secret message).
+     */
+    fun decodeAll(
+        contexts: List<String>,
+        coverTexts: List<String>,
+        conversionMode: ConversionMode = Settings.conversionMode,
+        steganographyMode: SteganographyMode = Settings.steganographyMode
+    ): List<String?> {
+        // Invert step 3
+        val cipherBits = when (steganographyMode) {
+            SteganographyMode.Arithmetic -> { Arithmetic.decodeAll(contexts, coverTexts) }
+            SteganographyMode.Huffman -> { Huffman.decodeAll(contexts, coverTexts) }
+        }
+
+        // Invert steps 2 to 0 for every cover text on its own, they are cheap compared to step 3 anyway
+        val secretMessages = cipherBits.map { bits ->
+            bits?.let {
+                try {
+                    val plainBits = Crypto.decrypt(it)
+
+                    val preparedSecretMessage = when (conversionMode) {
+                        ConversionMode.Arithmetic -> { Arithmetic.decompress(plainBits) }
+                        ConversionMode.UTF8 -> { UTF8.decode(plainBits) }
+                    }
+
+                    unprepare(preparedSecretMessage)
+                }
+                // E.g. no start or stop signal after decoding a cover text of an unrelated message
+                catch (exception: Exception) {
+                    null
+                }
+            }
+        }
+
+        return secretMessages
+    }
+
     /**
      * Function to prepare a secret message for binary encoding.
      *
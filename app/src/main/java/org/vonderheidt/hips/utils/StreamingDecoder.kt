@@ -0,0 +1,108 @@
+package org.vonderheidt.hips.utils
+
+import org.vonderheidt.hips.data.Settings
+
+/**
+ * Class that represents a native decoder that cover texts are fed to incrementally, e.g. one message of a split cover text at a time.
+ *
+ * Keeps the coder state and the tokens decoded so far between calls, so consecutive messages continue where the last one ended without decoding it again.
+ * Cipher bits can be pulled as soon as they are decoded, so checking a prefix of the secret message can stop after a few tokens.
+ *
+ * Leases a context of the pool for its whole lifetime, so that its KV cache isn't used by other jobs in between. Needs to be closed to release it.
+ *
+ * @param context The context to decode the cover text with.
+ * @param numberOfCipherBits Number of cipher bits after which decoding stops, -1 to decode all fed cover texts.
+ * @param isResumed Boolean that is true if decoding continues after the tokens cached by the last call of decode, false otherwise.
+ * @param steganographyMode Steganography mode, determined by Settings object.
+ */
+class StreamingDecoder(
+    context: String,
+    numberOfCipherBits: Int = -1,
+    isResumed: Boolean = false,
+    steganographyMode: SteganographyMode = Settings.steganographyMode
+) : AutoCloseable {
+    private val ctx = LlamaCpp.acquireCtx()
+
+    private var decoder = when (steganographyMode) {
+        SteganographyMode.Arithmetic -> {
+            createArithmetic(context = context.toByteArray(charset = Charsets.UTF_8), ctx = ctx, numberOfCipherBits = numberOfCipherBits, isResumed = isResumed)
+        }
+        SteganographyMode.Huffman -> {
+            createHuffman(context = context.toByteArray(charset = Charsets.UTF_8), ctx = ctx, numberOfCipherBits = numberOfCipherBits, isResumed = isResumed)
+        }
+    }
+
+    /**
+     * Function to feed the next part of the cover text to the decoder.
+     *
+     * The last token is only decoded by the next call of `feed` or by `finish`, as the last token of the whole cover text is decoded differently.
+     *
+     * @param coverText The next part of the cover text.
+     * @param isLastFeed Boolean that is true if no more cover text follows, false otherwise.
+     * @throws IllegalArgumentException If a cover text token could not be predicted (e.g. decoding with wrong context).
+     */
+    fun feed(coverText: String, isLastFeed: Boolean = false) {
+        feed(decoder = decoder, coverText = coverText.toByteArray(charset = Charsets.UTF_8), ctx = ctx, isLastFeed = isLastFeed)
+    }
+
+    /**
+     * Function to signal that no more cover text follows, so that the last token is decoded.
+     *
+     * @throws IllegalArgumentException If the last cover text token could not be predicted.
+     */
+    fun finish() {
+        feed(decoder = decoder, coverText = ByteArray(0), ctx = ctx, isLastFeed = true)
+    }
+
+    /**
+     * Function to take the cipher bits that were decoded but not pulled yet. Only complete bytes are taken, the rest stays available.
+     *
+     * @param maxNumberOfBits Maximum number of bits to take.
+     * @return The encrypted binary representation of the next part of the secret message.
+     */
+    fun pull(maxNumberOfBits: Int = Int.MAX_VALUE): ByteArray {
+        return pull(decoder = decoder, maxNumberOfBits = maxNumberOfBits)
+    }
+
+    /**
+     * @return Number of cipher bits that were decoded but not pulled yet.
+     */
+    fun getNumberOfAvailableBits(): Int {
+        return getNumberOfAvailableBits(decoder = decoder)
+    }
+
+    /**
+     * @return Boolean that is true if all cover text was decoded or enough cipher bits were found, false otherwise.
+     */
+    fun isComplete(): Boolean {
+        return isComplete(decoder = decoder)
+    }
+
+    /**
+     * Function to free the native decoder. Does nothing if it is already freed.
+     */
+    override fun close() {
+        if (decoder != 0L) {
+            destroy(decoder = decoder)
+            decoder = 0L
+
+            LlamaCpp.releaseCtx(ctx)
+        }
+    }
+
+    // Declare the native methods called via JNI as Kotlin external functions
+
+    private external fun createArithmetic(context: ByteArray, temperature: Float = Settings.temperature, topK: Int = Settings.topK, precision: Int = Settings.precision, ctx: Long, numberOfCipherBits: Int, isResumed: Boolean): Long
+
+    private external fun createHuffman(context: ByteArray, minBitsPerToken: Int = Huffman.getMinBitsPerToken(), maxBitsPerToken: Int = Huffman.getMaxBitsPerToken(), ctx: Long, numberOfCipherBits: Int, isResumed: Boolean): Long
+
+    private external fun feed(decoder: Long, coverText: ByteArray, ctx: Long, isLastFeed: Boolean)
+
+    private external fun pull(decoder: Long, maxNumberOfBits: Int): ByteArray
+
+    private external fun getNumberOfAvailableBits(decoder: Long): Int
+
+    private external fun isComplete(decoder: Long): Boolean
+
+    private external fun destroy(decoder: Long)
+}